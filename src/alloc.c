@@ -474,6 +474,9 @@ free_all_mem(void)
 # ifdef FEAT_QUICKFIX
     free_quickfix();
 # endif
+# ifdef FEAT_BORE
+    bore_ctrlp_free();
+# endif
 
     // Close all script inputs.
     close_all_scripts();
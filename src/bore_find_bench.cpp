@@ -0,0 +1,242 @@
+/* vi:set ts=8 sts=4 sw=4 et:
+ *
+ * VIM - Vi IMproved    by Bram Moolenaar
+ *
+ * Do ":help uganda"  in Vim to read copying and usage conditions.
+ * Do ":help credits" in Vim to see a list of people who contributed.
+ * See README.txt for an overview of the Vim source code.
+ */
+
+/*
+ * bore_find_bench.cpp: Micro-benchmark for the borefind string search kernels
+ * in if_bore_find.h. Build and run with "make borebench".
+ *
+ * Searches a synthetic corpus of source-like text, split into files of
+ * BENCH_FILE_SIZE bytes like borefind does, and prints the throughput of each
+ * kernel in GB/s, and of the case-insensitive kernel against searching a
+ * lowercased copy of every file. Also checks that the kernels agree.
+ * The regex section searches with if_bore_regex.h, with and without the
+ * literal prefilter.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "if_bore_find.h"
+#include "if_bore_regex.h"
+
+#define BENCH_CORPUS_SIZE (64 * 1024 * 1024)
+#define BENCH_FILE_SIZE (32 * 1024)
+#define BENCH_MAX_MATCH 1000
+#define BENCH_MIN_SECONDS 0.5
+
+static const char* bench_words[] = {
+    "int", "char", "const", "return", "if", "for", "while", "struct", "static",
+    "void", "bore_t*", "b", "file_index", "search", "i", "=", "==", "+", "->",
+    "(", ")", "{", "}", ";", "0", "1", "NULL", "match", "what_len", "text",
+};
+
+static const char* bench_patterns[] = {
+    "x",
+    "if",
+    "int",
+    "return",
+    "hello_world",
+    "search_context",
+    "bore_resolve_match_location",
+    "this pattern is a lot longer than most of the searches",
+};
+
+static const char* bench_regex_patterns[] = {
+    "hello_world",
+    "\\<return\\>",
+    "hello_\\w\\+",
+    "if\\s*(\\s*i\\s*==",
+    "^\\s*struct\\>",
+    "\\d\\d\\d",
+    "[A-Z]\\{3}_[A-Z]",
+};
+
+// Upper case words, so that the ignore case benchmark finds more matches
+static const char* bench_upper_words[] = {
+    "Hello_World", "INT", "Return", "SEARCH_CONTEXT",
+};
+
+static char* bench_make_corpus(size_t size)
+{
+    char* corpus = (char*)malloc(size);
+    size_t n = 0;
+    unsigned seed = 12345;
+    int column = 0;
+
+    while (n < size)
+    {
+        seed = seed * 1103515245 + 12345;
+        unsigned r = seed >> 16;
+        const char* word = (r % 5000 == 0) ? "hello_world" :
+            (r % 997 == 0) ? bench_upper_words[r % (sizeof(bench_upper_words) / sizeof(bench_upper_words[0]))] :
+            bench_words[r % (sizeof(bench_words) / sizeof(bench_words[0]))];
+        size_t len = strlen(word);
+        for (size_t i = 0; i < len && n < size; ++i)
+            corpus[n++] = word[i];
+        column += (int)len + 1;
+        if (n < size)
+            corpus[n++] = (column > 70 || r % 11 == 0) ? '\n' : ' ';
+        if (corpus[n - 1] == '\n')
+            column = 0;
+    }
+    return corpus;
+}
+
+static long bench_run(const exact_string_search_t* kernel, const char* corpus, size_t size, const char* what, double* gbps)
+{
+    static int out[BENCH_MAX_MATCH];
+    long hits = 0;
+    int iterations = 0;
+    double seconds = 0;
+    int what_len = (int)strlen(what);
+
+    auto start = std::chrono::steady_clock::now();
+    do
+    {
+        hits = 0;
+        for (size_t offset = 0; offset < size; offset += BENCH_FILE_SIZE)
+        {
+            int len = (int)(size - offset < BENCH_FILE_SIZE ? size - offset : BENCH_FILE_SIZE);
+            hits += kernel->search(corpus + offset, len, what, what_len, out, out + BENCH_MAX_MATCH);
+        }
+        ++iterations;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (seconds < BENCH_MIN_SECONDS);
+
+    *gbps = (double)size * iterations / seconds / 1e9;
+    return hits;
+}
+
+// Lowercases the text into a buffer before searching it
+struct lowercase_search_t : public exact_string_search_t
+{
+    lowercase_search_t(const exact_string_search_t* search, char* buffer) : m_search(search), m_buffer(buffer) {}
+
+    virtual int search(const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const
+    {
+        for (int i = 0; i < text_len; ++i)
+            m_buffer[i] = (char)bore_fold_ascii((unsigned char)text[i]);
+        m_buffer[text_len] = 0;
+        return m_search->search(m_buffer, text_len, what, what_len, out, out_end);
+    }
+
+private:
+    const exact_string_search_t* m_search;
+    char* m_buffer;
+};
+
+int main(void)
+{
+    // One extra byte, quick_search_t reads one byte past the end of the text
+    char* corpus = bench_make_corpus(BENCH_CORPUS_SIZE + 1);
+    bore_search_kernel_t detected = bore_search_kernel_detect();
+    int failed = 0;
+
+    printf("corpus %d MB, files of %d KB, best kernel: %s\n",
+            BENCH_CORPUS_SIZE / (1024 * 1024), BENCH_FILE_SIZE / 1024,
+            detected == BORE_SEARCH_AVX2 ? "avx2" : detected == BORE_SEARCH_SSE2 ? "sse2" : "scalar");
+    printf("%-56s %9s %8s %8s %8s %8s\n", "pattern", "hits", "old", "quick", "sse2", "avx2");
+
+    for (size_t i = 0; i < sizeof(bench_patterns) / sizeof(bench_patterns[0]); ++i)
+    {
+        const char* what = bench_patterns[i];
+        quick_search_t quick(what, (int)strlen(what));
+        old_search_t old;
+        double gbps_old = 0, gbps_quick = 0, gbps_sse2 = 0, gbps_avx2 = 0;
+        long hits_old = 0, hits_sse2, hits_avx2;
+
+        // old_search_t needs at least two characters
+        if (what[1])
+            hits_old = bench_run(&old, corpus, BENCH_CORPUS_SIZE, what, &gbps_old);
+        long hits = bench_run(&quick, corpus, BENCH_CORPUS_SIZE, what, &gbps_quick);
+        hits_sse2 = hits_avx2 = hits;
+#ifdef BORE_SEARCH_X86
+        if (detected >= BORE_SEARCH_SSE2)
+        {
+            sse2_search_t sse2;
+            hits_sse2 = bench_run(&sse2, corpus, BENCH_CORPUS_SIZE, what, &gbps_sse2);
+        }
+        if (detected >= BORE_SEARCH_AVX2)
+        {
+            avx2_search_t avx2;
+            hits_avx2 = bench_run(&avx2, corpus, BENCH_CORPUS_SIZE, what, &gbps_avx2);
+        }
+#endif
+        printf("%-56s %9ld %8.2f %8.2f %8.2f %8.2f\n", what, hits, gbps_old, gbps_quick, gbps_sse2, gbps_avx2);
+
+        if (hits_sse2 != hits || hits_avx2 != hits || (what[1] && hits_old != hits))
+        {
+            printf("  mismatch: old %ld, sse2 %ld, avx2 %ld\n", hits_old, hits_sse2, hits_avx2);
+            failed = 1;
+        }
+    }
+
+    // Ignoring case: lowercase copy of each file + quick_search_t, as borefind -i
+    // used to do, against fold_search_t on the original text
+    char* lowercase = (char*)malloc(BENCH_FILE_SIZE + 1);
+    printf("\n%-56s %9s %8s %8s\n", "pattern (ignore case)", "hits", "copy", "fold");
+    for (size_t i = 0; i < sizeof(bench_patterns) / sizeof(bench_patterns[0]); ++i)
+    {
+        const char* what = bench_patterns[i];
+        quick_search_t quick(what, (int)strlen(what));
+        fold_search_t fold(what, (int)strlen(what), detected, NULL);
+        lowercase_search_t copy(&quick, lowercase);
+        double gbps_copy = 0, gbps_fold = 0;
+
+        long hits = bench_run(&copy, corpus, BENCH_CORPUS_SIZE, what, &gbps_copy);
+        long hits_fold = bench_run(&fold, corpus, BENCH_CORPUS_SIZE, what, &gbps_fold);
+        printf("%-56s %9ld %8.2f %8.2f\n", what, hits, gbps_copy, gbps_fold);
+
+        if (hits_fold != hits)
+        {
+            printf("  mismatch: fold %ld\n", hits_fold);
+            failed = 1;
+        }
+    }
+
+    // Regex, matching lines. The prefilter column is the full search, the dfa
+    // column runs the dfa on every line.
+    printf("\n%-56s %9s %8s %8s\n", "regex", "lines", "dfa", "prefltr");
+    for (size_t i = 0; i < sizeof(bench_regex_patterns) / sizeof(bench_regex_patterns[0]); ++i)
+    {
+        const char* what = bench_regex_patterns[i];
+        bore_regex_t* regex = new bore_regex_t;
+        const char* error = regex->compile(what, (int)strlen(what), 0);
+        if (error)
+        {
+            printf("%-56s %s\n", what, error);
+            failed = 1;
+            delete regex;
+            continue;
+        }
+        bore_string_search_t literal(regex->literal, regex->literal_len, 0, detected, NULL);
+        regex_search_t dfa, prefilter;
+        dfa.init(regex, NULL);
+        prefilter.init(regex, literal.get());
+        double gbps_dfa = 0, gbps_prefilter = 0;
+
+        long hits = bench_run(&dfa, corpus, BENCH_CORPUS_SIZE, what, &gbps_dfa);
+        long hits_prefilter = hits;
+        if (regex->literal_len > 0)
+            hits_prefilter = bench_run(&prefilter, corpus, BENCH_CORPUS_SIZE, what, &gbps_prefilter);
+        printf("%-56s %9ld %8.2f %8.2f\n", what, hits, gbps_dfa, gbps_prefilter);
+
+        if (hits_prefilter != hits)
+        {
+            printf("  mismatch: prefilter %ld\n", hits_prefilter);
+            failed = 1;
+        }
+        delete regex;
+    }
+
+    free(lowercase);
+    free(corpus);
+    return failed;
+}
@@ -2261,6 +2261,9 @@ buflist_new(
 	buf_copy_options(buf, BCO_ALWAYS);
     }
 
+#ifdef FEAT_BORE
+    buf->b_bore_generation = 0;
+#endif
     buf->b_wininfo->wi_fpos.lnum = lnum;
     buf->b_wininfo->wi_win = curwin;
 
@@ -3584,6 +3587,9 @@ buf_set_name(int fnum, char_u *name)
 	// files on Win32.
 	fname_expand(buf, &buf->b_ffname, &buf->b_sfname);
 	buf->b_fname = buf->b_sfname;
+#ifdef FEAT_BORE
+	buf->b_bore_generation = 0;
+#endif
     }
 }
 
@@ -3611,6 +3617,9 @@ buf_name_changed(buf_T *buf)
     status_redraw_all();	// status lines need to be redrawn
     fmarks_check_names(buf);	// check named file marks
     ml_timestamp(buf);		// reset timestamp
+#ifdef FEAT_BORE
+    buf->b_bore_generation = 0;	// lookup the file in the solution again
+#endif
 }
 
 /*
@@ -768,6 +768,13 @@ buf_write(
     else
 	overwriting = FALSE;
 
+#ifdef FEAT_BORE
+    // The lines of a mapped file can't be read from it while it is written.
+    if (overwriting && buf->b_ml.ml_bore_map != NULL
+					       && ml_bore_load(buf) == FAIL)
+	return FAIL;
+#endif
+
     if (exiting)
 	settmode(TMODE_COOK);	    // when exiting allow typeahead now
 
@@ -2431,6 +2438,11 @@ restore_backup:
 	u_update_save_nr(buf);
     }
 
+#ifdef FEAT_BORE
+    // borefind has to search the file again
+    bore_file_written(fname);
+#endif
+
     // If written to the current file, update the timestamp of the swap file
     // and reset the BF_WRITE_MASK flags. Also sets buf->b_mtime.
     if (overwriting)
@@ -1673,6 +1673,10 @@ set_var_lval(
 	else if (op != NULL && *op != '=')
 	{
 	    tv_op(lp->ll_tv, rettv, op);
+#ifdef FEAT_BORE
+	    if (lp->ll_list != NULL)
+		list_changed(lp->ll_list);
+#endif
 	    return;
 	}
 	else
@@ -1689,6 +1693,10 @@ set_var_lval(
 	    lp->ll_tv->v_lock = 0;
 	    init_tv(rettv);
 	}
+#ifdef FEAT_BORE
+	if (lp->ll_list != NULL)
+	    list_changed(lp->ll_list);
+#endif
     }
 }
 
@@ -29,7 +29,9 @@ static void f_balloon_split(typval_T *argvars, typval_T *rettv);
 # endif
 #endif
 #ifdef FEAT_BORE
+# include "if_bore.h"
 static void f_bore_ctrlpmatch(typval_T *argvars, typval_T *rettv);
+static void f_bore_stats(typval_T *argvars, typval_T *rettv);
 static void f_bore_statusline(typval_T *argvars, typval_T *rettv);
 #endif
 static void f_byte2line(typval_T *argvars, typval_T *rettv);
@@ -1706,6 +1708,8 @@ static funcentry_T global_functions[] =
 //#ifdef FEAT_BORE
     {"bore_ctrlpmatch",	1, 8, FEARG_1,   arg1_buffer,
 			ret_list_string,    BORE_FUNC(f_bore_ctrlpmatch)},
+    {"bore_stats",	0, 0, 0,	    NULL,
+			ret_dict_any,	    BORE_FUNC(f_bore_stats)},
     {"bore_statusline",	0, 1, 0,	    arg1_buffer,
 			ret_string,	    BORE_FUNC(f_bore_statusline)},
 //#endif
@@ -3252,6 +3256,16 @@ f_balloon_split(typval_T *argvars, typval_T *rettv UNUSED)
 
 #ifdef FEAT_BORE
 
+/*
+ * "bore_stats()" function
+ */
+    static void
+f_bore_stats(typval_T *argvars UNUSED, typval_T *rettv)
+{
+    if (rettv_dict_alloc(rettv) == OK)
+	bore_stats(rettv->vval.v_dict);
+}
+
 /*
  * "bore_statusline(flags)" function
  */
@@ -3320,6 +3334,406 @@ static void bore_ctrlp_mmode_fullline(bore_ctrlp_search_item_t* item, int *len)
 
 typedef void (*bore_ctrlp_mmode_func)(bore_ctrlp_search_item_t* item, int *len);
 
+// Items are searched in chunks, on several threads when there are many
+#define BORE_CTRLP_CHUNK	4096
+#define BORE_CTRLP_MAX_MATCHES	256
+
+// The items of the list searched last, and the items that matched its last
+// substring query, so that a query that extends it only searches those. The
+// items are valid while the list has the same changedtick, the list is not
+// used otherwise, it may have been freed.
+typedef struct bore_ctrlp_cache_t
+{
+    list_T*			list;
+    varnumber_T			changedtick;
+    int				item_count;
+    int				search_mode;
+    bore_ctrlp_search_item_t*	items;
+    int*			lengths;
+    char_u*			query;	    // NULL when hits are not valid
+    int				ignorecase;
+    int*			hits;
+    int				hit_count;
+} bore_ctrlp_cache_t;
+
+static bore_ctrlp_cache_t bore_ctrlp_cache;
+
+static void bore_ctrlp_cache_clear_hits(void)
+{
+    VIM_CLEAR(bore_ctrlp_cache.query);
+    VIM_CLEAR(bore_ctrlp_cache.hits);
+    bore_ctrlp_cache.hit_count = 0;
+}
+
+static void bore_ctrlp_cache_clear(void)
+{
+    bore_ctrlp_cache_clear_hits();
+    VIM_CLEAR(bore_ctrlp_cache.items);
+    VIM_CLEAR(bore_ctrlp_cache.lengths);
+    bore_ctrlp_cache.list = NULL;
+}
+
+# if defined(EXITFREE) || defined(PROTO)
+    void
+bore_ctrlp_free(void)
+{
+    bore_ctrlp_cache_clear();
+}
+# endif
+
+/*
+ * Get the search items of "list", the cached ones when it is the list
+ * searched last and it was not changed since.
+ */
+    static bore_ctrlp_search_item_t*
+bore_ctrlp_get_items(list_T* list, int search_mode, bore_ctrlp_mmode_func mmode_func)
+{
+    bore_ctrlp_cache_t* c = &bore_ctrlp_cache;
+    listitem_T* li;
+    int i = 0;
+
+    CHECK_LIST_MATERIALIZE(list);
+    if (c->items != NULL && c->list == list && c->changedtick == list->lv_changedtick
+	    && c->search_mode == search_mode)
+	return c->items;
+
+    bore_ctrlp_cache_clear();
+    c->items = (bore_ctrlp_search_item_t*)alloc(sizeof(bore_ctrlp_search_item_t) * (list->lv_len + 1));
+    c->lengths = (int*)alloc(sizeof(int) * (list->lv_len + 1));
+    if (c->items == NULL || c->lengths == NULL)
+    {
+	bore_ctrlp_cache_clear();
+	return NULL;
+    }
+
+    for (li = list->lv_first; li != NULL; li = li->li_next)
+    {
+	if (li->li_tv.v_type == VAR_STRING && li->li_tv.vval.v_string != NULL)
+	    c->items[i].str = li->li_tv.vval.v_string;
+	else
+	    c->items[i].str = (char_u*)"";
+	mmode_func(c->items + i, c->lengths + i);
+	++i;
+    }
+    c->list = list;
+    c->changedtick = list->lv_changedtick;
+    c->item_count = list->lv_len;
+    c->search_mode = search_mode;
+    return c->items;
+}
+
+/*
+ * Return TRUE when the items matching "query" are among the hits of the last
+ * query, i.e. it extends that query.
+ */
+    static int
+bore_ctrlp_extends_query(char_u* query, int ignorecase)
+{
+    bore_ctrlp_cache_t* c = &bore_ctrlp_cache;
+    size_t len;
+
+    // a case sensitive match is also a case insensitive one, but not the
+    // other way around
+    if (c->query == NULL || (!c->ignorecase && ignorecase))
+	return FALSE;
+    len = STRLEN(c->query);
+    if (c->ignorecase)
+	return 0 == STRNICMP(query, c->query, len);
+    return 0 == STRNCMP(query, c->query, len);
+}
+
+/*
+ * Score an item that matched all filters like matchfuzzy() scores a match.
+ * The characters of a filter are matched where it follows a path separator
+ * last, or else at its last occurrence.
+ */
+    static int
+bore_ctrlp_score(char_u* str, char_u* search, char_u** filters, int filter_count)
+{
+    int_u matches[BORE_CTRLP_MAX_MATCHES];
+    int count = 0;
+    int f, i, j;
+
+    for (f = 0; f < filter_count; ++f)
+    {
+	int len = (int)STRLEN(filters[f]);
+	char_u* best = NULL;
+	char_u* after_sep = NULL;
+	char_u* p;
+
+	for (p = (char_u*)strstr((char*)search, (char*)filters[f]); p != NULL;
+		p = (char_u*)strstr((char*)p + 1, (char*)filters[f]))
+	{
+	    best = p;
+	    if (p > search && (p[-1] == '/' || p[-1] == '\\'))
+		after_sep = p;
+	}
+	if (after_sep != NULL)
+	    best = after_sep;
+	for (j = 0; best != NULL && j < len && count < BORE_CTRLP_MAX_MATCHES; ++j)
+	    matches[count++] = (int_u)(best - search) + j;
+    }
+
+    // sorted and unique, filters can overlap
+    for (i = 1; i < count; ++i)
+    {
+	int_u m = matches[i];
+	for (j = i; j > 0 && matches[j - 1] > m; --j)
+	    matches[j] = matches[j - 1];
+	matches[j] = m;
+    }
+    for (i = 1, j = count > 0; i < count; ++i)
+    {
+	if (matches[i] != matches[j - 1])
+	    matches[j++] = matches[i];
+    }
+    count = j;
+    if (count == 0)
+	return 0;
+
+    // the score uses character indexes
+    if (has_mbyte)
+    {
+	char_u* p = str;
+	int_u byte_idx = 0;
+	int_u char_idx = 0;
+
+	for (i = 0; i < count; ++i)
+	{
+	    while (byte_idx < matches[i] && *p != NUL)
+	    {
+		int l = (*mb_ptr2len)(p);
+		p += l;
+		byte_idx += l;
+		++char_idx;
+	    }
+	    matches[i] = char_idx;
+	}
+    }
+    return fuzzy_match_compute_score(str, MB_CHARLEN(str), matches, count);
+}
+
+typedef struct bore_ctrlp_scan_t
+{
+    const bore_ctrlp_search_item_t* items;
+    const int*	candidates;	// the items to search, all when NULL
+    int		count;
+    char_u**	filters;
+    int		filter_count;
+    int		ignorecase;
+    int		rank;
+    char*	hit;		// per candidate
+    int*	score;		// per candidate, when ranking
+} bore_ctrlp_scan_t;
+
+/*
+ * Search chunk "chunk" of the candidates for all filters, on any thread.
+ */
+    static void
+bore_ctrlp_scan_chunk(void* ctx, int worker UNUSED, int chunk)
+{
+    bore_ctrlp_scan_t* scan = (bore_ctrlp_scan_t*)ctx;
+    char_u buf[MAXPATHL];
+    int i = chunk * BORE_CTRLP_CHUNK;
+    int end = i + BORE_CTRLP_CHUNK < scan->count ? i + BORE_CTRLP_CHUNK : scan->count;
+
+    for (; i < end; ++i)
+    {
+	const bore_ctrlp_search_item_t* item = scan->items + (scan->candidates ? scan->candidates[i] : i);
+	char_u* search = item->start;
+	int f;
+
+	if (scan->ignorecase)
+	{
+	    char_u* src = item->start;
+	    char_u* dst = buf;
+	    int j = 0;
+	    for (; *src && j < MAXPATHL - 1; ++src, ++dst, ++j)
+		*dst = TOLOWER_LOC(*src);
+	    *dst = '\0';
+	    search = buf;
+	}
+
+	for (f = 0; f < scan->filter_count; ++f)
+	{
+	    if (!strstr((char*)search, (char*)scan->filters[f]))
+		break;
+	}
+
+	scan->hit[i] = f == scan->filter_count;
+	if (scan->hit[i] && scan->rank)
+	    scan->score[i] = bore_ctrlp_score(item->start, search, scan->filters, scan->filter_count);
+    }
+}
+
+typedef struct bore_ctrlp_rank_t
+{
+    int score;
+    int item;
+} bore_ctrlp_rank_t;
+
+/*
+ * Return TRUE if "x" ranks before "y": a higher score, then the list order.
+ */
+    static int
+bore_ctrlp_rank_before(const bore_ctrlp_rank_t* x, const bore_ctrlp_rank_t* y)
+{
+    return x->score > y->score || (x->score == y->score && x->item < y->item);
+}
+
+    static int
+bore_ctrlp_compare_rank(const void* vx, const void* vy)
+{
+    return bore_ctrlp_rank_before((const bore_ctrlp_rank_t*)vx, (const bore_ctrlp_rank_t*)vy) ? -1 : 1;
+}
+
+/*
+ * Keep the "limit" best ranked of "count" hits in "heap", which has the worst
+ * one at the top. Returns the number kept, sorted best first.
+ */
+    static int
+bore_ctrlp_best(const bore_ctrlp_rank_t* hits, int count, int limit, bore_ctrlp_rank_t* heap)
+{
+    int size = 0;
+    int i;
+
+    for (i = 0; i < count; ++i)
+    {
+	int k;
+
+	if (size < limit)
+	{
+	    // sift up
+	    for (k = size++; k > 0 && bore_ctrlp_rank_before(&heap[(k - 1) / 2], &hits[i]); k = (k - 1) / 2)
+		heap[k] = heap[(k - 1) / 2];
+	    heap[k] = hits[i];
+	}
+	else if (bore_ctrlp_rank_before(&hits[i], &heap[0]))
+	{
+	    // replace the worst and sift down
+	    for (k = 0; 2 * k + 1 < size; )
+	    {
+		int child = 2 * k + 1;
+		if (child + 1 < size && bore_ctrlp_rank_before(&heap[child], &heap[child + 1]))
+		    ++child;
+		if (!bore_ctrlp_rank_before(&hits[i], &heap[child]))
+		    break;
+		heap[k] = heap[child];
+		k = child;
+	    }
+	    heap[k] = hits[i];
+	}
+    }
+    qsort(heap, size, sizeof(bore_ctrlp_rank_t), bore_ctrlp_compare_rank);
+    return size;
+}
+
+/*
+ * Find the items that match all "filters" of "query". Only the hits of the
+ * last query are searched when "query" extends it. Returns the number of
+ * matches put in "matches", at most "match_limit" (when above 0), ranked when
+ * "rank" is set.
+ */
+    static int
+bore_ctrlp_substring(
+	char_u* query,
+	int ignorecase,
+	char_u** filters,
+	int filter_count,
+	int rank,
+	int match_limit,
+	char_u** matches)
+{
+    bore_ctrlp_cache_t* c = &bore_ctrlp_cache;
+    bore_ctrlp_scan_t scan;
+    bore_ctrlp_rank_t* ranks = NULL;
+    bore_ctrlp_rank_t* best = NULL;
+    int* hits;
+    int hit_count = 0;
+    int match_count = 0;
+    int chunk_count;
+    int thread_count;
+    int i;
+
+    scan.items = c->items;
+    scan.candidates = NULL;
+    scan.count = c->item_count;
+    if (bore_ctrlp_extends_query(query, ignorecase))
+    {
+	scan.candidates = c->hits;
+	scan.count = c->hit_count;
+    }
+    scan.filters = filters;
+    scan.filter_count = filter_count;
+    scan.ignorecase = ignorecase;
+    scan.rank = rank;
+    scan.hit = (char*)alloc(scan.count + 1);
+    scan.score = rank ? (int*)alloc(sizeof(int) * (scan.count + 1)) : NULL;
+    hits = (int*)alloc(sizeof(int) * (scan.count + 1));
+    if (scan.hit == NULL || hits == NULL || (rank && scan.score == NULL))
+    {
+	vim_free(scan.hit);
+	vim_free(scan.score);
+	vim_free(hits);
+	bore_ctrlp_cache_clear_hits();
+	return 0;
+    }
+
+    chunk_count = (scan.count + BORE_CTRLP_CHUNK - 1) / BORE_CTRLP_CHUNK;
+    thread_count = scan.count >= 2 * BORE_CTRLP_CHUNK ? bore_search_thread_count() : 1;
+    bore_parallel_for(thread_count, chunk_count, bore_ctrlp_scan_chunk, &scan);
+
+    if (rank)
+	ranks = (bore_ctrlp_rank_t*)alloc(sizeof(bore_ctrlp_rank_t) * (scan.count + 1));
+    for (i = 0; i < scan.count; ++i)
+    {
+	if (scan.hit[i])
+	{
+	    int item = scan.candidates ? scan.candidates[i] : i;
+	    if (ranks != NULL)
+	    {
+		ranks[hit_count].score = scan.score[i];
+		ranks[hit_count].item = item;
+	    }
+	    hits[hit_count++] = item;
+	}
+    }
+
+    if (ranks != NULL)
+    {
+	int limit = match_limit > 0 && match_limit < hit_count ? match_limit : hit_count;
+	best = (bore_ctrlp_rank_t*)alloc(sizeof(bore_ctrlp_rank_t) * (limit + 1));
+	if (best != NULL)
+	{
+	    match_count = bore_ctrlp_best(ranks, hit_count, limit, best);
+	    for (i = 0; i < match_count; ++i)
+		matches[i] = c->items[best[i].item].str;
+	}
+    }
+    else
+    {
+	for (; match_count < hit_count; ++match_count)
+	{
+	    if (match_limit > 0 && match_count >= match_limit)
+		break;
+	    matches[match_count] = c->items[hits[match_count]].str;
+	}
+    }
+
+    // the hits of this query are refined by the next one
+    bore_ctrlp_cache_clear_hits();
+    c->query = vim_strsave(query);
+    c->ignorecase = ignorecase;
+    c->hits = hits;
+    c->hit_count = hit_count;
+
+    vim_free(scan.hit);
+    vim_free(scan.score);
+    vim_free(ranks);
+    vim_free(best);
+    return match_count;
+}
+
 /*
  * "bore_ctrlpmatch()" function
  */
@@ -3341,6 +3755,11 @@ f_bore_ctrlpmatch(typval_T *argvars, typval_T *rettv)
     char_u* crfile = NULL;	    // The file in the current window.
     int regex = 0;		    // In regex mode: 1 or 0.
     int nosort = 0;		    // No sort: 1 or 0. Sort can be disabled by ctrlp or by plugin
+    int rank = 0;		    // Rank substring matches like matchfuzzy(): 1 or 0.
+    char_u* rank_var = get_var_value((char_u *)"g:bore_ctrlp_rank");
+
+    if (rank_var != NULL)
+	rank = atoi((char*)rank_var);
 
     if (argvars[0].v_type == VAR_LIST && argvars[0].vval.v_list != NULL)
     {
@@ -3374,6 +3793,8 @@ f_bore_ctrlpmatch(typval_T *argvars, typval_T *rettv)
 	    regex = tv_get_number(&dict_item->di_tv);
 	if (dict_item = dict_find(dict, "nosort", -1))
 	    nosort = tv_get_number(&dict_item->di_tv);
+	if (dict_item = dict_find(dict, "rank", -1))
+	    rank = tv_get_number(&dict_item->di_tv);
     }
     else
     {
@@ -3399,9 +3820,8 @@ f_bore_ctrlpmatch(typval_T *argvars, typval_T *rettv)
     int search_mode = 0;
     int match_count = 0;
 
-    bore_ctrlp_search_item_t* search_items = (bore_ctrlp_search_item_t*)alloc(sizeof(bore_ctrlp_search_item_t) * search_item_count);
-    int* search_lengths = (int*)alloc(sizeof(int) * search_item_count);
-    char_u** matches = (char_u**)alloc(sizeof(char_u*) * search_item_count);
+    bore_ctrlp_search_item_t* search_items;
+    char_u** matches = (char_u**)alloc(sizeof(char_u*) * (search_item_count + 1));
 
     if (0 == strcmp(mmode, "filename-only"))
 	search_mode = 1;
@@ -3420,27 +3840,23 @@ f_bore_ctrlpmatch(typval_T *argvars, typval_T *rettv)
     };
     const bore_ctrlp_mmode_func mmode_func = mmode_funcs[search_mode];
 
-    // fill search items using the correct search_mode function
-    {
-	listitem_T *li;
-	int i = 0;
-	for (li = list_items->lv_first; li != NULL; li = li->li_next)
-	{
-	    search_items[i].str = li->li_tv.vval.v_string;
-	    mmode_func(search_items + i, search_lengths + i);
-	    ++i;
-	}
-    }
+    // fill search items using the correct search_mode function, they are
+    // kept for the next call with the same list
+    search_items = bore_ctrlp_get_items(list_items, search_mode, mmode_func);
+    if (search_items == NULL || matches == NULL)
+	goto error;
 
     int input_str_ignorecase = ignorecase(input_str);
     char_u* input_str_case_prefix = input_str_ignorecase ? "\\c" : "\\C";
 
-    do_cmdline_cmd("sy clear CtrlPMatch");
-    do_cmdline_cmd("call clearmatches()");
+#ifdef FEAT_SEARCH_EXTRA
+    clear_matches(curwin);
+#endif
 
     // no search
     if (input_str[0] == '\0')
     {
+	bore_ctrlp_cache_clear_hits();
 	int search_idx = 0;
 	for (; search_idx < search_item_count; ++search_idx)
 	{
@@ -3453,6 +3869,8 @@ f_bore_ctrlpmatch(typval_T *argvars, typval_T *rettv)
     else if (regex)
     {
 	char_u input_str_with_case[MAXPATHL];
+
+	bore_ctrlp_cache_clear_hits();
 	strcpy(input_str_with_case, input_str_case_prefix);
 
 	if (1 == search_mode) // only-filename, don't match anything in path
@@ -3506,6 +3924,10 @@ f_bore_ctrlpmatch(typval_T *argvars, typval_T *rettv)
     {
 	int numfilters = 0;
 	char_u* filters[64];
+	char_u* query = vim_strsave(input_str);
+
+	if (query == NULL)
+	    goto error;
 
 	// substring - if ignorecase, convert to lower case
 	if (input_str_ignorecase)
@@ -3515,85 +3937,41 @@ f_bore_ctrlpmatch(typval_T *argvars, typval_T *rettv)
 		*s = TOLOWER_LOC(*s);
 	}
 
-	// substring - fill all substring filters and corresponding syntax highlighting patterns
+	// substring - fill all substring filters
 	{
-	    char_u syntax_pattern[MAXPATHL];
 	    char_u* filter = (char_u*) strtok((char*)input_str, " ");
 	    while (filter != NULL && numfilters < 64)
 	    {
 		filters[numfilters++] = filter;
-
-		// add syntax highlighting for every filter, i.e. every substring match
-		{
-		    // TODO-pkack use temp buffer instead of allocation for escaped string
-		    char_u* pattern = vim_strsave_escaped(filter, "^$.*~\\");
-		    strcpy(syntax_pattern, input_str_case_prefix);
-		    if (1 == search_mode) // only-filename, don't match anything in path
-			vim_strcat(syntax_pattern, "\\([^\\/\\\\]*$\\)\\@=", MAXPATHL);
-		    vim_strcat(syntax_pattern, pattern, MAXPATHL);
-		    vim_snprintf((char*)IObuff, IOSIZE, "call matchadd('CtrlPMatch', '%s')", syntax_pattern);
-		    do_cmdline_cmd(IObuff);
-		    vim_free(pattern);
-		}
 		filter = (char_u*) strtok(NULL, " ");
 	    }
 	}
 
-	// substring - for every search item, find match for all filters
-	char buf[MAXPATHL];
-	int search_idx = 0;
-	for (; search_idx < search_item_count; ++search_idx)
-	{
-	    char_u *search;
-	    if (input_str_ignorecase)
-	    {
-		char_u* src = search_items[search_idx].start;
-		char_u* dst = buf;
-		int j = 0;
-		for (; *src && j < MAXPATHL - 1; ++src, ++dst, ++j) 
-		    *dst = TOLOWER_LOC(*src);
-		*dst = '\0';
-		search = buf;
-	    }
-	    else
-	    {
-		search = search_items[search_idx].start;
-	    }
-
-	    int f = 0;
-	    for (; f < numfilters; ++f)
-	    {
-		if (!strstr(search, filters[f]))
-		    break;
-	    }
-
-	    if (f == numfilters)
-	    {
-		// in tab substring modes (mode 2 and 3)
-		if (search_mode & 2)
-		{
-		    // add back the non-searchable part of the string with a tab character
-		    if (search_lengths[search_idx] > 0)
-			search_lengths[search_idx] = '\t';
-		}
-
-		matches[match_count++] = search_items[search_idx].str;
-		if (match_limit > 0 && match_count >= match_limit) 
-		    break;
-	    }
+	// substring - highlight every filter, the window finds them in the
+	// lines it draws without compiling a pattern
+#ifdef FEAT_SEARCH_EXTRA
+	bore_match_add_filters(curwin, (char_u*)"CtrlPMatch", filters, numfilters,
+		(input_str_ignorecase ? BORE_MATCH_IC : 0) | (1 == search_mode ? BORE_MATCH_TAIL : 0));
+#endif
 
-	}
+	// substring - find the items matching all filters, in parallel
+	match_count = bore_ctrlp_substring(query, input_str_ignorecase, filters, numfilters, rank,
+		match_limit, matches);
+	vim_free(query);
     }
 
     // append result items
     if (match_count > 0)
     {
-	do_cmdline_cmd("cal matchadd('CtrlPLinePre', '^>')");
+#ifdef FEAT_SEARCH_EXTRA
+	char_u* line_pre = (char_u*)">";
+	bore_match_add_filters(curwin, (char_u*)"CtrlPLinePre", &line_pre, 1, BORE_MATCH_START);
+#endif
 
 	if (crfile_buf != NULL)
 	{
 	    int match_idx = 0;
-	    if (nosort)
+	    if (nosort || rank)
 	    {
 		// exclude current file from results
 		for (; match_idx < match_count; ++match_idx)
@@ -3627,9 +4005,7 @@ f_bore_ctrlpmatch(typval_T *argvars, typval_T *rettv)
     }
 
 error:
-    free(search_items);
-    free(search_lengths);
-    free(matches);
+    vim_free(matches);
 }
 #endif
 
@@ -2031,6 +2031,9 @@ do_write(exarg_T *eap)
 	    fname = alt_buf->b_sfname;
 	    alt_buf->b_sfname = curbuf->b_sfname;
 	    curbuf->b_sfname = fname;
+#ifdef FEAT_BORE
+	    alt_buf->b_bore_generation = 0;
+#endif
 	    buf_name_changed(curbuf);
 
 	    apply_autocmds(EVENT_BUFFILEPOST, NULL, NULL, FALSE, curbuf);
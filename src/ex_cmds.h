@@ -238,10 +238,10 @@ EXCMD(CMD_borefind,	"borefind",	ex_borefind,
 	EX_NEEDARG|EX_EXTRA,
 	ADDR_NONE),
 EXCMD(CMD_boreopen,	"boreopen",	ex_boreopen,
-	EX_WORD1,
+	EX_EXTRA,
 	ADDR_NONE),
 EXCMD(CMD_boresln,		"boresln",	ex_boresln,
-	EX_FILE1,
+	EX_BANG|EX_FILE1,
 	ADDR_NONE),
 EXCMD(CMD_boretoggle,	"boretoggle",	ex_boretoggle,
 	EX_WORD1,
@@ -32,6 +32,15 @@
 # define HAVE_DIRFD
 #endif
 
+#ifdef FEAT_BORE
+// readfile() adds the lines of a new file with ml_bulk_append() when it can
+# define READ_APPEND(lnum, line, len, newfile) \
+    (bulk ? ml_bulk_append(line, len) : ml_append(lnum, line, len, newfile))
+#else
+# define READ_APPEND(lnum, line, len, newfile) \
+    ml_append(lnum, line, len, newfile)
+#endif
+
 static char_u *next_fenc(char_u **pp, int *alloced);
 #ifdef FEAT_EVAL
 static char_u *readfile_charconvert(char_u *fname, char_u *fenc, int *fdp);
@@ -183,6 +192,9 @@ readfile(
     int		try_dos;
     int		try_unix;
     int		file_rewind = FALSE;
+#ifdef FEAT_BORE
+    int		bulk = FALSE;		// adding lines with ml_bulk_append()
+#endif
     int		can_retry;
     linenr_T	conv_error = 0;		// line nr with conversion error
     linenr_T	illegal_byte = 0;	// line nr with illegal byte
@@ -899,6 +911,15 @@ retry:
 	    error = TRUE;
 	    goto failed;
 	}
+#ifdef FEAT_BORE
+	if (bulk)
+	{
+	    // Drop the previously read lines.
+	    (void)ml_bulk_end(FALSE);
+	    bulk = FALSE;
+	    lnum = from;
+	}
+#endif
 	// Delete the previously read lines.
 	while (lnum > from)
 	    ml_delete(lnum--);
@@ -1121,6 +1142,51 @@ retry:
 #endif
     }
 
+#ifdef FEAT_BORE
+    // A large file is mapped and its lines are found when they are needed.
+    // That works when it isn't converted and it has no CR-NL line breaks.
+    if (newfile && wasempty && from == 0 && lines_to_skip == 0
+	    && lines_to_read == MAXLNUM && !filtering && !read_stdin
+	    && !read_buffer && !read_fifo && !recoverymode && !converted
+	    && tmpname == NULL && filesize == 0
+	    && curbuf->b_ml.ml_line_count == linecnt
+	    && (fileformat == EOL_UNIX
+			       || (fileformat == EOL_UNKNOWN && try_unix))
+# ifdef FEAT_PERSISTENT_UNDO
+	    && !read_undo_file
+# endif
+# ifdef FEAT_CRYPT
+	    && *curbuf->b_p_key == NUL
+# endif
+	    )
+    {
+	int	eol;
+
+	if (bore_map_read(curbuf, fd, filesize_disk, fileformat == EOL_UNKNOWN,
+				   enc_utf8 && !curbuf->b_p_bin, &eol) == OK)
+	{
+	    if (fileformat == EOL_UNKNOWN && set_options)
+		set_fileformat(EOL_UNIX, OPT_LOCAL);
+	    fileformat = EOL_UNIX;
+	    if (!eol)
+	    {
+		if (set_options)
+		    curbuf->b_p_eol = FALSE;
+		read_no_eol_lnum = curbuf->b_ml.ml_line_count;
+	    }
+	    lnum = curbuf->b_ml.ml_line_count;
+	    filesize = filesize_disk;
+	    linerest = 0;
+	    goto failed;
+	}
+    }
+
+    // The lines of a new file fill the memfile blocks one after the other.
+    if (!bulk && newfile && wasempty && from == 0 && !recoverymode
+	    && curbuf->b_ml.ml_line_count == linecnt)
+	bulk = ml_bulk_start(curbuf) == OK;
+#endif
+
     while (!error && !got_int)
     {
 	/*
@@ -2169,7 +2235,7 @@ rewind_retry:
 		    {
 			*ptr = NUL;	    // end of line
 			len = (colnr_T) (ptr - line_start + 1);
-			if (ml_append(lnum, line_start, len, newfile) == FAIL)
+			if (READ_APPEND(lnum, line_start, len, newfile) == FAIL)
 			{
 			    error = TRUE;
 			    break;
@@ -2198,7 +2264,16 @@ rewind_retry:
 	    while (++ptr, --size >= 0)
 	    {
 		if ((c = *ptr) != NUL && c != NL)  // catch most common case
+		{
+#ifdef FEAT_BORE
+		    // skip to the end of the line
+		    char_u *eol = bore_find_eol(ptr + 1, ptr + 1 + size);
+
+		    size -= (long)(eol - ptr - 1);
+		    ptr = eol - 1;
+#endif
 		    continue;
+		}
 		if (c == NUL)
 		    *ptr = NL;	// NULs are replaced by newlines!
 		else
@@ -2239,7 +2314,7 @@ rewind_retry:
 				ff_error = EOL_DOS;
 			    }
 			}
-			if (ml_append(lnum, line_start, len, newfile) == FAIL)
+			if (READ_APPEND(lnum, line_start, len, newfile) == FAIL)
 			{
 			    error = TRUE;
 			    break;
@@ -2294,7 +2369,7 @@ failed:
 	}
 	*ptr = NUL;
 	len = (colnr_T)(ptr - line_start + 1);
-	if (ml_append(lnum, line_start, len, newfile) == FAIL)
+	if (READ_APPEND(lnum, line_start, len, newfile) == FAIL)
 	    error = TRUE;
 	else
 	{
@@ -2305,6 +2380,13 @@ failed:
 	    read_no_eol_lnum = ++lnum;
 	}
     }
+#ifdef FEAT_BORE
+    if (bulk && ml_bulk_end(TRUE) == FAIL)
+    {
+	error = TRUE;
+	lnum = from;
+    }
+#endif
 
     if (set_options)
 	save_file_ff(curbuf);		// remember the current file format
@@ -2370,13 +2452,19 @@ failed:
 	// need to delete the last line, which comes from the empty buffer
 	if (newfile && wasempty && !(curbuf->b_ml.ml_flags & ML_EMPTY))
 	{
+#ifdef FEAT_BORE
+	    // a mapped file has it in the memfile only
+	    if (curbuf->b_ml.ml_bore_map == NULL)
+#endif
+	    {
 #ifdef FEAT_NETBEANS_INTG
-	    netbeansFireChanges = 0;
+		netbeansFireChanges = 0;
 #endif
-	    ml_delete(curbuf->b_ml.ml_line_count);
+		ml_delete(curbuf->b_ml.ml_line_count);
 #ifdef FEAT_NETBEANS_INTG
-	    netbeansFireChanges = 1;
+		netbeansFireChanges = 1;
 #endif
+	    }
 	    --linecnt;
 	}
 	linecnt = curbuf->b_ml.ml_line_count - linecnt;
@@ -3999,6 +4087,16 @@ move_lines(buf_T *frombuf, buf_T *tobuf)
     linenr_T	lnum;
     char_u	*p;
 
+#ifdef FEAT_BORE
+    // The lines of a mapped file are not copied
+    if (frombuf->b_ml.ml_bore_map != NULL
+				      && (tobuf->b_ml.ml_flags & ML_EMPTY))
+    {
+	ml_bore_move(frombuf, tobuf);
+	return OK;
+    }
+#endif
+
     // Copy the lines in "frombuf" to "tobuf".
     curbuf = tobuf;
     for (lnum = 1; lnum <= frombuf->b_ml.ml_line_count; ++lnum)
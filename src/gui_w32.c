@@ -4881,15 +4881,6 @@ _WndProc(
 	return _OnDpiChanged(hwnd, (UINT)LOWORD(wParam), (UINT)HIWORD(wParam),
 		(RECT*)lParam);
 
-#ifdef FEAT_BORE
-    case WM_USER + 1234:
-    {
-	extern void bore_async_execute_update(DWORD flags);
-	bore_async_execute_update(lParam);
-	break;
-    } 
-#endif
-
     default:
 #ifdef MSWIN_FIND_REPLACE
 	if (uMsg == s_findrep_msg && s_findrep_msg != 0)
@@ -15,33 +15,81 @@
 // #define BORE_VIMPROFILE
 // __pragma(optimize("", off))
 
+// The steps are always timed for bore_stats(), BORE_VIMPROFILE shows them too
+#define BORE_VIMPROFILE_INIT long long ptime = 0
+#define BORE_VIMPROFILE_START ptime = bore_time_us()
 #ifdef BORE_VIMPROFILE
-#define BORE_VIMPROFILE_INIT proftime_T ptime
-#define BORE_VIMPROFILE_START profile_start(&ptime)
 #define BORE_VIMPROFILE_STOP(str) do \
 { \
     char pmess[100]; \
-    profile_end(&ptime); \
-    vim_snprintf(pmess, 100, "%s %s", profile_msg(&ptime), str); \
+    ptime = bore_time_us() - ptime; \
+    bore_stats_phase(str, ptime); \
+    vim_snprintf(pmess, 100, "%10.6f %s", ptime / 1000000.0, str); \
     const int p_msg_silent = msg_silent; \
     msg_silent = 0; \
     msg(_(pmess)); \
     msg_silent = p_msg_silent; \
 } while(0)
 #else
-#define BORE_VIMPROFILE_INIT
-#define BORE_VIMPROFILE_START
-#define BORE_VIMPROFILE_STOP(str)
+#define BORE_VIMPROFILE_STOP(str) bore_stats_phase(str, bore_time_us() - ptime)
 #endif
 
 #if defined(FEAT_BORE)
 
-static int bore_canonicalize (const char* src, char* dst, DWORD* attr);
+#ifndef MSWIN
+#include <sys/mman.h>
+#include <setjmp.h>
+#endif
+#if defined(_M_X64) || defined(__x86_64__)
+#define BORE_EOL_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef MSWIN
+#define BORE_PATHSEP '\\'
+#define BORE_ATTR_DIRECTORY FILE_ATTRIBUTE_DIRECTORY
+#else
+#define BORE_PATHSEP '/'
+#define BORE_ATTR_DIRECTORY 0x10
+#endif
+
+static int bore_canonicalize (const char* src, char* dst, u32* attr);
 static u32 bore_string_hash(const char* s);
 static u32 bore_string_hash_n(const char* s, int n);
-static int bore_is_excluded_file(const char* path);
+static void bore_file_hash_clear(bore_t* b);
+static bore_file_t* bore_find_path(bore_t* b, const char* path);
 static int bore_is_excluded_file_n(const char* path, int len);
 
+#ifdef MSWIN
+#define bore_qsort_s qsort_s
+#define bore_bsearch_s bsearch_s
+#else
+// qsort_s and bsearch_s with the MSVC argument order. Only used from the
+// main thread, so the context can be passed through a static.
+typedef int (*bore_compare_t)(void* ctx, const void* vx, const void* vy);
+static bore_compare_t bore_sort_compare;
+static void* bore_sort_ctx;
+
+static int bore_sort_trampoline(const void* vx, const void* vy)
+{
+    return bore_sort_compare(bore_sort_ctx, vx, vy);
+}
+
+static void bore_qsort_s(void* base, size_t count, size_t size, bore_compare_t compare, void* ctx)
+{
+    bore_sort_compare = compare;
+    bore_sort_ctx = ctx;
+    qsort(base, count, size, bore_sort_trampoline);
+}
+
+static void* bore_bsearch_s(const void* key, const void* base, size_t count, size_t size, bore_compare_t compare, void* ctx)
+{
+    bore_sort_compare = compare;
+    bore_sort_ctx = ctx;
+    return bsearch(key, base, count, size, bore_sort_trampoline);
+}
+#endif
+
 void bore_prealloc(bore_alloc_t* p, size_t size)
 {
     p->base = (u8*)lalloc(size + BORE_CACHELINE, TRUE);
@@ -95,20 +143,28 @@ void bore_alloc_free(bore_alloc_t* p)
 
 static bore_t* g_bore = 0;
 
+// Bumped whenever the files of g_bore change, invalidates b_bore_generation
+static int g_bore_file_generation = 0;
+
+// Set while borefind searches g_bore. The workers read the files and the
+// strings, which must not change or be freed by commands that the progress
+// callback runs (autocommands when the quickfix window is opened or redrawn).
+static int g_bore_searching = FALSE;
+
 static void bore_free(bore_t* b)
 {
-    int i;
     if (!b) return;
+    bore_watch_free(b->watch);
+    bore_index_free(b);
     bore_alloc_free(&b->file_alloc);
     bore_alloc_free(&b->file_ext_alloc);
+    bore_alloc_free(&b->file_hash_alloc);
+    bore_alloc_free(&b->toggle_suffix_alloc);
     bore_alloc_free(&b->toggle_index_alloc);
     bore_alloc_free(&b->data_alloc);
     bore_alloc_free(&b->config_alloc);
     bore_alloc_free(&b->proj_alloc);
-    for (i = 0; i < BORE_SEARCH_JOBS; ++i)
-    {
-        bore_alloc_free(&b->search[i].filedata);
-    }
+    bore_alloc_free(&b->dep_alloc);
     vim_free(b);
 }
 
@@ -134,6 +190,15 @@ static u32 bore_strndup(bore_t* b, const char* s, size_t len)
     return p - (char*)b->data_alloc.base;
 }
 
+static u32 bore_strcat(bore_t* b, const char* s1, size_t len1, const char* s2, size_t len2)
+{
+    char* p = (char*)bore_alloc(&b->data_alloc, len1 + len2 + 1);
+    memcpy(p, s1, len1);
+    memcpy(p + len1, s2, len2);
+    p[len1 + len2] = 0;
+    return p - (char*)b->data_alloc.base;
+}
+
 static int bore_str_match_len(const char* target, const char* candidate)
 {
     int len = 0;
@@ -165,7 +230,7 @@ static int bore_is_sln_directory(bore_t* b)
     return b->sln_dir == b->sln_path;
 }
 
-static int bore_is_excluded_file(const char* path)
+int bore_is_excluded_file(const char* path)
 {
     return bore_is_excluded_file_n(path, -1);
 }
@@ -178,7 +243,7 @@ static int bore_is_excluded_file_n(const char* path, int len)
     else
         ext = (char*)vim_strrchr((char_u*)path, '.');
 
-    if (0 == ext || *ext != '.')
+    if (0 == ext || ext < path || *ext != '.')
         return 0;
     ++ext;
 
@@ -244,8 +309,125 @@ static int bore_is_excluded_file_n(const char* path, int len)
     return 0;
 }
 
-static void bore_load_vcxproj_files(bore_t* b, int proj_index, const char* path)
+static void bore_add_dep(bore_t* b, u32 path)
+{
+    *(u32*)bore_alloc(&b->dep_alloc, sizeof(u32)) = path;
+    ++b->dep_count;
+}
+
+// Remember the directory of a file found by a wildcard (or where the wildcard
+// starts), a file added to it invalidates the solution cache and reloads a
+// watched solution
+static void bore_add_dep_dir(bore_t* b, const char* path)
+{
+    const char* wildcard = strchr(path, '*');
+    size_t len = wildcard ? (size_t)(wildcard - path) : strlen(path);
+    while (len > 0 && path[len - 1] != BORE_PATHSEP && path[len - 1] != '/')
+        --len;
+    if (len <= 1)
+        return;
+    --len; // without the separator
+    if (b->dep_count > 0)
+    {
+        const char* last = bore_str(b, ((u32*)b->dep_alloc.base)[b->dep_count - 1]);
+        if (0 == STRNCMP(last, path, len) && last[len] == 0)
+            return;
+    }
+    bore_add_dep(b, bore_strndup(b, path, len));
+}
+
+// Threads for listing and parsing files, mostly waiting for the file system,
+// so more threads than cores
+static int bore_io_thread_count(bore_t* b)
+{
+    int thread_count = 2 * b->ini.cpu_cores;
+    if (thread_count > BORE_MAX_SEARCH_THREADS)
+        thread_count = BORE_MAX_SEARCH_THREADS;
+    return thread_count;
+}
+
+static void bore_add_file(bore_t* b, int proj_index, const char* path)
+{
+    bore_file_t* files = (bore_file_t*)bore_alloc(&b->file_alloc, sizeof(bore_file_t));
+    files->file = bore_strndup(b, path, strlen(path));
+    files->proj_index = proj_index;
+    ++b->file_count;
+}
+
+static void bore_add_wildcard_files(bore_t* b, int proj_index, char* pattern)
+{
+    char buf[BORE_MAX_PATH];
+    u32 attr;
+    int retval;
+    int num_files;
+    char_u **files;
+
+    bore_add_dep_dir(b, pattern);
+    retval = gen_expand_wildcards(1, (char_u**)&pattern, &num_files, &files, EW_FILE|EW_NOTWILD);
+    if (retval)
+    {
+        for (int i = 0; i < num_files; ++i)
+        {
+            char* fn = (char*)files[i];
+            if (!bore_is_excluded_file(fn) && FAIL != bore_canonicalize(fn, buf, &attr))
+            {
+                if (!(BORE_ATTR_DIRECTORY & attr))
+                {
+                    bore_add_dep_dir(b, buf);
+                    bore_add_file(b, proj_index, buf);
+                }
+            }
+        }
+    }
+    FreeWild(num_files, files);
+}
+
+// A file or wildcard included by a project, parsed on a worker thread
+typedef struct bore_include_t
+{
+    u32 path;     // offset in the worker's data
+    int wildcard; // expanded on the main thread, gen_expand_wildcards isn't thread safe
+} bore_include_t;
+
+typedef struct bore_proj_parse_worker_t
+{
+    bore_alloc_t include_alloc; // array of bore_include_t
+    bore_alloc_t data_alloc;
+    int include_count;
+} bore_proj_parse_worker_t;
+
+typedef struct bore_proj_includes_t
+{
+    int worker;
+    int first;
+    int count;
+} bore_proj_includes_t;
+
+typedef struct bore_proj_parse_t
+{
+    bore_t* b;
+    bore_proj_includes_t* proj; // the includes of each project
+    bore_proj_parse_worker_t worker[BORE_MAX_SEARCH_THREADS];
+} bore_proj_parse_t;
+
+static void bore_add_include(bore_proj_parse_worker_t* w, const char* path, int wildcard)
+{
+    size_t len = strlen(path);
+    bore_include_t* include = (bore_include_t*)bore_alloc(&w->include_alloc, sizeof(bore_include_t));
+    char* p = (char*)bore_alloc(&w->data_alloc, len + 1);
+    memcpy(p, path, len + 1);
+    include->path = (u32)(p - (char*)w->data_alloc.base);
+    include->wildcard = wildcard;
+    ++w->include_count;
+}
+
+// Runs on a worker thread, only reads b. The includes are canonicalized here,
+// so that the file system lookups of all workers overlap.
+static void bore_load_vcxproj_files(void* ctx, int worker, int proj_index)
 {
+    bore_proj_parse_t* parse = (bore_proj_parse_t*)ctx;
+    bore_proj_parse_worker_t* w = &parse->worker[worker];
+    bore_proj_t* proj = (bore_proj_t*)parse->b->proj_alloc.base + proj_index;
     FILE* f;
     char buf[BORE_MAX_PATH];
     char filename_buf[BORE_MAX_PATH];
@@ -253,15 +435,22 @@ static void bore_load_vcxproj_files(bore_t* b, int proj_index, const char* path)
     char* ext_part;
     int path_len;
     int skipFile = 0;
-    DWORD attr;
-    BOOL is_csproj;
+    u32 attr;
+    int is_csproj;
+
+    parse->proj[proj_index].worker = worker;
+    parse->proj[proj_index].first = w->include_count;
+    parse->proj[proj_index].count = 0;
+    if (!proj->project_file_path)
+        return;
 
+    const char* path = bore_str(parse->b, proj->project_file_path);
     f = fopen(path, "rb");
     if (!f)
         return;
 
     strcpy(filename_buf, path);
-    filename_part = (char*)vim_strrchr((char_u*)filename_buf, '\\') + 1;
+    filename_part = (char*)vim_strrchr((char_u*)filename_buf, BORE_PATHSEP) + 1;
     path_len = filename_part - filename_buf;
     ext_part = (char*)vim_strrchr((char_u*)filename_buf, '.');
     is_csproj = ext_part > filename_part && 0 == STRNCMP((char*)ext_part, ".csproj", 7);
@@ -294,41 +483,13 @@ static void bore_load_vcxproj_files(bore_t* b, int proj_index, const char* path)
                     skipFile = bore_is_excluded_file_n(fn, len);
                     if (!skipFile && FAIL != bore_canonicalize(fn, buf, &attr))
                     {
-                        if (!(FILE_ATTRIBUTE_DIRECTORY & attr))
-                        {
-                            bore_file_t* files = (bore_file_t*)bore_alloc(&b->file_alloc, sizeof(bore_file_t));
-                            files->file = bore_strndup(b, buf, strlen(buf));
-                            files->proj_index = proj_index;
-                            ++b->file_count;
-                        }
+                        if (!(BORE_ATTR_DIRECTORY & attr))
+                            bore_add_include(w, buf, 0);
                     }
                     continue;
                 }
 
-                int retval;
-                int num_files;
-                char_u **files;
-
-                retval = gen_expand_wildcards(1, (char_u**)&fn, &num_files, &files, EW_FILE|EW_NOTWILD);
-                if (retval)
-                {
-                    for (int i = 0; i < num_files; ++i)
-                    {
-                        char* fn = (char*)files[i];
-                        skipFile = bore_is_excluded_file(fn);
-                        if (!skipFile && FAIL != bore_canonicalize(fn, buf, &attr))
-                        {
-                            if (!(FILE_ATTRIBUTE_DIRECTORY & attr))
-                            {
-                                bore_file_t* files = (bore_file_t*)bore_alloc(&b->file_alloc, sizeof(bore_file_t));
-                                files->file = bore_strndup(b, buf, strlen(buf));
-                                files->proj_index = proj_index;
-                                ++b->file_count;
-                            }
-                        }
-                    }
-                }
-                FreeWild(num_files, files);
+                bore_add_include(w, fn, 1);
             }
         }
     }
@@ -337,33 +498,11 @@ static void bore_load_vcxproj_files(bore_t* b, int proj_index, const char* path)
 
     if (is_csproj)
     {
-        int retval;
-        int num_files;
-        char_u **files;
-
-        filename_part = filename_buf;
         vim_strncpy(filename_buf + path_len, "**/*.cs", 7);
-        retval = gen_expand_wildcards(1, (char_u**)&filename_part, &num_files, &files, EW_FILE|EW_NOTWILD);
-        if (retval)
-        {
-            for (int i = 0; i < num_files; ++i)
-            {
-                char* fn = (char*)files[i];
-                skipFile = bore_is_excluded_file(fn);
-                if (!skipFile && FAIL != bore_canonicalize(fn, buf, &attr))
-                {
-                    if (!(FILE_ATTRIBUTE_DIRECTORY & attr))
-                    {
-                        bore_file_t* files = (bore_file_t*)bore_alloc(&b->file_alloc, sizeof(bore_file_t));
-                        files->file = bore_strndup(b, buf, strlen(buf));
-                        files->proj_index = proj_index;
-                        ++b->file_count;
-                    }
-                }
-            }
-        }
-        FreeWild(num_files, files);
+        bore_add_include(w, filename_buf, 1);
     }
+
+    parse->proj[proj_index].count = w->include_count - parse->proj[proj_index].first;
 }
 
 typedef struct bore_guid_map_t
@@ -380,7 +519,7 @@ static int bore_extract_projects_and_files_from_sln(bore_t* b, const char* sln_p
     char buf2[BORE_MAX_PATH];
     int result = FAIL;
     int state = 0;
-    int sln_path_dir_len = (char*)vim_strrchr((char_u*)sln_path, '\\') - sln_path + 1;
+    int sln_path_dir_len = (char*)vim_strrchr((char_u*)sln_path, BORE_PATHSEP) - sln_path + 1;
 
     regmatch.regprog = vim_regcomp((char_u*)"^Project(\"{.\\{-}}\") = \"\\(.\\{-}\\)\", \"\\(.\\{-}\\)\", \"{\\(.\\{-}\\)}\"", RE_MAGIC + RE_STRING);
     regmatch.rm_ic = 0;
@@ -453,14 +592,14 @@ static int bore_extract_projects_and_files_from_sln(bore_t* b, const char* sln_p
                 char* ends = strstr(buf, " = ");
                 if (ends)
                 {
-                    DWORD attr = 0;
+                    u32 attr = 0;
                     int skipFile = 0;
 
                     *ends = 0;
                     skipFile = bore_is_excluded_file(&buf[2]); // "\t\t"
                     if (!skipFile && FAIL != bore_canonicalize(&buf[2], buf, &attr))
                     {
-                        if (!(FILE_ATTRIBUTE_DIRECTORY & attr))
+                        if (!(BORE_ATTR_DIRECTORY & attr))
                         {
                             bore_file_t* files = (bore_file_t*)bore_alloc(&b->file_alloc, sizeof(bore_file_t));
                             files->file = bore_strndup(b, buf, strlen(buf));
@@ -573,53 +712,27 @@ done:
     return result;
 }
 
-static int bore_find_dir_proj_for_file(bore_t* b, char* fn)
+static void bore_add_dir_proj(bore_t* b, const char* root, size_t root_len, const char* dir, size_t len)
 {
-    bore_proj_t* projects = (bore_proj_t*)b->proj_alloc.base;
-    int best_score = 0;
-    int best_i = 0;
-    int i;
-    char* rel_path_start = fn + b->sln_dir_len;
-    if (strchr(rel_path_start, '\\'))
-    {
-        for (i = 1; i < b->proj_count; ++i)
-        {
-            int score = bore_str_match_score(rel_path_start, bore_str(b, projects[i].project_sln_name));
-            if (score > best_score)
-            {
-                best_score = score;
-                best_i = i;
-            }
-        }
-    }
-    return best_i;
+    bore_proj_t* proj = (bore_proj_t*)bore_alloc(&b->proj_alloc, sizeof(bore_proj_t));
+    ++b->proj_count;
+    proj->project_sln_name = bore_strndup(b, dir, len);
+    proj->project_sln_guid = 0;
+    proj->project_sln_path = proj->project_sln_name;
+    proj->project_file_path = bore_strcat(b, root, root_len, dir, len);
 }
 
-static int bore_extract_projects_and_files_from_dir(bore_t* b, const char* sln_path)
+// Add the listed files of a directory solution, the first level directories
+// are the projects
+static void bore_add_dir_list(bore_t* b, bore_dir_list_t* list)
 {
-    BOOL is_git_repo;
-    {
-        ++emsg_silent;
-        char *cmd = "git rev-parse --is-inside-work-tree";
-        char* res = get_cmd_output(cmd, NULL, SHELL_READ & SHELL_SILENT, NULL);
-        is_git_repo = res && !STRNCMP(res, "true", 4);
-        --emsg_silent;
-    }
-    char* subdir_cmd = is_git_repo ? "git ls-tree -d --name-only HEAD" : "dir /b /ad";
-    char* files_cmd = is_git_repo ? "git ls-files" : "dir /s /b /a-d";
-
-    size_t sln_path_len = strlen(sln_path);
-    char buf[BORE_MAX_PATH];
-    char* output;
-    char *line;
-    DWORD attr;
-    int skipFile;
-    int len;
+    char root[BORE_MAX_PATH];
+    size_t root_len = b->sln_dir_len;
+    u32* dirs = (u32*)list->dir_alloc.base;
+    bore_file_t* files = (bore_file_t*)list->file_alloc.base;
     int i;
-    
-    output = get_cmd_output(subdir_cmd, 0, SHELL_READ & SHELL_SILENT, &len);
-    if (!output)
-        goto done;
+
+    vim_strncpy((char_u*)root, (char_u*)bore_str(b, b->sln_dir), root_len);
 
     // add root dir as base project
     {
@@ -631,73 +744,168 @@ static int bore_extract_projects_and_files_from_dir(bore_t* b, const char* sln_p
         proj->project_file_path = b->sln_path;
     }
 
-    // add all first level sub dirs as projects
-    for (i = 0; i < len; ++i)
+    for (i = 0; i < list->dir_count; ++i)
     {
-        line = output + i;
-        while (i < len && output[i] != '\r' && output[i] != '\n')
-            ++i;
-        output[i] = 0;
-        if (output[i+1] == '\n')
-            ++i;
+        const char* dir = (const char*)list->data_alloc.base + dirs[i];
+        bore_add_dir_proj(b, root, root_len, dir, strlen(dir));
+    }
 
-        if (FAIL != bore_canonicalize(line, buf, &attr))
-        {
-            if ((FILE_ATTRIBUTE_DIRECTORY & attr))
-            {
-                bore_proj_t* proj = (bore_proj_t*)bore_alloc(&b->proj_alloc, sizeof(bore_proj_t));
-                ++b->proj_count;
-                proj->project_sln_name = bore_strndup(b, buf + sln_path_len, strlen(buf + sln_path_len));
-                proj->project_sln_guid = 0;
-                proj->project_sln_path = proj->project_sln_name;
-                proj->project_file_path = bore_strndup(b, buf, strlen(buf));
-            }
-        }
+    for (i = 0; i < list->file_count; ++i)
+    {
+        const char* rel = (const char*)list->data_alloc.base + files[i].file;
+        size_t len = strlen(rel);
+        bore_file_t* file = (bore_file_t*)bore_alloc(&b->file_alloc, sizeof(bore_file_t));
+        file->file = bore_strcat(b, root, root_len, rel, len);
+        file->proj_index = files[i].proj_index;
+        ++b->file_count;
     }
+}
 
-    output = get_cmd_output(files_cmd, 0, SHELL_READ & SHELL_SILENT, &len);
-    if (!output)
-        goto done;
+static int bore_watch_enabled(void)
+{
+    char* watch = (char*)get_var_value((char_u *)"g:bore_watch");
+    return watch && atoi(watch);
+}
+
+// Files are listed from the git index in a git directory, unless
+// g:bore_git_untracked is set. Returns TRUE then, with the index and the
+// prefix of root in it. Other directories (and git directories with
+// g:bore_git_untracked or an index that can't be read) are walked, skipping
+// what .gitignore files ignore and exclude (.git/info/exclude, empty if root
+// isn't in a git work tree).
+static int bore_dir_uses_git_index(const char* root, char* index, char* prefix, char* exclude)
+{
+    char git_dir[BORE_MAX_PATH];
+    char work_tree[BORE_MAX_PATH];
+    char* untracked = (char*)get_var_value((char_u *)"g:bore_git_untracked");
+    char* c;
 
-    // add every listed file
-    for (i = 0; i < len; ++i)
+    *exclude = NUL;
+    if (FAIL == bore_find_git_dir(root, git_dir, work_tree))
+        return FALSE;
+    vim_snprintf(exclude, BORE_MAX_PATH, "%s%cinfo%cexclude", git_dir, BORE_PATHSEP, BORE_PATHSEP);
+    if (untracked && atoi(untracked))
+        return FALSE;
+
+    // The index has the paths relative to the work tree, '/' separated
+    vim_strncpy((char_u*)prefix, (char_u*)root + strlen(work_tree), BORE_MAX_PATH - 1);
+    for (c = prefix; *c; ++c)
+        if (*c == BORE_PATHSEP)
+            *c = '/';
+    vim_snprintf(index, BORE_MAX_PATH, "%s%cindex", git_dir, BORE_PATHSEP);
+    return TRUE;
+}
+
+// Watch all directories that were walked, the files in them are added and
+// removed as they change. With g:bore_index the files that are written are
+// reported too, the index doesn't know what they contain.
+static void bore_watch_walked_dirs(bore_t* b, bore_dir_list_t* list)
+{
+    char* index = (char*)get_var_value((char_u *)"g:bore_index");
+    int ok;
+
+    b->watch = bore_watch_start(bore_str(b, b->sln_dir), index && atoi(index));
+    b->watch_mode = BW_DIR;
+    if (!b->watch)
+        return;
+#ifdef MSWIN
+    ok = OK == bore_watch_add(b->watch, "", TRUE);
+#else
+    u32* dirs = (u32*)list->subdir_alloc.base;
+    int i;
+    ok = OK == bore_watch_add(b->watch, "", FALSE);
+    for (i = 0; ok && i < list->subdir_count; ++i)
+        ok = OK == bore_watch_add(b->watch, (char*)list->data_alloc.base + dirs[i], FALSE);
+#endif
+    if (!ok)
     {
-        line = output + i;
-        while (i < len && output[i] != '\r' && output[i] != '\n')
-            ++i;
-        output[i] = 0;
-        if (output[i+1] == '\n')
-            ++i;
+        bore_watch_free(b->watch);
+        b->watch = NULL;
+        emsg(_("boresln: Could not watch all directories of the solution"));
+    }
+}
 
-        skipFile = bore_is_excluded_file(line);
-        if (!skipFile && FAIL != bore_canonicalize(line, buf, &attr))
-        {
-            if (!(FILE_ATTRIBUTE_DIRECTORY & attr))
-            {
-                int proj_index = bore_find_dir_proj_for_file(b, buf);
-                bore_file_t* files = (bore_file_t*)bore_alloc(&b->file_alloc, sizeof(bore_file_t));
-                files->file = bore_strndup(b, buf, strlen(buf));
-                files->proj_index = proj_index;
-                ++b->file_count;
-            }
-        }
+static int bore_extract_projects_and_files_from_dir(bore_t* b, const char* sln_path)
+{
+    char root[BORE_MAX_PATH];
+    char index[BORE_MAX_PATH];
+    char prefix[BORE_MAX_PATH];
+    char exclude[BORE_MAX_PATH];
+    bore_dir_list_t list;
+
+    vim_strncpy((char_u*)root, (char_u*)sln_path, BORE_MAX_PATH - 1);
+    if (bore_dir_uses_git_index(root, index, prefix, exclude)
+            && OK == bore_read_git_index(index, prefix, &list))
+    {
+        // The file list changes with the index
+        bore_add_dep(b, bore_strndup(b, index, strlen(index)));
+    }
+    else
+    {
+        // Also when the index has a version or extension that isn't read
+        // Without git there is nothing to validate the solution cache with
+        b->cache_file = 0;
+        if (*exclude)
+            b->exclude_file = bore_strndup(b, exclude, strlen(exclude));
+        if (FAIL == bore_walk_dir(root, bore_io_thread_count(b), *exclude ? exclude : NULL, &list))
+            return FAIL;
+        if (bore_watch_enabled())
+            bore_watch_walked_dirs(b, &list);
     }
 
-done:
+    bore_add_dir_list(b, &list);
+    bore_dir_list_free(&list);
     return OK;
 }
 
 static int bore_extract_files_from_projects(bore_t* b)
 {
-    bore_proj_t* proj = (bore_proj_t*)b->proj_alloc.base;
-    int i;
+    bore_proj_parse_t parse;
+    int thread_count;
+    int i, k;
+
+    if (b->proj_count == 0)
+        return OK;
+
+    thread_count = bore_io_thread_count(b);
+    if (thread_count > b->proj_count)
+        thread_count = b->proj_count;
+
+    memset(&parse, 0, sizeof(parse));
+    parse.b = b;
+    parse.proj = (bore_proj_includes_t*)alloc(sizeof(bore_proj_includes_t) * b->proj_count);
+    if (!parse.proj)
+        return FAIL;
+    for (i = 0; i < thread_count; ++i)
+    {
+        bore_prealloc(&parse.worker[i].include_alloc, sizeof(bore_include_t) * 4096);
+        bore_prealloc(&parse.worker[i].data_alloc, 256 * 1024);
+    }
+
+    bore_parallel_for(thread_count, b->proj_count, bore_load_vcxproj_files, &parse);
+
+    // Merge in project order, so that the result doesn't depend on the
+    // scheduling of the workers
     for (i = 0; i < b->proj_count; ++i)
     {
-        if (proj[i].project_file_path)
+        bore_proj_parse_worker_t* w = &parse.worker[parse.proj[i].worker];
+        bore_include_t* include = (bore_include_t*)w->include_alloc.base + parse.proj[i].first;
+        for (k = 0; k < parse.proj[i].count; ++k)
         {
-            bore_load_vcxproj_files(b, i, bore_str(b, proj[i].project_file_path));
+            char* path = (char*)w->data_alloc.base + include[k].path;
+            if (include[k].wildcard)
+                bore_add_wildcard_files(b, i, path);
+            else
+                bore_add_file(b, i, path);
         }
     }
+
+    for (i = 0; i < thread_count; ++i)
+    {
+        bore_alloc_free(&parse.worker[i].include_alloc);
+        bore_alloc_free(&parse.worker[i].data_alloc);
+    }
+    vim_free(parse.proj);
     return OK;
 }
 
@@ -708,8 +916,8 @@ static int bore_find_filename(void* ctx, const void* vx, const void* vy)
     bore_file_t* y = (bore_file_t*)vy;
     const char* y_path = bore_str(b, y->file);
     const int i = bore_str_match_len(x_path, y_path);
-    BOOL xi_is_file = x_path[i] == '\0' || !strchr(x_path + i, '\\');
-    BOOL yi_is_file = y_path[i] == '\0' || !strchr(y_path + i, '\\');
+    int xi_is_file = x_path[i] == '\0' || !strchr(x_path + i, BORE_PATHSEP);
+    int yi_is_file = y_path[i] == '\0' || !strchr(y_path + i, BORE_PATHSEP);
     // group-directories-first
     if (xi_is_file ^ yi_is_file)
         return yi_is_file - xi_is_file;
@@ -726,7 +934,7 @@ static int bore_sort_files(void* ctx, const void* vx, const void* vy)
     return bore_find_filename(b, fn, y);
 }
 
-static int bore_sort_filenames(const void* ctx, const void* vx, const void* vy)
+static int bore_sort_filenames(void* ctx, const void* vx, const void* vy)
 {
     char x_path[BORE_MAX_PATH];
     char y_path[BORE_MAX_PATH];
@@ -750,7 +958,7 @@ void bore_sortfilenames(char_u** files, int count, char_u* current)
         return;
     BORE_VIMPROFILE_INIT;
     BORE_VIMPROFILE_START;
-    qsort_s(&files[0], count, sizeof(char_u*), bore_sort_filenames, current_path);
+    bore_qsort_s(&files[0], count, sizeof(char_u*), bore_sort_filenames, current_path);
     BORE_VIMPROFILE_STOP("bore_sortfilenames");
 }
 
@@ -792,7 +1000,7 @@ static int bore_sort_and_cleanup_files(bore_t* b)
         return OK;
 
     // sort
-    qsort_s(files, b->file_count, sizeof(bore_file_t), bore_sort_files, b);
+    bore_qsort_s(files, b->file_count, sizeof(bore_file_t), bore_sort_files, b);
 
     // uniq
     {
@@ -821,6 +1029,15 @@ static int bore_sort_and_cleanup_files(bore_t* b)
     return OK;
 }
 
+static u32 bore_file_ext_hash(const char* path)
+{
+    u32 path_len = (u32)strlen(path);
+    const char* ext = (const char*)vim_strrchr((char_u*)path, '.');
+
+    ext = ext ? ext + 1 : path + path_len;
+    return bore_string_hash(ext);
+}
+
 static int bore_build_extension_list(bore_t* b)
 {
     bore_file_t* files = (bore_file_t*)b->file_alloc.base;
@@ -828,14 +1045,7 @@ static int bore_build_extension_list(bore_t* b)
     u32* ext_hash = (u32*)b->file_ext_alloc.base;
     u32 i;
     for (i = 0; i < (u32)b->file_count; ++i)
-    {
-        char* path = bore_str(b, files[i].file);
-        u32 path_len = (u32)strlen(path);
-        char* ext = vim_strrchr(path, '.');
-
-        ext = ext ? ext + 1 : path + path_len;
-        ext_hash[i] = bore_string_hash(ext);
-    }
+        ext_hash[i] = bore_file_ext_hash(bore_str(b, files[i].file));
 
     return OK;
 }
@@ -849,63 +1059,169 @@ static int bore_sort_toggle_entry(const void* vx, const void* vy)
     else if (x->basename_hash < y->basename_hash)
         return -1;
     else
-        return x->extension_index - y->extension_index;
+        return x->suffix_index - y->suffix_index;
+}
+
+// Read the boretoggle suffixes from g:bore_toggle, a comma separated list of
+// file name endings. One without a '.' is an extension. A suffix that is too
+// long, has a path separator or ends in a '.' is left out with an error.
+static void bore_load_toggle_suffixes(bore_t* b)
+{
+    const char* list = (const char*)get_var_value((char_u *)"g:bore_toggle");
+    const char* p;
+
+    if (!list)
+        list = "cpp,cxx,c,cc,inl,inc,hpp,hxx,h,hh,pro,asm,s";
+
+    bore_prealloc(&b->toggle_suffix_alloc, sizeof(bore_toggle_suffix_t) * 16);
+    b->toggle_suffix_count = 0;
+    b->toggle_hash = bore_string_hash(list);
+    for (p = list; *p; )
+    {
+        const char* end = p;
+        const char* ext;
+        bore_toggle_suffix_t* suffix;
+        int len;
+
+        while (*end && *end != ',')
+            ++end;
+        while (p < end && VIM_ISWHITE(*p))
+            ++p;
+        len = (int)(end - p);
+        while (len > 0 && VIM_ISWHITE(p[len - 1]))
+            --len;
+        if (len > 0 && (len + 2 > BORE_MAX_TOGGLE_SUFFIX || p[len - 1] == '.'
+                    || memchr(p, '/', len) || memchr(p, '\\', len)))
+            semsg(_("boresln: Invalid suffix in g:bore_toggle: %.*s"), len, p);
+        else if (len > 0)
+        {
+            suffix = (bore_toggle_suffix_t*)bore_alloc(&b->toggle_suffix_alloc, sizeof(bore_toggle_suffix_t));
+            suffix->len = 0;
+            if (!memchr(p, '.', len))
+                suffix->str[suffix->len++] = '.';
+            memcpy(suffix->str + suffix->len, p, len);
+            suffix->len += len;
+            suffix->str[suffix->len] = NUL;
+            ext = vim_strrchr(suffix->str, '.') + 1;
+            suffix->ext_hash = bore_string_hash(ext);
+            b->toggle_suffix_count++;
+        }
+        p = *end ? end + 1 : end;
+    }
+}
+
+// The index of the longest toggle suffix the file name of path ends with, and
+// the length of the name before it. Returns -1 if there is none.
+static int bore_match_toggle_suffix(bore_t* b, const char* path, u32 ext_hash, int* stem_len)
+{
+    const bore_toggle_suffix_t* suffixes = (const bore_toggle_suffix_t*)b->toggle_suffix_alloc.base;
+    const char* basename = (const char*)vim_strrchr((char_u*)path, BORE_PATHSEP);
+    int basename_len;
+    int best = -1;
+    int i;
+
+    basename = basename ? basename + 1 : path;
+    basename_len = (int)strlen(basename);
+    for (i = 0; i < b->toggle_suffix_count; ++i)
+    {
+        if (suffixes[i].ext_hash != ext_hash || suffixes[i].len > basename_len)
+            continue;
+        if (best >= 0 && suffixes[i].len <= suffixes[best].len)
+            continue;
+        if (0 == STRICMP(basename + basename_len - suffixes[i].len, suffixes[i].str))
+            best = i;
+    }
+    if (best >= 0)
+        *stem_len = basename_len - suffixes[best].len;
+    return best;
+}
+
+// Fill in the toggle entry of a file, returns FALSE if boretoggle doesn't
+// toggle between files with its name
+static int bore_make_toggle_entry(bore_t* b, u32 file, u32 file_ext, bore_toggle_entry_t* e)
+{
+    char* path = bore_str(b, file);
+    char* basename = vim_strrchr(path, BORE_PATHSEP);
+    int stem_len;
+    int suffix_index = bore_match_toggle_suffix(b, path, file_ext, &stem_len);
+
+    if (-1 == suffix_index)
+        return FALSE;
+
+    basename = basename ? basename + 1 : path;
+
+    e->file = file;
+    e->suffix_index = suffix_index;
+    e->basename_hash = bore_string_hash_n(basename, stem_len);
+    e->next = 0;
+    return TRUE;
+}
+
+// Set the entry each entry toggles to: of the files with the same name and
+// the next suffix that has any, the one with the most similar path
+static void bore_link_toggle_entries(bore_t* b)
+{
+    bore_toggle_entry_t* entries = (bore_toggle_entry_t*)b->toggle_index_alloc.base;
+    int count = b->toggle_entry_count;
+    int first, last;
+    int i, j, k;
+    int run_end, next, next_end;
+
+    for (first = 0; first < count; first = last)
+    {
+        for (last = first + 1; last < count && entries[last].basename_hash == entries[first].basename_hash; ++last)
+            ;
+        for (i = first; i < last; i = run_end)
+        {
+            for (run_end = i + 1; run_end < last && entries[run_end].suffix_index == entries[i].suffix_index; ++run_end)
+                ;
+            next = run_end < last ? run_end : first;
+            for (next_end = next + 1; next_end < last && entries[next_end].suffix_index == entries[next].suffix_index; ++next_end)
+                ;
+            for (j = i; j < run_end; ++j)
+            {
+                const char* path = bore_str(b, entries[j].file);
+                int best = j;
+                int best_score = 0;
+
+                if (next != i)
+                {
+                    for (k = next; k < next_end; ++k)
+                    {
+                        int score = bore_str_match_score(path, bore_str(b, entries[k].file));
+                        if (best == j || score > best_score)
+                        {
+                            best_score = score;
+                            best = k;
+                        }
+                    }
+                }
+                entries[j].next = best;
+            }
+        }
+    }
 }
 
 static int bore_build_toggle_index(bore_t* b)
 {
     bore_file_t* files = (bore_file_t*)b->file_alloc.base;
     u32* file_ext = (u32*)b->file_ext_alloc.base;
+    bore_toggle_entry_t e;
     u32 i;
-    u32 seq[] =
-    {
-        bore_string_hash("cpp"),
-        bore_string_hash("cxx"),
-        bore_string_hash("c"),
-        bore_string_hash("cc"),
-        bore_string_hash("inl"),
-        bore_string_hash("inc"),
-        bore_string_hash("hpp"),
-        bore_string_hash("hxx"),
-        bore_string_hash("h"),
-        bore_string_hash("hh"),
-        bore_string_hash("pro"),
-        bore_string_hash("asm"),
-        bore_string_hash("s"),
-    };
+
     bore_prealloc(&b->toggle_index_alloc, b->file_count * sizeof(bore_toggle_entry_t));
     b->toggle_entry_count = 0;
     for (i = 0; i < (u32)b->file_count; ++i)
     {
-        int j;
-        int ext_index = -1;
-        for (j = 0; j < sizeof(seq)/sizeof(seq[0]); ++j)
-            if (seq[j] == file_ext[i])
-            {
-                ext_index = j;
-                break;
-            }
-
-        if (-1 == ext_index)
+        if (!bore_make_toggle_entry(b, files[i].file, file_ext[i], &e))
             continue;
 
-        char* path = bore_str(b, files[i].file);
-        u32 path_len = (u32)strlen(path);
-        char* ext = vim_strrchr(path, '.');
-        char* basename = vim_strrchr(path, '\\');
-
-        ext = ext ? ext + 1 : path + path_len;
-        basename = basename ? basename + 1 : path;
-
-        bore_toggle_entry_t* e = (bore_toggle_entry_t*)bore_alloc(&b->toggle_index_alloc, 
-            sizeof(bore_toggle_entry_t));
-        e->file = files[i].file;
-        e->extension_index = ext_index;
-        e->basename_hash = bore_string_hash_n(basename, (int)(ext - basename));
+        *(bore_toggle_entry_t*)bore_alloc(&b->toggle_index_alloc, sizeof(bore_toggle_entry_t)) = e;
         b->toggle_entry_count++;
     }
     qsort(b->toggle_index_alloc.base, b->toggle_entry_count, sizeof(bore_toggle_entry_t), 
             bore_sort_toggle_entry);
+    bore_link_toggle_entries(b);
 
     return OK;
 }
@@ -915,10 +1231,16 @@ static int bore_write_filelist_to_file(bore_t* b)
     FILE* f;
     char* tmp_file;
     int i;
-    tmp_file = vim_tempname('b', TRUE);
-    if (!tmp_file)
-        return FAIL;
-    f = fopen(tmp_file, "w");
+    // Written again to the same file when the files change
+    if (!b->sln_filelist)
+    {
+        tmp_file = vim_tempname('b', TRUE);
+        if (!tmp_file)
+            return FAIL;
+        b->sln_filelist = bore_strndup(b, tmp_file, strlen(tmp_file));
+        vim_free(tmp_file);
+    }
+    f = fopen(bore_str(b, b->sln_filelist), "w");
     if (!f)
         return FAIL;
     for (i = 0; i < b->file_count; ++i)
@@ -927,47 +1249,315 @@ static int bore_write_filelist_to_file(bore_t* b)
         fprintf(f, "%s\n", fn);
     }
     fclose(f);
-    b->sln_filelist = bore_strndup(b, tmp_file, strlen(tmp_file));
     return OK;
 }
 
-static void bore_load_ini(bore_ini_t* ini)
+#define BORE_CACHE_MAGIC 0x434c5342 // "BSLC"
+#define BORE_CACHE_VERSION 2
+
+// The solution cache is the parsed solution: the header, followed by the
+// stamps and data offsets of the dependencies, and the arenas in the order of
+// the sizes.
+typedef struct bore_cache_header_t
 {
-    SYSTEM_INFO sys_info;
-    GetSystemInfo(&sys_info);
-    ini->cpu_cores = (int)sys_info.dwNumberOfProcessors;
-    ini->borebuf_height = 30;
+    u32 magic;
+    u32 version;
+    u32 sln_path;
+    u32 sln_dir;
+    u32 sln_dir_len;
+    u32 sln_name;
+    int config_count;
+    int proj_count;
+    int file_count;
+    int toggle_entry_count;
+    int dep_count;
+    u32 data_size;
+    u32 config_size;
+    u32 proj_size;
+    u32 file_size;
+    u32 file_ext_size;
+    u32 toggle_index_size;
+    u32 toggle_hash;
+} bore_cache_header_t;
+
+static void bore_cache_filename(bore_t* b, char* buf, size_t size)
+{
+    char* dir = (char*)get_var_value((char_u *)"g:bore_cache_dir");
+    if (!dir || !*dir)
+        return;
+    vim_snprintf(buf, size, "%s%c%s-%08x.bcache", dir, BORE_PATHSEP,
+            bore_str(b, b->sln_name), bore_string_hash(bore_str(b, b->sln_path)));
+    b->cache_file = bore_strndup(b, buf, strlen(buf));
 }
 
-static int bore_extract_sln_from_path(bore_t* b, const char* path)
+// The trigram index is saved next to the solution cache, it is checked
+// against the files when it is loaded. Empty without g:bore_cache_dir.
+static void bore_index_filename(bore_t* b, char* buf, size_t size)
 {
-    char buf[BORE_MAX_PATH];
-    DWORD path_attr = 0;
-    if (FAIL == bore_canonicalize((char*)path, buf, &path_attr))
-        return FAIL;
+    char* dir = (char*)get_var_value((char_u *)"g:bore_cache_dir");
 
-    size_t path_len = strlen(buf);
-    b->sln_dir = bore_strndup(b, buf, path_len + 1); // trailing backslash
-    char* sln_dir_str = bore_str(b, b->sln_dir);
+    *buf = NUL;
+    if (dir && *dir)
+        vim_snprintf(buf, size, "%s%c%s-%08x.bidx", dir, BORE_PATHSEP,
+                bore_str(b, b->sln_name), bore_string_hash(bore_str(b, b->sln_path)));
+}
+
+static int bore_cache_write_alloc(FILE* f, bore_alloc_t* p, u32* size)
+{
+    *size = (u32)(p->cursor - p->base);
+    return *size == 0 || 1 == fwrite(p->base, *size, 1, f);
+}
+
+static void bore_cache_save(bore_t* b)
+{
+    char tmp[BORE_MAX_PATH];
+    bore_cache_header_t header;
+    bore_file_stamp_t stamp;
+    u32* deps;
+    int ok = 1;
+    int i;
+    FILE* f;
+
+    // Written to a temporary file first, so that a concurrent boresln never
+    // reads half a cache
+    vim_snprintf(tmp, sizeof(tmp), "%s.tmp", bore_str(b, b->cache_file));
+    f = mch_fopen(tmp, "wb");
+    if (!f)
+        return;
 
-    if (path_attr & FILE_ATTRIBUTE_DIRECTORY)
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, f);
+
+    deps = (u32*)b->dep_alloc.base;
+    for (i = 0; i < b->dep_count; ++i)
     {
-        b->sln_path = b->sln_dir;
+        bore_get_file_stamp(bore_str(b, deps[i]), &stamp);
+        ok = ok && 1 == fwrite(&stamp, sizeof(stamp), 1, f);
+    }
+    ok = ok && (b->dep_count == 0 || 1 == fwrite(deps, sizeof(u32) * b->dep_count, 1, f));
+
+    header.magic = BORE_CACHE_MAGIC;
+    header.version = BORE_CACHE_VERSION;
+    header.sln_path = b->sln_path;
+    header.sln_dir = b->sln_dir;
+    header.sln_dir_len = (u32)b->sln_dir_len;
+    header.sln_name = b->sln_name;
+    header.config_count = b->config_count;
+    header.proj_count = b->proj_count;
+    header.file_count = b->file_count;
+    header.toggle_entry_count = b->toggle_entry_count;
+    header.toggle_hash = b->toggle_hash;
+    header.dep_count = b->dep_count;
+    ok = ok && bore_cache_write_alloc(f, &b->data_alloc, &header.data_size);
+    ok = ok && bore_cache_write_alloc(f, &b->config_alloc, &header.config_size);
+    ok = ok && bore_cache_write_alloc(f, &b->proj_alloc, &header.proj_size);
+    ok = ok && bore_cache_write_alloc(f, &b->file_alloc, &header.file_size);
+    ok = ok && bore_cache_write_alloc(f, &b->file_ext_alloc, &header.file_ext_size);
+    ok = ok && bore_cache_write_alloc(f, &b->toggle_index_alloc, &header.toggle_index_size);
+
+    ok = ok && 0 == fseek(f, 0, SEEK_SET) && 1 == fwrite(&header, sizeof(header), 1, f);
+    ok = 0 == fclose(f) && ok;
+    if (!ok || 0 != mch_rename(tmp, bore_str(b, b->cache_file)))
+        mch_remove((char_u*)tmp);
+}
+
+static int bore_cache_read_alloc(FILE* f, bore_alloc_t* p, u32 size, u32 slack)
+{
+    bore_prealloc(p, size + slack);
+    p->cursor = p->base + size;
+    return size == 0 || 1 == fread(p->base, size, 1, f);
+}
+
+// Replace the parsed solution in b with the cache, if it is still valid.
+static int bore_cache_load(bore_t* b)
+{
+    bore_cache_header_t header;
+    bore_file_stamp_t* stamps = NULL;
+    bore_file_stamp_t stamp;
+    bore_t c;
+    bore_t parsed;
+    u32* deps;
+    int result = FAIL;
+    int i;
+    FILE* f;
+
+    memset(&c, 0, sizeof(c));
+    f = mch_fopen(bore_str(b, b->cache_file), "rb");
+    if (!f)
+        return FAIL;
+
+    if (1 != fread(&header, sizeof(header), 1, f)
+            || header.magic != BORE_CACHE_MAGIC
+            || header.version != BORE_CACHE_VERSION
+            || header.toggle_hash != b->toggle_hash
+            || header.dep_count <= 0)
+        goto done;
+
+    // The dependencies are paths in the data, which is read next
+    stamps = (bore_file_stamp_t*)alloc(sizeof(bore_file_stamp_t) * header.dep_count);
+    if (!stamps
+            || 1 != fread(stamps, sizeof(bore_file_stamp_t) * header.dep_count, 1, f)
+            || !bore_cache_read_alloc(f, &c.dep_alloc, sizeof(u32) * header.dep_count, 0)
+            || !bore_cache_read_alloc(f, &c.data_alloc, header.data_size, 64 * 1024))
+        goto done;
+
+    deps = (u32*)c.dep_alloc.base;
+    for (i = 0; i < header.dep_count; ++i)
+    {
+        if (deps[i] >= header.data_size)
+            goto done;
+        bore_get_file_stamp(bore_str(&c, deps[i]), &stamp);
+        if (stamp.mtime != stamps[i].mtime || stamp.size != stamps[i].size)
+            goto done;
+    }
+
+    if (!bore_cache_read_alloc(f, &c.config_alloc, header.config_size, 0)
+            || !bore_cache_read_alloc(f, &c.proj_alloc, header.proj_size, 0)
+            || !bore_cache_read_alloc(f, &c.file_alloc, header.file_size, 0)
+            || !bore_cache_read_alloc(f, &c.file_ext_alloc, header.file_ext_size, 0)
+            || !bore_cache_read_alloc(f, &c.toggle_index_alloc, header.toggle_index_size, 0))
+        goto done;
+
+    c.cache_file = bore_strndup(&c, bore_str(b, b->cache_file), strlen(bore_str(b, b->cache_file)));
+    c.sln_path = header.sln_path;
+    c.sln_dir = header.sln_dir;
+    c.sln_dir_len = header.sln_dir_len;
+    c.sln_name = header.sln_name;
+    c.config_count = header.config_count;
+    c.proj_count = header.proj_count;
+    c.file_count = header.file_count;
+    c.toggle_entry_count = header.toggle_entry_count;
+    c.dep_count = header.dep_count;
+    c.ini = b->ini;
+    c.toggle_suffix_count = b->toggle_suffix_count;
+    c.toggle_suffix_alloc = b->toggle_suffix_alloc;
+    c.toggle_hash = b->toggle_hash;
+
+    // Swap the arenas, the ones parsed so far are freed below
+    parsed = *b;
+    *b = c;
+    c = parsed;
+    result = OK;
+
+done:
+    fclose(f);
+    vim_free(stamps);
+    bore_alloc_free(&c.data_alloc);
+    bore_alloc_free(&c.config_alloc);
+    bore_alloc_free(&c.proj_alloc);
+    bore_alloc_free(&c.file_alloc);
+    bore_alloc_free(&c.file_ext_alloc);
+    bore_alloc_free(&c.toggle_index_alloc);
+    bore_alloc_free(&c.dep_alloc);
+    return result;
+}
+
+int bore_cpu_count(void)
+{
+#ifdef MSWIN
+    SYSTEM_INFO sys_info;
+    GetSystemInfo(&sys_info);
+    return (int)sys_info.dwNumberOfProcessors;
+#else
+    long cpu_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpu_cores > 0 ? (int)cpu_cores : 1;
+#endif
+}
+
+int bore_search_thread_count(void)
+{
+    const char_u* str = get_var_value((char_u *)"g:bore_search_thread_count");
+    int thread_count = str ? atoi((char*)str) : 8;
+
+    if (thread_count < 1)
+        return 1;
+    return thread_count < BORE_MAX_SEARCH_THREADS ? thread_count : BORE_MAX_SEARCH_THREADS;
+}
+
+long long bore_time_us(void)
+{
+#ifdef MSWIN
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return now.QuadPart / freq.QuadPart * 1000000 +
+        now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+bore_stats_t g_bore_stats;
+static bore_stats_phases_t* g_bore_stats_phases; // the command being timed
+
+// Time the steps of a bore command until bore_stats_end. Returns the command
+// that was timed before, it is timed again after this one.
+static bore_stats_phases_t* bore_stats_begin(bore_stats_phases_t* phases)
+{
+    bore_stats_phases_t* outer = g_bore_stats_phases;
+    phases->count = 0;
+    phases->us = bore_time_us();
+    ++phases->runs;
+    g_bore_stats_phases = phases;
+    return outer;
+}
+
+static void bore_stats_end(bore_stats_phases_t* outer)
+{
+    g_bore_stats_phases->us = bore_time_us() - g_bore_stats_phases->us;
+    g_bore_stats_phases = outer;
+}
+
+void bore_stats_phase(const char* name, long long us)
+{
+    bore_stats_phases_t* phases = g_bore_stats_phases;
+    if (phases && phases->count < BORE_MAX_STATS_PHASES)
+    {
+        phases->phase[phases->count].name = name;
+        phases->phase[phases->count].us = us;
+        ++phases->count;
+    }
+}
+
+static void bore_load_ini(bore_ini_t* ini)
+{
+    ini->cpu_cores = bore_cpu_count();
+    ini->borebuf_height = 30;
+}
+
+static int bore_extract_sln_from_path(bore_t* b, const char* path)
+{
+    char buf[BORE_MAX_PATH];
+    u32 path_attr = 0;
+    if (FAIL == bore_canonicalize((char*)path, buf, &path_attr))
+        return FAIL;
+
+    size_t path_len = strlen(buf);
+    b->sln_dir = bore_strndup(b, buf, path_len + 1); // trailing backslash
+    char* sln_dir_str = bore_str(b, b->sln_dir);
+
+    if (path_attr & BORE_ATTR_DIRECTORY)
+    {
+        b->sln_path = b->sln_dir;
 
         char* pc = vim_strrchr(sln_dir_str, '.');
         // Special case. If the solution path is .git folder, then assume
         // code paths start one level up from that
-        if (pc && 0 == STRNCMP(pc, ".git", 4) && (pc[4] == '\\' || pc[4] == 0))
+        if (pc && 0 == STRNCMP(pc, ".git", 4) && (pc[4] == BORE_PATHSEP || pc[4] == 0))
             *(pc - 1) = 0; // Remove trailing backslash
         else
         {
             pc = sln_dir_str + path_len - 1;
-            if (*pc == '\\')
+            if (*pc == BORE_PATHSEP)
                 *pc = 0; // Remove trailing backslash
         }
 
         // set solution name to deepest directory name
-        pc = vim_strrchr(sln_dir_str, '\\');
+        pc = vim_strrchr(sln_dir_str, BORE_PATHSEP);
         if (pc)
             ++pc;
         else
@@ -976,14 +1566,14 @@ static int bore_extract_sln_from_path(bore_t* b, const char* path)
 
         // Add trailing backslash
         pc = sln_dir_str + strlen(sln_dir_str);
-        *pc++ = '\\';
+        *pc++ = BORE_PATHSEP;
         *pc = 0;
     }
     else
     {
         b->sln_path = bore_strndup(b, buf, path_len);
 
-        char* pc = vim_strrchr(sln_dir_str, '\\');
+        char* pc = vim_strrchr(sln_dir_str, BORE_PATHSEP);
 
         // set solution name to file name part of path
         if (pc)
@@ -1083,13 +1673,16 @@ static void bore_set_sln_config(bore_t* b, int sln_config)
 
 static void bore_init_sln_config(bore_t* b)
 {
+    // bore_match_sln_config splits the string in place
+    char release_x64[] = "Release|x64";
+    char win32[] = "Win32";
     int sln_config = -1;
     if (b->config_count > 0)
     {
-        sln_config = bore_match_sln_config(b, "Release|x64");
+        sln_config = bore_match_sln_config(b, release_x64);
         if (sln_config < 0)
         {
-            sln_config = bore_match_sln_config(b, "Win32");
+            sln_config = bore_match_sln_config(b, win32);
             if (sln_config < 0)
             {
                 sln_config = 0; // no match, pick the first one
@@ -1101,37 +1694,40 @@ static void bore_init_sln_config(bore_t* b)
 
 struct bore_async_execute_context_t
 {
-    HANDLE wait_thread;
-    PROCESS_INFORMATION spawned_process;
-    HANDLE result_handle;
-    DWORD completed;
-    DWORD duration;
-    DWORD exit_code;
+    int qf_id;          // quickfix list that the output is parsed into
+    int ended;          // 1 when the job exited, 2 when its output closed
+    int shown;          // the quickfix window was opened for an error
+    garray_T partial;   // output after the last newline
+    time_t start;
+    int completed;
+    int duration;
+    int exit_code;
     char title[256];
 };
 
 static struct bore_async_execute_context_t g_bore_async_execute_context;
 
-static void bore_load_sln(const char* path)
-{
-    g_bore_async_execute_context.wait_thread = INVALID_HANDLE_VALUE;
-    g_bore_async_execute_context.result_handle = INVALID_HANDLE_VALUE;
+static void bore_watch_begin(bore_t* b);
+static void bore_picker_refresh(bore_t* b);
 
+// A reload keeps the current directory, it is done when a watched solution
+// changed
+static void bore_load_sln(const char* path, int forceit, int reload)
+{
     char buf[BORE_MAX_PATH];
-    int i;
     char* c;
+    bore_proj_t* projects;
+    int i;
+    bore_stats_phases_t* outer_stats = bore_stats_begin(&g_bore_stats.sln);
     bore_t* b = (bore_t*)alloc(sizeof(bore_t));
     memset(b, 0, sizeof(bore_t));
+    g_bore_stats.sln_cached = FALSE;
 
     bore_prealloc(&b->data_alloc, 8*1024*1024);
     bore_prealloc(&b->file_alloc, sizeof(bore_file_t)*64*1024);
     bore_prealloc(&b->proj_alloc, sizeof(bore_proj_t)*256);
     bore_prealloc(&b->config_alloc, sizeof(bore_proj_t)*8);
-
-    for (i = 0; i < BORE_SEARCH_JOBS; ++i)
-    {
-        bore_prealloc(&b->search[i].filedata, 1*1024*1024);
-    }
+    bore_prealloc(&b->dep_alloc, sizeof(u32)*256);
 
     // Allocate something small, so that we can use offset 0 as NULL
     c = (char*)bore_alloc(&b->data_alloc, sizeof(char));
@@ -1140,20 +1736,42 @@ static void bore_load_sln(const char* path)
     if (FAIL == bore_extract_sln_from_path(b, path))
         goto fail;
 
-    sprintf(buf, "cd %s", bore_str(b, b->sln_dir));
-    ++msg_silent;
-    do_cmdline_cmd(buf);
-    --msg_silent;
+    if (!reload)
+    {
+        sprintf(buf, "cd %s", bore_str(b, b->sln_dir));
+        ++msg_silent;
+        do_cmdline_cmd(buf);
+        --msg_silent;
+    }
 
+#ifdef FEAT_CLIENTSERVER
     if (!g_bore || STRICMP(bore_str(g_bore, g_bore->sln_name), bore_str(b, b->sln_name)))
     {
         serverSetName(bore_str(b, b->sln_name));
     }
+#endif
 
     bore_load_ini(&b->ini);
+    bore_load_toggle_suffixes(b);
 
     BORE_VIMPROFILE_INIT;
 
+    bore_cache_filename(b, buf, sizeof(buf));
+    if (b->cache_file && !forceit)
+    {
+        int cached;
+
+        BORE_VIMPROFILE_START;
+        cached = bore_cache_load(b);
+        BORE_VIMPROFILE_STOP("bore_cache_load");
+        if (OK == cached)
+        {
+            g_bore_stats.sln_cached = TRUE;
+            bore_init_sln_config(b);
+            goto loaded;
+        }
+    }
+
     if (bore_is_sln_directory(b))
     {
         BORE_VIMPROFILE_START;
@@ -1172,6 +1790,16 @@ static void bore_load_sln(const char* path)
         if (FAIL == bore_extract_files_from_projects(b))
             goto fail;
         BORE_VIMPROFILE_STOP("bore_extract_files_from_projects");
+
+        // A change of the solution or a project invalidates the solution
+        // cache and reloads a watched solution
+        projects = (bore_proj_t*)b->proj_alloc.base;
+        bore_add_dep(b, b->sln_path);
+        for (i = 0; i < b->proj_count; ++i)
+        {
+            if (projects[i].project_file_path)
+                bore_add_dep(b, projects[i].project_file_path);
+        }
     }
 
     BORE_VIMPROFILE_START;
@@ -1193,6 +1821,14 @@ static void bore_load_sln(const char* path)
         goto fail;
     BORE_VIMPROFILE_STOP("bore_build_toggle_index");
 
+    if (b->cache_file)
+    {
+        BORE_VIMPROFILE_START;
+        bore_cache_save(b);
+        BORE_VIMPROFILE_STOP("bore_cache_save");
+    }
+
+loaded:
     BORE_VIMPROFILE_START;
     if (FAIL == bore_write_filelist_to_file(b))
         goto fail;
@@ -1204,25 +1840,631 @@ static void bore_load_sln(const char* path)
     sprintf(buf, "let g:bore_filelist_file=\'%s\'", bore_str(b, b->sln_filelist));
     do_cmdline_cmd(buf);
 
+    if (b->cache_file)
+    {
+        vim_snprintf(buf, sizeof(buf), "let g:bore_cache_file=\'%s\'", bore_str(b, b->cache_file));
+        do_cmdline_cmd(buf);
+    }
+
     bore_set_proj(b, -1);
 
     bore_free(g_bore);
     g_bore = b;
+    ++g_bore_file_generation;
+
+    bore_watch_begin(b);
+    bore_picker_refresh(b);
+
+    // Build the trigram index for borefind in the background
+    c = (char*)get_var_value((char_u *)"g:bore_index");
+    if (c && atoi(c))
+    {
+        char idx[BORE_MAX_PATH];
+
+        bore_index_filename(b, idx, sizeof(idx));
+        bore_index_start(b, idx);
+        if (*idx)
+        {
+            vim_snprintf(buf, sizeof(buf), "let g:bore_index_file=\'%s\'", idx);
+            do_cmdline_cmd(buf);
+        }
+    }
+    bore_stats_end(outer_stats);
+    return;
+
+fail:
+    bore_free(b);
+    bore_stats_end(outer_stats);
+    semsg(_("Could not open solution %s"), path);
     return;
+}
+
+static void bore_watch_failed(bore_t* b)
+{
+    bore_watch_free(b->watch);
+    b->watch = NULL;
+    emsg(_("boresln: Could not watch the solution for changes"));
+}
+
+// Start watching a loaded solution when g:bore_watch is set. The directories
+// of a walked directory solution are watched when it is walked.
+static void bore_watch_begin(bore_t* b)
+{
+    char index[BORE_MAX_PATH];
+    char prefix[BORE_MAX_PATH];
+    char exclude[BORE_MAX_PATH];
+    u32* deps = (u32*)b->dep_alloc.base;
+    int ok;
+    int i;
+
+    if (b->watch || !bore_watch_enabled())
+        return;
+
+    if (bore_is_sln_directory(b))
+    {
+        if (!bore_dir_uses_git_index(bore_str(b, b->sln_dir), index, prefix, exclude))
+            return;
+        b->git_index = bore_strndup(b, index, strlen(index));
+        b->git_prefix = bore_strndup(b, prefix, strlen(prefix));
+
+        // Git writes a new index and renames it, so the directory is watched
+        vim_strrchr(index, BORE_PATHSEP)[1] = NUL;
+        b->watch = bore_watch_start(index, TRUE);
+        b->watch_mode = BW_GIT_INDEX;
+        ok = b->watch && OK == bore_watch_add(b->watch, "", FALSE);
+    }
+    else
+    {
+        b->watch = bore_watch_start("", TRUE);
+        b->watch_mode = BW_SLN;
+        ok = b->watch != NULL;
+        for (i = 0; ok && i < b->dep_count; ++i)
+        {
+            char dir[BORE_MAX_PATH];
+            char* sep;
+
+            vim_strncpy((char_u*)dir, (char_u*)bore_str(b, deps[i]), BORE_MAX_PATH - 2);
+            if (mch_isdir((char_u*)dir))
+                sep = dir + strlen(dir);
+            else if (NULL == (sep = vim_strrchr(dir, BORE_PATHSEP)))
+                continue;
+            sep[0] = BORE_PATHSEP;
+            sep[1] = NUL;
+            ok = OK == bore_watch_add(b->watch, dir, FALSE);
+        }
+    }
+
+    if (!ok)
+        bore_watch_failed(b);
+}
+
+// Load a watched solution again, after a change that can't be applied to the
+// files or when changes were lost
+static void bore_reload(bore_t* b)
+{
+    char path[BORE_MAX_PATH];
+
+    vim_strncpy((char_u*)path, (char_u*)bore_str(b, b->sln_path), BORE_MAX_PATH - 1);
+    bore_load_sln(path, FALSE, TRUE);
+
+    // It can't be loaded any more, keep the files as they were
+    if (g_bore == b)
+    {
+        bore_watch_free(b->watch);
+        b->watch = NULL;
+    }
+}
+
+static int bore_compare_u32(const void* vx, const void* vy)
+{
+    const u32 x = *(const u32*)vx;
+    const u32 y = *(const u32*)vy;
+    return x < y ? -1 : x > y;
+}
+
+static int bore_compare_strings(const void* vx, const void* vy)
+{
+    return strcmp(*(const char**)vx, *(const char**)vy);
+}
+
+// The project of a file added to a directory solution, path is relative to
+// it. A new first level directory is a new project.
+static int bore_dir_proj_index(bore_t* b, const char* path)
+{
+    char root[BORE_MAX_PATH];
+    bore_proj_t* projects = (bore_proj_t*)b->proj_alloc.base;
+    const char* sep = strchr(path, BORE_PATHSEP);
+    size_t len;
+    int i;
+
+    if (!sep)
+        return 0;
+    len = sep - path;
+    for (i = 1; i < b->proj_count; ++i)
+    {
+        const char* name = bore_str(b, projects[i].project_sln_name);
+        if (0 == STRNICMP(name, path, len) && name[len] == NUL)
+            return i;
+    }
+    vim_strncpy((char_u*)root, (char_u*)bore_str(b, b->sln_dir), b->sln_dir_len);
+    bore_add_dir_proj(b, root, b->sln_dir_len, path, len);
+    return b->proj_count - 1;
+}
+
+// Build the trigram index of the changed files again
+static void bore_index_restart(bore_t* b)
+{
+    char buf[BORE_MAX_PATH];
+
+    bore_index_filename(b, buf, sizeof(buf));
+    bore_index_start(b, buf);
+}
+
+// Remove the files that are set in remove, and add the paths (relative to the
+// solution directory) that aren't there yet. The files stay sorted, and the
+// extension list, the toggle index and the trigram index follow them.
+static void bore_update_files(bore_t* b, char* remove, const char** add, int add_count)
+{
+    char path[BORE_MAX_PATH];
+    bore_file_t* files = (bore_file_t*)b->file_alloc.base;
+    u32* file_ext = (u32*)b->file_ext_alloc.base;
+    bore_toggle_entry_t* entries = (bore_toggle_entry_t*)b->toggle_index_alloc.base;
+    bore_alloc_t added_alloc;
+    bore_alloc_t file_alloc;
+    bore_alloc_t file_ext_alloc;
+    bore_alloc_t toggle_alloc;
+    bore_alloc_t removed_alloc;
+    bore_alloc_t old_index_alloc;
+    bore_file_t* added;
+    bore_file_t* new_files;
+    u32* new_file_ext;
+    u32* removed;
+    u32* old_file_index;
+    bore_toggle_entry_t* added_entries;
+    bore_toggle_entry_t* new_entries;
+    int added_count = 0;
+    int added_entry_count = 0;
+    int removed_count = 0;
+    int count;
+    int restart_index;
+    int i, j, k, n;
+
+    // The workers of an index that isn't complete read the files and the
+    // strings that change here
+    restart_index = bore_index_stop(b);
+
+    vim_strncpy((char_u*)path, (char_u*)bore_str(b, b->sln_dir), b->sln_dir_len);
+    bore_prealloc(&added_alloc, sizeof(bore_file_t) * (add_count + 1));
+    for (i = 0; i < add_count; ++i)
+    {
+        size_t len = strlen(add[i]);
+        bore_file_t* file;
+
+        if (b->sln_dir_len + len + 1 > BORE_MAX_PATH)
+            continue;
+        memcpy(path + b->sln_dir_len, add[i], len + 1);
+        file = bore_find_path(b, path);
+        if (file)
+        {
+            // Still there, or removed and added again
+            remove[file - files] = 0;
+            continue;
+        }
+        file = (bore_file_t*)bore_alloc(&added_alloc, sizeof(bore_file_t));
+        file->proj_index = bore_dir_proj_index(b, add[i]);
+        file->file = bore_strndup(b, path, b->sln_dir_len + len);
+        ++added_count;
+    }
+
+    added = (bore_file_t*)added_alloc.base;
+    bore_qsort_s(added, added_count, sizeof(bore_file_t), bore_sort_files, b);
+    for (i = 1, n = added_count > 0; i < added_count; ++i)
+    {
+        if (0 != STRICMP(bore_str(b, added[i].file), bore_str(b, added[n - 1].file)))
+            added[n++] = added[i];
+    }
+    added_count = n;
+
+    for (i = 0; i < b->file_count; ++i)
+        removed_count += remove[i];
+
+    if (added_count == 0 && removed_count == 0)
+    {
+        bore_alloc_free(&added_alloc);
+        if (restart_index)
+            bore_index_restart(b);
+        return;
+    }
+
+    count = b->file_count - removed_count + added_count;
+    bore_prealloc(&file_alloc, sizeof(bore_file_t) * (count + 1024));
+    bore_prealloc(&file_ext_alloc, sizeof(u32) * (count + 1024));
+    bore_prealloc(&removed_alloc, sizeof(u32) * (removed_count + 1));
+    bore_prealloc(&old_index_alloc, sizeof(u32) * (count + 1));
+    new_files = (bore_file_t*)bore_alloc(&file_alloc, sizeof(bore_file_t) * count);
+    new_file_ext = (u32*)bore_alloc(&file_ext_alloc, sizeof(u32) * count);
+    removed = (u32*)bore_alloc(&removed_alloc, sizeof(u32) * removed_count);
+    old_file_index = (u32*)bore_alloc(&old_index_alloc, sizeof(u32) * count);
+
+    // Merge the files that stay with the new ones
+    for (i = 0, j = 0, k = 0, n = 0; i < b->file_count || j < added_count; )
+    {
+        if (i < b->file_count && remove[i])
+            removed[n++] = files[i++].file;
+        else if (j == added_count || (i < b->file_count && bore_sort_files(b, &files[i], &added[j]) < 0))
+        {
+            new_files[k] = files[i];
+            new_file_ext[k] = file_ext[i];
+            old_file_index[k++] = i++;
+        }
+        else
+        {
+            new_files[k] = added[j];
+            new_file_ext[k] = bore_file_ext_hash(bore_str(b, added[j].file));
+            old_file_index[k++] = ~0u;
+            ++j;
+        }
+    }
+
+    // The toggle entries of the removed files go, the ones of the new files
+    // are merged in
+    qsort(removed, removed_count, sizeof(u32), bore_compare_u32);
+    bore_prealloc(&toggle_alloc, sizeof(bore_toggle_entry_t) * (b->toggle_entry_count + added_count + 1024));
+    added_entries = (bore_toggle_entry_t*)bore_alloc(&toggle_alloc, sizeof(bore_toggle_entry_t) * added_count);
+    for (j = 0; j < added_count; ++j)
+    {
+        u32 ext = bore_file_ext_hash(bore_str(b, added[j].file));
+        if (bore_make_toggle_entry(b, added[j].file, ext, &added_entries[added_entry_count]))
+            ++added_entry_count;
+    }
+    qsort(added_entries, added_entry_count, sizeof(bore_toggle_entry_t), bore_sort_toggle_entry);
+    // The added entries are at the start of the arena, the merged ones follow
+    // and are moved down at the end
+    new_entries = (bore_toggle_entry_t*)bore_alloc(&toggle_alloc,
+            sizeof(bore_toggle_entry_t) * (b->toggle_entry_count + added_entry_count));
+    added_entries = (bore_toggle_entry_t*)toggle_alloc.base;
+    for (i = 0, j = 0, k = 0; i < b->toggle_entry_count || j < added_entry_count; )
+    {
+        if (i < b->toggle_entry_count &&
+                bsearch(&entries[i].file, removed, removed_count, sizeof(u32), bore_compare_u32))
+            ++i;
+        else if (j == added_entry_count ||
+                (i < b->toggle_entry_count && bore_sort_toggle_entry(&entries[i], &added_entries[j]) <= 0))
+            new_entries[k++] = entries[i++];
+        else
+            new_entries[k++] = added_entries[j++];
+    }
+    memmove(toggle_alloc.base, new_entries, sizeof(bore_toggle_entry_t) * k);
+    toggle_alloc.cursor = toggle_alloc.base + sizeof(bore_toggle_entry_t) * k;
+
+    bore_alloc_free(&b->file_alloc);
+    bore_alloc_free(&b->file_ext_alloc);
+    bore_alloc_free(&b->toggle_index_alloc);
+    b->file_alloc = file_alloc;
+    b->file_ext_alloc = file_ext_alloc;
+    b->toggle_index_alloc = toggle_alloc;
+    b->file_count = count;
+    b->toggle_entry_count = k;
+    bore_link_toggle_entries(b);
+    bore_file_hash_clear(b);
+
+    if (restart_index)
+        bore_index_restart(b);
+    else
+        bore_index_remap(b, old_file_index);
+    bore_write_filelist_to_file(b);
+    bore_picker_refresh(b);
+
+    bore_alloc_free(&added_alloc);
+    bore_alloc_free(&removed_alloc);
+    bore_alloc_free(&old_index_alloc);
+}
+
+// The git index was written, the difference to the files listed from it
+// before is applied
+static int bore_update_from_git_index(bore_t* b)
+{
+    bore_dir_list_t list;
+    bore_file_t* files = (bore_file_t*)b->file_alloc.base;
+    bore_file_t* listed;
+    bore_alloc_t add_alloc;
+    u32* table;
+    char* remove;
+    u32 size = 1;
+    u32 mask;
+    u32 h;
+    int add_count = 0;
+    int i;
+
+    if (FAIL == bore_read_git_index(bore_str(b, b->git_index), bore_str(b, b->git_prefix), &list))
+        return FAIL;
+
+    // The files by their path relative to the solution, in an open
+    // addressing hash table
+    while (size < 2 * (u32)b->file_count)
+        size <<= 1;
+    mask = size - 1;
+    table = (u32*)alloc(sizeof(u32) * size);
+    remove = (char*)alloc(b->file_count + 1);
+    if (!table || !remove)
+    {
+        vim_free(table);
+        vim_free(remove);
+        bore_dir_list_free(&list);
+        return FAIL;
+    }
+    memset(table, 0xff, sizeof(u32) * size);
+    memset(remove, 1, b->file_count);
+    for (i = 0; i < b->file_count; ++i)
+    {
+        for (h = bore_string_hash(bore_rel_path(b, files[i].file)) & mask; table[h] != ~0u; h = (h + 1) & mask)
+            ;
+        table[h] = i;
+    }
+
+    bore_prealloc(&add_alloc, sizeof(char*) * 256);
+    listed = (bore_file_t*)list.file_alloc.base;
+    for (i = 0; i < list.file_count; ++i)
+    {
+        const char* path = (const char*)list.data_alloc.base + listed[i].file;
+        for (h = bore_string_hash(path) & mask; table[h] != ~0u; h = (h + 1) & mask)
+        {
+            if (0 == STRICMP(path, bore_rel_path(b, files[table[h]].file)))
+                break;
+        }
+        if (table[h] != ~0u)
+            remove[table[h]] = 0;
+        else
+        {
+            *(const char**)bore_alloc(&add_alloc, sizeof(char*)) = path;
+            ++add_count;
+        }
+    }
+
+    bore_update_files(b, remove, (const char**)add_alloc.base, add_count);
+
+    bore_alloc_free(&add_alloc);
+    vim_free(table);
+    vim_free(remove);
+    bore_dir_list_free(&list);
+    return OK;
+}
+
+// Set the files below dir (ending with a separator) in remove, they are next
+// to each other in the sorted files
+static void bore_remove_dir_files(bore_t* b, const char* dir, char* remove)
+{
+    bore_file_t* files = (bore_file_t*)b->file_alloc.base;
+    size_t len = strlen(dir);
+    int lo = 0;
+    int hi = b->file_count;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (0 != STRNICMP(bore_str(b, files[mid].file), dir, len) &&
+                bore_find_filename(b, dir, &files[mid]) > 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < b->file_count && 0 == STRNICMP(bore_str(b, files[lo].file), dir, len); ++lo)
+        remove[lo] = 1;
+}
+
+// Files and directories of a walked directory solution were added or
+// removed. Whatever is at the paths now is listed and added, and what is gone
+// is removed.
+static int bore_update_from_dir(bore_t* b, const char* data, const bore_watch_event_t* events, int count)
+{
+    char path[BORE_MAX_PATH];
+    bore_dir_list_t list;
+    bore_file_t* files = (bore_file_t*)b->file_alloc.base;
+    bore_file_t* listed;
+    const char** paths = (const char**)alloc(sizeof(char*) * count);
+    const char** add = NULL;
+    char* missing = (char*)alloc(count);
+    char* remove = (char*)alloc_clear(b->file_count + 1);
+    int result = FAIL;
+    int i, n;
+
+    if (!paths || !missing || !remove)
+        goto done;
+
+    for (i = 0; i < count; ++i)
+        paths[i] = data + events[i].path;
+    qsort(paths, count, sizeof(char*), bore_compare_strings);
+    for (i = 0, n = 0; i < count; ++i)
+    {
+        const char* name = (const char*)vim_strrchr((char_u*)paths[i], BORE_PATHSEP);
+        name = name ? name + 1 : paths[i];
+        // Other files may be ignored now, it is walked again
+        if (0 == STRCMP(name, ".gitignore"))
+            goto done;
+        if (n == 0 || 0 != STRCMP(paths[i], paths[n - 1]))
+            paths[n++] = paths[i];
+    }
+
+    if (FAIL == bore_walk_paths(bore_str(b, b->sln_dir), paths, n, bore_io_thread_count(b),
+                b->exclude_file ? bore_str(b, b->exclude_file) : NULL, &list, missing))
+        goto done;
+
+#ifndef MSWIN
+    // The new directories are watched too
+    {
+        u32* dirs = (u32*)list.subdir_alloc.base;
+        for (i = 0; i < list.subdir_count; ++i)
+        {
+            if (FAIL == bore_watch_add(b->watch, (char*)list.data_alloc.base + dirs[i], FALSE))
+            {
+                bore_dir_list_free(&list);
+                goto done;
+            }
+        }
+    }
+#endif
+
+    // A path that is gone was a file or a directory
+    vim_strncpy((char_u*)path, (char_u*)bore_str(b, b->sln_dir), b->sln_dir_len);
+    for (i = 0; i < n; ++i)
+    {
+        size_t len = strlen(paths[i]);
+        bore_file_t* file;
+
+        if (!missing[i] || b->sln_dir_len + len + 2 > BORE_MAX_PATH)
+            continue;
+        memcpy(path + b->sln_dir_len, paths[i], len + 1);
+        file = (bore_file_t*)bore_bsearch_s(path, files, b->file_count, sizeof(bore_file_t),
+                bore_find_filename, b);
+        if (file)
+            remove[file - files] = 1;
+        else
+        {
+            path[b->sln_dir_len + len] = BORE_PATHSEP;
+            path[b->sln_dir_len + len + 1] = NUL;
+            bore_remove_dir_files(b, path, remove);
+        }
+    }
+
+    add = (const char**)alloc(sizeof(char*) * (list.file_count + 1));
+    if (add)
+    {
+        listed = (bore_file_t*)list.file_alloc.base;
+        for (i = 0; i < list.file_count; ++i)
+            add[i] = (const char*)list.data_alloc.base + listed[i].file;
+        bore_update_files(b, remove, add, list.file_count);
+        result = OK;
+    }
+    bore_dir_list_free(&list);
+
+done:
+    vim_free(paths);
+    vim_free(missing);
+    vim_free(remove);
+    vim_free(add);
+    return result;
+}
+
+// A solution is loaded again when the solution or a project changed, or when
+// a file in a directory with wildcard includes was added or removed
+static int bore_sln_changed(bore_t* b, const char* data, const bore_watch_event_t* events, int count)
+{
+    u32* deps = (u32*)b->dep_alloc.base;
+    int i, k;
+
+    for (i = 0; i < count; ++i)
+    {
+        const char* path = data + events[i].path;
+        const char* name = (const char*)vim_strrchr((char_u*)path, BORE_PATHSEP);
+        size_t dir_len = name ? name - path : 0;
+
+        for (k = 0; k < b->dep_count; ++k)
+        {
+            const char* dep = bore_str(b, deps[k]);
+            if (0 == STRICMP(path, dep))
+                return TRUE;
+            if (0 == STRNICMP(path, dep, dir_len) && dep[dir_len] == NUL &&
+                    !(events[i].flags & BORE_WATCH_CHANGED))
+            {
+                // Files that are replaced when they are written are still
+                // there, and temporary files are gone again
+                bore_file_t* file = bore_find_path(b, path);
+                if ((file != NULL) != (mch_getperm((char_u*)path) >= 0))
+                    return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+// A file of the solution was written, borefind searches it even where the
+// trigram index says it can't contain the string
+static void bore_file_changed(bore_t* b, const char* path)
+{
+    bore_file_t* file;
+
+    if (!b->index)
+        return;
+    file = bore_find_path(b, path);
+    if (file)
+        bore_index_changed(b, (int)(file - (bore_file_t*)b->file_alloc.base));
+}
+
+// The files of a walked directory that were written, the other events are
+// moved to the front. Returns their number.
+static int bore_dir_files_changed(bore_t* b, const char* data, bore_watch_event_t* events, int count)
+{
+    char path[BORE_MAX_PATH];
+    int i, n;
+
+    vim_strncpy((char_u*)path, (char_u*)bore_str(b, b->sln_dir), b->sln_dir_len);
+    for (i = 0, n = 0; i < count; ++i)
+    {
+        if (events[i].flags != BORE_WATCH_CHANGED)
+            events[n++] = events[i];
+        else if (b->sln_dir_len + strlen(data + events[i].path) < BORE_MAX_PATH)
+        {
+            STRCPY(path + b->sln_dir_len, data + events[i].path);
+            bore_file_changed(b, path);
+        }
+    }
+    return n;
+}
+
+// Apply the changes since the last command before the files are used
+static void bore_watch_update(void)
+{
+    bore_t* b = g_bore;
+    bore_alloc_t data_alloc;
+    bore_alloc_t event_alloc;
+    bore_watch_event_t* events;
+    const char* data;
+    int reload = FALSE;
+    int count;
+    int i;
+
+    // Applied by the next command after the search
+    if (!b || !b->watch || g_bore_searching)
+        return;
+
+    bore_prealloc(&data_alloc, 64 * 1024);
+    bore_prealloc(&event_alloc, sizeof(bore_watch_event_t) * 256);
+    count = bore_watch_read(b->watch, &data_alloc, &event_alloc);
+    events = (bore_watch_event_t*)event_alloc.base;
+    data = (const char*)data_alloc.base;
+    if (count < 0)
+        reload = TRUE;
+    else if (count == 0)
+        ;
+    else if (b->watch_mode == BW_SLN)
+        reload = bore_sln_changed(b, data, events, count);
+    else if (b->watch_mode == BW_GIT_INDEX)
+    {
+        for (i = 0; i < count; ++i)
+        {
+            if (0 == STRCMP(data + events[i].path, "index"))
+            {
+                reload = FAIL == bore_update_from_git_index(b);
+                break;
+            }
+        }
+    }
+    else if (0 < (count = bore_dir_files_changed(b, data, events, count)))
+        reload = FAIL == bore_update_from_dir(b, data, events, count);
+    bore_alloc_free(&data_alloc);
+    bore_alloc_free(&event_alloc);
 
-fail:
-    bore_free(b);
-    semsg(_("Could not open solution %s"), path);
-    return;
+    if (reload)
+        bore_reload(b);
 }
 
-static void bore_print_sln(DWORD elapsed)
+static void bore_print_sln(long elapsed)
 {
     if (g_bore)
     {
         if (elapsed)
         {
-            vim_snprintf(IObuff, IOSIZE, "%s; %d projects; %d files; %u ms",
+            vim_snprintf(IObuff, IOSIZE, "%s; %d projects; %d files; %ld ms",
                 bore_str(g_bore, g_bore->sln_path),
                 g_bore->proj_count,
                 g_bore->file_count, elapsed);
@@ -1238,7 +2480,8 @@ static void bore_print_sln(DWORD elapsed)
     }
 }
 
-static int bore_canonicalize(const char* src, char* dst, DWORD* attr)
+#ifdef MSWIN
+static int bore_canonicalize(const char* src, char* dst, u32* attr)
 {
     WCHAR wbuf[BORE_MAX_PATH];
     WCHAR wbuf2[BORE_MAX_PATH];
@@ -1260,6 +2503,67 @@ static int bore_canonicalize(const char* src, char* dst, DWORD* attr)
         return FAIL;
     return OK;
 }
+#else
+// Make src absolute and remove "." and ".." components without resolving
+// symlinks, the same way GetFullPathName does.
+static int bore_canonicalize(const char* src, char* dst, u32* attr)
+{
+    char buf[BORE_MAX_PATH];
+    char* r;
+    char* w;
+    size_t len = 0;
+
+    if (!mch_isFullName((char_u*)src))
+    {
+        if (FAIL == mch_dirname((char_u*)buf, BORE_MAX_PATH))
+            return FAIL;
+        len = strlen(buf);
+        if (len + 1 < BORE_MAX_PATH)
+            buf[len++] = '/';
+    }
+    if (len + strlen(src) >= BORE_MAX_PATH)
+        return FAIL;
+    strcpy(buf + len, src);
+
+    r = buf;
+    w = dst;
+    while (*r)
+    {
+        if (*r == '/')
+        {
+            ++r;
+            continue;
+        }
+        if (r[0] == '.' && (r[1] == '/' || r[1] == NUL))
+        {
+            ++r;
+            continue;
+        }
+        if (r[0] == '.' && r[1] == '.' && (r[2] == '/' || r[2] == NUL))
+        {
+            r += 2;
+            while (w > dst && *--w != '/')
+                ;
+            continue;
+        }
+        *w++ = '/';
+        while (*r && *r != '/')
+            *w++ = *r++;
+    }
+    if (w == dst)
+        *w++ = '/';
+    *w = NUL;
+
+    if (attr)
+    {
+        stat_T st;
+        if (0 != mch_stat(dst, &st))
+            return FAIL;
+        *attr = S_ISDIR(st.st_mode) ? BORE_ATTR_DIRECTORY : 0;
+    }
+    return OK;
+}
+#endif
 
 static u32 bore_string_hash(const char *str)
 {
@@ -1278,60 +2582,114 @@ static u32 bore_string_hash_n(const char *str, int n)
     return h + (h >> 5);
 }
 
-static void bore_display_search_result(bore_t* b, const char* arg, const char* filename, int found)
+static const char* bore_truncated_str(int truncated)
 {
-    exarg_T eap;
-    char* title = (char*)alloc(100);
-    vim_snprintf(title, 100, "borefind %s; %d%s matching lines", arg, found > 0 ? found : -found, found < 0 ? " (truncated)" : "");
-
-    memset(&eap, 0, sizeof(eap));
-    eap.cmdidx = CMD_cgetfile;
-    eap.arg = (char*)filename;
-    eap.cmdlinep = &title;
-    ex_cfile(&eap);
-
-    memset(&eap, 0, sizeof(eap));
-    eap.cmdidx = CMD_cwindow;
-    ex_copen(&eap);
-
-    vim_free(title);
+    return truncated == 3 ? " (cancelled)" : truncated ? " (truncated)" : "";
 }
 
-static void bore_save_match_to_file(bore_t* b, FILE* cf, const bore_match_t* match, int match_count)
+// State for handing over borefind matches to the quickfix list while searching
+typedef struct bore_find_stream_t
+{
+    bore_t* b;
+    const char* arg;
+    int qf_id;          // the quickfix list, 0 until there are matches
+    int added;          // matches added to the quickfix list
+    int keys_cancel;    // cancel when a key is typed
+} bore_find_stream_t;
+
+// Returns FAIL when the list is gone or was changed by something else.
+static int bore_add_matches_to_qf(bore_t* b, int qf_id, const bore_matches_t* matches, int first, int count)
 {
+    const bore_match_t* match = matches->match + first;
     int i;
-    for (i = 0; i < match_count; ++i, ++match)
+    for (i = 0; i < count; ++i, ++match)
     {
         char* fn = bore_rel_path(b, ((bore_file_t*)(b->file_alloc.base))[match->file_index].file);
-        fprintf(cf, "%s:%d:%d:%s\n", fn, match->row, match->column + 1, match->line);
+        if (FAIL == qf_bore_add_entry(qf_id, (char_u*)fn, match->row, match->column + 1,
+                    (char_u*)(matches->line_pool + match->line)))
+            return FAIL;
     }
+    return OK;
 }
 
-static int bore_find(bore_t* b, const char* arg, bore_search_t* search)
+static int bore_find_progress(void* ctx, const bore_matches_t* matches, int first, int match_count)
 {
-    int found = 0;
-    char_u *tmp = vim_tempname('f', TRUE);
-    FILE* cf = 0;
-    bore_match_t* match = 0;
-    int truncated = 0;
-
-    match = (bore_match_t*)alloc(search->match_count * sizeof(bore_match_t));
+    bore_find_stream_t* stream = (bore_find_stream_t*)ctx;
 
-    int threadCount = 8;
-    const char_u* threadCountStr = get_var_value((char_u *)"g:bore_search_thread_count");
-    if (threadCountStr)
+    if (match_count > 0)
     {
-        threadCount = atoi(threadCountStr);
+        if (stream->added == 0)
+        {
+            // Start the list with the first matches and show it
+            exarg_T eap;
+            vim_snprintf((char*)IObuff, IOSIZE, "borefind %s; searching...", stream->arg);
+            stream->qf_id = qf_bore_new_list(IObuff, 0);
+            if (FAIL == bore_add_matches_to_qf(stream->b, stream->qf_id, matches, first, match_count)
+                    || FAIL == qf_bore_update_buffer(stream->qf_id, NULL))
+                return TRUE;
+
+            memset(&eap, 0, sizeof(eap));
+            eap.cmdidx = CMD_cwindow;
+            ex_copen(&eap);
+        }
+        // Another list was made current or this one was changed, e.g. by an
+        // autocommand, the search stops
+        else if (FAIL == bore_add_matches_to_qf(stream->b, stream->qf_id, matches, first, match_count)
+                || FAIL == qf_bore_update_buffer(stream->qf_id, NULL))
+            return TRUE;
+        stream->added += match_count;
+        update_screen(0);
     }
 
+    // CTRL-C, or any typed key, cancels the search
+    ui_breakcheck();
+    return got_int || (stream->keys_cancel && char_avail());
+}
+
+// Returns the number of matches, which are added to a new quickfix list while
+// searching, or -1 if the search failed with an error.
+static int bore_find(bore_t* b, const char* arg, bore_search_t* search, int* truncated)
+{
+    int found = 0;
+    bore_matches_t matches;
+    bore_find_stream_t stream;
+    bore_stats_phases_t* outer_stats = bore_stats_begin(&g_bore_stats.find);
+
+    // The storage is fixed while searching, as matches are read from it
+    // while the workers add more
+    *truncated = 0;
+    memset(&matches, 0, sizeof(matches));
+    matches.match_size = search->match_count;
+    matches.match = (bore_match_t*)alloc(matches.match_size * sizeof(bore_match_t));
+    matches.line_pool_size = BORE_MATCHLINEPOOL;
+    matches.line_pool = (char*)alloc(matches.line_pool_size);
+    if (!matches.match || !matches.line_pool)
+        goto fail;
+
+    int threadCount = bore_search_thread_count();
+
+    const char_u* prefetchStr = get_var_value((char_u *)"g:bore_search_prefetch");
+    if (!prefetchStr || atoi(prefetchStr))
+        search->options |= BS_PREFETCH;
+
+    memset(&stream, 0, sizeof(stream));
+    stream.b = b;
+    stream.arg = arg;
+    // Keys from mappings, registers and scripts must not cancel the search
+    stream.keys_cancel = !exmode_active && !reg_executing && typebuf.tb_len == 0 && !using_script();
+
     BORE_VIMPROFILE_INIT;
     BORE_VIMPROFILE_START;
 
-    found = bore_dofind(b, threadCount, &truncated, match, search->match_count, search);
-    if (0 == found)
+    g_bore_searching = TRUE;
+    found = bore_dofind(b, threadCount, truncated, &matches, search,
+            bore_find_progress, &stream);
+    g_bore_searching = FALSE;
+    BORE_VIMPROFILE_STOP("bore_dofind");
+    if (found <= 0)
         goto fail;
 
-    BORE_VIMPROFILE_STOP("bore_dofind");
+    vim_snprintf((char*)IObuff, IOSIZE, "borefind %s; %d%s matching lines", arg, found, bore_truncated_str(*truncated));
 
     if (search->options & BS_SORTRESULT)
     {
@@ -1340,45 +2698,197 @@ static int bore_find(bore_t* b, const char* arg, bore_search_t* search)
         bore_match_sort_t match_sort_context;
         match_sort_context.b = b;
         match_sort_context.cur_file = bore_str(b, files[search->file_index].file);
-        qsort_s(match, found, sizeof(bore_match_t), bore_sort_matches, &match_sort_context);
+        bore_qsort_s(matches.match, found, sizeof(bore_match_t), bore_sort_matches, &match_sort_context);
         BORE_VIMPROFILE_STOP("bore_sort_search_result");
+
+        // Fill the list again in sorted order, unless it was changed
+        BORE_VIMPROFILE_START;
+        if (stream.qf_id != 0 && 0 != qf_bore_new_list(IObuff, stream.qf_id)
+                && OK == bore_add_matches_to_qf(b, stream.qf_id, &matches, 0, found))
+            qf_bore_update_buffer(stream.qf_id, NULL);
+        BORE_VIMPROFILE_STOP("bore_display_search_result");
+    }
+    else
+    {
+        qf_bore_update_buffer(stream.qf_id, IObuff);
     }
 
-    BORE_VIMPROFILE_START;
+fail:
+    vim_free(matches.match);
+    vim_free(matches.line_pool);
+    g_bore_stats.find_matches = found;
+    g_bore_stats.find_truncated = *truncated;
+    bore_stats_end(outer_stats);
+    return found;
+}
+
+// The :boreopen picker shows the files of the solution straight from the
+// string arena, its lines are never copied into the buffer. With a filter it
+// shows the files that contain all words of the filter.
+typedef struct bore_picker_t
+{
+    int fnum;           // buffer number, 0 if there is no picker
+    u32* view;          // the files shown, all files when NULL
+    int count;
+    char* filter;       // NULL when all files are shown
+    int ignorecase;
+} bore_picker_t;
+
+static bore_picker_t g_bore_picker;
+
+static char_u* bore_picker_get_line(buf_T* buf, linenr_T lnum)
+{
+    bore_picker_t* p = &g_bore_picker;
+    bore_file_t* files;
+
+    if (!g_bore || lnum > p->count)
+        return (char_u*)"";
+    files = (bore_file_t*)g_bore->file_alloc.base;
+    return (char_u*)bore_rel_path(g_bore, files[p->view ? p->view[lnum - 1] : (u32)lnum - 1].file);
+}
 
-    cf = mch_fopen((char *)tmp, "wb");
-    if (cf == NULL)
+// Show the files of b that contain all words of filter. When the filter
+// extends the current one only the files shown are searched.
+static void bore_picker_filter(bore_t* b, const char* filter)
+{
+    bore_picker_t* p = &g_bore_picker;
+    bore_file_t* files = (bore_file_t*)b->file_alloc.base;
+    char words[BORE_MAX_PATH];
+    char* filters[64];
+    char path[BORE_MAX_PATH];
+    int filter_count = 0;
+    int refine;
+    int count;
+    int ic;
+    u32* view;
+    int i, j, n;
+
+    filter = skipwhite((char_u*)filter);
+    ic = ignorecase((char_u*)filter);
+    refine = p->filter && (p->ignorecase || !ic) &&
+        0 == (p->ignorecase ? STRNICMP(filter, p->filter, STRLEN(p->filter)) :
+                STRNCMP(filter, p->filter, STRLEN(p->filter)));
+
+    vim_strncpy((char_u*)words, (char_u*)filter, BORE_MAX_PATH - 1);
+    if (ic)
     {
-        semsg(_(e_cant_open_file_str), tmp);
-        goto fail;
+        for (i = 0; words[i]; ++i)
+            words[i] = TOLOWER_LOC(words[i]);
+    }
+    for (i = 0; words[i] && filter_count < 64; )
+    {
+        while (words[i] == ' ')
+            words[i++] = NUL;
+        if (words[i])
+            filters[filter_count++] = words + i;
+        while (words[i] && words[i] != ' ')
+            ++i;
+    }
+
+    if (filter_count == 0)
+    {
+        VIM_CLEAR(p->view);
+        VIM_CLEAR(p->filter);
+        p->count = b->file_count;
+        return;
+    }
+
+    count = refine ? p->count : b->file_count;
+    view = (u32*)alloc(sizeof(u32) * (count + 1));
+    if (!view)
+        return;
+    for (i = 0, n = 0; i < count; ++i)
+    {
+        u32 file = refine && p->view ? p->view[i] : (u32)i;
+        char* rel = bore_rel_path(b, files[file].file);
+        char* search = rel;
+
+        if (ic)
+        {
+            for (j = 0; rel[j] && j < BORE_MAX_PATH - 1; ++j)
+                path[j] = TOLOWER_LOC(rel[j]);
+            path[j] = NUL;
+            search = path;
+        }
+        for (j = 0; j < filter_count; ++j)
+        {
+            if (!strstr(search, filters[j]))
+                break;
+        }
+        if (j == filter_count)
+            view[n++] = file;
     }
-    bore_save_match_to_file(b, cf, match, found);
 
-    fclose(cf);
+    vim_free(p->view);
+    vim_free(p->filter);
+    p->view = view;
+    p->count = n;
+    p->filter = (char*)vim_strsave((char_u*)filter);
+    p->ignorecase = ic;
+}
+
+// The lines of the picker buffer changed
+static void bore_picker_update_buffer(int cursor_to_top)
+{
+    buf_T* buf = g_bore_picker.fnum ? buflist_findnr(g_bore_picker.fnum) : NULL;
+    tabpage_T* tp;
+    win_T* wp;
 
-    bore_display_search_result(b, arg, tmp, truncated ? -found : found);
-    mch_remove(tmp);
+    if (!buf || !buf->b_ml.ml_mfp)
+        return;
+    if (!buf->b_ml.ml_bore_get)
+    {
+        // ml_bore_load() copied the lines into the memfile, e.g. for ":g",
+        // start again with an empty one.
+        if (!(buf->b_ml.ml_flags & ML_EMPTY))
+        {
+            u_blockfree(buf);
+            u_clearall(buf);
+            ml_close(buf, TRUE);
+            if (FAIL == ml_open(buf))
+                return;
+        }
+        // The lines come from the files of the solution
+        buf->b_ml.ml_bore_get = bore_picker_get_line;
+        buf->b_ml.ml_flags &= ~ML_EMPTY;
+    }
+    buf->b_ml.ml_line_count = g_bore_picker.count > 0 ? g_bore_picker.count : 1;
+    FOR_ALL_TAB_WINDOWS(tp, wp)
+    {
+        if (wp->w_buffer != buf)
+            continue;
+        if (cursor_to_top || wp->w_cursor.lnum > buf->b_ml.ml_line_count)
+        {
+            wp->w_cursor.lnum = 1;
+            wp->w_cursor.col = 0;
+            wp->w_topline = 1;
+        }
+        changed_window_setting_win(wp);
+    }
+    redraw_buf_later(buf, UPD_NOT_VALID);
+}
 
-    BORE_VIMPROFILE_STOP("bore_display_search_result");
+// The files of the solution changed, or another solution was loaded
+static void bore_picker_refresh(bore_t* b)
+{
+    char* filter = g_bore_picker.filter;
 
-fail:
-    vim_free(tmp);
-    vim_free(match);
-    if (cf) fclose(cf);
-    return truncated ? -found : found;
+    g_bore_picker.filter = NULL;
+    bore_picker_filter(b, filter ? filter : "");
+    vim_free(filter);
+    bore_picker_update_buffer(FALSE);
 }
 
-// Display filename in the borebuf.
+// Display the picker in the borebuf window.
 // Window height is at least minheight (if possible)
 // mappings is a null-terminated array of strings with buffer mappings of the form "<key> <command>"
-static void bore_show_borebuf(bore_t* b, const char* filename, int minheight, const char** mappings)
+static void bore_show_borebuf(bore_t* b, int minheight, const char** mappings)
 {
     char_u  maparg[512];
     win_T   *wp;
     int    empty_fnum = 0;
     int    alt_fnum = 0;
     buf_T  *buf;
-    FILE   *filelist_fd = 0;
     int    n;
 
 #ifdef FEAT_GUI
@@ -1409,11 +2919,24 @@ static void bore_show_borebuf(bore_t* b, const char* filename, int minheight, co
 		win_setheight((int)p_hh);
 
             alt_fnum = curbuf->b_fnum;
-            // Piggyback on the help window which has the properties we want for borebuf too.
-            // (readonly, can't insert text, etc)
-            (void)do_ecmd(0, (char*)filename, NULL, NULL, ECMD_LASTL,
-		    ECMD_HIDE + ECMD_SET_HELP,
-                    NULL);  // buffer is still open, don't store info
+            // The picker buffer is hidden when its window is closed and
+            // shown again
+            buf = g_bore_picker.fnum ? buflist_findnr(g_bore_picker.fnum) : NULL;
+            if (FAIL == do_ecmd(buf ? buf->b_fnum : 0, NULL, NULL, NULL, ECMD_ONE,
+                        ECMD_HIDE + ECMD_OLDBUF, NULL))
+                goto erret;
+            if (!buf)
+            {
+                (void)setfname(curbuf, (char_u*)"[boreopen]", NULL, FALSE);
+                set_option_value_give_err((char_u*)"bt", 0L, (char_u*)"nofile", OPT_LOCAL);
+                set_option_value_give_err((char_u*)"bh", 0L, (char_u*)"hide", OPT_LOCAL);
+                set_option_value_give_err((char_u*)"swf", 0L, NULL, OPT_LOCAL);
+                set_option_value_give_err((char_u*)"ma", 0L, NULL, OPT_LOCAL);
+                set_option_value_give_err((char_u*)"ro", 1L, NULL, OPT_LOCAL);
+                g_bore_picker.fnum = curbuf->b_fnum;
+            }
+            // Editing it lists it again
+            set_option_value_give_err((char_u*)"bl", 0L, NULL, OPT_LOCAL);
             if ((cmdmod.cmod_flags & CMOD_KEEPALT) == 0)
                 curwin->w_alt_fnum = alt_fnum;
             empty_fnum = curbuf->b_fnum;
@@ -1423,6 +2946,8 @@ static void bore_show_borebuf(bore_t* b, const char* filename, int minheight, co
         }
     }
 
+    bore_picker_update_buffer(TRUE);
+
     // Press enter to open the file on the current line
     while(*mappings)
     {
@@ -1456,7 +2981,11 @@ erret:
 
 static void bore_print_build()
 {
-    if (1 == g_bore_async_execute_context.completed)
+    if ('\0' == g_bore_async_execute_context.title[0])
+    {
+        msg(_("borebuild: No build was started"));
+    }
+    else if (1 == g_bore_async_execute_context.completed)
     {
         if (0 == g_bore_async_execute_context.exit_code)
         {
@@ -1478,6 +3007,8 @@ static void bore_print_build()
     }
     else if (0 == g_bore_async_execute_context.completed)
     {
+        g_bore_async_execute_context.duration =
+            (int)(vim_time() - g_bore_async_execute_context.start);
         vim_snprintf(IObuff, IOSIZE,
             "%s; running; %d seconds...",
             g_bore_async_execute_context.title,
@@ -1493,183 +3024,128 @@ static void bore_print_build()
     }
 }
 
-void bore_async_execute_update(DWORD flags)
+#ifdef FEAT_JOB_CHANNEL
+// Parse the complete lines of "output" into the build quickfix list, the
+// rest is kept until its newline arrives. "flush" parses the rest as well.
+static void bore_async_execute_output(char_u* output, int flush)
 {
-    DWORD first = flags & (1 << 31);
-    DWORD completed = flags & (1 << 30);
-    DWORD bytes_read = 0;
-    DWORD bytes_avail = 0;
-    int errors = 0;
-    char buffer[4096];
-
-    BORE_VIMPROFILE_INIT;
-    BORE_VIMPROFILE_START;
+    struct bore_async_execute_context_t* ctx = &g_bore_async_execute_context;
+    char_u* nl = vim_strrchr(output, '\n');
+    int valid = FALSE;
 
-    int	saved_need_wait_return = need_wait_return;
-    int	saved_msg_nowait = msg_nowait;
-    need_wait_return = FALSE;
-    msg_nowait = TRUE;
-
-    for (;;)
+    if (NULL == nl && !flush)
     {
-        BOOL result = PeekNamedPipe(
-            g_bore_async_execute_context.result_handle, 
-            NULL,
-            0,
-            NULL,
-            &bytes_avail,
-            NULL);
-
-        if (!result)
-        {
-            if (!completed)
-                msg_attr(_("bore_async_execute_update: Failed to peek pipe"), HL_ATTR(HLF_E));
-            break;
-        }
-        else if (bytes_avail == 0)
-        {
-            if (!completed)
-                msg_attr(_("bore_async_execute_update: No available data in pipe"), HL_ATTR(HLF_E));
-            break;
-        }
-
-        result = ReadFile(
-            g_bore_async_execute_context.result_handle,
-            &buffer[1],
-            sizeof(buffer) - 3,
-            &bytes_read,
-            NULL);
-
-        if (!result)
-        {
-            msg_attr(_("bore_async_execute_update: Read file error"), HL_ATTR(HLF_E));
-            goto done;
-        }
-        else if (bytes_read == 0)
-        {
-            msg(_("bore_async_execute_update: No bytes read"));
-            goto done;
-        }
+        ga_concat(&ctx->partial, output);
+        return;
+    }
 
-        // TODO-pkack: Handle partial read lines and bytes_avail > 4093 correctly
-        // format as string expression
-        buffer[0] = '\'';
-        buffer[bytes_read + 1] = '\'';
-        buffer[bytes_read + 2] = '\0';
+    if (NULL == nl)
+        ga_concat(&ctx->partial, output);
+    else
+        ga_concat_len(&ctx->partial, output, nl + 1 - output);
+    if (0 == ctx->partial.ga_len)
+        return;
+    ga_append(&ctx->partial, NUL);
 
-        // TODO-pkack: Is there a way to make cgetexpr/caddexpr handle output the same way as cgetfile/caddfile
-        // quick and dirty replace of ' with " instead of escaping correctly
-        char* c = buffer + 1;
-        char* end = c + bytes_read;
-        for (; c != end; ++c)
-            if (*c == '\'')
-                *c = '\"';
+    // The list is left alone when it was freed or replaced by a newer build
+    if (ctx->qf_id && qf_bore_add_lines(ctx->qf_id, ctx->partial.ga_data, &valid) < 0)
+        ctx->qf_id = 0;
 
-        // add output as error expressions
-        char* title = (char*)alloc(100);
-        vim_snprintf(title, 100, "borebuild");
-        exarg_T eap;
-        memset(&eap, 0, sizeof(eap));
-        eap.cmdidx = (first && !errors) ? CMD_cgetexpr : CMD_caddexpr;
-        eap.cmdlinep = &title;
-        eap.arg = buffer;
-        ex_cexpr(&eap);
-        vim_free(title);
-
-        ++errors;
-        if (bytes_read == bytes_avail)
-            break;
-    }
+    ctx->partial.ga_len = 0;
+    if (NULL != nl)
+        ga_concat(&ctx->partial, nl + 1);
 
-    if (first && errors)
+    if (valid && !ctx->shown)
     {
         exarg_T eap;
         memset(&eap, 0, sizeof(eap));
         eap.cmdidx = CMD_cwindow;
-        ex_copen(&eap);
-    }
-    update_screen(UPD_VALID);
-    
-done:
-    if (completed)
-    {
-        CloseHandle(g_bore_async_execute_context.wait_thread);
-        CloseHandle(g_bore_async_execute_context.spawned_process.hThread);
-        CloseHandle(g_bore_async_execute_context.spawned_process.hProcess);
-        CloseHandle(g_bore_async_execute_context.result_handle);
-        g_bore_async_execute_context.wait_thread = INVALID_HANDLE_VALUE;
-        g_bore_async_execute_context.spawned_process.hThread = INVALID_HANDLE_VALUE;
-        g_bore_async_execute_context.spawned_process.hProcess = INVALID_HANDLE_VALUE;
-        g_bore_async_execute_context.result_handle = INVALID_HANDLE_VALUE;
-        g_bore_async_execute_context.completed = 1;
-        bore_print_build();
+        ex_cwindow(&eap);
+        ctx->shown = TRUE;
     }
-
-    need_wait_return = saved_need_wait_return;
-    msg_nowait = saved_msg_nowait;
-
-    BORE_VIMPROFILE_STOP("bore_async_update");
 }
 
-static DWORD WINAPI bore_async_execute_wait_thread(LPVOID param)
+static void bore_async_execute_ended(int ended)
 {
-    extern HWND s_hwnd;
-    DWORD result;
-    DWORD bytes_avail;
-    DWORD first = 1;
-    DWORD completed = 0;
-
-    do
-    {
-        result = WaitForSingleObject(g_bore_async_execute_context.spawned_process.hProcess, 1000);
-        ++g_bore_async_execute_context.duration;
+    struct bore_async_execute_context_t* ctx = &g_bore_async_execute_context;
+    ctx->ended |= ended;
+    // The job can exit before all its output was read, wait for both
+    if (3 != ctx->ended)
+        return;
 
-        if (result == WAIT_TIMEOUT)
-        {
-            BOOL peek_success = PeekNamedPipe(
-                g_bore_async_execute_context.result_handle, 
-                NULL,
-                0,
-                0,
-                &bytes_avail,
-                NULL);
+    ga_clear(&ctx->partial);
+    ctx->duration = (int)(vim_time() - ctx->start);
+    ctx->completed = 1;
+    bore_print_build();
+}
 
-            if (!peek_success || 0 == bytes_avail)
-                continue;
-        }
-        else
-        {
-            GetExitCodeProcess(
-                g_bore_async_execute_context.spawned_process.hProcess,
-                &g_bore_async_execute_context.exit_code);
-            completed = 1;
-        }
+// "out_cb" of the build job, called with every chunk of raw output
+static int bore_async_execute_out_cb(int argcount, typval_T* argvars, typval_T* rettv, void* state UNUSED)
+{
+    if (argcount > 1 && VAR_STRING == argvars[1].v_type && NULL != argvars[1].vval.v_string)
+        bore_async_execute_output(argvars[1].vval.v_string, FALSE);
+    rettv->v_type = VAR_NUMBER;
+    rettv->vval.v_number = 0;
+    return FCERR_NONE;
+}
 
-        assert(sizeof(WPARAM) == sizeof(&bore_async_execute_update));
-        WPARAM wparam = (WPARAM)&bore_async_execute_update;
-        LPARAM lparam = (result & 0x3FFFFFFF) | (first << 31) | (completed << 30);
-        PostMessage(s_hwnd, WM_USER + 1234, wparam, lparam);
+// "close_cb" of the build job, all output has been read
+static int bore_async_execute_close_cb(int argcount UNUSED, typval_T* argvars UNUSED, typval_T* rettv, void* state UNUSED)
+{
+    bore_async_execute_output((char_u*)"", TRUE);
+    bore_async_execute_ended(2);
+    rettv->v_type = VAR_NUMBER;
+    rettv->vval.v_number = 0;
+    return FCERR_NONE;
+}
 
-        first = 0;
-    } while (completed == 0);
+// "exit_cb" of the build job
+static int bore_async_execute_exit_cb(int argcount, typval_T* argvars, typval_T* rettv, void* state UNUSED)
+{
+    if (argcount > 1 && VAR_NUMBER == argvars[1].v_type)
+        g_bore_async_execute_context.exit_code = (int)argvars[1].vval.v_number;
+    bore_async_execute_ended(1);
+    rettv->v_type = VAR_NUMBER;
+    rettv->vval.v_number = 0;
+    return FCERR_NONE;
+}
 
-    return 0;
+static void bore_async_execute_set_cb(callback_T* cb, char_u** name, cfunc_T func)
+{
+    // Registered once and kept, the job options take another reference
+    if (NULL == *name)
+        *name = vim_strsave(register_cfunc(func, NULL, NULL));
+    func_ref(*name);
+    cb->cb_name = *name;
 }
 
+// Run "cmdline" with the shell in the solution directory as a job. Its
+// output is parsed into a new quickfix list as it arrives.
 static void bore_async_execute(char* title, const char* cmdline)
 {
-    if (g_bore_async_execute_context.wait_thread != INVALID_HANDLE_VALUE)
+    static char_u* out_cb = NULL;
+    static char_u* close_cb = NULL;
+    static char_u* exit_cb = NULL;
+    struct bore_async_execute_context_t* ctx = &g_bore_async_execute_context;
+    jobopt_T opt;
+    job_T* job;
+
+    if (0 == ctx->completed && ctx->title[0])
     {
         emsg(_("bore_async_execute: Busy. Cannot launch another process."));
         return;
     }
-    g_bore_async_execute_context.completed = 0;
-    g_bore_async_execute_context.duration = 0;
-    g_bore_async_execute_context.exit_code = 0;
+    ctx->completed = 0;
+    ctx->ended = 0;
+    ctx->shown = FALSE;
+    ctx->duration = 0;
+    ctx->exit_code = 0;
+    ctx->start = vim_time();
+    ga_init2(&ctx->partial, 1, 4096);
     vim_strncpy(
-        g_bore_async_execute_context.title,
-        title,
-        sizeof(g_bore_async_execute_context.title));
+        (char_u*)ctx->title,
+        (char_u*)title,
+        sizeof(ctx->title) - 1);
 
     autowrite_all();
 
@@ -1678,127 +3154,69 @@ static void bore_async_execute(char* title, const char* cmdline)
     eap.cmdidx = CMD_cwindow;
     ex_cclose(&eap);
 
-    HANDLE output_handle;
-    HANDLE error_handle;
-
-    SECURITY_ATTRIBUTES sa_attr = {0};
-    sa_attr.nLength = sizeof(sa_attr);
-    sa_attr.bInheritHandle = TRUE;
-    sa_attr.lpSecurityDescriptor = NULL;
-
-    BOOL result = CreatePipe(
-        &g_bore_async_execute_context.result_handle,
-        &output_handle,
-        &sa_attr,
-        0);
-
-    if (!result)
-    {
-        emsg(_("bore_async_execute: Failed to create pipe"));
-        goto fail;
-    }
-
-    result = SetHandleInformation(
-        g_bore_async_execute_context.result_handle,
-        HANDLE_FLAG_INHERIT,
-        0);
-
-    if (!result)
-    {
-        emsg(_("bore_async_execute: Failed to remove inheritable flag for read handle"));
-        goto fail;
-    }
-
-    result = DuplicateHandle(
-        GetCurrentProcess(),
-        output_handle,
-        GetCurrentProcess(),
-        &error_handle,
-        0,
-        TRUE,
-        DUPLICATE_SAME_ACCESS);
-
-    if (!result)
-    {
-        emsg(_("bore_async_execute: Failed to duplicate stdout write handle for stderr"));
-        goto fail;
-    }
-
-    STARTUPINFO startup_info = {0};
-    char cmd[1024];
-
-    startup_info.cb = sizeof(startup_info);
-    startup_info.dwFlags = STARTF_USESTDHANDLES;
-    startup_info.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
-    startup_info.hStdOutput = output_handle;
-    startup_info.hStdError = error_handle;
-
-    if (-1 == _snprintf_s(cmd, sizeof(cmd), sizeof(cmd), "cmd.exe /c \"%s\"", cmdline))
+    ctx->qf_id = qf_bore_new_list((char_u*)ctx->title, FALSE);
+
+    // Raw output with stderr merged into stdout, lines are split here
+    clear_job_options(&opt);
+    opt.jo_set = JO_MODE | JO_OUT_CALLBACK | JO_CLOSE_CALLBACK | JO_EXIT_CB
+        | JO_IN_IO | JO_ERR_IO;
+    opt.jo_mode = CH_MODE_RAW;
+    opt.jo_io[PART_IN] = JIO_NULL;
+    opt.jo_io[PART_ERR] = JIO_OUT;
+    bore_async_execute_set_cb(&opt.jo_out_cb, &out_cb, bore_async_execute_out_cb);
+    bore_async_execute_set_cb(&opt.jo_close_cb, &close_cb, bore_async_execute_close_cb);
+    bore_async_execute_set_cb(&opt.jo_exit_cb, &exit_cb, bore_async_execute_exit_cb);
+    if (g_bore)
     {
-        emsg(_("bore_async_execute: Command line is too long"));
-        goto fail;
+        opt.jo_set2 = JO2_CWD;
+        opt.jo_cwd = (char_u*)bore_str(g_bore, g_bore->sln_dir);
     }
 
-    memset(
-            &g_bore_async_execute_context.spawned_process, 
-            0, 
-            sizeof(g_bore_async_execute_context.spawned_process));
-
-    BOOL process_created = CreateProcess(
-            NULL, 
-            cmd, 
-            NULL, 
-            &sa_attr, 
-            TRUE, 
-            CREATE_NO_WINDOW, 
-            NULL, 
-            NULL, 
-            &startup_info, 
-            &g_bore_async_execute_context.spawned_process);
+    // job_start() takes argv[] on Unix and a command string elsewhere
+#ifdef UNIX
+    char* argv[4];
+    argv[0] = (char*)p_sh;
+    argv[1] = (char*)p_shcf;
+    argv[2] = (char*)cmdline;
+    argv[3] = NULL;
+    job = job_start(NULL, argv, &opt, NULL);
+#else
+    typval_T argvars[1];
+    char cmd[1200];
+    vim_snprintf(cmd, sizeof(cmd), "%s %s \"%s\"", p_sh, p_shcf, cmdline);
+    argvars[0].v_type = VAR_STRING;
+    argvars[0].vval.v_string = (char_u*)cmd;
+    job = job_start(argvars, NULL, &opt, NULL);
+#endif
 
-    if (!process_created)
+    if (NULL == job || JOB_FAILED == job->jv_status)
     {
         emsg(_("bore_async_execute: Failed to spawn process"));
-        goto fail;
+        ga_clear(&ctx->partial);
+        ctx->completed = -1;
+        ctx->duration = -1;
+        ctx->exit_code = -1;
     }
-
-    CloseHandle(output_handle);
-    CloseHandle(error_handle);
-
-    DWORD thread_id = 0;
-
-    g_bore_async_execute_context.wait_thread = CreateThread(
-            NULL, 
-            4096, 
-            bore_async_execute_wait_thread, 
-            &g_bore_async_execute_context, 
-            0, 
-            &thread_id);
-
-    if (g_bore_async_execute_context.wait_thread == INVALID_HANDLE_VALUE)
+    else
     {
-        emsg(_("bore_async_execute: Failed to spawn wait thread"));
-        goto fail;
+        msg(ctx->title);
     }
-
-    msg(g_bore_async_execute_context.title);
-    return;
-
-fail:
-    CloseHandle(output_handle);
-    CloseHandle(error_handle);
-    CloseHandle(g_bore_async_execute_context.wait_thread);
-    CloseHandle(g_bore_async_execute_context.spawned_process.hThread);
-    CloseHandle(g_bore_async_execute_context.spawned_process.hProcess);
-    CloseHandle(g_bore_async_execute_context.result_handle);
-    g_bore_async_execute_context.wait_thread = INVALID_HANDLE_VALUE;
-    g_bore_async_execute_context.spawned_process.hThread = INVALID_HANDLE_VALUE;
-    g_bore_async_execute_context.spawned_process.hProcess = INVALID_HANDLE_VALUE;
-    g_bore_async_execute_context.result_handle = INVALID_HANDLE_VALUE;
+    // The callbacks keep the job alive until it ended
+    job_unref(job);
+}
+#else
+static void bore_async_execute(char* title, const char* cmdline)
+{
+    vim_strncpy(
+        g_bore_async_execute_context.title,
+        title,
+        sizeof(g_bore_async_execute_context.title) - 1);
     g_bore_async_execute_context.completed = -1;
     g_bore_async_execute_context.duration = -1;
     g_bore_async_execute_context.exit_code = -1;
+    emsg(_("bore_async_execute: Not supported without the +channel feature"));
 }
+#endif
 
 
 #endif
@@ -1809,42 +3227,123 @@ fail:
 
 void ex_boresln(exarg_T *eap)
 {
-    if (*eap->arg == NUL)
+    if (g_bore_searching)
+        emsg(_("boresln: Not while borefind is searching"));
+    else if (*eap->arg == NUL)
     {
+        bore_watch_update();
         bore_print_sln(0);
     }
     else
     {
-        DWORD start = GetTickCount();
-        DWORD elapsed;
-        bore_load_sln((char*)eap->arg);
-        elapsed = GetTickCount() - start;
-        bore_print_sln(elapsed);
+        elapsed_T start;
+        long elapsed_ms;
+        ELAPSED_INIT(start);
+        bore_load_sln((char*)eap->arg, eap->forceit, FALSE);
+        elapsed_ms = ELAPSED_FUNC(start);
+        bore_print_sln(elapsed_ms);
+    }
+}
+
+static void bore_file_hash_clear(bore_t* b)
+{
+    bore_alloc_free(&b->file_hash_alloc);
+    memset(&b->file_hash_alloc, 0, sizeof(bore_alloc_t));
+    b->file_hash_mask = 0;
+    if (b == g_bore)
+        ++g_bore_file_generation;
+}
+
+static void bore_file_hash_build(bore_t* b)
+{
+    bore_file_t* files = (bore_file_t*)b->file_alloc.base;
+    u32* table;
+    u32 size = 1;
+    u32 mask;
+    u32 h;
+    int i;
+
+    // At most half full
+    while (size <= 2 * (u32)b->file_count)
+        size <<= 1;
+    mask = size - 1;
+    bore_prealloc(&b->file_hash_alloc, sizeof(u32) * size);
+    table = (u32*)bore_alloc(&b->file_hash_alloc, sizeof(u32) * size);
+    memset(table, 0xff, sizeof(u32) * size);
+    for (i = 0; i < b->file_count; ++i)
+    {
+        for (h = bore_string_hash(bore_str(b, files[i].file)) & mask; table[h] != ~0u; h = (h + 1) & mask)
+            ;
+        table[h] = i;
+    }
+    b->file_hash_mask = mask;
+}
+
+// Lookup a canonical path, ignoring case
+static bore_file_t* bore_find_path(bore_t* b, const char* path)
+{
+    bore_file_t* files = (bore_file_t*)b->file_alloc.base;
+    u32* table;
+    u32 mask;
+    u32 h;
+
+    if (!b->file_hash_alloc.base)
+        bore_file_hash_build(b);
+    table = (u32*)b->file_hash_alloc.base;
+    mask = b->file_hash_mask;
+    for (h = bore_string_hash(path) & mask; table[h] != ~0u; h = (h + 1) & mask)
+    {
+        if (0 == STRICMP(path, bore_str(b, files[table[h]].file)))
+            return &files[table[h]];
     }
+    return NULL;
+}
+
+bore_file_t* bore_find_file(char* fn)
+{
+    char path[BORE_MAX_PATH];
+
+    if (FAIL == bore_canonicalize(fn, path, 0))
+        return NULL;
+
+    return bore_find_path(g_bore, path);
+}
+
+// Called after a buffer was written to fname
+void bore_file_written(char_u* fname)
+{
+    bore_file_t* file;
+
+    if (!g_bore || !g_bore->index)
+        return;
+    file = bore_find_file((char*)fname);
+    if (file)
+        bore_index_changed(g_bore, (int)(file - (bore_file_t*)g_bore->file_alloc.base));
 }
 
-bore_file_t* bore_find_file(char* fn)
+// The file of a buffer, looked up once per buffer name and solution file list
+static bore_file_t* bore_find_buf_file(buf_T* buf)
 {
-    char path[BORE_MAX_PATH];
+    bore_file_t* file;
 
-    if (FAIL == bore_canonicalize(fn, path, 0))
+    if (NULL == buf->b_fname || '\0' == buf->b_fname[0])
         return NULL;
-
-    bore_file_t* file = (bore_file_t*)bsearch_s( 
-        path,
-        g_bore->file_alloc.base,
-        g_bore->file_count,
-        sizeof(bore_file_t),
-        bore_find_filename,
-        g_bore);
-
-    return file;
+    if (buf->b_bore_generation != g_bore_file_generation)
+    {
+        file = bore_find_file((char*)buf->b_fname);
+        buf->b_bore_file_index = file ? (int)(file - (bore_file_t*)g_bore->file_alloc.base) : -1;
+        buf->b_bore_generation = g_bore_file_generation;
+    }
+    if (buf->b_bore_file_index < 0)
+        return NULL;
+    return (bore_file_t*)g_bore->file_alloc.base + buf->b_bore_file_index;
 }
 
 void borefind_parse_options(bore_t* b, char* arg, bore_search_t* search)
 {
     // Usage: [option(s)] what
     //   -i ignore case
+    //   -r what is a regex
     //   -p project only (based on current buffer)
     //   -e ext1,ext2,...,ext9
     //      filters the search based on a list of file extensions
@@ -1889,6 +3388,11 @@ void borefind_parse_options(bore_t* b, char* arg, bore_search_t* search)
                     options |= BS_PROJECT;
                     ++arg;
                 }
+                else if (*arg == 'r' && arg[1] == ' ')
+                {
+                    options |= BS_REGEX;
+                    ++arg;
+                }
                 else
                 {
                     // empty or unknown option, treat the rest as the search string
@@ -1911,19 +3415,19 @@ void borefind_parse_options(bore_t* b, char* arg, bore_search_t* search)
         }
     }
 
-    // convert search string to lower case
-    if (options & BS_IGNORECASE)
+    // convert search string to lower case, a regex folds case itself
+    if ((options & BS_IGNORECASE) && !(options & BS_REGEX))
     {
-        // _strlwr_s(what, search.what_len);
+        // ASCII only, the search folds non-ASCII characters itself
         char* c = what;
         for (; *c; ++c)
-            *c = TOLOWER_LOC(*c);
+            *c = TOLOWER_ASC(*c);
     }
 
     // lookup current buffer, use for scoring and project filtering
     if (NULL != curbuf->b_fname && '\0' != curbuf->b_fname)
     {
-        file = bore_find_file(curbuf->b_fname);
+        file = bore_find_buf_file(curbuf);
         if (NULL != file)
         {
             file_index = file - (bore_file_t*)b->file_alloc.base;
@@ -1970,29 +3474,35 @@ void borefind_parse_options(bore_t* b, char* arg, bore_search_t* search)
 
 void ex_borefind(exarg_T *eap)
 {
-    if (!g_bore)
+    bore_watch_update();
+    if (g_bore_searching)
+    {
+        emsg(_("borefind: Already searching"));
+    }
+    else if (!g_bore)
     {
         emsg(_("Load a solution first with boresln"));
     }
     else
     {
-        DWORD start = GetTickCount();
-        DWORD elapsed;
+        elapsed_T start;
+        long elapsed_ms;
         bore_search_t search;
         size_t arg_size = strlen(eap->arg) + 1;
         char* arg = lalloc(arg_size, TRUE);
         memcpy(arg, eap->arg, arg_size);
+        ELAPSED_INIT(start);
 
+        int truncated;
         borefind_parse_options(g_bore, arg, &search);
-        int found = bore_find(g_bore, (char*)eap->arg, &search);
-        elapsed = GetTickCount() - start;
-        vim_snprintf(IObuff, IOSIZE, "%d%s matching lines; borefind %s; %u ms",
-            found > 0 ? found : -found,
-            found < 0 ? " (truncated)" : "",
-            (char*)eap->arg, elapsed);
-        if (found)
+        int found = bore_find(g_bore, (char*)eap->arg, &search, &truncated);
+        elapsed_ms = ELAPSED_FUNC(start);
+        vim_snprintf(IObuff, IOSIZE, "%d%s matching lines; borefind %s; %ld ms",
+            found, bore_truncated_str(truncated),
+            (char*)eap->arg, elapsed_ms);
+        if (found > 0)
             msg(IObuff);
-        else
+        else if (found == 0)
             emsg(IObuff);
 
         vim_free(arg);
@@ -2001,6 +3511,7 @@ void ex_borefind(exarg_T *eap)
 
 void ex_boreopen(exarg_T *eap)
 {
+    bore_watch_update();
     if (!g_bore)
         emsg(_("Load a solution first with boresln"));
     else
@@ -2011,7 +3522,8 @@ void ex_boreopen(exarg_T *eap)
             "<CR> :ZZBoreopenselection<CR>", 
             "<2-LeftMouse> :ZZBoreopenselection<CR>",
             0};
-        bore_show_borebuf(g_bore, bore_str(g_bore, g_bore->sln_filelist), g_bore->ini.borebuf_height, mappings);
+        bore_picker_filter(g_bore, (char*)eap->arg);
+        bore_show_borebuf(g_bore, g_bore->ini.borebuf_height, mappings);
     }
 }
 
@@ -2045,7 +3557,7 @@ char_u* bore_statusline(int flags)
     bore_sln_config_t* config;
     bore_proj_t* proj;
     bore_file_t* file;
-    BOOL has_data = FALSE;
+    int has_data = FALSE;
 
     if (!g_bore || !flags)
         return NULL;
@@ -2056,7 +3568,7 @@ char_u* bore_statusline(int flags)
     {
         if (0x04 & flags)
         {
-            file = bore_find_file(curbuf->b_fname);
+            file = bore_find_buf_file(curbuf);
             if (file != NULL)
             {
                 proj = (bore_proj_t*)g_bore->proj_alloc.base + file->proj_index;
@@ -2091,6 +3603,587 @@ char_u* bore_statusline(int flags)
     return IObuff;
 }
 
+static void bore_stats_add_phases(dict_T* d, const bore_stats_phases_t* phases)
+{
+    list_T* l = list_alloc();
+    int i;
+
+    dict_add_number(d, "time", phases->us);
+    dict_add_number(d, "runs", phases->runs);
+    if (!l)
+        return;
+    dict_add_list(d, "phases", l);
+    for (i = 0; i < phases->count; ++i)
+    {
+        dict_T* phase = dict_alloc();
+        if (!phase)
+            break;
+        dict_add_string(phase, "name", (char_u*)phases->phase[i].name);
+        dict_add_number(phase, "time", phases->phase[i].us);
+        list_append_dict(l, phase);
+    }
+}
+
+static void bore_stats_add_search(dict_T* d, const bore_search_stats_t* stats)
+{
+    dict_add_number(d, "searched", stats->files_searched);
+    dict_add_number(d, "skipped_ext", stats->files_skipped_ext);
+    dict_add_number(d, "skipped_proj", stats->files_skipped_proj);
+    dict_add_number(d, "skipped_index", stats->files_skipped_index);
+    dict_add_number(d, "failed", stats->files_failed);
+    dict_add_number(d, "mapped", stats->files_mapped);
+    dict_add_number(d, "truncated_files", stats->files_truncated);
+    dict_add_number(d, "bytes", stats->bytes_read);
+    dict_add_number(d, "busy", stats->busy_us);
+}
+
+// Fill d with the counters of the last boresln and borefind, see
+// bore_stats_t. Times are in microseconds.
+void bore_stats(dict_T* d)
+{
+    const bore_stats_t* stats = &g_bore_stats;
+    dict_T* sln = dict_alloc();
+    dict_T* find = dict_alloc();
+    dict_T* memfile = dict_alloc();
+    list_T* threads = list_alloc();
+    int i;
+
+    if (!sln || !find || !memfile || !threads)
+    {
+        dict_unref(sln);
+        dict_unref(find);
+        dict_unref(memfile);
+        list_unref(threads);
+        return;
+    }
+    dict_add_dict(d, "sln", sln);
+    dict_add_dict(d, "find", find);
+    dict_add_dict(d, "memfile", memfile);
+    mf_bore_stats(memfile);
+
+    bore_stats_add_phases(sln, &stats->sln);
+    dict_add_number(sln, "cached", stats->sln_cached);
+    dict_add_number(sln, "files", g_bore ? g_bore->file_count : 0);
+    dict_add_number(sln, "projects", g_bore ? g_bore->proj_count : 0);
+
+    bore_stats_add_phases(find, &stats->find);
+    bore_stats_add_search(find, &stats->find_total);
+    dict_add_number(find, "matches", stats->find_matches);
+    dict_add_string(find, "truncated", (char_u*)(stats->find_truncated == 3 ? "cancelled" :
+                stats->find_truncated == 2 ? "matches" : stats->find_truncated ? "file" : ""));
+    dict_add_number(find, "indexed", stats->find_indexed);
+    dict_add_number(find, "prefetched", stats->find_prefetched);
+    dict_add_list(find, "threads", threads);
+    for (i = 0; i < stats->find_thread_count; ++i)
+    {
+        dict_T* thread = dict_alloc();
+        if (!thread)
+            break;
+        bore_stats_add_search(thread, &stats->find_thread[i]);
+        list_append_dict(threads, thread);
+    }
+}
+
+// Large files are mapped by readfile() and the lines of the buffer are found
+// in the mapping when they are needed, so that a file of any size shows up
+// after one pass that counts its lines. The line index is built as far as the
+// lines are asked for. The buffer is copied into its memfile before it is
+// changed or written, see ml_bore_load().
+#define BORE_MAP_MIN_SIZE_MB 64
+#define BORE_MAP_INDEX_STEP 64 // lines per entry of the line index
+
+typedef struct bore_map_t
+{
+    const char* data;
+    size_t size;
+    linenr_T line_count;
+    size_t* index;          // offset of line 1 + i * BORE_MAP_INDEX_STEP
+    linenr_T index_count;   // entries of index that are known
+    linenr_T lnum;          // the line in line, 0 if none
+    size_t offset;          // its offset
+    char_u* line;           // line lnum with NULs as NLs, like in the memfile
+    size_t line_size;
+#ifndef MSWIN
+    size_t map_size;        // size of the mapping, size is less when truncated
+    int fd;                 // to find the size when the file was truncated
+    int truncated;
+#endif
+} bore_map_t;
+
+#ifndef MSWIN
+// Reading the pages of a mapped file that another program truncated raises
+// SIGBUS. deathtrap() calls bore_map_sigbus(), which jumps back to where the
+// map was read, and the lines that were lost are empty from then on. The
+// signal mask is not saved, it costs a system call for every line.
+static sigjmp_buf bore_map_jump_env;
+static volatile sig_atomic_t bore_map_jump_active = FALSE;
+
+void bore_map_sigbus(void)
+{
+    // A search thread reading a mapped file
+    bore_find_sigbus();
+    if (bore_map_jump_active)
+    {
+        bore_map_jump_active = FALSE;
+        siglongjmp(bore_map_jump_env, 1);
+    }
+}
+
+// After the jump from deathtrap(): SIGBUS is still blocked.
+static void bore_map_fault(void)
+{
+    sigset_t set;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGBUS);
+    sigprocmask(SIG_UNBLOCK, &set, NULL);
+}
+
+// The file of map was truncated, only what is left of it is read.
+static void bore_map_truncated(bore_map_t* map)
+{
+    stat_T st;
+
+    bore_map_fault();
+    if (fstat(map->fd, &st) != 0 || st.st_size < 0)
+        map->size = 0;
+    else if ((u64)st.st_size < (u64)map->size)
+        map->size = (size_t)st.st_size;
+    map->lnum = 0;
+    if (!map->truncated)
+    {
+        map->truncated = TRUE;
+        emsg(_("The mapped file was truncated, the lines that were lost are empty"));
+    }
+}
+#endif
+
+static void bore_map_unmap(const char* data, size_t size)
+{
+#ifdef MSWIN
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+// Check that [p, end) is UTF-8 the way readfile() does, a word at a time
+// while it's ASCII.
+static int bore_map_is_utf8(const char_u* p, const char_u* end)
+{
+    while (p < end)
+    {
+        if (*p < 0x80)
+        {
+            u64 w;
+            while (end - p >= 8)
+            {
+                memcpy(&w, p, 8);
+                if (w & 0x8080808080808080ULL)
+                    break;
+                p += 8;
+            }
+            while (p < end && *p < 0x80)
+                ++p;
+        }
+        else
+        {
+            int l = utf_ptr2len_len((char_u*)p, (int)(end - p > 8 ? 8 : end - p));
+            if (l == 1 || l > end - p)
+                return FALSE;
+            p += l;
+        }
+    }
+    return TRUE;
+}
+
+// The offset of the line after the one at offset.
+static size_t bore_map_next(const bore_map_t* map, size_t offset)
+{
+    const char* nl;
+
+    if (offset >= map->size)
+        return map->size;
+    nl = (const char*)memchr(map->data + offset, '\n', map->size - offset);
+    return nl ? nl - map->data + 1 : map->size;
+}
+
+// Add the next entry to the line index, FALSE if all are known.
+static int bore_map_extend(bore_map_t* map)
+{
+    size_t offset;
+    int i;
+
+    if (map->index_count > (map->line_count - 1) / BORE_MAP_INDEX_STEP)
+        return FALSE;
+    offset = map->index[map->index_count - 1];
+    for (i = 0; i < BORE_MAP_INDEX_STEP; ++i)
+        offset = bore_map_next(map, offset);
+    map->index[map->index_count++] = offset;
+    return TRUE;
+}
+
+// The offset of line lnum, one of the last lines, found back from the end.
+static size_t bore_map_find_back(const bore_map_t* map, linenr_T lnum)
+{
+    size_t offset = map->size;
+    linenr_T l = map->line_count + 1;
+
+    if (offset == 0)
+        return 0;
+    if (map->data[map->size - 1] != '\n')
+    {
+        // The last line has no NL
+        l = map->line_count;
+        while (offset > 0 && map->data[offset - 1] != '\n')
+            --offset;
+    }
+    for (; l > lnum && offset > 0; --l)
+    {
+        --offset;
+        while (offset > 0 && map->data[offset - 1] != '\n')
+            --offset;
+    }
+    return offset;
+}
+
+// The offset of line lnum (1 to line_count).
+static size_t bore_map_find(bore_map_t* map, linenr_T lnum)
+{
+    linenr_T i = (lnum - 1) / BORE_MAP_INDEX_STEP;
+    linenr_T l;
+    size_t offset;
+
+    if (map->lnum && lnum >= map->lnum && lnum - map->lnum < BORE_MAP_INDEX_STEP)
+    {
+        // Near the last line, e.g. when the screen is drawn
+        l = map->lnum;
+        offset = map->offset;
+    }
+    else if (map->index_count <= i && map->line_count - lnum < BORE_MAP_INDEX_STEP
+#ifndef MSWIN
+            && !map->truncated
+#endif
+            )
+    {
+        // The modelines and "G" don't need the index
+        return bore_map_find_back(map, lnum);
+    }
+    else
+    {
+        while (map->index_count <= i)
+            bore_map_extend(map);
+        l = i * BORE_MAP_INDEX_STEP + 1;
+        offset = map->index[i];
+    }
+    for (; l < lnum; ++l)
+        offset = bore_map_next(map, offset);
+    return offset;
+}
+
+static char_u* bore_map_get_line(buf_T* buf, linenr_T lnum)
+{
+    char_u* line = bore_map_line(buf->b_ml.ml_bore_map, lnum);
+    return line ? line : (char_u*)"";
+}
+
+// Map the file of fd, opened by readfile(), and count its lines. The file is
+// read by readfile() instead, FAIL is returned, when it is smaller than
+// g:bore_map_size or it can't be mapped, when it starts with a BOM or is
+// encrypted, when check_utf8 is set and it isn't valid UTF-8, and when
+// detect_ff is set and its first line doesn't end in a NL only. eol is set
+// when the last line ends in a NL.
+int bore_map_read(buf_T* buf, int fd, off_T size, int detect_ff, int check_utf8, int* eol)
+{
+    const char* min_size_str = (const char*)get_var_value((char_u*)"g:bore_map_size");
+    long long min_size = min_size_str ? atoll(min_size_str) : BORE_MAP_MIN_SIZE_MB;
+    bore_map_t* map;
+    const char* data;
+    const char* p;
+    const char* end;
+    linenr_T count = 0;
+
+    if (min_size <= 0 || size < min_size * 1024 * 1024 || (u64)size > (u64)(size_t)-1)
+        return FAIL;
+
+#ifdef MSWIN
+    {
+        // The file can't be truncated while it is mapped
+        HANDLE map_handle = CreateFileMappingW((HANDLE)_get_osfhandle(fd), 0, PAGE_READONLY, 0, 0, 0);
+        if (!map_handle)
+            return FAIL;
+        data = (const char*)MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, (SIZE_T)size);
+        CloseHandle(map_handle);
+        if (!data)
+            return FAIL;
+    }
+#else
+    data = (const char*)mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == (const char*)MAP_FAILED)
+        return FAIL;
+# ifdef MADV_SEQUENTIAL
+    (void)madvise((void*)data, (size_t)size, MADV_SEQUENTIAL);
+# endif
+#endif
+
+#ifndef MSWIN
+    if (sigsetjmp(bore_map_jump_env, 0) != 0)
+    {
+        // Truncated while it was read, read it with read() instead
+        bore_map_fault();
+        goto fail;
+    }
+    bore_map_jump_active = TRUE;
+#endif
+    p = data;
+    end = data + size;
+    if (memcmp(p, "\xef\xbb\xbf", 3) == 0 || memcmp(p, "VimCrypt~", 9) == 0)
+        goto fail;
+    if (detect_ff)
+    {
+        // readfile() detects 'fileformat' in the first 64 Kbyte
+        const char* nl = (const char*)memchr(p, '\n', size < 0x10000 ? size : 0x10000);
+        if (!nl || memchr(p, '\r', nl - p))
+            goto fail;
+    }
+
+    while (p < end)
+    {
+        const char* nl = (const char*)memchr(p, '\n', end - p);
+        const char* line_end = nl ? nl : end;
+
+        if (check_utf8 && !bore_map_is_utf8((const char_u*)p, (const char_u*)line_end))
+            goto fail;
+        if (++count == MAXLNUM)
+            goto fail;
+        p = line_end + 1;
+    }
+#ifndef MSWIN
+    bore_map_jump_active = FALSE;
+#endif
+
+#if !defined(MSWIN) && defined(MADV_NORMAL)
+    (void)madvise((void*)data, (size_t)size, MADV_NORMAL);
+#endif
+
+    map = (bore_map_t*)alloc_clear(sizeof(bore_map_t));
+    if (!map)
+        goto fail;
+    map->index = (size_t*)alloc(((count - 1) / BORE_MAP_INDEX_STEP + 1) * sizeof(size_t));
+    if (!map->index)
+    {
+        vim_free(map);
+        goto fail;
+    }
+    map->data = data;
+    map->size = (size_t)size;
+    map->line_count = count;
+    map->index[0] = 0;
+    map->index_count = 1;
+#ifndef MSWIN
+    map->map_size = (size_t)size;
+    map->fd = dup(fd);
+#endif
+
+    buf->b_ml.ml_bore_map = map;
+    buf->b_ml.ml_bore_get = bore_map_get_line;
+    buf->b_ml.ml_line_count = count;
+    buf->b_ml.ml_flags &= ~ML_EMPTY;
+    *eol = data[size - 1] == '\n';
+    return OK;
+
+fail:
+#ifndef MSWIN
+    bore_map_jump_active = FALSE;
+#endif
+    bore_map_unmap(data, (size_t)size);
+    return FAIL;
+}
+
+// Line lnum of map, valid until the next call. NULL when out of memory.
+char_u* bore_map_line(bore_map_t* map, linenr_T lnum)
+{
+    size_t offset;
+    size_t len;
+    char_u* p;
+
+    if (lnum == map->lnum && map->line)
+        return map->line;
+
+#ifndef MSWIN
+    if (sigsetjmp(bore_map_jump_env, 0) != 0)
+    {
+        bore_map_truncated(map);
+        return (char_u*)"";
+    }
+    bore_map_jump_active = TRUE;
+#endif
+    offset = bore_map_find(map, lnum);
+    len = bore_map_next(map, offset) - offset;
+    if (len && map->data[offset + len - 1] == '\n')
+        --len;
+    if (len + 1 > map->line_size)
+    {
+        vim_free(map->line);
+        map->line_size = len + 1 > 256 ? len + 1 : 256;
+        map->line = (char_u*)alloc(map->line_size);
+        if (!map->line)
+        {
+#ifndef MSWIN
+            bore_map_jump_active = FALSE;
+#endif
+            map->line_size = 0;
+            map->lnum = 0;
+            return NULL;
+        }
+    }
+    memcpy(map->line, map->data + offset, len);
+    map->line[len] = NUL;
+    // NULs are stored as NLs
+    for (p = map->line; (p = (char_u*)memchr(p, NUL, map->line + len - p)) != NULL; ++p)
+        *p = NL;
+#ifndef MSWIN
+    bore_map_jump_active = FALSE;
+#endif
+    map->lnum = lnum;
+    map->offset = offset;
+    return map->line;
+}
+
+// bore_map_offset() while the map is read.
+static long bore_map_find_offset(buf_T* buf, bore_map_t* map, linenr_T lnum, long* offp, int ffdos)
+{
+    // The last line is counted with a NL when it has none in the file
+    size_t total = map->size + (map->size == 0 || map->data[map->size - 1] != '\n');
+    long size;
+
+    if (lnum == 0)
+    {
+        long offset = offp ? *offp : 0;
+        linenr_T lo = 0;
+        linenr_T hi;
+        linenr_T l;
+        size_t start;
+        size_t next;
+
+        if (offset <= 0)
+            return 1;
+        // The CRs of a dos 'fileformat' are not in the file
+        if (ffdos || (size_t)offset >= total)
+            return -1;
+        while (map->index[map->index_count - 1] <= (size_t)offset && bore_map_extend(map))
+            ;
+        // The last entry at or before offset
+        hi = map->index_count - 1;
+        while (lo < hi)
+        {
+            linenr_T mid = (lo + hi + 1) / 2;
+            if (map->index[mid] <= (size_t)offset)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        l = lo * BORE_MAP_INDEX_STEP + 1;
+        start = map->index[lo];
+        while (l < map->line_count && (next = bore_map_next(map, start)) <= (size_t)offset)
+        {
+            start = next;
+            ++l;
+        }
+        *offp = offset - (long)start;
+        return l;
+    }
+
+    if (lnum > map->line_count + 1)
+        return -1;
+    size = (long)(lnum > map->line_count ? total : bore_map_find(map, lnum));
+    // Count extra CR characters.
+    if (ffdos)
+        size += lnum - 1;
+    // Don't count the last line break if 'noeol' and ('bin' or 'nofixeol').
+    if ((!buf->b_p_fixeol || buf->b_p_bin) && !buf->b_p_eol && lnum > map->line_count)
+        size -= ffdos + 1;
+    return size;
+}
+
+// ml_find_line_or_offset() for the mapped lines of buf.
+long bore_map_offset(buf_T* buf, linenr_T lnum, long* offp)
+{
+    bore_map_t* map = buf->b_ml.ml_bore_map;
+    int ffdos = (get_fileformat(buf) == EOL_DOS);
+    long size;
+
+#ifndef MSWIN
+    if (sigsetjmp(bore_map_jump_env, 0) != 0)
+    {
+        bore_map_truncated(map);
+        return -1;
+    }
+    bore_map_jump_active = TRUE;
+#endif
+    size = bore_map_find_offset(buf, map, lnum, offp, ffdos);
+#ifndef MSWIN
+    bore_map_jump_active = FALSE;
+#endif
+    return size;
+}
+
+void bore_map_free(bore_map_t* map)
+{
+#ifdef MSWIN
+    bore_map_unmap(map->data, map->size);
+#else
+    bore_map_unmap(map->data, map->map_size);
+    if (map->fd >= 0)
+        close(map->fd);
+#endif
+    vim_free(map->index);
+    vim_free(map->line);
+    vim_free(map);
+}
+
+// The first NL or NUL in [p, end), or end.  readfile() skips the text of a
+// line with it, 16 bytes at a time with SSE2 or else a word at a time.
+char_u* bore_find_eol(char_u* p, char_u* end)
+{
+#ifdef BORE_EOL_SSE2
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, zero)));
+        if (mask)
+        {
+# ifdef _MSC_VER
+            unsigned long i;
+            _BitScanForward(&i, mask);
+            return p + i;
+# else
+            return p + __builtin_ctz(mask);
+# endif
+        }
+        p += 16;
+    }
+#else
+    while (end - p >= 8)
+    {
+        u64 w, n;
+        memcpy(&w, p, 8);
+        n = w ^ 0x0a0a0a0a0a0a0a0aULL;
+        if (((w - 0x0101010101010101ULL) & ~w & 0x8080808080808080ULL)
+                || ((n - 0x0101010101010101ULL) & ~n & 0x8080808080808080ULL))
+            break;
+        p += 8;
+    }
+#endif
+    while (p < end && *p != NL && *p != NUL)
+        ++p;
+    return p;
+}
+
 static bore_print_proj(bore_t* b, int proj_index)
 {
     const bore_proj_t* projects = (bore_proj_t*)b->proj_alloc.base;
@@ -2117,6 +4210,7 @@ static bore_print_proj(bore_t* b, int proj_index)
 
 void ex_boreproj(exarg_T *eap)
 {
+    bore_watch_update();
     if (!g_bore)
     {
         emsg(_("boreproj: Load a solution first with boresln"));
@@ -2140,7 +4234,7 @@ void ex_boreproj(exarg_T *eap)
             else if (NULL != curbuf->b_fname && '\0' != curbuf->b_fname)
             {
                 arg = curbuf->b_fname;
-                file = bore_find_file(arg);
+                file = bore_find_buf_file(curbuf);
                 if (NULL != file)
                     proj_index = file->proj_index;
             }
@@ -2162,7 +4256,7 @@ static bore_print_sln_config(bore_t* b, int print_all)
         int i;
         for (i = 0; i < g_bore->config_count; ++i)
         {
-            BOOL is_active = (g_bore->sln_config == i);
+            int is_active = (g_bore->sln_config == i);
             vim_snprintf(IObuff, IOSIZE, "%s %s|%s",
                 is_active ? "*" : " ",
                 bore_str(g_bore, sln_configs[i].config),
@@ -2214,35 +4308,29 @@ void ex_boreconfig(exarg_T *eap)
 
 void ex_boretoggle(exarg_T *eap)
 {
+    bore_watch_update();
     if (!g_bore)
         emsg(_("Load a solution first with boresln"));
     else
     {
         char path[BORE_MAX_PATH];
-        const char* ext;
         const char* basename;
-        size_t path_len;
         u32 basename_hash;
-        u32 ext_hash;
-        const bore_toggle_entry_t* e_begin = (const bore_toggle_entry_t*)g_bore->toggle_index_alloc.base;
+        int stem_len;
+        const bore_toggle_entry_t* entries = (const bore_toggle_entry_t*)g_bore->toggle_index_alloc.base;
+        const bore_toggle_entry_t* e_begin = entries;
         const bore_toggle_entry_t* e = e_begin;
         const bore_toggle_entry_t* e_end = e + g_bore->toggle_entry_count;
-        const bore_toggle_entry_t* e_buf;
-        const bore_toggle_entry_t* e_best;
-        int e_best_score;
 
         if (FAIL == bore_canonicalize(curbuf->b_fname, path, 0))
             return;
 
-        path_len = strlen(path);
-
-        ext = vim_strrchr(path, '.');
-        ext = ext ? ext + 1 : path + path_len;
-        ext_hash = bore_string_hash(ext);
+        if (-1 == bore_match_toggle_suffix(g_bore, path, bore_file_ext_hash(path), &stem_len))
+            return;
 
-        basename = vim_strrchr(path, '\\');
+        basename = vim_strrchr(path, BORE_PATHSEP);
         basename = basename ? basename + 1 : path;
-        basename_hash = bore_string_hash_n(basename, ext - basename);
+        basename_hash = bore_string_hash_n(basename, stem_len);
 
         // find first entry with identical basename using binary search
         while (e_begin < e_end)
@@ -2254,66 +4342,85 @@ void ex_boretoggle(exarg_T *eap)
                 e_end = e;
         }
 
-        if (e_begin->basename_hash != basename_hash || e_begin != e_end)
-            return;
-
-        // set first match and restore e_end
-        e = e_begin;
-        e_end = (const bore_toggle_entry_t*)g_bore->toggle_index_alloc.base + g_bore->toggle_entry_count;
-
         // Find the entry of this buffer's file
-        for (; e != e_end && e->basename_hash == basename_hash; ++e)
+        e_end = entries + g_bore->toggle_entry_count;
+        for (e = e_begin; e != e_end && e->basename_hash == basename_hash; ++e)
             if (0 == STRICMP(bore_str(g_bore, e->file), path))
                 break;
 
-        if (e == e_end || e->basename_hash != basename_hash)
-            return;
+        if (e == e_end || e->basename_hash != basename_hash || e == entries + e->next)
+            return; // no match
 
-        // Find what ext to toggle to
-        e_buf = e;
-        for(;;)
         {
-            ++e;
-            if (e == e_end || e->basename_hash != basename_hash)
-                e = e_begin;
-            if (e == e_buf)
-                return; // no match
-            if (e->extension_index != e_buf->extension_index)
-            {
-                break;
-            }
+            char *fn = bore_rel_path(g_bore, entries[e->next].file);
+            bore_open_file_buffer(fn);
         }
+    }
+}
 
-        // Find the best matching ext
-        e_best = e;
-        e_best_score = bore_str_match_score(path, bore_str(g_bore, e->file));
-        ++e;
-        for(; e != e_end && e_best->extension_index == e->extension_index; ++e)
-        {
-            int score = bore_str_match_score(path, bore_str(g_bore, e->file));
-            if (score > e_best_score)
-            {
-                e_best_score = score;
-                e_best = e;
-            }
-        }
+// The command that builds a directory, g:bore_build_cmd or one that fits the
+// build files in it. Returns FAIL when there is none.
+static int bore_dir_build_cmd(bore_t* b, int rebuild, char* cmd, int size)
+{
+    const char* dir = bore_str(b, b->sln_dir);
+    char fn[BORE_MAX_PATH];
+    char* user_cmd = (char*)get_var_value((char_u *)"g:bore_build_cmd");
+    int cores = b->ini.cpu_cores;
 
-        {
-            char *fn = bore_rel_path(g_bore, e_best->file);
-            bore_open_file_buffer(fn);
-        }
+    if (user_cmd && *user_cmd)
+    {
+        vim_strncpy((char_u*)cmd, (char_u*)user_cmd, size - 1);
+        return OK;
+    }
+
+    vim_snprintf(fn, sizeof(fn), "%sCMakeCache.txt", dir);
+    if (mch_getperm((char_u*)fn) >= 0)
+    {
+        vim_snprintf(cmd, size, "cmake --build . --parallel %d%s",
+            cores, rebuild ? " --clean-first" : "");
+        return OK;
+    }
+    vim_snprintf(fn, sizeof(fn), "%sbuild%cCMakeCache.txt", dir, BORE_PATHSEP);
+    if (mch_getperm((char_u*)fn) >= 0)
+    {
+        vim_snprintf(cmd, size, "cmake --build build --parallel %d%s",
+            cores, rebuild ? " --clean-first" : "");
+        return OK;
+    }
+    vim_snprintf(fn, sizeof(fn), "%sbuild.ninja", dir);
+    if (mch_getperm((char_u*)fn) >= 0)
+    {
+        vim_snprintf(cmd, size, "%s", rebuild ? "ninja -t clean && ninja" : "ninja");
+        return OK;
+    }
+    vim_snprintf(fn, sizeof(fn), "%sMakefile", dir);
+    if (mch_getperm((char_u*)fn) >= 0)
+    {
+        vim_snprintf(cmd, size, "make -j%d%s", cores, rebuild ? " -B" : "");
+        return OK;
     }
+    return FAIL;
 }
 
 void ex_borebuild(exarg_T *eap)
 {
-    if (!g_bore)
+    if (eap->cmdidx == CMD_borebuildinfo)
+    {
+        bore_print_build();
+    }
+    else if (!g_bore)
     {
         emsg(_("borebuild: Load a solution first with boresln"));
     }
     else if (bore_is_sln_directory(g_bore))
     {
-        emsg(_("borebuild: Directories are not supported, load an actual solution first with boresln"));
+        char cmd[1024];
+        if (eap->cmdidx != CMD_borebuildsln)
+            emsg(_("borebuild: Only borebuildsln is supported for directories"));
+        else if (FAIL == bore_dir_build_cmd(g_bore, eap->forceit, cmd, sizeof(cmd)))
+            emsg(_("borebuild: Set g:bore_build_cmd, no CMakeCache.txt, build.ninja or Makefile found"));
+        else
+            bore_async_execute(cmd, cmd);
     }
     else if (-1 == g_bore->sln_config)
     {
@@ -2323,10 +4430,6 @@ void ex_borebuild(exarg_T *eap)
     {
         emsg(_("borebuild: Failed to find msbuild executable in path"));
     }
-    else if (eap->cmdidx == CMD_borebuildinfo)
-    {
-        bore_print_build();
-    }
     else
     {
         char cmd[1024];
@@ -2351,7 +4454,7 @@ void ex_borebuild(exarg_T *eap)
             else if (NULL != curbuf->b_fname && '\0' != curbuf->b_fname)
             {
                 arg = curbuf->b_fname;
-                file = bore_find_file(arg);
+                file = bore_find_buf_file(curbuf);
             }
             if (NULL == file)
             {
@@ -2372,7 +4475,7 @@ void ex_borebuild(exarg_T *eap)
             else if (NULL != curbuf->b_fname && '\0' != curbuf->b_fname)
             {
                 arg = curbuf->b_fname;
-                file = bore_find_file(arg);
+                file = bore_find_buf_file(curbuf);
                 if (NULL != file)
                     proj_index = file->proj_index;
             }
@@ -2438,6 +4541,8 @@ void ex_Boreopenselection(exarg_T *eap)
     char_u* fn;
     if (!g_bore)
         return;
+    if (*ml_get_curline() == NUL)
+        return;
     fn = vim_strsave(ml_get_curline());
     if (!fn)
         return;
@@ -4,16 +4,18 @@
 
 #define BORE_MAX_SMALL_PATH 256
 #define BORE_MAX_PATH 1024
-#define BORE_SEARCH_JOBS 8
-#define BORE_SEARCH_RESULTS 8
+#define BORE_MAX_SEARCH_THREADS 32
 #define BORE_CACHELINE 64 
 #define BORE_MAXMATCHPERFILE 1000
 #define BORE_MAXMATCHTOTAL 100000
+#define BORE_MAXMATCHLINE 1011 // longest line text kept for a match
+#define BORE_MATCHLINEPOOL 8 * 1024 * 1024 // line texts of all matches of a search
 #define BORE_MAX_SEARCH_EXTENSIONS 9
 #define BORE_HUGEFILE_SIZE 16 * 1024 * 1024
 
 typedef unsigned char u8;
 typedef unsigned int u32;
+typedef unsigned long long u64;
 
 typedef struct bore_alloc_t
 {
@@ -44,6 +46,8 @@ typedef enum
     BS_HUGEFILES = 2,
     BS_PROJECT = 4,
     BS_SORTRESULT = 8,
+    BS_REGEX = 16,
+    BS_PREFETCH = 32,
 } bore_search_option_t;
 
 typedef struct bore_search_t
@@ -62,40 +66,142 @@ typedef struct bore_match_t
     u32 file_index;
     u32 row;
     u32 column;
-    char line[1024 - 12];
+    u32 line; // offset of the line text in bore_matches_t::line_pool
 } bore_match_t;
 
+// Result of a search. Matches on the same line share the line text.
+typedef struct bore_matches_t
+{
+    bore_match_t* match;
+    int match_count;
+    int match_size;     // capacity of match
+    char* line_pool;    // NUL terminated line texts
+    u32 line_pool_used;
+    u32 line_pool_size;
+} bore_matches_t;
+
+#define BORE_MAX_STATS_PHASES 16
+
+// The wall time of a step of a bore command
+typedef struct bore_stats_phase_t
+{
+    const char* name;
+    long long us;
+} bore_stats_phase_t;
+
+// The steps of the last run of a bore command
+typedef struct bore_stats_phases_t
+{
+    int count;
+    bore_stats_phase_t phase[BORE_MAX_STATS_PHASES];
+    long long us;   // from start to end
+    int runs;       // since Vim started
+} bore_stats_phases_t;
+
+// What a search worker did, counted by the worker itself
+typedef struct bore_search_stats_t
+{
+    long long files_searched;       // read and searched
+    long long files_skipped_ext;    // skipped by the extension filter
+    long long files_skipped_proj;   // skipped by the project filter
+    long long files_skipped_index;  // can't contain the string according to the index
+    long long files_failed;         // can't be read, or huge without BS_HUGEFILES
+    long long files_mapped;         // mapped instead of read
+    long long files_truncated;      // had more than BORE_MAXMATCHPERFILE matches
+    long long bytes_read;
+    long long busy_us;
+} bore_search_stats_t;
+
+// Always kept, returned by bore_stats()
+typedef struct bore_stats_t
+{
+    bore_stats_phases_t sln;    // the last boresln
+    int sln_cached;             // it was loaded from the solution cache
+
+    bore_stats_phases_t find;   // the last borefind
+    int find_thread_count;
+    int find_truncated;         // truncated of bore_dofind
+    int find_matches;
+    int find_indexed;           // the trigram index was used
+    long long find_prefetched;  // files opened ahead of the workers
+    bore_search_stats_t find_total;
+    bore_search_stats_t find_thread[BORE_MAX_SEARCH_THREADS];
+} bore_stats_t;
+
+extern bore_stats_t g_bore_stats;
+
 typedef struct bore_ini_t
 {
     int borebuf_height; // Default height of borebuf window
     int cpu_cores; // Max number of cpu cores to be used
 } bore_ini_t;
 
-typedef struct __declspec(align(BORE_CACHELINE)) bore_search_job_t
-{
-    bore_alloc_t filedata;
-    int fileindex;
-} bore_search_job_t;
-
-typedef struct __declspec(align(BORE_CACHELINE)) bore_search_result_t
-{ 
-    int hits;
-    bore_match_t result[BORE_MAXMATCHPERFILE];  
-} bore_search_result_t;
-
 typedef struct bore_file_t
 {
     u32 file;
     u32 proj_index;
 } bore_file_t;
 
+// Modification time and size of a file or directory
+typedef struct bore_file_stamp_t
+{
+    long long mtime;
+    long long size;
+} bore_file_stamp_t;
+
 typedef struct bore_toggle_entry_t
 {
-    u32 basename_hash;
-    int extension_index;
+    u32 basename_hash; // hash of the file name without the toggle suffix
+    int suffix_index;  // the toggle suffix of the file name
     u32 file;
+    u32 next;          // the entry boretoggle goes to, its own index if none
 } bore_toggle_entry_t;
 
+#define BORE_MAX_TOGGLE_SUFFIX 32
+
+// A file name ending boretoggle cycles through, e.g. ".h" or "_test.cpp"
+typedef struct bore_toggle_suffix_t
+{
+    u32 ext_hash; // hash of the extension in the suffix
+    int len;
+    char str[BORE_MAX_TOGGLE_SUFFIX];
+} bore_toggle_suffix_t;
+
+// The files and first level directories below a directory, listed by
+// bore_walk_dir or bore_read_git_index. The paths are relative to the directory.
+typedef struct bore_dir_list_t
+{
+    bore_alloc_t data_alloc; // the paths
+    bore_alloc_t dir_alloc;  // array of u32 offsets of the first level directories, sorted
+    bore_alloc_t file_alloc; // array of bore_file_t, proj_index is 0 for files in the
+                             // directory itself and 1 + the index in dir_alloc otherwise
+    bore_alloc_t subdir_alloc; // array of u32 offsets of all walked directories, ending
+                               // with a separator
+    int dir_count;
+    int file_count;
+    int subdir_count;
+} bore_dir_list_t;
+
+#define BORE_WATCH_ADDED 1   // created or renamed to the path
+#define BORE_WATCH_REMOVED 2 // deleted or renamed from the path
+#define BORE_WATCH_CHANGED 4 // written to
+#define BORE_WATCH_DIR 8     // the path is a directory (not always known)
+
+// A change reported by bore_watch_read
+typedef struct bore_watch_event_t
+{
+    u32 path; // offset in the data, relative to the root of the watch
+    int flags;
+} bore_watch_event_t;
+
+// What bore_t::watch watches
+typedef enum
+{
+    BW_SLN,       // the solution, the projects and the wildcard directories
+    BW_GIT_INDEX, // the git index of a directory solution
+    BW_DIR,       // the directories of a directory solution
+} bore_watch_mode_t;
+
 typedef struct bore_t
 {
     u32 sln_path; // abs path of solution
@@ -117,16 +223,36 @@ typedef struct bore_t
     int file_count;
     bore_alloc_t file_alloc;      // array of bore_file_t sorted by file name
     bore_alloc_t file_ext_alloc;  // array of extension hashes
+    bore_alloc_t file_hash_alloc; // open addressing table of file indices keyed on
+                                  // the case-folded path, ~0u if empty (built on demand)
+    u32 file_hash_mask;
 
-    // array of bore_toggle_entry_t;
+    // array of bore_toggle_suffix_t in toggle order (g:bore_toggle)
+    int toggle_suffix_count;
+    bore_alloc_t toggle_suffix_alloc;
+    u32 toggle_hash; // hash of the suffixes, the toggle index of a cache must match
+
+    // array of bore_toggle_entry_t sorted by basename hash and suffix
     int toggle_entry_count;
     bore_alloc_t toggle_index_alloc;
 
     bore_alloc_t data_alloc; // bulk data (filenames, strings, etc)
 
+    // files and directories the solution was read from (u32 data offsets),
+    // collected when the solution cache is enabled
+    u32 cache_file; // where the solution cache is saved (optional)
+    int dep_count;
+    bore_alloc_t dep_alloc;
+
+    // file system changes, applied to the files before they are used (optional)
+    struct bore_watch_t* watch;
+    int watch_mode;   // bore_watch_mode_t
+    u32 git_index;    // the git index a directory solution is listed from
+    u32 git_prefix;   // the solution directory relative to the work tree, '/' separated
+    u32 exclude_file; // .git/info/exclude when walking a git work tree
+
     // context used for searching
-    bore_search_job_t search[BORE_SEARCH_JOBS];
-    bore_search_result_t search_result[BORE_SEARCH_RESULTS];
+    struct bore_index_t* index; // trigram index, built in the background (optional)
 
     bore_ini_t ini;
 } bore_t;
@@ -138,4 +264,83 @@ void bore_alloc_free(bore_alloc_t* p);
 
 char* bore_str(bore_t* b, u32 offset);
 
-int bore_dofind(bore_t* b, int threadCount, int* truncated, bore_match_t* match, int match_size, bore_search_t* search);
+// Called on the thread calling bore_dofind with the matches [first, first+count)
+// found since the last call (count may be 0) while the search runs. Return
+// non-zero to cancel.
+typedef int (*bore_find_progress_t)(void* ctx, const bore_matches_t* matches, int first, int count);
+
+// Returns the number of matches, or -1 if the BS_REGEX pattern is invalid (an
+// error has been given). truncated is set to 1 if a file had too many matches,
+// 2 if matches is full, and 3 if the search was cancelled.
+int bore_dofind(bore_t* b, int threadCount, int* truncated, bore_matches_t* matches, bore_search_t* search,
+        bore_find_progress_t progress, void* progress_ctx);
+// Get the stamp of a file, -1 if it doesn't exist.
+void bore_get_file_stamp(const char* filename, bore_file_stamp_t* stamp);
+// Build the index in the background. With a filename it is loaded from there
+// if it was saved for the same files, and saved when it is complete.
+void bore_index_start(bore_t* b, const char* filename);
+void bore_index_free(bore_t* b);
+// Stop building the index before the files change. Returns TRUE if it was
+// stopped, then it has to be started again, a complete index is kept.
+int bore_index_stop(bore_t* b);
+// The files changed, old_file_index has the previous index of every file or
+// ~0u for the new ones (which are always searched).
+void bore_index_remap(bore_t* b, const u32* old_file_index);
+// The file was written, it is searched even if the index says it can't
+// contain the string. Only called from the main thread.
+void bore_index_changed(bore_t* b, int file_index);
+
+// Called by deathtrap() for SIGBUS: when this thread is searching a mapped file
+// that was truncated it jumps back to read the file instead.
+void bore_find_sigbus(void);
+// For test_override("bore_truncate").
+void bore_find_truncate_for_testing(int val);
+
+// The number of processors, at least 1.
+int bore_cpu_count(void);
+// The threads borefind searches on, g:bore_search_thread_count or 8.
+int bore_search_thread_count(void);
+// A monotonic clock in microseconds.
+long long bore_time_us(void);
+// Add a step to the bore command that is timed, if any.
+void bore_stats_phase(const char* name, long long us);
+
+// Call proc(ctx, worker, i) for every i in [0, count) on up to thread_count
+// workers (at most BORE_MAX_SEARCH_THREADS), the calling thread is worker 0.
+// The other workers are the threads of borefind, which are started the first
+// time and then kept. Returns when all calls are done. Only call it from the
+// main thread.
+typedef void (*bore_parallel_proc_t)(void* ctx, int worker, int i);
+void bore_parallel_for(int thread_count, int count, bore_parallel_proc_t proc, void* ctx);
+
+int bore_is_excluded_file(const char* path);
+
+// Find the git work tree that dir (ending with a separator) is in. Returns OK
+// and the git directory and the work tree (ending with a separator), or FAIL.
+int bore_find_git_dir(const char* dir, char* git_dir, char* work_tree);
+// List the files in the git index that are below prefix, a directory relative
+// to the work tree ("" or ending with '/'). Returns FAIL if the index can't be
+// read (e.g. a split or sparse index).
+int bore_read_git_index(const char* index_path, const char* prefix, bore_dir_list_t* list);
+// List the files below root (ending with a separator) on up to thread_count
+// threads, skipping the files that bore_is_excluded_file, .gitignore files and
+// exclude_file (optional, a .git/info/exclude file) exclude.
+int bore_walk_dir(const char* root, int thread_count, const char* exclude_file, bore_dir_list_t* list);
+// List the files at the paths below root (relative to it and sorted) like
+// bore_walk_dir would, the directories with everything below them. missing[i]
+// is set to 1 for the paths that don't exist, 0 otherwise.
+int bore_walk_paths(const char* root, const char** paths, int count, int thread_count,
+        const char* exclude_file, bore_dir_list_t* list, char* missing);
+void bore_dir_list_free(bore_dir_list_t* list);
+
+// Watch directories for files that are added and removed, changes are polled
+// with bore_watch_read. With changes, files that are written to are reported
+// too. The paths added and reported are relative to root ("" for absolute
+// paths). With tree the directories below it are watched too, if the system
+// can (Windows), otherwise they have to be added one by one.
+struct bore_watch_t* bore_watch_start(const char* root, int changes);
+int bore_watch_add(struct bore_watch_t* watch, const char* dir, int tree);
+// Append the changes since the last call, returns the number of events or -1
+// if some were lost (everything may have changed).
+int bore_watch_read(struct bore_watch_t* watch, bore_alloc_t* data_alloc, bore_alloc_t* event_alloc);
+void bore_watch_free(struct bore_watch_t* watch);
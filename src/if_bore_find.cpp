@@ -1,13 +1,31 @@
 /* vi:set ts=8 sts=4 sw=4 et: */
 
-#ifdef FEAT_BORE
-
 extern "C" {
 #include "if_bore.h"
 #include "vim.h"
 }
-#include <windows.h>
-#include <winnt.h>
+
+#ifdef FEAT_BORE
+
+#include "if_bore_thread.h"
+#include "if_bore_find.h"
+#include "if_bore_regex.h"
+
+#ifndef MSWIN
+#include <sys/mman.h>
+#endif
+
+// The files a search is about to read are prefetched with io_uring on Linux,
+// by a few blocking threads elsewhere
+#if defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  include <linux/io_uring.h>
+#  include <sys/syscall.h>
+#  if defined(IO_URING_OP_SUPPORTED) && defined(__NR_io_uring_setup)
+#   define BORE_IO_URING
+#  endif
+# endif
+#endif
 
 //#define BORE_CVPROFILE
 
@@ -30,111 +48,26 @@ int g_cv_initialized;
 #define BORE_CVDEINITSPAN
 #endif
 
-#define BTSOUTPUT(j) if (p != out_end) *p++ = j; else goto done;
-struct exact_string_search_t
-{
-    virtual int search(const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const = 0;
-};
-
-struct quick_search_t : public exact_string_search_t
-{
-    quick_search_t(const char *what, int what_len)
-    {
-        /* Preprocessing */
-        pre_qs_bc((const unsigned char*)what, what_len, m_qs_bc);
-    }
-
-    virtual int search (const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const
-    {
-        int j;
-        const unsigned char* x = (const unsigned char*)what;
-        int m = what_len;
-        const unsigned char* y = (const unsigned char*)text;
-        int n = text_len;
-        int* p = out;
-
-        j = 0;
-        while (j <= n - m)
-        {
-            if (memcmp(x, y + j, m) == 0)
-                BTSOUTPUT(j);
-            j += m_qs_bc[y[j + m]];               /* shift */
-        }
-
-done:
-        return p - out;
-    }
-
-private:
-    enum { ASIZE = 256 };
-    int m_qs_bc[ASIZE];
-    void pre_qs_bc(const unsigned char *x, int m, int qs_bc[])
-    {
-        int i;
-
-        for (i = 0; i < ASIZE; ++i)
-            qs_bc[i] = m + 1;
-        for (i = 0; i < m; ++i)
-            qs_bc[x[i]] = m - i;
-    }
-};
-
-struct old_search_t : public exact_string_search_t
-{
-    virtual int search(const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const
-    {
-        // http://www-igm.univ-mlv.fr/~lecroq/string/index.html
-        const char* y = text;
-        int n = text_len;
-        const char* x = what;
-        int m = what_len;
-        int* p = out;
-        int j, k, ell;
-
-        /* Preprocessing */
-        if (x[0] == x[1])
-        {
-            k = 2;
-            ell = 1;
-        }
-        else
-        {
-            k = 1;
-            ell = 2;
-        }
-
-        /* Searching */
-        j = 0;
-        while (j <= n - m)
-        {
-            if (x[1] != y[j + 1])
-                j += k;
-            else
-            {
-                if (memcmp(x + 2, y + j + 2, m - 2) == 0 && x[0] == y[j])
-                {
-                    BTSOUTPUT(j);
-                }
-                j += ell;
-            }
-        }
-done:
-        return p - out;
-    }
-};
-
-#undef BTSOUTPUT
+// How often the matches found so far are handed over while searching
+#define BORE_PROGRESS_INTERVAL_MS 20
 
+// Append a bore_match_t for every offset to match_alloc. The line texts are
+// appended to line_alloc, once for each line with matches.
 static void bore_resolve_match_location(int file_index, const char* p, u32 filesize, 
-        bore_match_t* match, bore_match_t* match_end, int* offset, int offset_count)
+        bore_alloc_t* match_alloc, bore_alloc_t* line_alloc, const int* offset, int offset_count)
 {
     const int* offset_end = offset + offset_count;
     const char* pbegin = p;
     const char* linebegin = p;
     const char* fileend = p + filesize;
     int line = 1;
+    int stored_line = 0;
+    u32 line_offset = 0;
+
+    match_alloc->cursor = match_alloc->base;
+    line_alloc->cursor = line_alloc->base;
 
-    while(offset < offset_end && match < match_end)
+    while(offset < offset_end)
     {
         const char* pend = pbegin + *offset;
         while (p < pend)
@@ -145,18 +78,25 @@ static void bore_resolve_match_location(int file_index, const char* p, u32 files
                 linebegin = p;
             }
         }
-        const char* lineend = pend;
-        while (lineend < fileend && *lineend != '\r' && *lineend != '\n')
-            ++lineend;
-        size_t linelen = lineend - linebegin;
-        if (linelen > sizeof(match->line) - 1)
-            linelen = sizeof(match->line) - 1;
+        if (line != stored_line)
+        {
+            const char* lineend = pend;
+            while (lineend < fileend && *lineend != '\r' && *lineend != '\n')
+                ++lineend;
+            size_t linelen = lineend - linebegin;
+            if (linelen > BORE_MAXMATCHLINE)
+                linelen = BORE_MAXMATCHLINE;
+            line_offset = (u32)(line_alloc->cursor - line_alloc->base);
+            char* text = (char*)bore_alloc(line_alloc, linelen + 1);
+            memcpy(text, linebegin, linelen);
+            text[linelen] = 0;
+            stored_line = line;
+        }
+        bore_match_t* match = (bore_match_t*)bore_alloc(match_alloc, sizeof(bore_match_t));
         match->file_index = file_index;
         match->row = line;
         match->column = p - linebegin;
-        memcpy(match->line, linebegin, linelen);
-        match->line[linelen] = 0;
-        ++match;
+        match->line = line_offset;
         ++offset;
     }
 }
@@ -164,260 +104,2054 @@ static void bore_resolve_match_location(int file_index, const char* p, u32 files
 struct search_context_t 
 {
     bore_t* b;
-    LONG* remaining_file_count;
+    struct bore_search_pool_t* pool;
+    bore_atomic_t* remaining_file_count;
     bore_alloc_t filedata;
-    bore_alloc_t filedata_lowercase;
+    bore_alloc_t file_match;    // bore_match_t of the current file
+    bore_alloc_t file_line;     // line texts of the current file
     const exact_string_search_t* string_search;
     bore_search_t* search;
-    bore_match_t* match;
-    LONG match_size;
-    LONG* match_count;
+    const u64* candidates; // files to search from the trigram index, or NULL
+    bore_matches_t* matches;    // protected by pool->lock
+    bore_atomic_t* cancel;
     int was_truncated;
+    bore_search_stats_t stats;  // of the current search, only this worker writes it
 };
 
-static void search_one_file(struct search_context_t* search_context, const char* filename, int file_index)
+#define BORE_PREFETCH_THREADS 8     // blocking prefetch threads without io_uring
+#define BORE_PREFETCH_DEPTH 128     // io_uring operations in flight
+#define BORE_PREFETCH_WINDOW 1024   // files the prefetch runs ahead of the search
+#define BORE_PREFETCH_SAMPLE_MS 10  // the prefetch starts when the workers read
+#define BORE_PREFETCH_SLOW_FILES 100 // fewer files than this per thread in this time
+
+#ifdef BORE_IO_URING
+// The rings of an io_uring instance, mapped from the kernel
+typedef struct bore_uring_t
+{
+    int fd;
+    unsigned entries;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned to_submit;
+} bore_uring_t;
+#endif
+
+// Worker threads are created once and sleep between searches, also when
+// another solution is opened. Each context runs on its own thread while the
+// thread calling bore_dofind hands over the matches. If no thread could be
+// started the caller runs the first context itself. The prefetch threads open
+// the files ahead of the workers so that the reads of a cold cache overlap.
+// bore_parallel_for runs its calls on the same threads.
+struct bore_search_pool_t
+{
+    int thread_count;       // started threads
+    int requested_thread_count;
+    bore_thread_t threads[BORE_MAX_SEARCH_THREADS];
+    search_context_t contexts[BORE_MAX_SEARCH_THREADS];
+    int prefetch_thread_count;
+    bore_thread_t prefetch_threads[BORE_PREFETCH_THREADS];
+    int prefetch;           // the current search is prefetched
+    bore_atomic_t prefetch_next; // the file before it is prefetched next
+    bore_atomic_t searching;     // workers still searching
+    bore_atomic_t prefetched;    // files opened by the prefetch
+    bore_cond_t searched_cond;   // searching has dropped to 0
+#ifdef BORE_IO_URING
+    bore_uring_t ring;      // used by the only prefetch thread, if fd >= 0
+#endif
+    bore_mutex_t lock;
+    bore_cond_t work_cond;  // a new search has been posted (or quit is set)
+    bore_cond_t done_cond;  // the last busy worker has finished
+    u32 generation;         // incremented for every posted search
+    int busy;               // workers still running the current search
+    int quit;
+    struct bore_parallel_t* parallel; // posted by bore_parallel_for, else a search
+    int in_use;             // a search or bore_parallel_for is running, only
+                            // used by the main thread
+};
+
+static bore_search_pool_t* g_bore_search_pool;
+
+// Files at least this big are mapped instead of read. Smaller ones are
+// cheaper to copy than to map and unmap.
+#define BORE_MAP_MIN_SIZE (256 * 1024)
+
+// The contents of a file, read into a buffer or mapped
+typedef struct bore_file_view_t
+{
+    const char* data;
+    size_t size;
+    void* map;              // the mapped view, NULL if the file was read
+} bore_file_view_t;
+
+// Map the file, or read the whole file into filedata if it is small, can't be
+// mapped or map is FALSE. Close the view with bore_close_file.
+// Returns FAIL if the file can't be read or is huge and hugefiles is not set.
+static int bore_open_file(bore_file_view_t* view, bore_alloc_t* filedata, const char* filename, int hugefiles,
+        int map)
 {
+    int result = FAIL;
+
+    view->data = NULL;
+    view->size = 0;
+    view->map = NULL;
+#ifdef MSWIN
     HANDLE file_handle = INVALID_HANDLE_VALUE;
-    bore_search_result_t search_result = {0};
-    BORE_CVINITSPAN;
+    WCHAR fn[BORE_MAX_PATH];
+    if (0 == MultiByteToWideChar(CP_UTF8, 0, filename, -1, fn, BORE_MAX_PATH))
+        goto done;
 
-    char* start = NULL;
-    int size = 0;
+    file_handle = CreateFileW(fn, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file_handle == INVALID_HANDLE_VALUE)
+        goto done;
 
     {
-        BORE_CVBEGINSPAN("opn"); // CvEnterSpanA(g_series1, &span, "op %s", filename);
-        WCHAR fn[BORE_MAX_PATH];
-        int result = MultiByteToWideChar(CP_UTF8, 0, filename, -1, fn, BORE_MAX_PATH);
-        if (result == 0)
+        DWORD filesize = GetFileSize(file_handle, 0);
+        if (filesize == INVALID_FILE_SIZE)
+            goto done;
+
+        if (!hugefiles && (filesize > BORE_HUGEFILE_SIZE))
+            goto done;
+
+        if (map && filesize >= BORE_MAP_MIN_SIZE)
         {
-            goto skip;
+            // The file can't be truncated while the view is mapped
+            HANDLE map_handle = CreateFileMappingW(file_handle, 0, PAGE_READONLY, 0, 0, 0);
+            if (map_handle)
+            {
+                view->map = MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(map_handle);
+                if (view->map)
+                {
+                    view->data = (const char*)view->map;
+                    view->size = filesize;
+                    result = OK;
+                    goto done;
+                }
+            }
         }
 
-        file_handle = CreateFileW(fn, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
-        if (file_handle == INVALID_HANDLE_VALUE)
+        filedata->cursor = filedata->base;
+        bore_alloc(filedata, filesize);
+
+        char* p = (char*)filedata->base;
+        DWORD remaining = filesize;
+        while(remaining)
         {
-            goto skip;
+            DWORD readbytes;
+            if(!ReadFile(file_handle, p + filesize - remaining, remaining, &readbytes, 0))
+                goto done;
+            remaining -= readbytes;
         }
-        BORE_CVENDSPAN();
+        view->data = p;
+        view->size = filesize;
     }
+    result = OK;
 
-    {
-        BORE_CVBEGINSPAN("rd"); // CvEnterSpanA(g_series1, &span, "rd %s", filename);
-        
+done:
+    if (file_handle != INVALID_HANDLE_VALUE) 
+        CloseHandle(file_handle);
+#else
+    struct stat st;
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        goto done;
 
-        DWORD filesize = GetFileSize(file_handle, 0);
-        if (filesize == INVALID_FILE_SIZE)
-            goto skip;
+    if (0 != fstat(fd, &st) || !S_ISREG(st.st_mode))
+        goto done;
 
-        if (!(search_context->search->options & BS_HUGEFILES) && (filesize > BORE_HUGEFILE_SIZE))
-            goto skip;
+    if (!hugefiles && (st.st_size > BORE_HUGEFILE_SIZE))
+        goto done;
 
-        search_context->filedata.cursor = search_context->filedata.base;
-        bore_alloc(&search_context->filedata, filesize);
+# ifdef POSIX_FADV_SEQUENTIAL
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+# endif
 
+    if (map && st.st_size >= BORE_MAP_MIN_SIZE)
+    {
+        // Faulted in up front, the searches read all of it. A file that is
+        // truncated while it is mapped raises SIGBUS, see bore_scan_file.
+        int flags = MAP_PRIVATE;
+# ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+# endif
+        void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, flags, fd, 0);
+        if (p != MAP_FAILED)
         {
-            char* p = (char*)search_context->filedata.base;
-            DWORD remaining = filesize;
-            while(remaining)
-            {
-                DWORD readbytes;
-                if(!ReadFile(file_handle, p + filesize - remaining, remaining, &readbytes, 0))
-                    goto skip;
-                remaining -= readbytes;
-            }
+# ifdef MADV_SEQUENTIAL
+            (void)madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+# endif
+            view->map = p;
+            view->data = (const char*)p;
+            view->size = (size_t)st.st_size;
+            result = OK;
+            goto done;
         }
+    }
+
+    {
+        size_t filesize = (size_t)st.st_size;
+        filedata->cursor = filedata->base;
+        bore_alloc(filedata, filesize);
 
-        if (search_context->search->options & BS_IGNORECASE)
+        char* p = (char*)filedata->base;
+        size_t offset = 0;
+        while (offset < filesize)
         {
-            search_context->filedata_lowercase.cursor = search_context->filedata_lowercase.base;
-            bore_alloc(&search_context->filedata_lowercase, filesize);
+            ssize_t readbytes = pread(fd, p + offset, filesize - offset, (off_t)offset);
+            if (readbytes < 0 && errno == EINTR)
+                continue;
+            if (readbytes < 0)
+                goto done;
+            if (readbytes == 0)
+                break; // the file shrunk while reading, search what is left
+            offset += readbytes;
+        }
+        filesize = offset;
+        view->data = p;
+        view->size = filesize;
+    }
+    result = OK;
 
-            char* dst = (char*)search_context->filedata_lowercase.base;
-            u8* src = search_context->filedata.base;
-            u8* end = src + filesize;
-            for ( ; src < end; ++src, ++dst)
-                *dst = TOLOWER_LOC(*src);
+done:
+    if (fd >= 0)
+        close(fd);
+#endif
+    return result;
+}
+
+static void bore_close_file(bore_file_view_t* view)
+{
+    if (!view->map)
+        return;
+#ifdef MSWIN
+    UnmapViewOfFile(view->map);
+#else
+    munmap(view->map, view->size);
+#endif
+    view->map = NULL;
+}
+
+// For test_override("bore_truncate"): the files that are mapped are truncated
+// to half their size before they are scanned
+static int bore_truncate_for_testing = FALSE;
+
+void bore_find_truncate_for_testing(int val)
+{
+    bore_truncate_for_testing = val;
+}
+
+#ifndef MSWIN
+// Reading the pages of a mapped file that another program truncated raises
+// SIGBUS in the thread that reads them. deathtrap() calls bore_find_sigbus()
+// in that thread, which jumps back to bore_scan_file if it is scanning one.
+static thread_local sigjmp_buf* volatile bore_scan_jump_env;
+
+void bore_find_sigbus(void)
+{
+    sigjmp_buf* env = bore_scan_jump_env;
+    if (env)
+    {
+        bore_scan_jump_env = NULL;
+        siglongjmp(*env, 1);
+    }
+}
+#endif
 
-            start = (char*)search_context->filedata_lowercase.base;
-            size = search_context->filedata_lowercase.cursor - search_context->filedata_lowercase.base;
+// Call scan(ctx, view) with the contents of the file. When the file is mapped
+// and it is truncated while scan reads it, scan is stopped and called again
+// with what is left of the file, read into filedata. scan must not hold a lock
+// while it reads the view.
+// Returns FAIL if the file can't be read or is huge and hugefiles is not set.
+static int bore_scan_file(bore_alloc_t* filedata, const char* filename, int hugefiles,
+        void (*scan)(void* ctx, const bore_file_view_t* view), void* ctx)
+{
+    bore_file_view_t view;
+    if (FAIL == bore_open_file(&view, filedata, filename, hugefiles, TRUE))
+        return FAIL;
+#ifndef MSWIN
+    if (view.map)
+    {
+        // The signal mask is not saved, it would cost a system call per file
+        sigjmp_buf env;
+        if (sigsetjmp(env, 0) != 0)
+        {
+            // After the jump from deathtrap(): SIGBUS is still blocked
+            sigset_t set;
+            sigemptyset(&set);
+            sigaddset(&set, SIGBUS);
+            pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+            bore_close_file(&view);
+            if (FAIL == bore_open_file(&view, filedata, filename, hugefiles, FALSE))
+                return FAIL;
         }
         else
         {
-            start = (char*)search_context->filedata.base;
-            size = search_context->filedata.cursor - search_context->filedata.base;
+            bore_scan_jump_env = &env;
+            if (bore_truncate_for_testing
+                    && truncate(filename, (off_t)(view.size / 2)) != 0)
+                bore_scan_jump_env = NULL;
         }
-
-        BORE_CVENDSPAN();
     }
+#endif
+    scan(ctx, &view);
+#ifndef MSWIN
+    bore_scan_jump_env = NULL;
+#endif
+    bore_close_file(&view);
+    return OK;
+}
 
+// Trigram index
+//
+// The distinct trigrams of the (lowercased) contents of every file are
+// collected, and every trigram has a posting list of the files that contain
+// it. A search only reads the files that are in the posting lists of all
+// trigrams of the search string, the files that are not indexed and the files
+// that were changed since they were indexed.
+//
+// Files with more than BORE_INDEX_MAX_TRIGRAMS distinct trigrams are not
+// indexed, those are mostly binary files that would be in nearly every posting
+// list. They are always searched, like huge and unreadable files.
+//
+// The complete index is saved when it has a filename, and loaded by the next
+// boresln of the same files. The stamps of the files are compared once when it is built or loaded,
+// later changes are reported by bore_index_changed, so that a search doesn't
+// have to look at the files it skips.
+#define BORE_INDEX_MAX_TRIGRAMS 20000
+#define BORE_INDEX_SET_SIZE 65536   // a power of two, the set of a file stays sparse
+#define BORE_INDEX_MAX_THREADS 4
+#define BORE_INDEX_MAGIC 0x58444942 // "BIDX"
+#define BORE_INDEX_VERSION 2
+
+typedef struct bore_index_header_t
+{
+    u32 magic;
+    u32 version;
+    u32 file_count;
+    u32 path_hash;              // of the paths of the files, in order
+    u32 trigram_count;          // not compared with the expected header
+    u32 posting_count;
+} bore_index_header_t;
+
+typedef struct bore_index_trigram_t
+{
+    u32 trigram;
+    u32 first;                  // its files are the postings up to the first of the next one
+} bore_index_trigram_t;
 
-    {
-        BORE_CVBEGINSPAN("srch");
-
-        // Search for the text
-        int match_offset[BORE_MAXMATCHPERFILE];
-        int match_in_file = search_context->string_search->search(
-                start, 
-                size,
-                search_context->search->what, 
-                search_context->search->what_len, 
-                &match_offset[0], 
-                &match_offset[BORE_MAXMATCHPERFILE]);
+struct bore_index_t
+{
+    bore_t* b;
+    char* filename;             // where the index is saved when it is complete, or NULL
+    int file_count;
+    int words;                  // u64 words in a bitmap of the files
+    u32 trigram_count;
+    bore_index_trigram_t* trigrams; // sorted, and one more with the end of the postings
+    u32* postings;              // file indices of the posting lists
+    u64* unindexed;             // files that are not in the posting lists
+    u32** file_trigrams;        // distinct trigrams of each file indexed since the
+                                // posting lists were built, or NULL
+    u32* file_trigram_count;
+    bore_file_stamp_t* stamp;   // file time and size when it was indexed
+    u64* stale;                 // files that changed while they were indexed or
+                                // before the index was loaded, set by the thread
+    u64* changed;               // files written since, set by the main thread
+    u32* column;                // bit of each file after the files changed, ~0u if
+                                // not indexed (NULL while they are unchanged)
+    bore_thread_t thread;
+    bore_atomic_t next_chunk;   // next 64 files to index
+    bore_atomic_t ready;
+    bore_atomic_t cancel;
+};
 
-        // Fill the result with the line's text, etc.
-        bore_resolve_match_location(
-                file_index, 
-                (char*)search_context->filedata.base, 
-                search_context->filedata.cursor - search_context->filedata.base, 
-                &search_result.result[0], 
-                &search_result.result[BORE_MAXMATCHPERFILE], 
-                match_offset, 
-                match_in_file);
+// The distinct trigrams of the file that is indexed by a thread
+typedef struct bore_index_scan_t
+{
+    u32* set;                   // open addressing, trigram + 1 or 0 for an empty slot
+    u32* slot;                  // the slots of the set that are used
+    int count;                  // BORE_INDEX_MAX_TRIGRAMS + 1 when there are too many
+} bore_index_scan_t;
 
-        if (match_in_file == BORE_MAXMATCHPERFILE)
-            search_context->was_truncated = 1;
+static u32 bore_index_hash(u32 trigram)
+{
+    u32 h = trigram * 0x9E3779B1u;
+    return h ^ (h >> 16);
+}
 
-        search_result.hits = match_in_file;
+void bore_get_file_stamp(const char* filename, bore_file_stamp_t* stamp)
+{
+    stamp->mtime = -1;
+    stamp->size = -1;
+#ifdef MSWIN
+    WCHAR fn[BORE_MAX_PATH];
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (0 == MultiByteToWideChar(CP_UTF8, 0, filename, -1, fn, BORE_MAX_PATH))
+        return;
+    if (!GetFileAttributesExW(fn, GetFileExInfoStandard, &fad))
+        return;
+    stamp->mtime = ((long long)fad.ftLastWriteTime.dwHighDateTime << 32) | fad.ftLastWriteTime.dwLowDateTime;
+    stamp->size = ((long long)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+#else
+    struct stat st;
+    if (0 != stat(filename, &st))
+        return;
+# ifdef __linux__
+    stamp->mtime = (long long)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+# else
+    stamp->mtime = (long long)st.st_mtime;
+# endif
+    stamp->size = (long long)st.st_size;
+#endif
+}
 
-        BORE_CVENDSPAN();
+// Without the set (out of memory) no file is indexed
+static void bore_index_scan_init(bore_index_scan_t* scan)
+{
+    scan->set = (u32*)alloc_clear(sizeof(u32) * BORE_INDEX_SET_SIZE);
+    scan->slot = (u32*)alloc(sizeof(u32) * BORE_INDEX_MAX_TRIGRAMS);
+    scan->count = 0;
+    if (!scan->set || !scan->slot)
+    {
+        VIM_CLEAR(scan->set);
+        VIM_CLEAR(scan->slot);
     }
+}
 
-    {
-        BORE_CVBEGINSPAN("wr");
+static void bore_index_scan_free(bore_index_scan_t* scan)
+{
+    vim_free(scan->set);
+    vim_free(scan->slot);
+}
 
-        LONG start_index = InterlockedExchangeAdd(search_context->match_count, search_result.hits);
+// Collect the distinct trigrams in the view, until there are too many
+static void bore_index_scan(void* ctx, const bore_file_view_t* view)
+{
+    bore_index_scan_t* scan = (bore_index_scan_t*)ctx;
+
+    // Left by the previous file, or by the mapping of this one when it was
+    // truncated
+    for (int i = 0; i < scan->count && i < BORE_INDEX_MAX_TRIGRAMS; ++i)
+        scan->set[scan->slot[i]] = 0;
+    scan->count = 0;
+
+    const u8* p = (const u8*)view->data;
+    const u8* end = p + view->size;
+    u32 trigram = 0;
+    for (int i = 0; p < end; ++p, ++i)
+    {
+        trigram = ((trigram << 8) | bore_fold_ascii(*p)) & 0xffffff;
+        if (i < 2)
+            continue;
 
-        int n = search_result.hits;
-        if (start_index + n >= search_context->match_size)
+        u32 h = bore_index_hash(trigram) & (BORE_INDEX_SET_SIZE - 1);
+        while (scan->set[h] != 0 && scan->set[h] != trigram + 1)
+            h = (h + 1) & (BORE_INDEX_SET_SIZE - 1);
+        if (scan->set[h] != 0)
+            continue;
+        if (scan->count == BORE_INDEX_MAX_TRIGRAMS)
         {
-            search_context->was_truncated = 2; // Out of space. Signal quit.
-            n = search_context->match_size - start_index;
+            ++scan->count;
+            return;
         }
-
-        if (n > 0)
-            memcpy(&search_context->match[start_index], search_result.result, sizeof(bore_match_t) * n);
-
-        BORE_CVENDSPAN();
+        scan->set[h] = trigram + 1;
+        scan->slot[scan->count++] = h;
     }
+}
 
-skip:
-    if (file_handle != INVALID_HANDLE_VALUE) 
+static void bore_index_one_file(bore_index_t* index, int file_index, bore_index_scan_t* scan, bore_alloc_t* filedata)
+{
+    bore_t* b = index->b;
+    bore_file_t* const files = (bore_file_t*)b->file_alloc.base;
+    const char* filename = bore_str(b, files[file_index].file);
+    u32* trigrams = NULL;
+
+    // Take the stamp before reading, a change while indexing makes it stale
+    bore_get_file_stamp(filename, &index->stamp[file_index]);
+
+    if (!scan->set
+            || FAIL == bore_scan_file(filedata, filename, 0, bore_index_scan, scan)
+            || scan->count > BORE_INDEX_MAX_TRIGRAMS
+            || !(trigrams = (u32*)alloc(sizeof(u32) * (scan->count + 1))))
     {
-        CloseHandle(file_handle);
+        // Huge, unreadable and binary files are always searched
+        index->unindexed[file_index >> 6] |= 1ull << (file_index & 63);
+        return;
     }
-    BORE_CVDEINITSPAN;
+
+    for (int i = 0; i < scan->count; ++i)
+        trigrams[i] = scan->set[scan->slot[i]] - 1;
+    index->file_trigrams[file_index] = trigrams;
+    index->file_trigram_count[file_index] = scan->count;
 }
 
-static DWORD WINAPI search_worker(struct search_context_t* search_context)
+// Files are indexed in chunks of 64 so that no two threads write the same word
+static void bore_index_worker(bore_index_t* index)
 {
-    bore_file_t* const files = (bore_file_t*)search_context->b->file_alloc.base;
-    u32 proj_index =
-        search_context->search->options & BS_PROJECT &&
-        ~0u != search_context->search->file_index ?
-        files[search_context->search->file_index].proj_index :
-        ~0u;
+    bore_alloc_t filedata;
+    bore_index_scan_t scan;
+    bore_prealloc(&filedata, 100000);
+    bore_index_scan_init(&scan);
 
-    for (;;)
+    while (!bore_atomic_load(&index->cancel))
     {
-        LONG file_index = InterlockedDecrement(search_context->remaining_file_count);
-        if (file_index < 0)
+        int chunk = (int)bore_atomic_add(&index->next_chunk, 1);
+        int first = chunk * 64;
+        int last = first + 64;
+        if (first >= index->file_count)
             break;
+        if (last > index->file_count)
+            last = index->file_count;
+        for (int i = first; i < last; ++i)
+            bore_index_one_file(index, i, &scan, &filedata);
+    }
 
-        // skip files based on file extension filter
-        if (search_context->search->ext_count > 0)
-        {
-            u32 file_ext = *((u32*)search_context->b->file_ext_alloc.base + file_index);
-            int i;
-            for (i = 0; i < search_context->search->ext_count; ++i)
-            {
-                if (file_ext == search_context->search->ext[i])
-                    break;
-            }
+    bore_index_scan_free(&scan);
+    bore_alloc_free(&filedata);
+}
 
-            if (i == search_context->search->ext_count)
-                continue;
-        }
+BORE_THREAD_PROC(bore_index_worker_thread)
+{
+    bore_index_worker((bore_index_t*)param);
+    BORE_THREAD_RETURN;
+}
 
-        // skip files based on project filter
-        if (proj_index != ~0u && proj_index != files[file_index].proj_index)
-            continue;
+// The number of files of each trigram while the posting lists are built, in
+// an open addressing table that grows
+typedef struct bore_index_count_t
+{
+    u32 trigram;                // + 1, 0 for an empty slot
+    u32 count;                  // files, then where its next file goes in the postings
+} bore_index_count_t;
 
-        search_one_file(search_context, bore_str(search_context->b, files[file_index].file), file_index);
+typedef struct bore_index_counts_t
+{
+    bore_index_count_t* slot;
+    u32 mask;
+    u32 used;
+} bore_index_counts_t;
 
-        if (search_context->was_truncated > 1)
-            break;
+static int bore_index_counts_grow(bore_index_counts_t* counts)
+{
+    u32 mask = counts->slot ? counts->mask * 2 + 1 : 4095;
+    bore_index_count_t* slot = (bore_index_count_t*)alloc_clear(sizeof(bore_index_count_t) * ((size_t)mask + 1));
 
+    if (!slot)
+        return FAIL;
+    for (u32 i = 0; counts->slot && i <= counts->mask; ++i)
+    {
+        if (counts->slot[i].trigram == 0)
+            continue;
+        u32 h = bore_index_hash(counts->slot[i].trigram - 1) & mask;
+        while (slot[h].trigram != 0)
+            h = (h + 1) & mask;
+        slot[h] = counts->slot[i];
     }
-    return 0;
+    vim_free(counts->slot);
+    counts->slot = slot;
+    counts->mask = mask;
+    return OK;
 }
 
-int bore_dofind(bore_t* b, int thread_count, int* truncated_, bore_match_t* match, int match_size, bore_search_t* search)
+// Returns the count of the trigram, added if it is new, or NULL when out of memory
+static bore_index_count_t* bore_index_count(bore_index_counts_t* counts, u32 trigram)
 {
-#ifdef BORE_CVPROFILE
-    if (!g_cv_initialized)
+    u32 h;
+
+    for (;;)
     {
-        GUID guid = { 0x551695cb, 0x80ac, 0x4c14, 0x98, 0x58, 0xec, 0xb9, 0x43, 0x48, 0xd4, 0x3e };
-        CvInitProvider(&guid, &g_provider);
-        CvCreateMarkerSeriesA(g_provider, "bore_find", &g_series1);
-        g_cv_initialized = 1;
+        h = bore_index_hash(trigram) & counts->mask;
+        while (counts->slot[h].trigram != 0 && counts->slot[h].trigram != trigram + 1)
+            h = (h + 1) & counts->mask;
+        if (counts->slot[h].trigram != 0 || (counts->used + 1) * 2 <= counts->mask)
+            break;
+        if (FAIL == bore_index_counts_grow(counts))
+            return NULL;
     }
-#endif  
+    if (counts->slot[h].trigram == 0)
+    {
+        counts->slot[h].trigram = trigram + 1;
+        ++counts->used;
+    }
+    return &counts->slot[h];
+}
 
-    LONG file_count = b->file_count;
-    *truncated_ = 0;    
+static int bore_index_compare_trigram(const void* a, const void* b)
+{
+    u32 ta = ((const bore_index_trigram_t*)a)->trigram;
+    u32 tb = ((const bore_index_trigram_t*)b)->trigram;
+    return ta < tb ? -1 : ta > tb;
+}
 
-    quick_search_t string_search(search->what, search->what_len);
+// Build the posting lists from the trigrams of the files that were indexed.
+// The files in the posting lists that were loaded are kept, except the ones
+// in reindexed (may be NULL).
+static int bore_index_build(bore_index_t* index, const u64* reindexed)
+{
+    bore_index_counts_t counts = {NULL, 0, 0};
+    bore_index_count_t* count;
+    bore_index_trigram_t* trigrams = NULL;
+    u32* postings = NULL;
+    u32 trigram_count = 0;
+    u32 posting_count = 0;
+    u32 i, j, k;
+    int ok = FALSE;
+
+#define BORE_INDEX_KEEP(f) (!reindexed || !(reindexed[(f) >> 6] & (1ull << ((f) & 63))))
+    if (FAIL == bore_index_counts_grow(&counts))
+        return FAIL;
+
+    for (k = 0; k < index->trigram_count; ++k)
+    {
+        u32 n = 0;
+        for (j = index->trigrams[k].first; j < index->trigrams[k + 1].first; ++j)
+            n += BORE_INDEX_KEEP(index->postings[j]);
+        if (n == 0)
+            continue;
+        if (!(count = bore_index_count(&counts, index->trigrams[k].trigram)))
+            goto theend;
+        count->count += n;
+    }
+    for (i = 0; i < (u32)index->file_count; ++i)
+    {
+        for (j = 0; j < index->file_trigram_count[i]; ++j)
+        {
+            if (!(count = bore_index_count(&counts, index->file_trigrams[i][j])))
+                goto theend;
+            ++count->count;
+        }
+    }
 
-    if (thread_count < 1)
+    // The trigrams are sorted for the search, their first posting is where
+    // the files of each are put next
+    trigrams = (bore_index_trigram_t*)alloc(sizeof(bore_index_trigram_t) * ((size_t)counts.used + 1));
+    if (!trigrams)
+        goto theend;
+    for (i = 0; i <= counts.mask; ++i)
     {
-        thread_count = 1;
+        if (counts.slot[i].trigram == 0)
+            continue;
+        trigrams[trigram_count].trigram = counts.slot[i].trigram - 1;
+        trigrams[trigram_count++].first = counts.slot[i].count;
     }
-    else if (thread_count > 32) 
+    qsort(trigrams, trigram_count, sizeof(bore_index_trigram_t), bore_index_compare_trigram);
+    for (k = 0; k < trigram_count; ++k)
     {
-        thread_count = 32;
+        u32 n = trigrams[k].first;
+        trigrams[k].first = posting_count;
+        bore_index_count(&counts, trigrams[k].trigram)->count = posting_count;
+        posting_count += n;
     }
+    trigrams[trigram_count].trigram = ~0u;
+    trigrams[trigram_count].first = posting_count;
 
-    HANDLE threads[32] = {0};
-    search_context_t search_contexts[32] = {0};
-    LONG match_count = 0;
-    for (int i = 0; i < thread_count; ++i) 
+    postings = (u32*)alloc(sizeof(u32) * ((size_t)posting_count + 1));
+    if (!postings)
+        goto theend;
+    for (k = 0; k < index->trigram_count; ++k)
+    {
+        count = NULL;
+        for (j = index->trigrams[k].first; j < index->trigrams[k + 1].first; ++j)
+        {
+            if (!BORE_INDEX_KEEP(index->postings[j]))
+                continue;
+            if (!count)
+                count = bore_index_count(&counts, index->trigrams[k].trigram);
+            postings[count->count++] = index->postings[j];
+        }
+    }
+    for (i = 0; i < (u32)index->file_count; ++i)
+    {
+        for (j = 0; j < index->file_trigram_count[i]; ++j)
+            postings[bore_index_count(&counts, index->file_trigrams[i][j])->count++] = i;
+        VIM_CLEAR(index->file_trigrams[i]);
+        index->file_trigram_count[i] = 0;
+    }
+#undef BORE_INDEX_KEEP
+
+    vim_free(index->trigrams);
+    vim_free(index->postings);
+    index->trigram_count = trigram_count;
+    index->trigrams = trigrams;
+    index->postings = postings;
+    ok = TRUE;
+
+theend:
+    vim_free(counts.slot);
+    if (!ok)
     {
-        search_contexts[i].b = b;
-        search_contexts[i].remaining_file_count = &file_count;
-        bore_prealloc(&search_contexts[i].filedata, 100000);
-        bore_prealloc(&search_contexts[i].filedata_lowercase, 100000);
-        search_contexts[i].string_search = &string_search;
-        search_contexts[i].search = search;
-        search_contexts[i].match = match;
-        search_contexts[i].match_size = match_size;
-        search_contexts[i].match_count = &match_count;
+        vim_free(trigrams);
+        vim_free(postings);
     }
+    return ok ? OK : FAIL;
+}
+
+// FNV-1a of the paths, a saved index is only used for the same files
+static u32 bore_index_path_hash(bore_index_t* index)
+{
+    bore_t* b = index->b;
+    bore_file_t* const files = (bore_file_t*)b->file_alloc.base;
+    u32 h = 2166136261u;
 
-    for (int i = 0; i < thread_count - 1; ++i)
-        threads[i] = CreateThread(0, 0, (LPTHREAD_START_ROUTINE)search_worker, &search_contexts[i], 0, 0);
+    for (int i = 0; i < index->file_count; ++i)
+    {
+        const u8* p = (const u8*)bore_str(b, files[i].file);
+        do
+            h = (h ^ *p) * 16777619u;
+        while (*p++);
+    }
+    return h;
+}
 
-    search_worker(&search_contexts[thread_count - 1]);
+static void bore_index_header(bore_index_t* index, bore_index_header_t* header)
+{
+    memset(header, 0, sizeof(*header));
+    header->magic = BORE_INDEX_MAGIC;
+    header->version = BORE_INDEX_VERSION;
+    header->file_count = index->file_count;
+    header->path_hash = bore_index_path_hash(index);
+    header->trigram_count = index->trigram_count;
+    header->posting_count = index->trigrams ? index->trigrams[index->trigram_count].first : 0;
+}
 
-    WaitForMultipleObjects(thread_count - 1, threads, TRUE, INFINITE);
+// Written to a temporary file and renamed, another Vim may load it meanwhile
+static void bore_index_save(bore_index_t* index)
+{
+    char tmp[BORE_MAX_PATH];
+    bore_index_header_t header;
+    FILE* f;
+    int ok;
+
+    if (!index->filename)
+        return;
+    vim_snprintf(tmp, sizeof(tmp), "%s.tmp", index->filename);
+    f = mch_fopen(tmp, "wb");
+    if (!f)
+        return;
+
+    bore_index_header(index, &header);
+    ok = 1 == fwrite(&header, sizeof(header), 1, f)
+        && 1 == fwrite(index->trigrams, sizeof(bore_index_trigram_t) * (header.trigram_count + 1), 1, f)
+        && (header.posting_count == 0 || 1 == fwrite(index->postings, sizeof(u32) * header.posting_count, 1, f))
+        && 1 == fwrite(index->unindexed, sizeof(u64) * index->words, 1, f)
+        && 1 == fwrite(index->stamp, sizeof(bore_file_stamp_t) * index->file_count, 1, f);
+    ok = 0 == fclose(f) && ok;
+    if (!ok || 0 != mch_rename(tmp, index->filename))
+        mch_remove((char_u*)tmp);
+}
 
-    for (int i = 0; i < thread_count; ++i)
+// Read the index that was saved for the same files. Returns FAIL if there is
+// none, then the index is empty again.
+static int bore_index_load(bore_index_t* index)
+{
+    bore_index_header_t expected;
+    bore_index_header_t header;
+    bore_file_stamp_t stamp;
+    u32 k;
+    int ok;
+    FILE* f;
+
+    if (!index->filename || !(f = mch_fopen(index->filename, "rb")))
+        return FAIL;
+
+    // The counts are checked with the size before anything is allocated
+    bore_index_header(index, &expected);
+    bore_get_file_stamp(index->filename, &stamp);
+    ok = 1 == fread(&header, sizeof(header), 1, f)
+        && 0 == memcmp(&header, &expected, offsetof(bore_index_header_t, trigram_count))
+        && stamp.size == (long long)(sizeof(header)
+                + sizeof(bore_index_trigram_t) * ((long long)header.trigram_count + 1)
+                + sizeof(u32) * (long long)header.posting_count
+                + sizeof(u64) * index->words
+                + sizeof(bore_file_stamp_t) * index->file_count);
+    if (ok)
+    {
+        index->trigrams = (bore_index_trigram_t*)alloc(sizeof(bore_index_trigram_t) * ((size_t)header.trigram_count + 1));
+        index->postings = (u32*)alloc(sizeof(u32) * ((size_t)header.posting_count + 1));
+        ok = index->trigrams && index->postings
+            && 1 == fread(index->trigrams, sizeof(bore_index_trigram_t) * (header.trigram_count + 1), 1, f)
+            && (header.posting_count == 0 || 1 == fread(index->postings, sizeof(u32) * header.posting_count, 1, f))
+            && 1 == fread(index->unindexed, sizeof(u64) * index->words, 1, f)
+            && 1 == fread(index->stamp, sizeof(bore_file_stamp_t) * index->file_count, 1, f)
+            && EOF == fgetc(f);
+    }
+    fclose(f);
+
+    // A damaged index must not point outside of the postings and files
+    ok = ok && index->trigrams[0].first == 0
+        && index->trigrams[header.trigram_count].first == header.posting_count;
+    for (k = 0; ok && k < header.trigram_count; ++k)
+        ok = index->trigrams[k].trigram < index->trigrams[k + 1].trigram
+            && index->trigrams[k].first <= index->trigrams[k + 1].first;
+    for (k = 0; ok && k < header.posting_count; ++k)
+        ok = index->postings[k] < (u32)index->file_count;
+
+    if (!ok)
     {
-        if (search_contexts[i].was_truncated > *truncated_)
-            *truncated_ = search_contexts[i].was_truncated;
+        VIM_CLEAR(index->trigrams);
+        VIM_CLEAR(index->postings);
+        memset(index->unindexed, 0, sizeof(u64) * index->words);
+        return FAIL;
     }
+    index->trigram_count = header.trigram_count;
+    return OK;
+}
 
-    if (*truncated_ > 1)
-        match_count = match_size;
+// Compare the stamps of the files with the ones they were indexed with. The
+// files that changed are indexed again when reindex is set, otherwise they
+// are stale. Returns the number of files that were indexed again.
+static int bore_index_validate(bore_index_t* index, int reindex)
+{
+    bore_t* b = index->b;
+    bore_file_t* const files = (bore_file_t*)b->file_alloc.base;
+    bore_alloc_t filedata;
+    bore_index_scan_t scan;
+    u64* reindexed = NULL;
+    int changed = 0;
 
-    for (int i = 0; i < thread_count; ++i) 
+    if (reindex)
     {
-        bore_alloc_free(&search_contexts[i].filedata);
-        bore_alloc_free(&search_contexts[i].filedata_lowercase);
+        reindexed = (u64*)alloc_clear(sizeof(u64) * index->words);
+        if (!reindexed)
+            reindex = FALSE;
     }
-
-    return match_count;
+    if (reindex)
+    {
+        bore_prealloc(&filedata, 100000);
+        bore_index_scan_init(&scan);
+    }
+    for (int i = 0; i < index->file_count && !bore_atomic_load(&index->cancel); ++i)
+    {
+        bore_file_stamp_t stamp;
+        bore_get_file_stamp(bore_str(b, files[i].file), &stamp);
+        if (stamp.mtime == index->stamp[i].mtime && stamp.size == index->stamp[i].size)
+            continue;
+        ++changed;
+        if (reindex)
+        {
+            reindexed[i >> 6] |= 1ull << (i & 63);
+            index->unindexed[i >> 6] &= ~(1ull << (i & 63));
+            bore_index_one_file(index, i, &scan, &filedata);
+        }
+        else
+            index->stale[i >> 6] |= 1ull << (i & 63);
+    }
+    if (reindex)
+    {
+        bore_index_scan_free(&scan);
+        bore_alloc_free(&filedata);
+        // Without the new posting lists the files are searched, and the index
+        // is not saved
+        if (changed > 0 && FAIL == bore_index_build(index, reindexed))
+        {
+            for (int w = 0; w < index->words; ++w)
+                index->stale[w] |= reindexed[w];
+            changed = 0;
+        }
+        vim_free(reindexed);
+    }
+    return changed;
 }
 
+BORE_THREAD_PROC(bore_index_thread)
+{
+    bore_index_t* index = (bore_index_t*)param;
+    bore_thread_t threads[BORE_INDEX_MAX_THREADS];
+    int thread_count = index->b->ini.cpu_cores;
+    int i, started = 0;
 
-#endif
+    // A saved index only needs the files that changed since
+    if (OK == bore_index_load(index))
+    {
+        if (bore_index_validate(index, TRUE) > 0 && !bore_atomic_load(&index->cancel))
+            bore_index_save(index);
+        if (!bore_atomic_load(&index->cancel))
+            bore_atomic_store(&index->ready, 1);
+        BORE_THREAD_RETURN;
+    }
 
+    if (thread_count > BORE_INDEX_MAX_THREADS)
+        thread_count = BORE_INDEX_MAX_THREADS;
+    for (i = 0; i < thread_count - 1; ++i)
+    {
+        if (!bore_thread_start(&threads[started], bore_index_worker_thread, index))
+            break;
+        ++started;
+    }
+
+    bore_index_worker(index);
+
+    for (i = 0; i < started; ++i)
+        bore_thread_join(threads[i]);
+
+    // Without the posting lists the index is not used
+    if (!bore_atomic_load(&index->cancel) && OK == bore_index_build(index, NULL))
+    {
+        bore_index_save(index);
+        // The files that were written while they were indexed are searched
+        bore_index_validate(index, FALSE);
+        bore_atomic_store(&index->ready, 1);
+    }
+    BORE_THREAD_RETURN;
+}
+
+void bore_index_start(bore_t* b, const char* filename)
+{
+    bore_index_t* index;
+
+    bore_index_free(b);
+    if (b->file_count == 0)
+        return;
+
+    index = (bore_index_t*)alloc_clear(sizeof(bore_index_t));
+    if (!index)
+        return;
+
+    index->b = b;
+    index->file_count = b->file_count;
+    index->words = (b->file_count + 63) / 64;
+    index->filename = *filename ? (char*)vim_strsave((char_u*)filename) : NULL;
+    index->unindexed = (u64*)alloc_clear(sizeof(u64) * index->words);
+    index->file_trigrams = (u32**)alloc_clear(sizeof(u32*) * index->file_count);
+    index->file_trigram_count = (u32*)alloc_clear(sizeof(u32) * index->file_count);
+    index->stamp = (bore_file_stamp_t*)alloc_clear(sizeof(bore_file_stamp_t) * index->file_count);
+    index->stale = (u64*)alloc_clear(sizeof(u64) * index->words);
+    index->changed = (u64*)alloc_clear(sizeof(u64) * index->words);
+    if ((*filename && !index->filename) || !index->unindexed || !index->file_trigrams ||
+            !index->file_trigram_count || !index->stamp || !index->stale || !index->changed ||
+            !bore_thread_start(&index->thread, bore_index_thread, index))
+    {
+        vim_free(index->filename);
+        vim_free(index->unindexed);
+        vim_free(index->file_trigrams);
+        vim_free(index->file_trigram_count);
+        vim_free(index->stamp);
+        vim_free(index->stale);
+        vim_free(index->changed);
+        vim_free(index);
+        return;
+    }
+
+    b->index = index;
+}
+
+void bore_index_free(bore_t* b)
+{
+    bore_index_t* index = b->index;
+    if (!index)
+        return;
+
+    bore_atomic_store(&index->cancel, 1);
+    bore_thread_join(index->thread);
+
+    // Left when it was cancelled before the posting lists were built
+    for (int i = 0; i < index->file_count; ++i)
+        vim_free(index->file_trigrams[i]);
+    vim_free(index->filename);
+    vim_free(index->trigrams);
+    vim_free(index->postings);
+    vim_free(index->unindexed);
+    vim_free(index->file_trigrams);
+    vim_free(index->file_trigram_count);
+    vim_free(index->stamp);
+    vim_free(index->stale);
+    vim_free(index->changed);
+    vim_free(index->column);
+    vim_free(index);
+    b->index = NULL;
+}
+
+void bore_index_changed(bore_t* b, int file_index)
+{
+    bore_index_t* index = b->index;
+    u32 i;
+
+    if (!index)
+        return;
+    i = index->column ? index->column[file_index] : (u32)file_index;
+    if (i != ~0u)
+        index->changed[i >> 6] |= 1ull << (i & 63);
+}
+
+int bore_index_stop(bore_t* b)
+{
+    // The worker threads read the files while indexing
+    if (!b->index || bore_atomic_load(&b->index->ready))
+        return FALSE;
+    bore_index_free(b);
+    return TRUE;
+}
+
+void bore_index_remap(bore_t* b, const u32* old_file_index)
+{
+    bore_index_t* index = b->index;
+    u32* column;
+    int i;
+
+    if (!index)
+        return;
+    column = (u32*)alloc(sizeof(u32) * (b->file_count > 0 ? b->file_count : 1));
+    if (!column)
+    {
+        bore_index_free(b);
+        return;
+    }
+    for (i = 0; i < b->file_count; ++i)
+    {
+        u32 old = old_file_index[i];
+        column[i] = old == ~0u || !index->column ? old : index->column[old];
+    }
+    vim_free(index->column);
+    index->column = column;
+}
+
+struct bore_parallel_t
+{
+    bore_parallel_proc_t proc;
+    void* ctx;
+    int count;
+    int worker_count;       // workers [0, worker_count) make the calls
+    bore_atomic_t next;
+};
+
+static void bore_parallel_worker(bore_parallel_t* parallel, int worker)
+{
+    for (;;)
+    {
+        int i = (int)bore_atomic_add(&parallel->next, 1);
+        if (i >= parallel->count)
+            break;
+        parallel->proc(parallel->ctx, worker, i);
+    }
+}
+
+static const bore_index_trigram_t* bore_index_find(const bore_index_t* index, u32 trigram)
+{
+    u32 lo = 0;
+    u32 hi = index->trigram_count;
+
+    while (lo < hi)
+    {
+        u32 mid = lo + (hi - lo) / 2;
+        if (index->trigrams[mid].trigram < trigram)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < index->trigram_count && index->trigrams[lo].trigram == trigram ? &index->trigrams[lo] : NULL;
+}
+
+// Returns a bitmap of the files that may contain what, or NULL if all files
+// have to be searched.
+static u64* bore_index_candidates(bore_t* b, const char* what, int what_len, int ignorecase)
+{
+    bore_index_t* index = b->index;
+    if (!index || !bore_atomic_load(&index->ready) || what_len < 3)
+        return NULL;
+
+    u64* candidates = (u64*)alloc(sizeof(u64) * index->words);
+    u64* row = (u64*)alloc(sizeof(u64) * index->words);
+    if (!candidates || !row)
+    {
+        vim_free(candidates);
+        vim_free(row);
+        return NULL;
+    }
+    memset(candidates, 0xff, sizeof(u64) * index->words);
+
+    const u8* p = (const u8*)what;
+    u32 trigram = 0;
+    int ascii_run = 0;
+    for (int i = 0; i < what_len; ++i)
+    {
+        trigram = ((trigram << 8) | bore_fold_ascii(p[i])) & 0xffffff;
+        ascii_run = p[i] < 0x80 ? ascii_run + 1 : 0;
+        if (i < 2)
+            continue;
+
+        // Ignoring case, non-ASCII characters may be stored differently in the file
+        if (ignorecase && ascii_run < 3)
+            continue;
+
+        const bore_index_trigram_t* t = bore_index_find(index, trigram);
+        memset(row, 0, sizeof(u64) * index->words);
+        for (u32 j = t ? t[0].first : 0; t && j < t[1].first; ++j)
+            row[index->postings[j] >> 6] |= 1ull << (index->postings[j] & 63);
+        for (int w = 0; w < index->words; ++w)
+            candidates[w] &= row[w];
+    }
+    vim_free(row);
+
+    // The files that are not indexed or changed may contain anything
+    for (int w = 0; w < index->words; ++w)
+        candidates[w] |= index->unindexed[w] | index->stale[w] | index->changed[w];
+
+    return candidates;
+}
+
+static int bore_index_may_contain(const bore_index_t* index, const u64* candidates, int file_index)
+{
+    u32 i = index->column ? index->column[file_index] : (u32)file_index;
+    return i == ~0u || (candidates[i >> 6] & (1ull << (i & 63))) != 0;
+}
+
+// Case-insensitive compare of text with a pattern that contains non-ASCII
+// characters. With a utf-8 'encoding' the characters are case folded, otherwise
+// single bytes are lowercased.
+static int bore_verify_fold(const char* text, const char* text_end, const char* what, int what_len)
+{
+    const char_u* t = (const char_u*)text;
+    const char_u* tend = (const char_u*)text_end;
+    const char_u* w = (const char_u*)what;
+    const char_u* wend = w + what_len;
+
+    while (w < wend)
+    {
+        if (t >= tend)
+            return 0;
+        if (*t < 0x80 && *w < 0x80)
+        {
+            if (bore_fold_ascii(*t++) != *w++)
+                return 0;
+        }
+        else if (!enc_utf8)
+        {
+            if (TOLOWER_LOC(*t++) != TOLOWER_LOC(*w++))
+                return 0;
+        }
+        else
+        {
+            int tlen = utf_ptr2len_len((char_u*)t, (int)(tend - t));
+            int wlen = utf_ptr2len_len((char_u*)w, (int)(wend - w));
+            if (tlen > tend - t || wlen > wend - w)
+                return 0;
+            if (utf_fold(utf_ptr2char((char_u*)t)) != utf_fold(utf_ptr2char((char_u*)w)))
+                return 0;
+            t += tlen;
+            w += wlen;
+        }
+    }
+    return 1;
+}
+
+// One file searched by search_one_file
+typedef struct search_file_t
+{
+    struct search_context_t* search_context;
+    int file_index;
+    int size;
+    int mapped;
+    int hits;
+} search_file_t;
+
+// Search the contents of a file, the matches are put in file_match and
+// file_line
+static void search_one_view(void* ctx, const bore_file_view_t* view)
+{
+    search_file_t* file = (search_file_t*)ctx;
+    search_context_t* search_context = file->search_context;
+    const char* start = view->data;
+    int size = (int)view->size;
+
+    file->size = size;
+    file->mapped = view->map != NULL;
+
+    // Search for the text
+    int match_offset[BORE_MAXMATCHPERFILE];
+    int hits = search_context->string_search->search(
+            start, 
+            size,
+            search_context->search->what, 
+            search_context->search->what_len, 
+            &match_offset[0], 
+            &match_offset[BORE_MAXMATCHPERFILE]);
+
+    // Fill the result with the line's text, etc.
+    bore_resolve_match_location(
+            file->file_index, 
+            start, 
+            size, 
+            &search_context->file_match,
+            &search_context->file_line,
+            match_offset, 
+            hits);
+    file->hits = hits;
+}
+
+static void search_one_file(struct search_context_t* search_context, const char* filename, int file_index)
+{
+    BORE_CVINITSPAN;
+
+    search_file_t file;
+    int hits = 0;
+
+    file.search_context = search_context;
+    file.file_index = file_index;
+
+    {
+        BORE_CVBEGINSPAN("srch"); // CvEnterSpanA(g_series1, &span, "srch %s", filename);
+
+        if (FAIL == bore_scan_file(&search_context->filedata, filename,
+                    search_context->search->options & BS_HUGEFILES, search_one_view, &file))
+        {
+            ++search_context->stats.files_failed;
+            goto skip;
+        }
+
+        hits = file.hits;
+        ++search_context->stats.files_searched;
+        search_context->stats.bytes_read += file.size;
+        if (file.mapped)
+            ++search_context->stats.files_mapped;
+        if (hits == BORE_MAXMATCHPERFILE)
+        {
+            search_context->was_truncated = 1;
+            ++search_context->stats.files_truncated;
+        }
+
+        BORE_CVENDSPAN();
+    }
+
+    if (hits > 0)
+    {
+        BORE_CVBEGINSPAN("wr");
+
+        // Matches are committed under the lock, so that the calling thread
+        // can hand over the committed matches while the search is running
+        const bore_match_t* file_match = (const bore_match_t*)search_context->file_match.base;
+        const char* file_line = (const char*)search_context->file_line.base;
+        bore_matches_t* matches = search_context->matches;
+
+        bore_mutex_lock(&search_context->pool->lock);
+
+        int n = hits;
+        if (matches->match_count + n > matches->match_size)
+            n = matches->match_size - matches->match_count;
+
+        // The line texts are in match order, n matches need the texts up to
+        // the end of the line of the last one
+        u32 line_size = 0;
+        for ( ; n > 0; --n)
+        {
+            line_size = file_match[n - 1].line + (u32)strlen(file_line + file_match[n - 1].line) + 1;
+            if (matches->line_pool_used + line_size <= matches->line_pool_size)
+                break;
+        }
+
+        if (n < hits)
+            search_context->was_truncated = 2; // Out of space. Signal quit.
+
+        if (n > 0)
+        {
+            u32 line_base = matches->line_pool_used;
+            bore_match_t* dst = matches->match + matches->match_count;
+            memcpy(matches->line_pool + line_base, file_line, line_size);
+            for (int i = 0; i < n; ++i)
+            {
+                dst[i] = file_match[i];
+                dst[i].line += line_base;
+            }
+            matches->line_pool_used += line_size;
+            matches->match_count += n;
+        }
+
+        bore_mutex_unlock(&search_context->pool->lock);
+
+        BORE_CVENDSPAN();
+    }
+
+skip:
+    BORE_CVDEINITSPAN;
+}
+
+// The project the search is restricted to, or ~0u
+static u32 search_proj_index(const search_context_t* search_context)
+{
+    bore_file_t* const files = (bore_file_t*)search_context->b->file_alloc.base;
+    return search_context->search->options & BS_PROJECT &&
+        ~0u != search_context->search->file_index ?
+        files[search_context->search->file_index].proj_index :
+        ~0u;
+}
+
+// Returns FALSE if the file is skipped by the filters of the search, which
+// is counted in stats if it is not NULL
+static int search_wants_file(const search_context_t* search_context, int file_index, u32 proj_index,
+        bore_search_stats_t* stats)
+{
+    bore_file_t* const files = (bore_file_t*)search_context->b->file_alloc.base;
+
+    // skip files based on file extension filter
+    if (search_context->search->ext_count > 0)
+    {
+        u32 file_ext = *((u32*)search_context->b->file_ext_alloc.base + file_index);
+        int i;
+        for (i = 0; i < search_context->search->ext_count; ++i)
+        {
+            if (file_ext == search_context->search->ext[i])
+                break;
+        }
+
+        if (i == search_context->search->ext_count)
+        {
+            if (stats)
+                ++stats->files_skipped_ext;
+            return FALSE;
+        }
+    }
+
+    // skip files based on project filter
+    if (proj_index != ~0u && proj_index != files[file_index].proj_index)
+    {
+        if (stats)
+            ++stats->files_skipped_proj;
+        return FALSE;
+    }
+
+    // skip files that can't contain the string according to the index
+    if (search_context->candidates &&
+            !bore_index_may_contain(search_context->b->index, search_context->candidates, file_index))
+    {
+        if (stats)
+            ++stats->files_skipped_index;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void search_worker(struct search_context_t* search_context)
+{
+    bore_file_t* const files = (bore_file_t*)search_context->b->file_alloc.base;
+    u32 proj_index = search_proj_index(search_context);
+    long long start = bore_time_us();
+
+    for (;;)
+    {
+        bore_atomic_t file_index = bore_atomic_dec(search_context->remaining_file_count);
+        if (file_index < 0)
+            break;
+
+        if (!search_wants_file(search_context, file_index, proj_index, &search_context->stats))
+            continue;
+
+        search_one_file(search_context, bore_str(search_context->b, files[file_index].file), file_index);
+
+        if (search_context->was_truncated > 1 || bore_atomic_load(search_context->cancel))
+            break;
+    }
+    search_context->stats.busy_us = bore_time_us() - start;
+}
+
+// Wait while the workers read the files from the cache, prefetching would
+// only add to their work. Returns FALSE when the search is over.
+static int bore_prefetch_wait_for_disk(bore_search_pool_t* pool)
+{
+    search_context_t* search_context = &pool->contexts[0];
+    int searching;
+
+    for (;;)
+    {
+        bore_atomic_t before = bore_atomic_load(search_context->remaining_file_count);
+        bore_mutex_lock(&pool->lock);
+        if (bore_atomic_load(&pool->searching) > 0)
+            bore_cond_wait_ms(&pool->searched_cond, &pool->lock, BORE_PREFETCH_SAMPLE_MS);
+        searching = bore_atomic_load(&pool->searching) > 0;
+        bore_mutex_unlock(&pool->lock);
+        if (!searching || bore_atomic_load(search_context->cancel))
+            return FALSE;
+        bore_atomic_t after = bore_atomic_load(search_context->remaining_file_count);
+        if (before - after < (bore_atomic_t)BORE_PREFETCH_SLOW_FILES * pool->thread_count)
+            return TRUE;
+    }
+}
+
+#ifdef BORE_IO_URING
+static int bore_uring_init(bore_uring_t* ring, unsigned entries)
+{
+    struct io_uring_params params;
+    u64 probe_buf[(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op)) / sizeof(u64) + 1];
+    struct io_uring_probe* probe = (struct io_uring_probe*)probe_buf;
+    static const int required_ops[] = { IORING_OP_OPENAT, IORING_OP_FADVISE, IORING_OP_CLOSE };
+    u8* sq;
+    u8* cq;
+    size_t i;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0)
+        return FAIL; // not supported, or disabled (e.g. by seccomp)
+
+    memset(probe_buf, 0, sizeof(probe_buf));
+    if (0 != syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256))
+        goto fail;
+    for (i = 0; i < sizeof(required_ops) / sizeof(required_ops[0]); ++i)
+        if (required_ops[i] > probe->last_op || !(probe->ops[required_ops[i]].flags & IO_URING_OP_SUPPORTED))
+            goto fail;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cq_ring_size > ring->sq_ring_size)
+            ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = 0;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED)
+    {
+        ring->sq_ring = NULL;
+        goto fail;
+    }
+    if (ring->cq_ring_size)
+    {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED)
+        {
+            ring->cq_ring = NULL;
+            goto fail;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    sq = (u8*)ring->sq_ring;
+    cq = ring->cq_ring ? (u8*)ring->cq_ring : sq;
+    ring->entries = params.sq_entries;
+    ring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return OK;
+
+fail:
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    return FAIL;
+}
+
+static void bore_uring_free(bore_uring_t* ring)
+{
+    if (ring->fd < 0)
+        return;
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+// The next free submission entry, cleared. The caller keeps the number of
+// operations in flight below the size of the ring.
+static struct io_uring_sqe* bore_uring_get_sqe(bore_uring_t* ring)
+{
+    unsigned tail = *ring->sq_tail + ring->to_submit;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ++ring->to_submit;
+    return sqe;
+}
+
+// Submit the queued entries and wait for at least wait_count completions
+static int bore_uring_submit(bore_uring_t* ring, unsigned wait_count)
+{
+    __atomic_store_n(ring->sq_tail, *ring->sq_tail + ring->to_submit, __ATOMIC_RELEASE);
+    for (;;)
+    {
+        long submitted = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait_count,
+                wait_count ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (submitted >= 0)
+        {
+            ring->to_submit -= (unsigned)submitted;
+            if (ring->to_submit == 0 || wait_count)
+                return OK;
+        }
+        else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return FAIL;
+    }
+}
+
+enum
+{
+    BORE_PREFETCH_OPEN,
+    BORE_PREFETCH_FADVISE,
+    BORE_PREFETCH_CLOSE,
+};
+
+// Keep opening the files the workers read next, and start reading each file
+// ahead (fadvise WILLNEED) when it is open. Nothing waits on the disk here but
+// the kernel, so many reads are in flight at once.
+static void bore_prefetch_uring(bore_search_pool_t* pool)
+{
+    bore_uring_t* ring = &pool->ring;
+    search_context_t* search_context = &pool->contexts[0];
+    bore_file_t* const files = (bore_file_t*)search_context->b->file_alloc.base;
+    u32 proj_index = search_proj_index(search_context);
+    off_t advise_len = (search_context->search->options & BS_HUGEFILES) ? 0 : BORE_HUGEFILE_SIZE;
+    bore_atomic_t next = bore_atomic_load(&pool->prefetch_next);
+    int inflight = 0;
+    int done = FALSE;
+
+    if (!bore_prefetch_wait_for_disk(pool))
+        return;
+
+    for (;;)
+    {
+        bore_atomic_t cursor = bore_atomic_load(search_context->remaining_file_count);
+
+        if (!bore_atomic_load(&pool->searching) || bore_atomic_load(search_context->cancel))
+            done = TRUE;
+        if (next > cursor)
+            next = cursor; // the workers are ahead
+        while (!done && inflight + 3 <= BORE_PREFETCH_DEPTH && next > 0 && next > cursor - BORE_PREFETCH_WINDOW)
+        {
+            --next;
+            if (!search_wants_file(search_context, (int)next, proj_index, NULL))
+                continue;
+            struct io_uring_sqe* sqe = bore_uring_get_sqe(ring);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (u64)(size_t)bore_str(search_context->b, files[next].file);
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe->user_data = BORE_PREFETCH_OPEN;
+            ++inflight;
+            bore_atomic_add(&pool->prefetched, 1);
+        }
+        if (next <= 0)
+            done = TRUE;
+        if (inflight == 0)
+        {
+            if (done)
+                break;
+            bore_sleep_ms(1); // the workers are far behind
+            continue;
+        }
+
+        if (FAIL == bore_uring_submit(ring, 1))
+            break;
+
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head)
+        {
+            const struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+            --inflight;
+            if (cqe->user_data == BORE_PREFETCH_OPEN && cqe->res >= 0)
+            {
+                // The close must run after the advice, also when it fails
+                struct io_uring_sqe* sqe = bore_uring_get_sqe(ring);
+                sqe->opcode = IORING_OP_FADVISE;
+                sqe->fd = cqe->res;
+                sqe->len = (u32)advise_len;
+                sqe->fadvise_advice = POSIX_FADV_WILLNEED;
+                sqe->flags = IOSQE_IO_HARDLINK;
+                sqe->user_data = BORE_PREFETCH_FADVISE;
+                sqe = bore_uring_get_sqe(ring);
+                sqe->opcode = IORING_OP_CLOSE;
+                sqe->fd = cqe->res;
+                sqe->user_data = BORE_PREFETCH_CLOSE;
+                inflight += 2;
+            }
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+#endif
+
+// Start reading a file into the cache without waiting for it
+static void bore_prefetch_file(const char* filename, int hugefiles, char* buf, size_t buf_size)
+{
+#ifdef MSWIN
+    // There is no read ahead hint for a file that isn't read, so it is read
+    WCHAR fn[BORE_MAX_PATH];
+    HANDLE file_handle;
+    DWORD readbytes;
+    if (0 == MultiByteToWideChar(CP_UTF8, 0, filename, -1, fn, BORE_MAX_PATH))
+        return;
+    file_handle = CreateFileW(fn, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file_handle == INVALID_HANDLE_VALUE)
+        return;
+    if (hugefiles || GetFileSize(file_handle, 0) <= BORE_HUGEFILE_SIZE)
+        while (ReadFile(file_handle, buf, (DWORD)buf_size, &readbytes, 0) && readbytes > 0)
+            ;
+    CloseHandle(file_handle);
+#else
+    struct stat st;
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+# ifdef POSIX_FADV_WILLNEED
+    if (0 == fstat(fd, &st) && S_ISREG(st.st_mode) && (hugefiles || st.st_size <= BORE_HUGEFILE_SIZE))
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+# endif
+    close(fd);
+#endif
+}
+
+// One of the blocking prefetch threads, used without io_uring
+static void bore_prefetch_blocking(bore_search_pool_t* pool)
+{
+    search_context_t* search_context = &pool->contexts[0];
+    bore_file_t* const files = (bore_file_t*)search_context->b->file_alloc.base;
+    u32 proj_index = search_proj_index(search_context);
+    int hugefiles = search_context->search->options & BS_HUGEFILES;
+    char* buf = NULL;
+    size_t buf_size = 0;
+
+    if (!bore_prefetch_wait_for_disk(pool))
+        return;
+#ifdef MSWIN
+    buf_size = 64 * 1024;
+    buf = (char*)alloc(buf_size);
+    if (!buf)
+        return;
+#endif
+    for (;;)
+    {
+        bore_atomic_t file_index = bore_atomic_dec(&pool->prefetch_next);
+        bore_atomic_t cursor;
+        if (file_index < 0)
+            break;
+
+        // Wait for the workers to come close
+        for (;;)
+        {
+            cursor = bore_atomic_load(search_context->remaining_file_count);
+            if (file_index >= cursor - BORE_PREFETCH_WINDOW
+                    || !bore_atomic_load(&pool->searching) || bore_atomic_load(search_context->cancel))
+                break;
+            bore_sleep_ms(1);
+        }
+        if (!bore_atomic_load(&pool->searching) || bore_atomic_load(search_context->cancel))
+            break;
+        if (file_index >= cursor)
+            continue; // already read by a worker
+
+        if (search_wants_file(search_context, (int)file_index, proj_index, NULL))
+        {
+            bore_prefetch_file(bore_str(search_context->b, files[file_index].file), hugefiles, buf, buf_size);
+            bore_atomic_add(&pool->prefetched, 1);
+        }
+    }
+    vim_free(buf);
+}
+
+static void prefetch_pool_worker(bore_search_pool_t* pool)
+{
+    u32 generation = 0;
+
+    for (;;)
+    {
+        bore_mutex_lock(&pool->lock);
+        while (!pool->quit && (pool->generation == generation || !pool->prefetch))
+        {
+            generation = pool->generation;
+            bore_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        generation = pool->generation;
+        int quit = pool->quit;
+        bore_mutex_unlock(&pool->lock);
+
+        if (quit)
+            break;
+
+#ifdef BORE_IO_URING
+        if (pool->ring.fd >= 0)
+            bore_prefetch_uring(pool);
+        else
+#endif
+            bore_prefetch_blocking(pool);
+
+        bore_mutex_lock(&pool->lock);
+        if (0 == --pool->busy)
+            bore_cond_signal(&pool->done_cond);
+        bore_mutex_unlock(&pool->lock);
+    }
+}
+
+BORE_THREAD_PROC(prefetch_pool_thread)
+{
+    prefetch_pool_worker((bore_search_pool_t*)param);
+    BORE_THREAD_RETURN;
+}
+
+static void search_pool_worker(struct search_context_t* search_context)
+{
+    bore_search_pool_t* pool = search_context->pool;
+    u32 generation = 0;
+
+    for (;;)
+    {
+        bore_mutex_lock(&pool->lock);
+        while (!pool->quit && pool->generation == generation)
+            bore_cond_wait(&pool->work_cond, &pool->lock);
+        generation = pool->generation;
+        int quit = pool->quit;
+        bore_parallel_t* parallel = pool->parallel;
+        bore_mutex_unlock(&pool->lock);
+
+        if (quit)
+            break;
+
+        // The thread calling bore_parallel_for is worker 0
+        if (parallel)
+        {
+            int worker = (int)(search_context - pool->contexts) + 1;
+            if (worker < parallel->worker_count)
+                bore_parallel_worker(parallel, worker);
+        }
+        else
+            search_worker(search_context);
+
+        bore_mutex_lock(&pool->lock);
+        if (!parallel && 0 == bore_atomic_dec(&pool->searching))
+            bore_cond_broadcast(&pool->searched_cond);
+        if (0 == --pool->busy)
+            bore_cond_signal(&pool->done_cond);
+        bore_mutex_unlock(&pool->lock);
+    }
+}
+
+BORE_THREAD_PROC(search_pool_thread)
+{
+    search_pool_worker((struct search_context_t*)param);
+    BORE_THREAD_RETURN;
+}
+
+static void bore_search_pool_destroy(bore_search_pool_t* pool)
+{
+    int i;
+
+    bore_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    bore_cond_broadcast(&pool->work_cond);
+    bore_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->thread_count; ++i)
+        bore_thread_join(pool->threads[i]);
+    for (i = 0; i < pool->prefetch_thread_count; ++i)
+        bore_thread_join(pool->prefetch_threads[i]);
+#ifdef BORE_IO_URING
+    bore_uring_free(&pool->ring);
+#endif
+
+    for (i = 0; i < pool->thread_count || i == 0; ++i)
+    {
+        bore_alloc_free(&pool->contexts[i].filedata);
+        bore_alloc_free(&pool->contexts[i].file_match);
+        bore_alloc_free(&pool->contexts[i].file_line);
+    }
+
+    bore_cond_destroy(&pool->searched_cond);
+    bore_cond_destroy(&pool->done_cond);
+    bore_cond_destroy(&pool->work_cond);
+    bore_mutex_destroy(&pool->lock);
+    vim_free(pool);
+}
+
+static bore_search_pool_t* bore_search_pool_create(int thread_count)
+{
+    bore_search_pool_t* pool = (bore_search_pool_t*)alloc_clear(sizeof(bore_search_pool_t));
+    int i;
+
+    if (!pool)
+        return NULL;
+#ifdef BORE_IO_URING
+    pool->ring.fd = -1;
+#endif
+
+    bore_mutex_init(&pool->lock);
+    bore_cond_init(&pool->work_cond);
+    bore_cond_init(&pool->done_cond);
+    bore_cond_init(&pool->searched_cond);
+
+    for (i = 0; i < thread_count; ++i)
+    {
+        pool->contexts[i].pool = pool;
+        bore_prealloc(&pool->contexts[i].filedata, 100000);
+        bore_prealloc(&pool->contexts[i].file_match, sizeof(bore_match_t) * 64);
+        bore_prealloc(&pool->contexts[i].file_line, 64 * 128);
+    }
+
+    for (i = 0; i < thread_count; ++i)
+    {
+        if (!bore_thread_start(&pool->threads[i], search_pool_thread, &pool->contexts[i]))
+            break;
+        ++pool->thread_count;
+    }
+
+    // With io_uring one thread keeps many files in flight
+    if (pool->thread_count > 0)
+    {
+        int prefetch_thread_count = BORE_PREFETCH_THREADS;
+#ifdef BORE_IO_URING
+        // An open is followed by two operations, their entries are queued
+        // while the others are still in flight
+        if (OK == bore_uring_init(&pool->ring, BORE_PREFETCH_DEPTH * 4))
+            prefetch_thread_count = 1;
+#endif
+        for (i = 0; i < prefetch_thread_count; ++i)
+        {
+            if (!bore_thread_start(&pool->prefetch_threads[i], prefetch_pool_thread, pool))
+                break;
+            ++pool->prefetch_thread_count;
+        }
+    }
+
+    // Could not start all threads, keep the first context for the caller
+    pool->requested_thread_count = thread_count;
+    for (i = pool->thread_count > 0 ? pool->thread_count : 1; i < thread_count; ++i)
+    {
+        bore_alloc_free(&pool->contexts[i].filedata);
+        bore_alloc_free(&pool->contexts[i].file_match);
+        bore_alloc_free(&pool->contexts[i].file_line);
+    }
+
+    return pool;
+}
+
+void bore_parallel_for(int thread_count, int count, bore_parallel_proc_t proc, void* ctx)
+{
+    bore_search_pool_t* pool = g_bore_search_pool;
+    bore_parallel_t parallel;
+
+    parallel.proc = proc;
+    parallel.ctx = ctx;
+    parallel.count = count;
+    parallel.worker_count = 1;
+    parallel.next = 0;
+
+    if (thread_count > count)
+        thread_count = count;
+    if (thread_count > BORE_MAX_SEARCH_THREADS)
+        thread_count = BORE_MAX_SEARCH_THREADS;
+    if (thread_count > 1 && !pool)
+        pool = g_bore_search_pool = bore_search_pool_create(bore_search_thread_count());
+
+    // Not while a search runs autocommands that get here
+    if (thread_count < 2 || !pool || pool->in_use || pool->thread_count == 0)
+    {
+        bore_parallel_worker(&parallel, 0);
+        return;
+    }
+
+    parallel.worker_count = thread_count <= pool->thread_count ? thread_count : pool->thread_count + 1;
+    pool->in_use = 1;
+    bore_mutex_lock(&pool->lock);
+    pool->parallel = &parallel;
+    pool->prefetch = 0;
+    pool->busy = pool->thread_count;
+    ++pool->generation;
+    bore_cond_broadcast(&pool->work_cond);
+    bore_mutex_unlock(&pool->lock);
+
+    bore_parallel_worker(&parallel, 0);
+
+    bore_mutex_lock(&pool->lock);
+    while (pool->busy > 0)
+        bore_cond_wait(&pool->done_cond, &pool->lock);
+    pool->parallel = NULL;
+    bore_mutex_unlock(&pool->lock);
+    pool->in_use = 0;
+}
+
+int bore_dofind(bore_t* b, int thread_count, int* truncated_, bore_matches_t* matches, bore_search_t* search,
+        bore_find_progress_t progress, void* progress_ctx)
+{
+#ifdef BORE_CVPROFILE
+    if (!g_cv_initialized)
+    {
+        GUID guid = { 0x551695cb, 0x80ac, 0x4c14, 0x98, 0x58, 0xec, 0xb9, 0x43, 0x48, 0xd4, 0x3e };
+        CvInitProvider(&guid, &g_provider);
+        CvCreateMarkerSeriesA(g_provider, "bore_find", &g_series1);
+        g_cv_initialized = 1;
+    }
+#endif  
+
+    bore_atomic_t file_count = b->file_count;
+    *truncated_ = 0;    
+
+    static int kernel = -1;
+    if (kernel < 0)
+        kernel = bore_search_kernel_detect();
+
+    // A regex is searched for in the lines that contain its literal
+    const char* what = search->what;
+    int what_len = search->what_len;
+    int ignorecase = search->options & BS_IGNORECASE;
+    bore_regex_t regex;
+    regex_search_t regex_search[BORE_MAX_SEARCH_THREADS];
+    if (search->options & BS_REGEX)
+    {
+        const char* error = regex.compile(search->what, search->what_len, ignorecase);
+        if (error)
+        {
+            semsg(_("borefind: %s: %s"), error, search->what);
+            return -1;
+        }
+        what = regex.literal;
+        what_len = regex.literal_len;
+        ignorecase = regex.ignorecase;
+    }
+
+    bore_string_search_t string_search(what, what_len,
+            ignorecase, (bore_search_kernel_t)kernel, bore_verify_fold);
+
+    if (thread_count < 1)
+    {
+        thread_count = 1;
+    }
+    else if (thread_count > BORE_MAX_SEARCH_THREADS) 
+    {
+        thread_count = BORE_MAX_SEARCH_THREADS;
+    }
+
+    // (Re)create the workers the first time or when the thread count changed
+    if (g_bore_search_pool && g_bore_search_pool->requested_thread_count != thread_count)
+    {
+        bore_search_pool_destroy(g_bore_search_pool);
+        g_bore_search_pool = NULL;
+    }
+    if (!g_bore_search_pool)
+        g_bore_search_pool = bore_search_pool_create(thread_count);
+    if (!g_bore_search_pool)
+        return 0;
+
+    bore_search_pool_t* pool = g_bore_search_pool;
+    int context_count = pool->thread_count > 0 ? pool->thread_count : 1;
+
+    long long phase_start = bore_time_us();
+    u64* candidates = bore_index_candidates(b, what, what_len, ignorecase);
+    if (candidates)
+        bore_stats_phase("bore_index_candidates", bore_time_us() - phase_start);
+    phase_start = bore_time_us();
+
+    bore_atomic_t cancel = 0;
+    int delivered = 0;
+    matches->match_count = 0;
+    matches->line_pool_used = 0;
+    for (int i = 0; i < context_count; ++i) 
+    {
+        search_context_t* search_context = &pool->contexts[i];
+        search_context->b = b;
+        search_context->remaining_file_count = &file_count;
+        search_context->string_search = string_search.get();
+        if (search->options & BS_REGEX)
+        {
+            regex_search[i].init(&regex, string_search.get());
+            search_context->string_search = &regex_search[i];
+        }
+        search_context->search = search;
+        search_context->candidates = candidates;
+        search_context->matches = matches;
+        search_context->cancel = &cancel;
+        search_context->was_truncated = 0;
+        memset(&search_context->stats, 0, sizeof(search_context->stats));
+    }
+
+    pool->in_use = 1;
+    if (pool->thread_count > 0)
+    {
+        bore_mutex_lock(&pool->lock);
+        pool->prefetch = (search->options & BS_PREFETCH) && pool->prefetch_thread_count > 0;
+        pool->prefetch_next = file_count;
+        pool->prefetched = 0;
+        pool->searching = pool->thread_count;
+        pool->busy = pool->thread_count + (pool->prefetch ? pool->prefetch_thread_count : 0);
+        ++pool->generation;
+        bore_cond_broadcast(&pool->work_cond);
+
+        // Hand over the matches found so far while the workers are searching
+        while (pool->busy > 0)
+        {
+            bore_cond_wait_ms(&pool->done_cond, &pool->lock, BORE_PROGRESS_INTERVAL_MS);
+            if (!progress)
+                continue;
+
+            int available = matches->match_count;
+            bore_mutex_unlock(&pool->lock);
+            if (progress(progress_ctx, matches, delivered, available - delivered))
+                bore_atomic_store(&cancel, 1);
+            delivered = available;
+            bore_mutex_lock(&pool->lock);
+        }
+        bore_mutex_unlock(&pool->lock);
+    }
+    else
+    {
+        search_worker(&pool->contexts[0]);
+    }
+    pool->in_use = 0;
+
+    bore_stats_phase("bore_search", bore_time_us() - phase_start);
+
+    bore_search_stats_t* total = &g_bore_stats.find_total;
+    memset(total, 0, sizeof(*total));
+    g_bore_stats.find_thread_count = context_count;
+    g_bore_stats.find_indexed = candidates != NULL;
+    g_bore_stats.find_prefetched = pool->thread_count > 0 ? pool->prefetched : 0;
+    vim_free(candidates);
+
+    for (int i = 0; i < context_count; ++i)
+    {
+        const bore_search_stats_t* stats = &pool->contexts[i].stats;
+        g_bore_stats.find_thread[i] = *stats;
+        total->files_searched += stats->files_searched;
+        total->files_skipped_ext += stats->files_skipped_ext;
+        total->files_skipped_proj += stats->files_skipped_proj;
+        total->files_skipped_index += stats->files_skipped_index;
+        total->files_failed += stats->files_failed;
+        total->files_mapped += stats->files_mapped;
+        total->files_truncated += stats->files_truncated;
+        total->bytes_read += stats->bytes_read;
+        total->busy_us += stats->busy_us;
+
+        if (pool->contexts[i].was_truncated > *truncated_)
+            *truncated_ = pool->contexts[i].was_truncated;
+    }
+    if (cancel)
+        *truncated_ = 3;
+
+    if (progress && matches->match_count > delivered)
+        progress(progress_ctx, matches, delivered, matches->match_count - delivered);
+
+    return matches->match_count;
+}
+
+
+#endif
@@ -0,0 +1,467 @@
+/* vi:set ts=8 sts=4 sw=4 et: */
+// String search kernels used by if_bore_find.cpp.
+// Kept free of vim dependencies so that bore_find_bench.cpp can include it.
+#pragma once
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BORE_SEARCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BORE_TARGET_SSE2
+#define BORE_TARGET_AVX2
+static int bore_search_ctz(unsigned x) { unsigned long i; _BitScanForward(&i, x); return (int)i; }
+#else
+#define BORE_TARGET_SSE2 __attribute__((target("sse2")))
+#define BORE_TARGET_AVX2 __attribute__((target("avx2")))
+#define bore_search_ctz(x) __builtin_ctz(x)
+#endif
+#endif
+
+#define BTSOUTPUT(j) if (p != out_end) *p++ = j; else goto done;
+struct exact_string_search_t
+{
+    virtual int search(const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const = 0;
+};
+
+struct quick_search_t : public exact_string_search_t
+{
+    quick_search_t(const char *what, int what_len)
+    {
+        /* Preprocessing */
+        pre_qs_bc((const unsigned char*)what, what_len, m_qs_bc);
+    }
+
+    virtual int search (const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const
+    {
+        int j;
+        const unsigned char* x = (const unsigned char*)what;
+        int m = what_len;
+        const unsigned char* y = (const unsigned char*)text;
+        int n = text_len;
+        int* p = out;
+
+        j = 0;
+        while (j <= n - m)
+        {
+            if (memcmp(x, y + j, m) == 0)
+            {
+                BTSOUTPUT(j);
+            }
+            j += m_qs_bc[y[j + m]];               /* shift */
+        }
+
+done:
+        return p - out;
+    }
+
+private:
+    enum { ASIZE = 256 };
+    int m_qs_bc[ASIZE];
+    void pre_qs_bc(const unsigned char *x, int m, int qs_bc[])
+    {
+        int i;
+
+        for (i = 0; i < ASIZE; ++i)
+            qs_bc[i] = m + 1;
+        for (i = 0; i < m; ++i)
+            qs_bc[x[i]] = m - i;
+    }
+};
+
+struct old_search_t : public exact_string_search_t
+{
+    virtual int search(const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const
+    {
+        // http://www-igm.univ-mlv.fr/~lecroq/string/index.html
+        const char* y = text;
+        int n = text_len;
+        const char* x = what;
+        int m = what_len;
+        int* p = out;
+        int j, k, ell;
+
+        /* Preprocessing */
+        if (x[0] == x[1])
+        {
+            k = 2;
+            ell = 1;
+        }
+        else
+        {
+            k = 1;
+            ell = 2;
+        }
+
+        /* Searching */
+        j = 0;
+        while (j <= n - m)
+        {
+            if (x[1] != y[j + 1])
+                j += k;
+            else
+            {
+                if (memcmp(x + 2, y + j + 2, m - 2) == 0 && x[0] == y[j])
+                {
+                    BTSOUTPUT(j);
+                }
+                j += ell;
+            }
+        }
+done:
+        return p - out;
+    }
+};
+
+#ifdef BORE_SEARCH_X86
+// First-and-last-byte filter (Wojciech Mula, "SIMD-friendly algorithms for
+// substring searching"). A block of positions is compared against the first and
+// the last byte of the pattern at once, and only the positions where both match
+// are verified with memcmp. Reports all (also overlapping) matches in order, like
+// quick_search_t.
+#define BORE_SIMD_VERIFY(k) \
+    { \
+        if (m <= 2 || memcmp(text + (k) + 1, what + 1, m - 2) == 0) \
+        { \
+            BTSOUTPUT(k); \
+        } \
+    }
+
+struct sse2_search_t : public exact_string_search_t
+{
+    BORE_TARGET_SSE2 virtual int search(const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const
+    {
+        const int m = what_len;
+        const int n = text_len;
+        int* p = out;
+        int j = 0;
+
+        if (m <= 0 || n < m)
+            return 0;
+
+        const __m128i first = _mm_set1_epi8(what[0]);
+        const __m128i last = _mm_set1_epi8(what[m - 1]);
+        for ( ; j + m - 1 + 16 <= n; j += 16)
+        {
+            const __m128i block_first = _mm_loadu_si128((const __m128i*)(text + j));
+            const __m128i block_last = _mm_loadu_si128((const __m128i*)(text + j + m - 1));
+            unsigned mask = (unsigned)_mm_movemask_epi8(
+                    _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+            while (mask)
+            {
+                BORE_SIMD_VERIFY(j + bore_search_ctz(mask));
+                mask &= mask - 1;
+            }
+        }
+
+        for ( ; j <= n - m; ++j)
+        {
+            if (text[j] == what[0] && text[j + m - 1] == what[m - 1])
+            {
+                BORE_SIMD_VERIFY(j);
+            }
+        }
+done:
+        return p - out;
+    }
+};
+
+struct avx2_search_t : public exact_string_search_t
+{
+    BORE_TARGET_AVX2 virtual int search(const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const
+    {
+        const int m = what_len;
+        const int n = text_len;
+        int* p = out;
+        int j = 0;
+
+        if (m <= 0 || n < m)
+            return 0;
+
+        const __m256i first = _mm256_set1_epi8(what[0]);
+        const __m256i last = _mm256_set1_epi8(what[m - 1]);
+        for ( ; j + m - 1 + 32 <= n; j += 32)
+        {
+            const __m256i block_first = _mm256_loadu_si256((const __m256i*)(text + j));
+            const __m256i block_last = _mm256_loadu_si256((const __m256i*)(text + j + m - 1));
+            unsigned mask = (unsigned)_mm256_movemask_epi8(
+                    _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+            while (mask)
+            {
+                BORE_SIMD_VERIFY(j + bore_search_ctz(mask));
+                mask &= mask - 1;
+            }
+        }
+
+        for ( ; j <= n - m; ++j)
+        {
+            if (text[j] == what[0] && text[j + m - 1] == what[m - 1])
+            {
+                BORE_SIMD_VERIFY(j);
+            }
+        }
+done:
+        return p - out;
+    }
+};
+
+#undef BORE_SIMD_VERIFY
+#endif
+
+#undef BTSOUTPUT
+
+typedef enum
+{
+    BORE_SEARCH_SCALAR,
+    BORE_SEARCH_SSE2,
+    BORE_SEARCH_AVX2,
+} bore_search_kernel_t;
+
+// The best kernel supported by this cpu (and os)
+static bore_search_kernel_t bore_search_kernel_detect(void)
+{
+#ifdef BORE_SEARCH_X86
+# ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] >= 7)
+    {
+        __cpuid(info, 1);
+        const int osxsave_avx = (1 << 27) | (1 << 28);
+        if ((info[2] & osxsave_avx) == osxsave_avx && (_xgetbv(0) & 6) == 6)
+        {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5))
+                return BORE_SEARCH_AVX2;
+        }
+    }
+#  if defined(_M_X64) || _M_IX86_FP >= 2
+    return BORE_SEARCH_SSE2;
+#  else
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) ? BORE_SEARCH_SSE2 : BORE_SEARCH_SCALAR;
+#  endif
+# else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return BORE_SEARCH_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return BORE_SEARCH_SSE2;
+# endif
+#endif
+    return BORE_SEARCH_SCALAR;
+}
+
+// Compares text with a pattern that contains non-ASCII characters, ignoring
+// case. Returns non-zero on a match.
+typedef int (*bore_fold_verify_t)(const char* text, const char* text_end, const char* what, int what_len);
+
+static inline unsigned char bore_fold_ascii(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// Case-insensitive search directly in the file data. The pattern must be
+// lowercased (ASCII only). Candidates are found with a first-and-last-byte
+// filter that accepts both cases of the anchor bytes, and are then checked with
+// an ASCII case-fold compare. A pattern with non-ASCII bytes is only anchored on
+// its first byte and every candidate is checked by verify, since the matching
+// text may differ in length.
+struct fold_search_t : public exact_string_search_t
+{
+    fold_search_t(const char* what, int what_len, bore_search_kernel_t kernel, bore_fold_verify_t verify)
+        : m_kernel(kernel), m_verify(verify), m_ascii(1), m_first_high(0)
+    {
+        for (int i = 0; i < what_len; ++i)
+        {
+            if ((unsigned char)what[i] >= 0x80)
+                m_ascii = 0;
+        }
+        if (what_len > 0)
+        {
+            m_first_lo = what[0];
+            m_first_up = what[0] >= 'a' && what[0] <= 'z' ? what[0] - ('a' - 'A') : what[0];
+            m_last_lo = what[what_len - 1];
+            m_last_up = m_last_lo >= 'a' && m_last_lo <= 'z' ? m_last_lo - ('a' - 'A') : m_last_lo;
+        }
+        if (!m_verify)
+            m_ascii = 1; // no verify function, compare non-ASCII bytes exactly
+        else if (!m_ascii && what_len > 0 && (unsigned char)what[0] >= 0x80)
+            m_first_high = 1; // any non-ASCII byte can start a match
+    }
+
+    virtual int search(const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const
+    {
+        const int m = what_len;
+        const int n = text_len;
+        int* p = out;
+        int j = 0;
+
+        if (m <= 0 || n < m)
+            return 0;
+
+#ifdef BORE_SEARCH_X86
+        if (m_kernel == BORE_SEARCH_AVX2)
+            j = search_avx2(text, n, what, m, &p, out_end);
+        else if (m_kernel == BORE_SEARCH_SSE2)
+            j = search_sse2(text, n, what, m, &p, out_end);
+#endif
+
+        const int last_j = m_ascii ? n - m : n - 1;
+        for ( ; j <= last_j && p != out_end; ++j)
+        {
+            if (is_anchor(text[j]) && is_match(text, n, j, what, m))
+                *p++ = j;
+        }
+        return p - out;
+    }
+
+private:
+    int is_anchor(char c) const
+    {
+        return m_first_high ? (unsigned char)c >= 0x80 : (c == m_first_lo || c == m_first_up);
+    }
+
+    int is_match(const char* text, int n, int j, const char* what, int m) const
+    {
+        if (!m_ascii)
+            return m_verify(text + j, text + n, what, m);
+
+        if (m <= 2)
+            return text[j + m - 1] == m_last_lo || text[j + m - 1] == m_last_up;
+
+        const unsigned char* t = (const unsigned char*)text + j + 1;
+        const unsigned char* w = (const unsigned char*)what + 1;
+        int len = m - 1;
+        int i = 0;
+#ifdef BORE_SEARCH_X86
+        if (m_kernel != BORE_SEARCH_SCALAR)
+        {
+            for ( ; i + 16 <= len; i += 16)
+            {
+                if (!equal_fold_sse2(t + i, w + i))
+                    return 0;
+            }
+        }
+#endif
+        for ( ; i < len; ++i)
+        {
+            if (bore_fold_ascii(t[i]) != w[i])
+                return 0;
+        }
+        return 1;
+    }
+
+#ifdef BORE_SEARCH_X86
+    // Lowercase A-Z in 16 bytes of text and compare with the pattern
+    BORE_TARGET_SSE2 static int equal_fold_sse2(const unsigned char* text, const unsigned char* what)
+    {
+        const __m128i t = _mm_loadu_si128((const __m128i*)text);
+        const __m128i upper = _mm_cmplt_epi8(_mm_add_epi8(t, _mm_set1_epi8((char)(0x80 - 'A'))), _mm_set1_epi8(-128 + 26));
+        const __m128i folded = _mm_or_si128(t, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(folded, _mm_loadu_si128((const __m128i*)what))) == 0xffff;
+    }
+
+    // The vectorized filter loops return the position where the scalar loop continues
+    BORE_TARGET_SSE2 int search_sse2(const char* text, int n, const char* what, int m, int** pp, const int* out_end) const
+    {
+        const int last_offset = m_ascii ? m - 1 : 0;
+        const __m128i first_lo = _mm_set1_epi8(m_first_lo);
+        const __m128i first_up = _mm_set1_epi8(m_first_up);
+        const __m128i last_lo = _mm_set1_epi8(m_last_lo);
+        const __m128i last_up = _mm_set1_epi8(m_last_up);
+        int* p = *pp;
+        int j = 0;
+
+        for ( ; j + last_offset + 16 <= n && p != out_end; j += 16)
+        {
+            const __m128i block_first = _mm_loadu_si128((const __m128i*)(text + j));
+            __m128i eq = m_first_high ? block_first :
+                _mm_or_si128(_mm_cmpeq_epi8(block_first, first_lo), _mm_cmpeq_epi8(block_first, first_up));
+            if (m_ascii)
+            {
+                const __m128i block_last = _mm_loadu_si128((const __m128i*)(text + j + last_offset));
+                eq = _mm_and_si128(eq, _mm_or_si128(_mm_cmpeq_epi8(block_last, last_lo), _mm_cmpeq_epi8(block_last, last_up)));
+            }
+            unsigned mask = (unsigned)_mm_movemask_epi8(eq);
+            for ( ; mask && p != out_end; mask &= mask - 1)
+            {
+                const int k = j + bore_search_ctz(mask);
+                if (is_match(text, n, k, what, m))
+                    *p++ = k;
+            }
+        }
+        *pp = p;
+        return p != out_end ? j : n;
+    }
+
+    BORE_TARGET_AVX2 int search_avx2(const char* text, int n, const char* what, int m, int** pp, const int* out_end) const
+    {
+        const int last_offset = m_ascii ? m - 1 : 0;
+        const __m256i first_lo = _mm256_set1_epi8(m_first_lo);
+        const __m256i first_up = _mm256_set1_epi8(m_first_up);
+        const __m256i last_lo = _mm256_set1_epi8(m_last_lo);
+        const __m256i last_up = _mm256_set1_epi8(m_last_up);
+        int* p = *pp;
+        int j = 0;
+
+        for ( ; j + last_offset + 32 <= n && p != out_end; j += 32)
+        {
+            const __m256i block_first = _mm256_loadu_si256((const __m256i*)(text + j));
+            __m256i eq = m_first_high ? block_first :
+                _mm256_or_si256(_mm256_cmpeq_epi8(block_first, first_lo), _mm256_cmpeq_epi8(block_first, first_up));
+            if (m_ascii)
+            {
+                const __m256i block_last = _mm256_loadu_si256((const __m256i*)(text + j + last_offset));
+                eq = _mm256_and_si256(eq, _mm256_or_si256(_mm256_cmpeq_epi8(block_last, last_lo), _mm256_cmpeq_epi8(block_last, last_up)));
+            }
+            unsigned mask = (unsigned)_mm256_movemask_epi8(eq);
+            for ( ; mask && p != out_end; mask &= mask - 1)
+            {
+                const int k = j + bore_search_ctz(mask);
+                if (is_match(text, n, k, what, m))
+                    *p++ = k;
+            }
+        }
+        *pp = p;
+        return p != out_end ? j : n;
+    }
+#endif
+
+    bore_search_kernel_t m_kernel;
+    bore_fold_verify_t m_verify;
+    int m_ascii;
+    int m_first_high;
+    char m_first_lo, m_first_up;
+    char m_last_lo, m_last_up;
+};
+
+// Holds one kernel of each kind and picks the best one for the cpu and options
+struct bore_string_search_t
+{
+    bore_string_search_t(const char* what, int what_len, int ignorecase,
+            bore_search_kernel_t kernel, bore_fold_verify_t verify)
+        : quick(what, what_len), fold(what, what_len, kernel, verify), selected(&quick)
+    {
+        if (ignorecase)
+            selected = &fold;
+#ifdef BORE_SEARCH_X86
+        else if (kernel == BORE_SEARCH_AVX2)
+            selected = &avx2;
+        else if (kernel == BORE_SEARCH_SSE2)
+            selected = &sse2;
+#endif
+    }
+
+    const exact_string_search_t* get() const { return selected; }
+
+private:
+    quick_search_t quick;
+    fold_search_t fold;
+#ifdef BORE_SEARCH_X86
+    sse2_search_t sse2;
+    avx2_search_t avx2;
+#endif
+    const exact_string_search_t* selected;
+};
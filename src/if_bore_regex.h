@@ -0,0 +1,1202 @@
+/* vi:set ts=8 sts=4 sw=4 et: */
+// Regex search used by if_bore_find.cpp for borefind -r.
+// A subset of the Vim regex syntax ('magic') is compiled to a byte based NFA,
+// which is run one line at a time as a lazily built DFA. The literal text that
+// every match must contain is extracted while compiling, so that the string
+// search kernels can skip the lines (and the trigram index the files) without
+// it. Kept free of vim dependencies like if_bore_find.h.
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "if_bore_find.h"
+
+#define BORE_REGEX_MAX_INST 4096
+#define BORE_REGEX_MAX_SET 256
+#define BORE_REGEX_MAX_LITERAL 64
+#define BORE_REGEX_MAX_REPEAT 256
+#define BORE_REGEX_MAX_DEPTH 32
+#define BORE_REGEX_MAX_CLASS_MB 32     // non-ASCII characters in one [] collection
+#define BORE_REGEX_DFA_STATES 1024     // cached DFA states, the cache is flushed when full
+#define BORE_REGEX_PREFILTER_HITS 256
+#define BORE_REGEX_EOL 256             // input symbol for the end of the line
+
+typedef enum
+{
+    BORE_RE_SET,    // consume a byte in set[]
+    BORE_RE_SPLIT,  // continue at out and out1
+    BORE_RE_JMP,
+    BORE_RE_BOL,    // ^
+    BORE_RE_EOL,    // $
+    BORE_RE_BOW,    // \<
+    BORE_RE_EOW,    // \>
+    BORE_RE_MATCH,
+} bore_regex_op_t;
+
+typedef struct bore_regex_inst_t
+{
+    unsigned char op;
+    unsigned short set;
+    int out;
+    int out1;
+} bore_regex_inst_t;
+
+// Word characters for \< and \>. Bytes of non-ASCII characters count as word
+// characters, like with the default 'iskeyword'.
+static inline int bore_regex_is_word(int c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_' || c >= 0x80;
+}
+
+// Supported: literal characters, ., [] collections (with ranges, [:name:] and
+// negation), \s \S \d \D \w \W \a \A \l \L \u \U \x \X \o \O \h \H, * \+ \= \?
+// \{n,m}, \( \) \%( \), \|, ^ $ \< \>, \c \C, \e \t \r and escaped punctuation.
+// Matches never span lines.
+struct bore_regex_t
+{
+    // Compile pattern. Ignoring case folds ASCII letters only. Returns NULL on
+    // success or a message describing the error.
+    const char* compile(const char* pattern, int len, int ignore_case)
+    {
+        m_p = (const unsigned char*)pattern;
+        m_end = m_p + len;
+        m_error = NULL;
+        m_depth = 0;
+        inst_count = 0;
+        set_count = 0;
+        literal_len = 0;
+
+        // \c and \C anywhere in the pattern override the option, like in Vim
+        ignorecase = ignore_case;
+        for (const unsigned char* p = m_p; p + 1 < m_end; ++p)
+        {
+            if (*p != '\\')
+                continue;
+            ++p;
+            if (*p == 'C' && ignorecase != 2)
+                ignorecase = 0;
+            else if (*p == 'c')
+                ignorecase = 2;
+        }
+        ignorecase = ignorecase != 0;
+
+        lit_t lit;
+        frag_t f = parse_alt(&lit);
+        if (!m_error && m_p < m_end)
+            set_error("unmatched \\)");
+        int match = emit(BORE_RE_MATCH, 0, -1, -1);
+        patch(f.patch, match);
+        start = f.start;
+        if (m_error)
+            return m_error;
+
+        memcpy(literal, lit.req, lit.req_len);
+        literal_len = lit.req_len;
+        literal[literal_len] = 0;
+        return NULL;
+    }
+
+    bore_regex_inst_t inst[BORE_REGEX_MAX_INST];
+    unsigned int set[BORE_REGEX_MAX_SET][8];
+    int inst_count;
+    int set_count;
+    int start;
+    int ignorecase;
+    char literal[BORE_REGEX_MAX_LITERAL + 1]; // in every match, lowercased when ignoring case
+    int literal_len;
+
+private:
+    struct frag_t
+    {
+        int start;
+        int patch;  // unpatched outs, (inst << 1 | is_out1), linked through the outs
+    };
+
+    struct lit_t
+    {
+        int exact;  // the fragment matches exactly s
+        int len;
+        unsigned char s[BORE_REGEX_MAX_LITERAL];
+        int req_len;    // longest known text in every match, s when exact
+        unsigned char req[BORE_REGEX_MAX_LITERAL];
+    };
+
+    typedef unsigned int set_bits_t[8];
+
+    const unsigned char* m_p;
+    const unsigned char* m_end;
+    const char* m_error;
+    char m_error_buf[80];
+    int m_depth;
+
+    void set_error(const char* error)
+    {
+        if (!m_error)
+            m_error = error;
+    }
+
+    int at(const char* s) const
+    {
+        size_t n = strlen(s);
+        return (size_t)(m_end - m_p) >= n && memcmp(m_p, s, n) == 0;
+    }
+
+    static void lit_none(lit_t* lit) { lit->exact = 0; lit->len = 0; lit->req_len = 0; }
+    static void lit_empty(lit_t* lit) { lit->exact = 1; lit->len = 0; lit->req_len = 0; }
+
+    static void lit_candidate(lit_t* lit, const unsigned char* s, int len)
+    {
+        if (len > lit->req_len)
+        {
+            memcpy(lit->req, s, len);
+            lit->req_len = len;
+        }
+    }
+
+    int emit(int op, int set_index, int out, int out1)
+    {
+        if (inst_count == BORE_REGEX_MAX_INST)
+        {
+            set_error("pattern too large");
+            return -1;
+        }
+        bore_regex_inst_t* i = &inst[inst_count];
+        i->op = (unsigned char)op;
+        i->set = (unsigned short)set_index;
+        i->out = out;
+        i->out1 = out1;
+        return inst_count++;
+    }
+
+    int* patch_field(int entry) { return (entry & 1) ? &inst[entry >> 1].out1 : &inst[entry >> 1].out; }
+
+    void patch(int list, int target)
+    {
+        if (m_error)
+            return;
+        while (list != -1)
+        {
+            int* field = patch_field(list);
+            list = *field;
+            *field = target;
+        }
+    }
+
+    int append(int l1, int l2)
+    {
+        if (m_error || l1 == -1)
+            return l2;
+        int last = l1;
+        while (*patch_field(last) != -1)
+            last = *patch_field(last);
+        *patch_field(last) = l2;
+        return l1;
+    }
+
+    frag_t single(int op, int set_index)
+    {
+        frag_t f = { -1, -1 };
+        int i = emit(op, set_index, -1, -1);
+        if (i >= 0)
+        {
+            f.start = i;
+            f.patch = i << 1;
+        }
+        return f;
+    }
+
+    frag_t empty() { return single(BORE_RE_JMP, 0); }
+
+    frag_t concat(frag_t a, frag_t b)
+    {
+        patch(a.patch, b.start);
+        frag_t f = { a.start, b.patch };
+        return f;
+    }
+
+    frag_t alt(frag_t a, frag_t b)
+    {
+        frag_t f = { -1, -1 };
+        int s = emit(BORE_RE_SPLIT, 0, a.start, b.start);
+        if (s >= 0)
+        {
+            f.start = s;
+            f.patch = append(a.patch, b.patch);
+        }
+        return f;
+    }
+
+    frag_t star(frag_t a)
+    {
+        frag_t f = { -1, -1 };
+        int s = emit(BORE_RE_SPLIT, 0, a.start, -1);
+        if (s >= 0)
+        {
+            patch(a.patch, s);
+            f.start = s;
+            f.patch = s << 1 | 1;
+        }
+        return f;
+    }
+
+    frag_t plus(frag_t a)
+    {
+        frag_t f = { -1, -1 };
+        int s = emit(BORE_RE_SPLIT, 0, a.start, -1);
+        if (s >= 0)
+        {
+            patch(a.patch, s);
+            f.start = a.start;
+            f.patch = s << 1 | 1;
+        }
+        return f;
+    }
+
+    frag_t quest(frag_t a)
+    {
+        frag_t f = { -1, -1 };
+        int s = emit(BORE_RE_SPLIT, 0, a.start, -1);
+        if (s >= 0)
+        {
+            f.start = s;
+            f.patch = append(a.patch, s << 1 | 1);
+        }
+        return f;
+    }
+
+    static void set_add(set_bits_t bits, int c) { bits[c >> 5] |= 1u << (c & 31); }
+    static int set_has(const set_bits_t bits, int c) { return (bits[c >> 5] >> (c & 31)) & 1; }
+
+    void set_add_range(set_bits_t bits, int lo, int hi)
+    {
+        for (int c = lo; c <= hi; ++c)
+        {
+            set_add(bits, c);
+            if (ignorecase && c >= 'a' && c <= 'z')
+                set_add(bits, c - ('a' - 'A'));
+            else if (ignorecase && c >= 'A' && c <= 'Z')
+                set_add(bits, c + ('a' - 'A'));
+        }
+    }
+
+    frag_t byte_set(const set_bits_t bits)
+    {
+        int i;
+        for (i = 0; i < set_count; ++i)
+        {
+            if (memcmp(set[i], bits, sizeof(set_bits_t)) == 0)
+                break;
+        }
+        if (i == set_count)
+        {
+            if (set_count == BORE_REGEX_MAX_SET)
+            {
+                set_error("pattern too large");
+                frag_t f = { -1, -1 };
+                return f;
+            }
+            memcpy(set[set_count++], bits, sizeof(set_bits_t));
+        }
+        return single(BORE_RE_SET, i);
+    }
+
+    frag_t byte_range(int lo, int hi)
+    {
+        set_bits_t bits = { 0 };
+        for (int c = lo; c <= hi; ++c)
+            set_add(bits, c);
+        return byte_set(bits);
+    }
+
+    // One character: a byte in ascii (which only has ASCII bytes), or any
+    // non-ASCII character when nonascii is set
+    frag_t char_set(const set_bits_t ascii, int nonascii)
+    {
+        frag_t f = byte_set(ascii);
+        if (nonascii)
+            f = alt(f, concat(byte_range(0xc0, 0xff), star(byte_range(0x80, 0xbf))));
+        return f;
+    }
+
+    // The bytes of one literal character
+    frag_t literal_char(const unsigned char* s, int len, lit_t* lit)
+    {
+        frag_t f = { -1, -1 };
+        lit_empty(lit);
+        for (int i = 0; i < len; ++i)
+        {
+            set_bits_t bits = { 0 };
+            set_add_range(bits, s[i], s[i]);
+            frag_t c = byte_set(bits);
+            f = i == 0 ? c : concat(f, c);
+            lit->s[lit->len++] = ignorecase ? bore_fold_ascii(s[i]) : s[i];
+        }
+        memcpy(lit->req, lit->s, lit->len);
+        lit->req_len = lit->len;
+        return f;
+    }
+
+    static int utf8_len(const unsigned char* p, const unsigned char* end)
+    {
+        int len = 1;
+        if (*p >= 0xc0)
+        {
+            while (p + len < end && (p[len] & 0xc0) == 0x80 && len < 4)
+                ++len;
+        }
+        return len;
+    }
+
+    // The ASCII part of \s, \d, ... Returns non-zero for a known class.
+    int class_bits(int c, set_bits_t bits, int* negated)
+    {
+        *negated = c >= 'A' && c <= 'Z';
+        switch (*negated ? c + ('a' - 'A') : c)
+        {
+            case 's': set_add(bits, ' '); set_add(bits, '\t'); break;
+            case 'd': set_add_class(bits, '0', '9'); break;
+            case 'w': set_add_class(bits, '0', '9'); set_add_class(bits, 'a', 'z'); set_add_class(bits, 'A', 'Z'); set_add(bits, '_'); break;
+            case 'a': set_add_class(bits, 'a', 'z'); set_add_class(bits, 'A', 'Z'); break;
+            case 'l': set_add_class(bits, 'a', 'z'); break;
+            case 'u': set_add_class(bits, 'A', 'Z'); break;
+            case 'x': set_add_class(bits, '0', '9'); set_add_class(bits, 'a', 'f'); set_add_class(bits, 'A', 'F'); break;
+            case 'o': set_add_class(bits, '0', '7'); break;
+            case 'h': set_add_class(bits, 'a', 'z'); set_add_class(bits, 'A', 'Z'); set_add(bits, '_'); break;
+            default: return 0;
+        }
+        if (*negated)
+            negate_ascii(bits);
+        return 1;
+    }
+
+    // Character classes are not affected by ignoring case
+    static void set_add_class(set_bits_t bits, int lo, int hi)
+    {
+        for (int c = lo; c <= hi; ++c)
+            set_add(bits, c);
+    }
+
+    static void negate_ascii(set_bits_t bits)
+    {
+        for (int w = 0; w < 4; ++w)
+            bits[w] = ~bits[w];
+        for (int w = 4; w < 8; ++w)
+            bits[w] = 0;
+        bits['\n' >> 5] &= ~(1u << ('\n' & 31));
+    }
+
+    int named_class(const unsigned char* name, int len, set_bits_t bits)
+    {
+        static const char* names[] = { "alnum", "alpha", "blank", "cntrl", "digit", "graph",
+            "lower", "print", "punct", "space", "upper", "xdigit" };
+        int n;
+        for (n = 0; n < (int)(sizeof(names) / sizeof(names[0])); ++n)
+        {
+            if ((int)strlen(names[n]) == len && memcmp(names[n], name, len) == 0)
+                break;
+        }
+        for (int c = 0; c < 0x80; ++c)
+        {
+            int alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+            int digit = c >= '0' && c <= '9';
+            int in = 0;
+            switch (n)
+            {
+                case 0: in = alpha || digit; break;
+                case 1: in = alpha; break;
+                case 2: in = c == ' ' || c == '\t'; break;
+                case 3: in = c < 0x20 || c == 0x7f; break;
+                case 4: in = digit; break;
+                case 5: in = c > 0x20 && c < 0x7f; break;
+                case 6: in = c >= 'a' && c <= 'z'; break;
+                case 7: in = c >= 0x20 && c < 0x7f; break;
+                case 8: in = c > 0x20 && c < 0x7f && !alpha && !digit; break;
+                case 9: in = c == ' ' || (c >= '\t' && c <= '\r'); break;
+                case 10: in = c >= 'A' && c <= 'Z'; break;
+                case 11: in = digit || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'); break;
+                default: return 0;
+            }
+            if (in)
+                set_add(bits, c);
+        }
+        return 1;
+    }
+
+    // A character in a [] collection, advances p. Returns -1 for a non-ASCII
+    // character.
+    static int collection_char(const unsigned char** p, const unsigned char* end)
+    {
+        const unsigned char* s = *p;
+        if (*s == '\\' && s + 1 < end)
+        {
+            int c = -1;
+            switch (s[1])
+            {
+                case 'e': c = '\033'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case '\\': case ']': case '^': case '-': c = s[1]; break;
+            }
+            if (c >= 0)
+            {
+                *p = s + 2;
+                return c;
+            }
+        }
+        if (*s >= 0x80)
+            return -1;
+        *p = s + 1;
+        return *s;
+    }
+
+    frag_t parse_collection(lit_t* lit)
+    {
+        const unsigned char* p = m_p + 1;
+        const unsigned char* mb[BORE_REGEX_MAX_CLASS_MB];
+        int mb_len[BORE_REGEX_MAX_CLASS_MB];
+        int mb_count = 0;
+        int negate = 0;
+        set_bits_t bits = { 0 };
+
+        lit_none(lit);
+        if (p < m_end && *p == '^')
+        {
+            negate = 1;
+            ++p;
+        }
+        if (p < m_end && *p == ']')
+        {
+            set_add_range(bits, ']', ']');
+            ++p;
+        }
+        while (p < m_end && *p != ']')
+        {
+            if (*p == '[' && p + 1 < m_end && p[1] == ':')
+            {
+                const unsigned char* name = p + 2;
+                const unsigned char* name_end = name;
+                while (name_end + 1 < m_end && *name_end >= 'a' && *name_end <= 'z')
+                    ++name_end;
+                if (name_end + 1 < m_end && name_end[0] == ':' && name_end[1] == ']'
+                        && named_class(name, (int)(name_end - name), bits))
+                {
+                    p = name_end + 2;
+                    continue;
+                }
+            }
+
+            if (*p >= 0x80)
+            {
+                int len = utf8_len(p, m_end);
+                if (negate || mb_count == BORE_REGEX_MAX_CLASS_MB
+                        || (p + len + 1 < m_end && p[len] == '-' && p[len + 1] != ']'))
+                {
+                    set_error("non-ASCII ranges and negated non-ASCII characters in [] are not supported");
+                    frag_t f = { -1, -1 };
+                    return f;
+                }
+                mb[mb_count] = p;
+                mb_len[mb_count++] = len;
+                p += len;
+                continue;
+            }
+
+            int lo = collection_char(&p, m_end);
+            int hi = lo;
+            if (p + 1 < m_end && *p == '-' && p[1] != ']')
+            {
+                ++p;
+                hi = collection_char(&p, m_end);
+                if (hi < 0)
+                {
+                    set_error("non-ASCII ranges and negated non-ASCII characters in [] are not supported");
+                    frag_t f = { -1, -1 };
+                    return f;
+                }
+                if (hi < lo)
+                {
+                    set_error("reverse range in []");
+                    frag_t f = { -1, -1 };
+                    return f;
+                }
+            }
+            set_add_range(bits, lo, hi);
+        }
+
+        if (p >= m_end)
+        {
+            // No closing ], the [ is a literal character like in Vim
+            ++m_p;
+            return literal_char((const unsigned char*)"[", 1, lit);
+        }
+        m_p = p + 1;
+
+        if (negate)
+        {
+            negate_ascii(bits);
+            return char_set(bits, 1);
+        }
+
+        frag_t f = byte_set(bits);
+        for (int i = 0; i < mb_count; ++i)
+        {
+            lit_t unused;
+            f = alt(f, literal_char(mb[i], mb_len[i], &unused));
+        }
+        return f;
+    }
+
+    frag_t parse_atom(lit_t* lit, int at_start)
+    {
+        frag_t f = { -1, -1 };
+        const unsigned char c = *m_p;
+        lit_none(lit);
+
+        if (c == '^' && at_start)
+        {
+            ++m_p;
+            lit_empty(lit);
+            return single(BORE_RE_BOL, 0);
+        }
+        if (c == '$' && (m_p + 1 == m_end || (m_p[1] == '\\' && m_p + 2 < m_end && (m_p[2] == '|' || m_p[2] == ')'))))
+        {
+            ++m_p;
+            lit_empty(lit);
+            return single(BORE_RE_EOL, 0);
+        }
+        if (c == '.')
+        {
+            set_bits_t bits = { 0 };
+            ++m_p;
+            negate_ascii(bits);
+            return char_set(bits, 1);
+        }
+        if (c == '[')
+            return parse_collection(lit);
+        if (c != '\\')
+        {
+            int len = utf8_len(m_p, m_end);
+            m_p += len;
+            return literal_char(m_p - len, len, lit);
+        }
+
+        if (m_p + 1 == m_end)
+        {
+            set_error("trailing \\");
+            return f;
+        }
+
+        const unsigned char e = m_p[1];
+        m_p += 2;
+        if (e == '(' || (e == '%' && m_p < m_end && *m_p == '('))
+        {
+            if (e == '%')
+                ++m_p;
+            if (++m_depth > BORE_REGEX_MAX_DEPTH)
+            {
+                set_error("too many nested \\(");
+                return f;
+            }
+            f = parse_alt(lit);
+            --m_depth;
+            if (!at("\\)"))
+            {
+                set_error("unmatched \\(");
+                return f;
+            }
+            m_p += 2;
+            return f;
+        }
+
+        set_bits_t bits = { 0 };
+        int negated;
+        if (class_bits(e, bits, &negated))
+            return char_set(bits, negated);
+
+        switch (e)
+        {
+            case '<':
+                lit_empty(lit);
+                return single(BORE_RE_BOW, 0);
+            case '>':
+                lit_empty(lit);
+                return single(BORE_RE_EOW, 0);
+            case 'c':
+            case 'C':
+            case 'm':
+                lit_empty(lit);
+                return empty();
+            case 'e':
+                return literal_char((const unsigned char*)"\033", 1, lit);
+            case 't':
+                return literal_char((const unsigned char*)"\t", 1, lit);
+            case 'r':
+                return literal_char((const unsigned char*)"\r", 1, lit);
+            case 'n':
+            case '_':
+                set_error("\\n and \\_x are not supported, matches never span lines");
+                return f;
+            case '+':
+            case '=':
+            case '?':
+            case '{':
+                snprintf(m_error_buf, sizeof(m_error_buf), "\\%c follows nothing", e);
+                set_error(m_error_buf);
+                return f;
+        }
+
+        if ((e >= 'a' && e <= 'z') || (e >= 'A' && e <= 'Z') || (e >= '0' && e <= '9') || e == '%' || e == '@' || e == '&')
+        {
+            snprintf(m_error_buf, sizeof(m_error_buf), "\\%c is not supported", e);
+            set_error(m_error_buf);
+            return f;
+        }
+
+        // Escaped punctuation
+        return literal_char(m_p - 1, 1, lit);
+    }
+
+    // Reads the n,m of \{n,m}. m is -1 when there is no maximum.
+    int parse_count(int* n, int* m)
+    {
+        int has_n = 0;
+        *n = 0;
+        *m = -1;
+        if (m_p < m_end && *m_p == '-')
+            ++m_p; // lazy, the same for finding matching lines
+        for (; m_p < m_end && *m_p >= '0' && *m_p <= '9'; ++m_p)
+        {
+            if (*n <= BORE_REGEX_MAX_REPEAT)
+                *n = *n * 10 + (*m_p - '0');
+            has_n = 1;
+        }
+        if (m_p < m_end && *m_p == ',')
+        {
+            ++m_p;
+            if (m_p < m_end && *m_p >= '0' && *m_p <= '9')
+            {
+                *m = 0;
+                for (; m_p < m_end && *m_p >= '0' && *m_p <= '9'; ++m_p)
+                {
+                    if (*m <= BORE_REGEX_MAX_REPEAT)
+                        *m = *m * 10 + (*m_p - '0');
+                }
+            }
+        }
+        else if (has_n)
+        {
+            *m = *n;
+        }
+        if (m_p < m_end && *m_p == '\\')
+            ++m_p;
+        if (m_p >= m_end || *m_p != '}')
+        {
+            set_error("syntax error in \\{}");
+            return 0;
+        }
+        ++m_p;
+        if (*n > BORE_REGEX_MAX_REPEAT || *m > BORE_REGEX_MAX_REPEAT)
+        {
+            set_error("\\{} count too large");
+            return 0;
+        }
+        if (*m >= 0 && *m < *n)
+        {
+            // Vim swaps them
+            int t = *n;
+            *n = *m;
+            *m = t;
+        }
+        return 1;
+    }
+
+    int at_multi() const
+    {
+        if (m_p >= m_end)
+            return 0;
+        if (*m_p == '*')
+            return 1;
+        return *m_p == '\\' && m_p + 1 < m_end && (m_p[1] == '+' || m_p[1] == '=' || m_p[1] == '?' || m_p[1] == '{');
+    }
+
+    frag_t parse_piece(lit_t* lit, int at_start)
+    {
+        const unsigned char* atom_begin = m_p;
+        lit_t atom;
+        frag_t f = parse_atom(&atom, at_start);
+        if (m_error || !at_multi())
+        {
+            *lit = atom;
+            return f;
+        }
+
+        lit_none(lit);
+        if (*m_p == '*')
+        {
+            ++m_p;
+            f = star(f);
+        }
+        else
+        {
+            const unsigned char multi = m_p[1];
+            m_p += 2;
+            if (multi == '+')
+            {
+                f = plus(f);
+                lit_candidate(lit, atom.req, atom.req_len);
+            }
+            else if (multi == '=' || multi == '?')
+            {
+                f = quest(f);
+            }
+            else
+            {
+                int n, m;
+                if (!parse_count(&n, &m))
+                    return f;
+                if (n > 0)
+                    lit_candidate(lit, atom.req, atom.req_len);
+
+                // n copies of the atom, followed by a * copy or m - n optional
+                // copies. The copies are made by compiling the atom again.
+                const unsigned char* multi_end = m_p;
+                const int copies = m < 0 ? n + 1 : m;
+                frag_t repeated = { -1, -1 };
+                for (int i = 0; i < copies && !m_error; ++i)
+                {
+                    frag_t copy = f;
+                    if (i > 0)
+                    {
+                        lit_t unused;
+                        m_p = atom_begin;
+                        copy = parse_atom(&unused, at_start);
+                    }
+                    if (i >= n)
+                        copy = m < 0 ? star(copy) : quest(copy);
+                    repeated = i > 0 ? concat(repeated, copy) : copy;
+                }
+                m_p = multi_end;
+                f = copies > 0 ? repeated : empty();
+            }
+        }
+
+        if (!m_error && at_multi())
+            set_error("nested multi");
+        return f;
+    }
+
+    frag_t parse_concat(lit_t* lit)
+    {
+        frag_t f = { -1, -1 };
+        unsigned char run[BORE_REGEX_MAX_LITERAL];
+        int run_len = 0;
+        int run_full = 0;
+        int all_exact = 1;
+        int have = 0;
+        int at_start = 1;
+
+        lit_none(lit);
+        while (!m_error && m_p < m_end && !at("\\|") && !at("\\)"))
+        {
+            const unsigned char* piece_begin = m_p;
+            lit_t piece;
+            frag_t g = parse_piece(&piece, at_start);
+            at_start = at_start && *piece_begin == '^' && m_p == piece_begin + 1;
+            f = have ? concat(f, g) : g;
+            have = 1;
+
+            // The consecutive exact pieces are in every match
+            if (piece.exact && !run_full)
+            {
+                int len = piece.len;
+                if (run_len + len > BORE_REGEX_MAX_LITERAL)
+                {
+                    len = BORE_REGEX_MAX_LITERAL - run_len;
+                    run_full = 1;
+                    all_exact = 0;
+                }
+                memcpy(run + run_len, piece.s, len);
+                run_len += len;
+            }
+            else if (!piece.exact)
+            {
+                all_exact = 0;
+                lit_candidate(lit, run, run_len);
+                lit_candidate(lit, piece.req, piece.req_len);
+                run_len = 0;
+                run_full = 0;
+            }
+        }
+        if (!have)
+            f = empty();
+
+        lit_candidate(lit, run, run_len);
+        if (all_exact)
+        {
+            lit->exact = 1;
+            memcpy(lit->s, run, run_len);
+            lit->len = run_len;
+        }
+        return f;
+    }
+
+    frag_t parse_alt(lit_t* lit)
+    {
+        frag_t f = parse_concat(lit);
+        while (!m_error && at("\\|"))
+        {
+            lit_t other;
+            m_p += 2;
+            f = alt(f, parse_concat(&other));
+            lit_none(lit);
+        }
+        return f;
+    }
+};
+
+// Lazily built DFA for one bore_regex_t. The states are sets of NFA
+// instructions, the assertions are evaluated when the next byte is known.
+// Not thread safe, each search thread has its own.
+struct bore_regex_dfa_t
+{
+    bore_regex_dfa_t() : m_re(NULL), m_state(NULL), m_trans(NULL), m_state_count(0), m_kernel(NULL), m_kernel_used(0),
+        m_kernel_size(0), m_hash(NULL), m_mark(NULL), m_gen(0), m_stack(NULL), m_next(NULL) {}
+    ~bore_regex_dfa_t() { release(); }
+
+    void init(const bore_regex_t* re)
+    {
+        release();
+        m_re = re;
+    }
+
+    // Returns the offset of the leftmost match in the line, or -1
+    int match_line(const unsigned char* line, int len)
+    {
+        if (!m_state && !allocate())
+            return -1;
+
+        int end = run(line, len, 0, AT_BOL);
+        if (end < 0)
+            return -1;
+
+        // Find where the first match starts
+        for (int begin = 0; begin < end; ++begin)
+        {
+            if (begin > 0 && (line[begin] & 0xc0) == 0x80)
+                continue;
+            int flags = ANCHORED | START | (begin == 0 ? AT_BOL : 0)
+                | (begin > 0 && bore_regex_is_word(line[begin - 1]) ? PREV_WORD : 0);
+            if (run(line, len, begin, flags) >= 0)
+                return begin;
+        }
+        return end;
+    }
+
+private:
+    enum { PREV_WORD = 1, AT_BOL = 2, ANCHORED = 4, START = 8 };
+    enum { NEXT_UNKNOWN = -1, NEXT_MATCH = -2, NEXT_DEAD = -3 };
+    enum { HASH_SIZE = BORE_REGEX_DFA_STATES * 2, ROW = BORE_REGEX_EOL + 1 };
+
+    struct state_t
+    {
+        int kernel;     // offset in m_kernel
+        int kernel_len;
+        int flags;
+    };
+
+    const bore_regex_t* m_re;
+    state_t* m_state;
+    int* m_trans;       // ROW entries per state: the row of the next state or NEXT_*
+    int m_state_count;
+    int* m_kernel;      // NFA instructions of the states, before the closure
+    int m_kernel_used;
+    int m_kernel_size;
+    int* m_hash;
+    unsigned* m_mark;
+    unsigned m_gen;
+    int* m_stack;
+    int* m_next;
+    int m_start[16];    // start state for each combination of flags
+
+    void release()
+    {
+        free(m_state);
+        free(m_trans);
+        free(m_kernel);
+        free(m_hash);
+        free(m_mark);
+        free(m_stack);
+        free(m_next);
+        m_state = NULL;
+        m_trans = NULL;
+        m_kernel = NULL;
+        m_hash = NULL;
+        m_mark = NULL;
+        m_stack = NULL;
+        m_next = NULL;
+    }
+
+    int allocate()
+    {
+        int n = m_re->inst_count;
+        m_kernel_size = BORE_REGEX_DFA_STATES * 16 > n * 4 ? BORE_REGEX_DFA_STATES * 16 : n * 4;
+        m_state = (state_t*)malloc(sizeof(state_t) * BORE_REGEX_DFA_STATES);
+        m_trans = (int*)malloc(sizeof(int) * ROW * BORE_REGEX_DFA_STATES);
+        m_kernel = (int*)malloc(sizeof(int) * m_kernel_size);
+        m_hash = (int*)malloc(sizeof(int) * HASH_SIZE);
+        m_mark = (unsigned*)calloc(n, sizeof(unsigned));
+        m_stack = (int*)malloc(sizeof(int) * (n * 3 + 4));
+        m_next = (int*)malloc(sizeof(int) * (n + 1));
+        if (!m_state || !m_trans || !m_kernel || !m_hash || !m_mark || !m_stack || !m_next)
+        {
+            release();
+            return 0;
+        }
+        m_gen = 0;
+        flush();
+        return 1;
+    }
+
+    void flush()
+    {
+        m_state_count = 0;
+        m_kernel_used = 0;
+        memset(m_hash, 0xff, sizeof(int) * HASH_SIZE);
+        memset(m_start, 0xff, sizeof(m_start));
+    }
+
+    // Returns the offset where the first match (from begin) ends, or -1
+    int run(const unsigned char* line, int len, int begin, int flags)
+    {
+        if (m_start[flags] < 0)
+            m_start[flags] = find_state(m_next, 0, flags, NULL) * ROW;
+        int row = m_start[flags];
+        const int* trans = m_trans;
+        const unsigned char* p = line + begin;
+        const unsigned char* end = line + len;
+        for (;; ++p)
+        {
+            int sym = p < end ? *p : BORE_REGEX_EOL;
+            int next = trans[row + sym];
+            if (next < 0)
+            {
+                if (next == NEXT_UNKNOWN)
+                    next = compute_next(row / ROW, sym);
+                if (next == NEXT_MATCH)
+                    return (int)(p - line);
+                if (next == NEXT_DEAD)
+                    return -1;
+            }
+            row = next;
+        }
+    }
+
+    static unsigned hash_state(const int* kernel, int kernel_len, int flags)
+    {
+        unsigned h = 2166136261u ^ (unsigned)flags;
+        for (int i = 0; i < kernel_len; ++i)
+            h = (h ^ (unsigned)kernel[i]) * 16777619u;
+        return h;
+    }
+
+    // Returns the state, adding it (after flushing the cache when it is full)
+    // if it is new
+    int find_state(const int* kernel, int kernel_len, int flags, int* flushed)
+    {
+        unsigned h = hash_state(kernel, kernel_len, flags) & (HASH_SIZE - 1);
+        for (; m_hash[h] >= 0; h = (h + 1) & (HASH_SIZE - 1))
+        {
+            const state_t* st = &m_state[m_hash[h]];
+            if (st->flags == flags && st->kernel_len == kernel_len
+                    && memcmp(m_kernel + st->kernel, kernel, sizeof(int) * kernel_len) == 0)
+                return m_hash[h];
+        }
+
+        if (m_state_count == BORE_REGEX_DFA_STATES || m_kernel_used + kernel_len > m_kernel_size)
+        {
+            flush();
+            if (flushed)
+                *flushed = 1;
+            h = hash_state(kernel, kernel_len, flags) & (HASH_SIZE - 1);
+        }
+
+        state_t* st = &m_state[m_state_count];
+        st->kernel = m_kernel_used;
+        st->kernel_len = kernel_len;
+        st->flags = flags;
+        memset(m_trans + m_state_count * ROW, 0xff, sizeof(int) * ROW);
+        if (kernel_len)
+            memcpy(m_kernel + m_kernel_used, kernel, sizeof(int) * kernel_len);
+        m_kernel_used += kernel_len;
+        m_hash[h] = m_state_count;
+        return m_state_count++;
+    }
+
+    static int compare_int(const void* a, const void* b)
+    {
+        return *(const int*)a - *(const int*)b;
+    }
+
+    // Returns the row of the next state or NEXT_MATCH or NEXT_DEAD
+    int compute_next(int s, int sym)
+    {
+        const bore_regex_inst_t* inst = m_re->inst;
+        const int flags = m_state[s].flags;
+        const int* kernel = m_kernel + m_state[s].kernel;
+        const int kernel_len = m_state[s].kernel_len;
+        const int word = sym != BORE_REGEX_EOL && bore_regex_is_word(sym);
+        int sp = 0;
+        int next_count = 0;
+        int matched = 0;
+
+        if (++m_gen == 0)
+        {
+            memset(m_mark, 0, sizeof(unsigned) * m_re->inst_count);
+            m_gen = 1;
+        }
+
+        for (int i = 0; i < kernel_len; ++i)
+            m_stack[sp++] = kernel[i];
+        if (!(flags & ANCHORED) || (flags & START))
+            m_stack[sp++] = m_re->start;
+
+        // Follow the empty transitions and collect the instructions that accept sym
+        while (sp > 0)
+        {
+            int i = m_stack[--sp];
+            if (m_mark[i] == m_gen)
+                continue;
+            m_mark[i] = m_gen;
+            const bore_regex_inst_t* in = &inst[i];
+            switch (in->op)
+            {
+                case BORE_RE_SET:
+                    if (sym != BORE_REGEX_EOL && ((m_re->set[in->set][sym >> 5] >> (sym & 31)) & 1))
+                        m_next[next_count++] = in->out;
+                    break;
+                case BORE_RE_SPLIT:
+                    m_stack[sp++] = in->out1;
+                    m_stack[sp++] = in->out;
+                    break;
+                case BORE_RE_JMP:
+                    m_stack[sp++] = in->out;
+                    break;
+                case BORE_RE_BOL:
+                    if (flags & AT_BOL)
+                        m_stack[sp++] = in->out;
+                    break;
+                case BORE_RE_EOL:
+                    if (sym == BORE_REGEX_EOL)
+                        m_stack[sp++] = in->out;
+                    break;
+                case BORE_RE_BOW:
+                    if (!(flags & PREV_WORD) && word)
+                        m_stack[sp++] = in->out;
+                    break;
+                case BORE_RE_EOW:
+                    if ((flags & PREV_WORD) && !word)
+                        m_stack[sp++] = in->out;
+                    break;
+                case BORE_RE_MATCH:
+                    matched = 1;
+                    break;
+            }
+        }
+
+        int next;
+        int flushed = 0;
+        if (matched)
+            next = NEXT_MATCH;
+        else if (sym == BORE_REGEX_EOL || ((flags & ANCHORED) && next_count == 0))
+            next = NEXT_DEAD;
+        else
+        {
+            qsort(m_next, next_count, sizeof(int), compare_int);
+            int unique = 0;
+            for (int i = 0; i < next_count; ++i)
+            {
+                if (unique == 0 || m_next[unique - 1] != m_next[i])
+                    m_next[unique++] = m_next[i];
+            }
+            next = find_state(m_next, unique, (flags & ANCHORED) | (word ? PREV_WORD : 0), &flushed) * ROW;
+        }
+
+        if (!flushed)
+            m_trans[s * ROW + sym] = next;
+        return next;
+    }
+};
+
+// Runs a compiled regex over the lines of the text and reports the leftmost
+// match of each matching line. When the regex has a literal only the lines in
+// which the prefilter finds it are run. One per search thread, for the DFA.
+struct regex_search_t : public exact_string_search_t
+{
+    regex_search_t() : m_re(NULL), m_prefilter(NULL) {}
+
+    void init(const bore_regex_t* re, const exact_string_search_t* prefilter)
+    {
+        m_re = re;
+        m_prefilter = re->literal_len > 0 ? prefilter : NULL;
+        m_dfa.init(re);
+    }
+
+    // what is ignored, the pattern has been compiled in init
+    virtual int search(const char* text, int text_len, const char* what, int what_len, int* out, const int* out_end) const
+    {
+        const char* end = text + text_len;
+        const char* next_line = text; // the lines before have been searched
+        int* p = out;
+
+        if (!m_prefilter)
+        {
+            while (next_line < end && p != out_end)
+                next_line = search_line(text, next_line, end, &p);
+            return p - out;
+        }
+
+        int hits[BORE_REGEX_PREFILTER_HITS];
+        while (next_line < end && p != out_end)
+        {
+            const char* base = next_line;
+            int hit_count = m_prefilter->search(base, (int)(end - base), m_re->literal, m_re->literal_len,
+                    hits, hits + BORE_REGEX_PREFILTER_HITS);
+            for (int h = 0; h < hit_count && p != out_end; ++h)
+            {
+                const char* hit = base + hits[h];
+                if (hit < next_line)
+                    continue;
+                const char* line = hit;
+                while (line > next_line && line[-1] != '\n')
+                    --line;
+                next_line = search_line(text, line, end, &p);
+            }
+            if (hit_count < BORE_REGEX_PREFILTER_HITS)
+                break;
+        }
+        return p - out;
+    }
+
+private:
+    const bore_regex_t* m_re;
+    const exact_string_search_t* m_prefilter;
+    mutable bore_regex_dfa_t m_dfa;
+
+    // Searches the line starting at line. Returns the start of the next line.
+    const char* search_line(const char* text, const char* line, const char* end, int** p) const
+    {
+        const char* line_end = (const char*)memchr(line, '\n', end - line);
+        const char* next_line = line_end ? line_end + 1 : end;
+        if (!line_end)
+            line_end = end;
+        if (line_end > line && line_end[-1] == '\r')
+            --line_end;
+
+        int column = m_dfa.match_line((const unsigned char*)line, (int)(line_end - line));
+        if (column >= 0)
+            *(*p)++ = (int)(line - text) + column;
+        return next_line;
+    }
+};
@@ -0,0 +1,85 @@
+/* vi:set ts=8 sts=4 sw=4 et: */
+// Threads, locks and atomics used by the workers in if_bore_find.cpp and
+// if_bore_walk.cpp.
+#pragma once
+
+#ifdef MSWIN
+#include <windows.h>
+#include <winnt.h>
+#include <intrin.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#ifdef MSWIN
+typedef LONG bore_atomic_t;
+typedef HANDLE bore_thread_t;
+typedef CRITICAL_SECTION bore_mutex_t;
+typedef CONDITION_VARIABLE bore_cond_t;
+#define bore_atomic_dec(p) InterlockedDecrement(p)
+#define bore_atomic_add(p, n) InterlockedExchangeAdd(p, n)
+#define bore_atomic_load(p) InterlockedCompareExchange(p, 0, 0)
+#define bore_atomic_store(p, n) InterlockedExchange(p, n)
+#define BORE_THREAD_PROC(name) static DWORD WINAPI name(LPVOID param)
+#define BORE_THREAD_RETURN return 0
+#define bore_thread_start(t, proc, param) (NULL != (*(t) = CreateThread(0, 0, proc, param, 0, 0)))
+#define bore_thread_join(t) do { WaitForSingleObject(t, INFINITE); CloseHandle(t); } while(0)
+#define bore_mutex_init(m) InitializeCriticalSection(m)
+#define bore_mutex_destroy(m) DeleteCriticalSection(m)
+#define bore_mutex_lock(m) EnterCriticalSection(m)
+#define bore_mutex_trylock(m) TryEnterCriticalSection(m)
+#define bore_mutex_unlock(m) LeaveCriticalSection(m)
+#define bore_cond_init(c) InitializeConditionVariable(c)
+#define bore_cond_destroy(c)
+#define bore_cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define bore_cond_wait_ms(c, m, ms) SleepConditionVariableCS(c, m, ms)
+#define bore_cond_broadcast(c) WakeAllConditionVariable(c)
+#define bore_cond_signal(c) WakeConditionVariable(c)
+#define bore_sleep_ms(ms) Sleep(ms)
+static inline int bore_ctz64(u64 x) { unsigned long i; _BitScanForward64(&i, x); return (int)i; }
+#else
+typedef long bore_atomic_t;
+typedef pthread_t bore_thread_t;
+typedef pthread_mutex_t bore_mutex_t;
+typedef pthread_cond_t bore_cond_t;
+#define bore_atomic_dec(p) __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST)
+#define bore_atomic_add(p, n) __atomic_fetch_add(p, n, __ATOMIC_SEQ_CST)
+#define bore_atomic_load(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define bore_atomic_store(p, n) __atomic_store_n(p, n, __ATOMIC_SEQ_CST)
+#define bore_ctz64(x) __builtin_ctzll(x)
+#define BORE_THREAD_PROC(name) static void* name(void* param)
+#define BORE_THREAD_RETURN return NULL
+#define bore_thread_start(t, proc, param) (0 == pthread_create(t, NULL, proc, param))
+#define bore_thread_join(t) pthread_join(t, NULL)
+#define bore_mutex_init(m) pthread_mutex_init(m, NULL)
+#define bore_mutex_destroy(m) pthread_mutex_destroy(m)
+#define bore_mutex_lock(m) pthread_mutex_lock(m)
+#define bore_mutex_trylock(m) (0 == pthread_mutex_trylock(m))
+#define bore_mutex_unlock(m) pthread_mutex_unlock(m)
+#define bore_cond_init(c) pthread_cond_init(c, NULL)
+#define bore_cond_destroy(c) pthread_cond_destroy(c)
+#define bore_cond_wait(c, m) pthread_cond_wait(c, m)
+#define bore_cond_broadcast(c) pthread_cond_broadcast(c)
+#define bore_cond_signal(c) pthread_cond_signal(c)
+static inline void bore_cond_wait_ms(bore_cond_t* c, bore_mutex_t* m, int ms)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(c, m, &ts);
+}
+static inline void bore_sleep_ms(int ms)
+{
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+}
+#endif
@@ -0,0 +1,1506 @@
+/* vi:set ts=8 sts=4 sw=4 et: */
+
+extern "C" {
+#include "if_bore.h"
+#include "vim.h"
+}
+
+#ifdef FEAT_BORE
+
+#include "if_bore_thread.h"
+
+#ifndef MSWIN
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+// Directory listing for boresln of a directory. The work tree is walked by a
+// pool of threads, each directory is a job that is pushed on the queue of the
+// worker that found it and other workers steal from when they run out. Git
+// repos are listed from the index file instead, without running git. The
+// directories can be watched for changes to keep the list up to date.
+
+#ifdef MSWIN
+#define BORE_PATHSEP '\\'
+#define BORE_IGNORE_CASE 1
+#else
+#define BORE_PATHSEP '/'
+#define BORE_IGNORE_CASE 0
+#endif
+
+//
+// .gitignore
+//
+
+typedef struct bore_ignore_rule_t
+{
+    const char* pattern;
+    int negate;   // !pattern
+    int dir_only; // pattern/
+    int anchored; // matched against the path, otherwise against the name
+} bore_ignore_rule_t;
+
+// The rules of one .gitignore file, chained to the rules of the directories
+// above it
+typedef struct bore_ignore_t
+{
+    struct bore_ignore_t* parent;
+    struct bore_ignore_t* next; // in the list of the worker that loaded it
+    int base_len; // length of the directory of the .gitignore, relative to the root
+    int rule_count;
+    bore_ignore_rule_t* rules;
+    char* text;
+} bore_ignore_t;
+
+static int bore_glob_eq(char a, char b)
+{
+    return a == b || (BORE_IGNORE_CASE && TOLOWER_ASC(a) == TOLOWER_ASC(b));
+}
+
+// Match the [...] class at p against c. Returns the closing ']', or NULL if
+// there is none and the '[' is a plain character.
+static const char* bore_glob_class(const char* p, char c, int* match)
+{
+    const char* q = p + 1;
+    int negate = 0;
+    int first = 1;
+
+    if (*q == '!' || *q == '^')
+    {
+        negate = 1;
+        ++q;
+    }
+    *match = 0;
+    for (; *q && (first || *q != ']'); ++q, first = 0)
+    {
+        char lo, hi;
+        if (*q == '\\' && q[1])
+            ++q;
+        lo = hi = *q;
+        if (q[1] == '-' && q[2] && q[2] != ']')
+        {
+            q += 2;
+            if (*q == '\\' && q[1])
+                ++q;
+            hi = *q;
+        }
+        if ((c >= lo && c <= hi) || (BORE_IGNORE_CASE &&
+                    TOLOWER_ASC(c) >= TOLOWER_ASC(lo) && TOLOWER_ASC(c) <= TOLOWER_ASC(hi)))
+            *match = 1;
+    }
+    if (*q != ']')
+        return NULL;
+    *match ^= negate;
+    return q;
+}
+
+// Match a gitignore glob against a path: * and ? don't match a '/', ** does
+static int bore_glob_match(const char* p, const char* t)
+{
+    while (*p)
+    {
+        if (p[0] == '*' && p[1] == '*')
+        {
+            p += 2;
+            // "a/**/b" also matches "a/b"
+            if (*p == '/' && bore_glob_match(p + 1, t))
+                return 1;
+            for (;; ++t)
+            {
+                if (bore_glob_match(p, t))
+                    return 1;
+                if (!*t)
+                    return 0;
+            }
+        }
+        if (*p == '*')
+        {
+            ++p;
+            for (;; ++t)
+            {
+                if (bore_glob_match(p, t))
+                    return 1;
+                if (!*t || *t == '/')
+                    return 0;
+            }
+        }
+        if (!*t)
+            return 0;
+        if (*p == '?')
+        {
+            if (*t == '/')
+                return 0;
+        }
+        else if (*p == '[')
+        {
+            int match;
+            const char* end = bore_glob_class(p, *t, &match);
+            if (end)
+            {
+                if (!match || *t == '/')
+                    return 0;
+                p = end;
+            }
+            else if (*t != '[')
+                return 0;
+        }
+        else
+        {
+            if (*p == '\\' && p[1])
+                ++p;
+            if (!bore_glob_eq(*p, *t))
+                return 0;
+        }
+        ++p;
+        ++t;
+    }
+    return !*t;
+}
+
+// Parse the rules in text (taken over), NULL if there are none
+static bore_ignore_t* bore_ignore_parse(char* text, bore_ignore_t* parent, int base_len)
+{
+    bore_ignore_t* ignore;
+    int line_count = 1;
+    char* p;
+
+    for (p = text; *p; ++p)
+        line_count += *p == '\n';
+
+    ignore = (bore_ignore_t*)alloc_clear(sizeof(bore_ignore_t));
+    if (!ignore)
+    {
+        vim_free(text);
+        return NULL;
+    }
+    ignore->rules = (bore_ignore_rule_t*)alloc(sizeof(bore_ignore_rule_t) * line_count);
+    ignore->text = text;
+    ignore->parent = parent;
+    ignore->base_len = base_len;
+    if (!ignore->rules)
+        return ignore;
+
+    for (p = text; *p; )
+    {
+        char* line = p;
+        char* end;
+        bore_ignore_rule_t* rule;
+
+        while (*p && *p != '\n')
+            ++p;
+        end = p;
+        if (*p)
+            *p++ = NUL;
+
+        // Trailing spaces are ignored unless they are escaped
+        while (end > line && (end[-1] == '\r' || (end[-1] == ' ' && !(end - 1 > line && end[-2] == '\\'))))
+            --end;
+        *end = NUL;
+        if (!*line || *line == '#')
+            continue;
+
+        rule = &ignore->rules[ignore->rule_count];
+        rule->negate = *line == '!';
+        if (rule->negate)
+            ++line;
+        else if (line[0] == '\\' && (line[1] == '!' || line[1] == '#'))
+            ++line;
+        rule->dir_only = end > line && end[-1] == '/';
+        if (rule->dir_only)
+            *--end = NUL;
+        rule->anchored = NULL != strchr(line, '/');
+        if (*line == '/')
+            ++line;
+        if (!*line)
+            continue;
+        rule->pattern = line;
+        ++ignore->rule_count;
+    }
+    return ignore;
+}
+
+static char* bore_read_text_file(const char* filename, size_t* size)
+{
+    FILE* f = mch_fopen(filename, "rb");
+    char* text = NULL;
+    long len;
+
+    if (!f)
+        return NULL;
+    if (0 == fseek(f, 0, SEEK_END) && (len = ftell(f)) >= 0 && 0 == fseek(f, 0, SEEK_SET))
+    {
+        text = (char*)alloc(len + 1);
+        if (text && (len == 0 || 1 == fread(text, len, 1, f)))
+        {
+            text[len] = NUL;
+            *size = (size_t)len;
+        }
+        else
+        {
+            vim_free(text);
+            text = NULL;
+        }
+    }
+    fclose(f);
+    return text;
+}
+
+static bore_ignore_t* bore_ignore_load(const char* filename, bore_ignore_t* parent, int base_len)
+{
+    size_t size;
+    char* text = bore_read_text_file(filename, &size);
+    return text ? bore_ignore_parse(text, parent, base_len) : NULL;
+}
+
+static void bore_ignore_free(bore_ignore_t* ignore)
+{
+    while (ignore)
+    {
+        bore_ignore_t* next = ignore->next;
+        vim_free(ignore->rules);
+        vim_free(ignore->text);
+        vim_free(ignore);
+        ignore = next;
+    }
+}
+
+// path is relative to the root, name points into it. The rules of the
+// deepest .gitignore decide, and the last matching rule in it.
+static int bore_is_ignored(const bore_ignore_t* ignore, const char* path, const char* name, int is_dir)
+{
+    for (; ignore; ignore = ignore->parent)
+    {
+        const char* rel = path + ignore->base_len;
+        for (int i = ignore->rule_count - 1; i >= 0; --i)
+        {
+            const bore_ignore_rule_t* rule = &ignore->rules[i];
+            if (rule->dir_only && !is_dir)
+                continue;
+            if (bore_glob_match(rule->pattern, rule->anchored ? rel : name))
+                return !rule->negate;
+        }
+    }
+    return 0;
+}
+
+//
+// Directory walker
+//
+
+typedef struct bore_walk_job_t
+{
+    const bore_ignore_t* ignore;
+    int proj_index;
+    int path_len;
+    char path[1]; // relative to the root, '/' separated and ending with '/' (or empty for the root)
+} bore_walk_job_t;
+
+enum { BORE_ENTRY_FILE, BORE_ENTRY_DIR };
+
+struct bore_walk_t;
+
+typedef struct bore_walk_worker_t
+{
+    struct bore_walk_t* walk;
+    bore_mutex_t lock;
+    bore_alloc_t queue;      // bore_walk_job_t*, the worker takes from the end and thieves from head
+    int head;
+    bore_alloc_t entry_alloc; // entries of the directory being read: type byte and name
+    bore_alloc_t data_alloc; // paths of the files and directories found
+    bore_alloc_t file_alloc; // bore_file_t
+    bore_alloc_t dir_alloc;  // u32 offsets of the directories listed
+    int file_count;
+    int dir_count;
+    bore_ignore_t* ignores;  // the rules loaded by this worker, freed after the walk
+} bore_walk_worker_t;
+
+typedef struct bore_walk_t
+{
+    char root[BORE_MAX_PATH];
+    int root_len;
+#ifndef MSWIN
+    int root_fd;
+#endif
+    int worker_count;
+    bore_atomic_t pending; // jobs queued or running
+    bore_atomic_t idle;    // workers waiting for jobs
+    bore_mutex_t idle_lock;
+    bore_cond_t idle_cond;
+    bore_walk_worker_t workers[BORE_MAX_SEARCH_THREADS];
+} bore_walk_t;
+
+static int bore_queue_size(bore_walk_worker_t* w)
+{
+    return (int)((w->queue.cursor - w->queue.base) / sizeof(bore_walk_job_t*));
+}
+
+static void bore_walk_push(bore_walk_worker_t* w, bore_walk_job_t* job)
+{
+    bore_walk_t* walk = w->walk;
+    bore_atomic_add(&walk->pending, 1);
+    bore_mutex_lock(&w->lock);
+    *(bore_walk_job_t**)bore_alloc(&w->queue, sizeof(bore_walk_job_t*)) = job;
+    bore_mutex_unlock(&w->lock);
+    if (bore_atomic_load(&walk->idle) > 0)
+    {
+        bore_mutex_lock(&walk->idle_lock);
+        bore_cond_signal(&walk->idle_cond);
+        bore_mutex_unlock(&walk->idle_lock);
+    }
+}
+
+// Take the newest job of the worker itself, or the oldest (the biggest
+// subtree) of another worker
+static bore_walk_job_t* bore_walk_pop(bore_walk_worker_t* w, int steal)
+{
+    bore_walk_job_t* job = NULL;
+    bore_mutex_lock(&w->lock);
+    int n = bore_queue_size(w);
+    if (n > w->head)
+    {
+        if (steal)
+            job = ((bore_walk_job_t**)w->queue.base)[w->head++];
+        else
+        {
+            job = ((bore_walk_job_t**)w->queue.base)[n - 1];
+            bore_alloc_trim(&w->queue, sizeof(bore_walk_job_t*));
+            --n;
+        }
+        if (n == w->head)
+        {
+            w->queue.cursor = w->queue.base;
+            w->head = 0;
+        }
+    }
+    bore_mutex_unlock(&w->lock);
+    return job;
+}
+
+// A job for the directory path (without the trailing '/'), or the root if
+// path_len is 0
+static bore_walk_job_t* bore_walk_job(const char* path, int path_len, const bore_ignore_t* ignore, int proj_index)
+{
+    bore_walk_job_t* job = (bore_walk_job_t*)alloc(sizeof(bore_walk_job_t) + path_len + 1);
+    if (!job)
+        return NULL;
+    memcpy(job->path, path, path_len);
+    if (path_len > 0)
+        job->path[path_len++] = '/';
+    job->path[path_len] = NUL;
+    job->path_len = path_len;
+    job->ignore = ignore;
+    job->proj_index = proj_index;
+    return job;
+}
+
+static void bore_walk_add_entry(bore_walk_worker_t* w, int type, const char* name, size_t len)
+{
+    char* p = (char*)bore_alloc(&w->entry_alloc, len + 2);
+    p[0] = (char)type;
+    memcpy(p + 1, name, len + 1);
+}
+
+// Read the entries of the directory of job into entry_alloc. Only regular
+// files (and links to them) and directories are listed, links to
+// directories aren't followed.
+#ifdef MSWIN
+static void bore_walk_read_dir(bore_walk_worker_t* w, bore_walk_job_t* job)
+{
+    bore_walk_t* walk = w->walk;
+    char path[BORE_MAX_PATH];
+    char name[BORE_MAX_PATH];
+    WCHAR wpath[BORE_MAX_PATH];
+    WIN32_FIND_DATAW fd;
+    HANDLE h;
+
+    if (walk->root_len + job->path_len + 2 > BORE_MAX_PATH)
+        return;
+    memcpy(path, walk->root, walk->root_len);
+    memcpy(path + walk->root_len, job->path, job->path_len);
+    strcpy(path + walk->root_len + job->path_len, "*");
+    if (0 == MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, BORE_MAX_PATH))
+        return;
+
+    h = FindFirstFileExW(wpath, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (h == INVALID_HANDLE_VALUE)
+        return;
+    do
+    {
+        int type = BORE_ENTRY_FILE;
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+                continue;
+            type = BORE_ENTRY_DIR;
+        }
+        if (0 == WideCharToMultiByte(CP_UTF8, 0, fd.cFileName, -1, name, BORE_MAX_PATH, 0, 0))
+            continue;
+        bore_walk_add_entry(w, type, name, strlen(name));
+    } while (FindNextFileW(h, &fd));
+    FindClose(h);
+}
+#else
+// The type of a name in the directory dir_fd, when the directory entry
+// doesn't tell, -1 to skip it
+static int bore_walk_stat_type(int dir_fd, const char* name, int follow)
+{
+    struct stat st;
+    if (0 != fstatat(dir_fd, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW))
+        return -1;
+    if (S_ISREG(st.st_mode))
+        return BORE_ENTRY_FILE;
+    if (S_ISDIR(st.st_mode))
+        return follow ? -1 : BORE_ENTRY_DIR;
+    if (S_ISLNK(st.st_mode) && !follow)
+        return bore_walk_stat_type(dir_fd, name, 1);
+    return -1;
+}
+
+static int bore_walk_dirent_type(int dir_fd, const char* name, int d_type)
+{
+    switch (d_type)
+    {
+    case DT_REG: return BORE_ENTRY_FILE;
+    case DT_DIR: return BORE_ENTRY_DIR;
+    case DT_LNK: return bore_walk_stat_type(dir_fd, name, 1);
+    case DT_UNKNOWN: return bore_walk_stat_type(dir_fd, name, 0);
+    default: return -1;
+    }
+}
+
+#ifdef __linux__
+// getdents64 returns many entries per call, without the locking and copying
+// of readdir
+typedef struct bore_dirent64_t
+{
+    u64 d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+} bore_dirent64_t;
+#endif
+
+static void bore_walk_read_dir(bore_walk_worker_t* w, bore_walk_job_t* job)
+{
+    int fd = openat(w->walk->root_fd, job->path_len ? job->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+#ifdef __linux__
+    char buf[32 * 1024];
+    long n;
+    while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0)
+    {
+        for (long offset = 0; offset < n; )
+        {
+            bore_dirent64_t* d = (bore_dirent64_t*)(buf + offset);
+            offset += d->d_reclen;
+            int type = bore_walk_dirent_type(fd, d->d_name, d->d_type);
+            if (type >= 0)
+                bore_walk_add_entry(w, type, d->d_name, strlen(d->d_name));
+        }
+    }
+    close(fd);
+#else
+    DIR* dir = fdopendir(fd);
+    struct dirent* d;
+    if (!dir)
+    {
+        close(fd);
+        return;
+    }
+    while (NULL != (d = readdir(dir)))
+    {
+        int type = bore_walk_dirent_type(fd, d->d_name, d->d_type);
+        if (type >= 0)
+            bore_walk_add_entry(w, type, d->d_name, strlen(d->d_name));
+    }
+    closedir(dir);
+#endif
+}
+#endif
+
+// List the directory of job. The subdirectories are pushed as jobs, unless
+// subdirs is given (for the root), then they are added to it.
+static void bore_walk_dir_job(bore_walk_worker_t* w, bore_walk_job_t* job, bore_alloc_t* subdirs)
+{
+    bore_walk_t* walk = w->walk;
+    const bore_ignore_t* ignore = job->ignore;
+    char path[BORE_MAX_PATH];
+    char* p;
+    char* end;
+
+    if (job->path_len > 0)
+    {
+        char* s = (char*)bore_alloc(&w->data_alloc, job->path_len + 1);
+        memcpy(s, job->path, job->path_len + 1);
+        *(u32*)bore_alloc(&w->dir_alloc, sizeof(u32)) = (u32)(s - (char*)w->data_alloc.base);
+        ++w->dir_count;
+    }
+
+    w->entry_alloc.cursor = w->entry_alloc.base;
+    bore_walk_read_dir(w, job);
+    end = (char*)w->entry_alloc.cursor;
+
+    for (p = (char*)w->entry_alloc.base; p < end; p += strlen(p + 1) + 2)
+    {
+        if (p[0] == BORE_ENTRY_FILE && 0 == strcmp(p + 1, ".gitignore"))
+        {
+            bore_ignore_t* rules;
+            if (walk->root_len + job->path_len + 11 > BORE_MAX_PATH)
+                break;
+            memcpy(path, walk->root, walk->root_len);
+            memcpy(path + walk->root_len, job->path, job->path_len);
+            strcpy(path + walk->root_len + job->path_len, ".gitignore");
+            rules = bore_ignore_load(path, (bore_ignore_t*)job->ignore, job->path_len);
+            if (rules)
+            {
+                rules->next = w->ignores;
+                w->ignores = rules;
+                ignore = rules;
+            }
+            break;
+        }
+    }
+
+    memcpy(path, job->path, job->path_len);
+    for (p = (char*)w->entry_alloc.base; p < end; p += strlen(p + 1) + 2)
+    {
+        const char* name = p + 1;
+        size_t len = strlen(name);
+        int is_dir = p[0] == BORE_ENTRY_DIR;
+
+        if (name[0] == '.' && (name[1] == NUL || (name[1] == '.' && name[2] == NUL)))
+            continue;
+        if (is_dir && 0 == strcmp(name, ".git"))
+            continue;
+        if (job->path_len + len + 2 > BORE_MAX_PATH)
+            continue;
+        memcpy(path + job->path_len, name, len + 1);
+        if (!is_dir && bore_is_excluded_file(name))
+            continue;
+        if (bore_is_ignored(ignore, path, path + job->path_len, is_dir))
+            continue;
+
+        if (is_dir)
+        {
+            bore_walk_job_t* child = bore_walk_job(path, job->path_len + (int)len, ignore, job->proj_index);
+            if (!child)
+                continue;
+            if (subdirs)
+                *(bore_walk_job_t**)bore_alloc(subdirs, sizeof(bore_walk_job_t*)) = child;
+            else
+                bore_walk_push(w, child);
+        }
+        else
+        {
+            bore_file_t* file = (bore_file_t*)bore_alloc(&w->file_alloc, sizeof(bore_file_t));
+            char* s = (char*)bore_alloc(&w->data_alloc, job->path_len + len + 1);
+            memcpy(s, path, job->path_len + len + 1);
+            file->file = (u32)(s - (char*)w->data_alloc.base);
+            file->proj_index = job->proj_index;
+            ++w->file_count;
+        }
+    }
+}
+
+static void bore_walk_worker(bore_walk_worker_t* w)
+{
+    bore_walk_t* walk = w->walk;
+    int index = (int)(w - walk->workers);
+
+    for (;;)
+    {
+        bore_walk_job_t* job = bore_walk_pop(w, 0);
+        for (int i = 1; !job && i < walk->worker_count; ++i)
+            job = bore_walk_pop(&walk->workers[(index + i) % walk->worker_count], 1);
+
+        if (job)
+        {
+            bore_walk_dir_job(w, job, NULL);
+            vim_free(job);
+            if (0 == bore_atomic_dec(&walk->pending))
+            {
+                bore_mutex_lock(&walk->idle_lock);
+                bore_cond_broadcast(&walk->idle_cond);
+                bore_mutex_unlock(&walk->idle_lock);
+            }
+            continue;
+        }
+
+        if (0 == bore_atomic_load(&walk->pending))
+            break;
+
+        // Another worker is still listing a directory, wait for it to push
+        // the subdirectories (or to finish)
+        bore_mutex_lock(&walk->idle_lock);
+        bore_atomic_add(&walk->idle, 1);
+        if (bore_atomic_load(&walk->pending) > 0)
+            bore_cond_wait_ms(&walk->idle_cond, &walk->idle_lock, 1);
+        bore_atomic_add(&walk->idle, -1);
+        bore_mutex_unlock(&walk->idle_lock);
+    }
+}
+
+BORE_THREAD_PROC(bore_walk_thread)
+{
+    bore_walk_worker((bore_walk_worker_t*)param);
+    BORE_THREAD_RETURN;
+}
+
+static int bore_compare_jobs(const void* vx, const void* vy)
+{
+    const bore_walk_job_t* x = *(const bore_walk_job_t**)vx;
+    const bore_walk_job_t* y = *(const bore_walk_job_t**)vy;
+    return strcmp(x->path, y->path);
+}
+
+static void bore_dir_list_init(bore_dir_list_t* list)
+{
+    memset(list, 0, sizeof(bore_dir_list_t));
+    bore_prealloc(&list->data_alloc, 1024 * 1024);
+    bore_prealloc(&list->dir_alloc, sizeof(u32) * 256);
+    bore_prealloc(&list->file_alloc, sizeof(bore_file_t) * 16 * 1024);
+    bore_prealloc(&list->subdir_alloc, sizeof(u32) * 1024);
+}
+
+// Append a path to the list, in the native form
+static u32 bore_dir_list_add_path(bore_dir_list_t* list, const char* path, size_t len)
+{
+    char* s = (char*)bore_alloc(&list->data_alloc, len + 1);
+    memcpy(s, path, len);
+    s[len] = NUL;
+#ifdef MSWIN
+    for (char* c = s; *c; ++c)
+        if (*c == '/')
+            *c = BORE_PATHSEP;
+#endif
+    return (u32)(s - (char*)list->data_alloc.base);
+}
+
+static bore_walk_t* bore_walk_init(const char* root, int thread_count)
+{
+    bore_walk_t* walk = (bore_walk_t*)alloc_clear(sizeof(bore_walk_t));
+    int i;
+
+    if (!walk)
+        return NULL;
+    walk->root_len = (int)strlen(root);
+    if (walk->root_len + 2 > BORE_MAX_PATH)
+    {
+        vim_free(walk);
+        return NULL;
+    }
+    strcpy(walk->root, root);
+#ifndef MSWIN
+    walk->root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (walk->root_fd < 0)
+    {
+        vim_free(walk);
+        return NULL;
+    }
+#endif
+
+    if (thread_count < 1)
+        thread_count = 1;
+    if (thread_count > BORE_MAX_SEARCH_THREADS)
+        thread_count = BORE_MAX_SEARCH_THREADS;
+    walk->worker_count = thread_count;
+    bore_mutex_init(&walk->idle_lock);
+    bore_cond_init(&walk->idle_cond);
+    for (i = 0; i < thread_count; ++i)
+    {
+        bore_walk_worker_t* w = &walk->workers[i];
+        w->walk = walk;
+        bore_mutex_init(&w->lock);
+        bore_prealloc(&w->queue, sizeof(bore_walk_job_t*) * 1024);
+        bore_prealloc(&w->entry_alloc, 64 * 1024);
+        bore_prealloc(&w->data_alloc, 1024 * 1024);
+        bore_prealloc(&w->file_alloc, sizeof(bore_file_t) * 16 * 1024);
+        bore_prealloc(&w->dir_alloc, sizeof(u32) * 1024);
+    }
+    return walk;
+}
+
+// Walk the jobs that were pushed, the calling thread is the first worker
+static void bore_walk_run(bore_walk_t* walk)
+{
+    bore_thread_t threads[BORE_MAX_SEARCH_THREADS];
+    int i, started = 0;
+
+    for (i = 1; i < walk->worker_count; ++i)
+    {
+        if (!bore_thread_start(&threads[started], bore_walk_thread, &walk->workers[i]))
+            break;
+        ++started;
+    }
+    bore_walk_worker(&walk->workers[0]);
+    for (i = 0; i < started; ++i)
+        bore_thread_join(threads[i]);
+    // Jobs pushed to workers that didn't start are taken by the others, so
+    // all queues are empty here
+}
+
+// Move what the workers found to list, and free the walk
+static void bore_walk_finish(bore_walk_t* walk, bore_dir_list_t* list)
+{
+    int i, k;
+
+    for (i = 0; i < walk->worker_count; ++i)
+    {
+        bore_walk_worker_t* w = &walk->workers[i];
+        bore_file_t* files = (bore_file_t*)w->file_alloc.base;
+        u32* dirs = (u32*)w->dir_alloc.base;
+        for (k = 0; k < w->file_count; ++k)
+        {
+            const char* path = (const char*)w->data_alloc.base + files[k].file;
+            bore_file_t* file = (bore_file_t*)bore_alloc(&list->file_alloc, sizeof(bore_file_t));
+            file->file = bore_dir_list_add_path(list, path, strlen(path));
+            file->proj_index = files[k].proj_index;
+        }
+        list->file_count += w->file_count;
+        for (k = 0; k < w->dir_count; ++k)
+        {
+            const char* path = (const char*)w->data_alloc.base + dirs[k];
+            *(u32*)bore_alloc(&list->subdir_alloc, sizeof(u32)) = bore_dir_list_add_path(list, path, strlen(path));
+        }
+        list->subdir_count += w->dir_count;
+
+        bore_ignore_free(w->ignores);
+        bore_alloc_free(&w->queue);
+        bore_alloc_free(&w->entry_alloc);
+        bore_alloc_free(&w->data_alloc);
+        bore_alloc_free(&w->file_alloc);
+        bore_alloc_free(&w->dir_alloc);
+        bore_mutex_destroy(&w->lock);
+    }
+    bore_cond_destroy(&walk->idle_cond);
+    bore_mutex_destroy(&walk->idle_lock);
+#ifndef MSWIN
+    close(walk->root_fd);
+#endif
+    vim_free(walk);
+}
+
+// The rules of .git/info/exclude, freed with the rules of the first worker
+static bore_ignore_t* bore_walk_load_exclude(bore_walk_t* walk, const char* exclude_file)
+{
+    bore_ignore_t* exclude = exclude_file ? bore_ignore_load(exclude_file, NULL, 0) : NULL;
+    if (exclude)
+    {
+        exclude->next = walk->workers[0].ignores;
+        walk->workers[0].ignores = exclude;
+    }
+    return exclude;
+}
+
+int bore_walk_dir(const char* root, int thread_count, const char* exclude_file, bore_dir_list_t* list)
+{
+    bore_walk_t* walk;
+    bore_walk_job_t* root_job;
+    bore_alloc_t subdirs;
+    bore_ignore_t* exclude;
+    int subdir_count;
+    int i;
+
+    walk = bore_walk_init(root, thread_count);
+    if (!walk)
+        return FAIL;
+    exclude = bore_walk_load_exclude(walk, exclude_file);
+
+    // The root is listed first, its subdirectories are the projects
+    bore_prealloc(&subdirs, sizeof(bore_walk_job_t*) * 256);
+    root_job = bore_walk_job("", 0, exclude, 0);
+    if (root_job)
+    {
+        bore_walk_dir_job(&walk->workers[0], root_job, &subdirs);
+        vim_free(root_job);
+    }
+    subdir_count = (int)((subdirs.cursor - subdirs.base) / sizeof(bore_walk_job_t*));
+    bore_walk_job_t** jobs = (bore_walk_job_t**)subdirs.base;
+    qsort(jobs, subdir_count, sizeof(bore_walk_job_t*), bore_compare_jobs);
+
+    bore_dir_list_init(list);
+    for (i = 0; i < subdir_count; ++i)
+    {
+        jobs[i]->proj_index = i + 1;
+        *(u32*)bore_alloc(&list->dir_alloc, sizeof(u32)) =
+            bore_dir_list_add_path(list, jobs[i]->path, jobs[i]->path_len - 1);
+        ++list->dir_count;
+        bore_walk_push(&walk->workers[i % walk->worker_count], jobs[i]);
+    }
+    bore_alloc_free(&subdirs);
+
+    bore_walk_run(walk);
+    bore_walk_finish(walk, list);
+    return OK;
+}
+
+// The .gitignore rules of a directory and the directories above it, while
+// bore_walk_paths goes through the sorted paths
+typedef struct bore_walk_level_t
+{
+    const bore_ignore_t* ignore;
+    int path_len; // of the directory, with the '/'
+    int ignored;
+} bore_walk_level_t;
+
+int bore_walk_paths(const char* root, const char** paths, int count, int thread_count,
+        const char* exclude_file, bore_dir_list_t* list, char* missing)
+{
+    bore_walk_level_t levels[BORE_MAX_PATH / 2];
+    char dir[BORE_MAX_PATH]; // the directory of levels, '/' separated
+    char path[BORE_MAX_PATH];
+    char full[BORE_MAX_PATH];
+    bore_walk_t* walk;
+    bore_walk_worker_t* w;
+    int level_count = 1;
+    int i;
+
+    walk = bore_walk_init(root, thread_count);
+    if (!walk)
+        return FAIL;
+    w = &walk->workers[0];
+    levels[0].ignore = bore_walk_load_exclude(walk, exclude_file);
+    levels[0].path_len = 0;
+    levels[0].ignored = 0;
+    dir[0] = NUL;
+
+    for (i = 0; i < count; ++i)
+    {
+        int len = (int)strlen(paths[i]);
+        int name_start, k;
+        stat_T st;
+
+        missing[i] = 0;
+        if (len == 0 || walk->root_len + len + 2 > BORE_MAX_PATH)
+            continue;
+        for (k = 0; k <= len; ++k)
+            path[k] = paths[i][k] == BORE_PATHSEP ? '/' : paths[i][k];
+        if (path[len - 1] == '/')
+            path[--len] = NUL;
+        memcpy(full, walk->root, walk->root_len);
+        memcpy(full + walk->root_len, paths[i], len + 1);
+        if (0 != mch_lstat(full, &st))
+        {
+            missing[i] = 1;
+            continue;
+        }
+#ifdef S_ISLNK
+        if (S_ISLNK(st.st_mode))
+        {
+            // Links to files are listed, links to directories aren't followed
+            if (0 != mch_stat(full, &st))
+            {
+                missing[i] = 1;
+                continue;
+            }
+            if (S_ISDIR(st.st_mode))
+                continue;
+        }
+#endif
+        if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode))
+            continue;
+
+        // Keep the levels that are shared with the previous path, and go
+        // down to the directory of this one
+        name_start = len;
+        while (name_start > 0 && path[name_start - 1] != '/')
+            --name_start;
+        while (level_count > 1 && (levels[level_count - 1].path_len > name_start ||
+                    0 != memcmp(dir, path, levels[level_count - 1].path_len)))
+            --level_count;
+        while (levels[level_count - 1].path_len < name_start)
+        {
+            bore_walk_level_t* parent = &levels[level_count - 1];
+            bore_walk_level_t* level = &levels[level_count++];
+            int end = parent->path_len;
+
+            while (path[end] != '/')
+                ++end;
+            memcpy(dir + parent->path_len, path + parent->path_len, end - parent->path_len + 1);
+            dir[end] = NUL;
+            level->path_len = end + 1;
+            level->ignore = parent->ignore;
+            level->ignored = parent->ignored || 0 == strcmp(dir + parent->path_len, ".git") ||
+                bore_is_ignored(parent->ignore, dir, dir + parent->path_len, 1);
+            dir[end] = '/';
+            if (!level->ignored && walk->root_len + level->path_len + 11 <= BORE_MAX_PATH)
+            {
+                bore_ignore_t* rules;
+                memcpy(full + walk->root_len, dir, level->path_len);
+                strcpy(full + walk->root_len + level->path_len, ".gitignore");
+                rules = bore_ignore_load(full, (bore_ignore_t*)parent->ignore, level->path_len);
+                if (rules)
+                {
+                    rules->next = w->ignores;
+                    w->ignores = rules;
+                    level->ignore = rules;
+                }
+            }
+        }
+
+        const bore_walk_level_t* level = &levels[level_count - 1];
+        const char* name = path + name_start;
+        int is_dir = S_ISDIR(st.st_mode);
+        if (level->ignored || (is_dir && 0 == strcmp(name, ".git")))
+            continue;
+        if (!is_dir && bore_is_excluded_file(name))
+            continue;
+        if (bore_is_ignored(level->ignore, path, name, is_dir))
+            continue;
+
+        if (is_dir)
+        {
+            bore_walk_job_t* job = bore_walk_job(path, len, level->ignore, 0);
+            if (job)
+                bore_walk_push(&walk->workers[i % walk->worker_count], job);
+        }
+        else
+        {
+            bore_file_t* file = (bore_file_t*)bore_alloc(&w->file_alloc, sizeof(bore_file_t));
+            char* s = (char*)bore_alloc(&w->data_alloc, len + 1);
+            memcpy(s, path, len + 1);
+            file->file = (u32)(s - (char*)w->data_alloc.base);
+            file->proj_index = 0;
+            ++w->file_count;
+        }
+    }
+
+    bore_dir_list_init(list);
+    bore_walk_run(walk);
+    bore_walk_finish(walk, list);
+    return OK;
+}
+
+void bore_dir_list_free(bore_dir_list_t* list)
+{
+    bore_alloc_free(&list->data_alloc);
+    bore_alloc_free(&list->dir_alloc);
+    bore_alloc_free(&list->file_alloc);
+    bore_alloc_free(&list->subdir_alloc);
+}
+
+//
+// Git
+//
+
+int bore_find_git_dir(const char* dir, char* git_dir, char* work_tree)
+{
+    char path[BORE_MAX_PATH];
+    size_t len = strlen(dir);
+
+    if (len + 5 > BORE_MAX_PATH)
+        return FAIL;
+    memcpy(path, dir, len + 1);
+    while (len > 0)
+    {
+        stat_T st;
+        strcpy(path + len, ".git");
+        if (0 == mch_stat(path, &st))
+        {
+            path[len] = NUL;
+            strcpy(work_tree, path);
+            if (S_ISDIR(st.st_mode))
+            {
+                vim_snprintf(git_dir, BORE_MAX_PATH, "%s.git", work_tree);
+                return OK;
+            }
+
+            // A worktree or submodule: "gitdir: <path>", relative to the
+            // work tree
+            size_t size;
+            strcpy(path + len, ".git");
+            char* text = bore_read_text_file(path, &size);
+            if (!text)
+                return FAIL;
+            int result = FAIL;
+            if (0 == STRNCMP(text, "gitdir: ", 8))
+            {
+                char* end = text + 8;
+                while (*end && *end != '\r' && *end != '\n')
+                    ++end;
+                *end = NUL;
+                if (mch_isFullName((char_u*)text + 8))
+                    vim_strncpy((char_u*)git_dir, (char_u*)text + 8, BORE_MAX_PATH - 1);
+                else
+                    vim_snprintf(git_dir, BORE_MAX_PATH, "%s%s", work_tree, text + 8);
+                result = OK;
+            }
+            vim_free(text);
+            return result;
+        }
+
+        // Up to the parent directory
+        --len;
+        while (len > 0 && path[len - 1] != BORE_PATHSEP && path[len - 1] != '/')
+            --len;
+    }
+    return FAIL;
+}
+
+static u32 bore_read_be32(const u8* p)
+{
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+}
+
+#define BORE_GIT_INDEX_ENTRY 62 // stat data, mode, sha-1 and flags
+#define BORE_GIT_MODE_TYPE 0170000
+#define BORE_GIT_MODE_DIR 0040000
+#define BORE_GIT_MODE_GITLINK 0160000
+
+// Reads index versions 2 to 4, see Documentation/gitformat-index.txt in git.
+// Repos with sha-256 object names, a split index or a sparse index are left
+// to git.
+int bore_read_git_index(const char* index_path, const char* prefix, bore_dir_list_t* list)
+{
+    char path[BORE_MAX_PATH];
+    char last_dir[BORE_MAX_PATH];
+    size_t prefix_len = strlen(prefix);
+    size_t path_len = 0;
+    size_t last_dir_len = 0;
+    size_t size;
+    u8* data;
+    const u8* p;
+    const u8* end;
+    u32 version, count, i;
+    int result = FAIL;
+
+    data = (u8*)bore_read_text_file(index_path, &size);
+    if (!data)
+        return FAIL;
+    if (size < 12 + 20 || 0 != memcmp(data, "DIRC", 4))
+        goto done;
+    version = bore_read_be32(data + 4);
+    count = bore_read_be32(data + 8);
+    if (version < 2 || version > 4)
+        goto done;
+
+    bore_dir_list_init(list);
+    p = data + 12;
+    end = data + size - 20; // the checksum
+    path[0] = NUL;
+    for (i = 0; i < count; ++i)
+    {
+        const u8* name;
+        size_t name_len;
+        u32 mode;
+        int flags; // the stages of a conflict are separate entries, boresln removes the duplicates
+
+        if (p + BORE_GIT_INDEX_ENTRY > end)
+            goto fail;
+        mode = bore_read_be32(p + 24);
+        flags = (p[60] << 8) | p[61];
+        name = p + BORE_GIT_INDEX_ENTRY;
+        if (version >= 3 && (flags & 0x4000))
+            name += 2; // extended flags
+        if (name >= end)
+            goto fail;
+
+        if (version == 4)
+        {
+            // The name replaces the last n bytes of the previous name
+            size_t strip = *name & 127;
+            while (*name++ & 128)
+            {
+                if (name >= end)
+                    goto fail;
+                strip = ((strip + 1) << 7) | (*name & 127);
+            }
+            if (strip > path_len)
+                goto fail;
+            path_len -= strip;
+            name_len = strnlen((const char*)name, end - name);
+            if (name + name_len >= end || path_len + name_len >= BORE_MAX_PATH)
+                goto fail;
+            memcpy(path + path_len, name, name_len + 1);
+            path_len += name_len;
+            p = name + name_len + 1;
+        }
+        else
+        {
+            name_len = strnlen((const char*)name, end - name);
+            if (name + name_len >= end || name_len >= BORE_MAX_PATH)
+                goto fail;
+            memcpy(path, name, name_len + 1);
+            path_len = name_len;
+            // Padded with 1-8 NULs to a multiple of eight bytes
+            p = p + ((name - p + name_len + 8) & ~7);
+        }
+
+        if ((mode & BORE_GIT_MODE_TYPE) == BORE_GIT_MODE_DIR)
+            goto fail; // sparse index
+        if ((mode & BORE_GIT_MODE_TYPE) == BORE_GIT_MODE_GITLINK)
+            continue; // submodule
+        if (path_len <= prefix_len || 0 != STRNCMP(path, prefix, prefix_len))
+            continue;
+
+        const char* rel = path + prefix_len;
+        const char* name_start = strrchr(rel, '/');
+        if (bore_is_excluded_file(name_start ? name_start + 1 : rel))
+            continue;
+
+        // The index is sorted, so the files of a directory are together
+        int proj_index = 0;
+        const char* slash = strchr(rel, '/');
+        if (slash)
+        {
+            size_t dir_len = slash - rel;
+            if (dir_len != last_dir_len || 0 != memcmp(last_dir, rel, dir_len))
+            {
+                memcpy(last_dir, rel, dir_len);
+                last_dir_len = dir_len;
+                *(u32*)bore_alloc(&list->dir_alloc, sizeof(u32)) = bore_dir_list_add_path(list, rel, dir_len);
+                ++list->dir_count;
+            }
+            proj_index = list->dir_count;
+        }
+
+        bore_file_t* file = (bore_file_t*)bore_alloc(&list->file_alloc, sizeof(bore_file_t));
+        file->file = bore_dir_list_add_path(list, rel, path_len - prefix_len);
+        file->proj_index = proj_index;
+        ++list->file_count;
+    }
+
+    // A split index keeps the entries in another file
+    while (p + 8 <= end)
+    {
+        u32 ext_size = bore_read_be32(p + 4);
+        if (0 == memcmp(p, "link", 4))
+            goto fail;
+        if (ext_size > (size_t)(end - p - 8))
+            goto fail;
+        p += 8 + ext_size;
+    }
+
+    result = OK;
+    goto done;
+
+fail:
+    bore_dir_list_free(list);
+done:
+    vim_free(data);
+    return result;
+}
+
+//
+// Watching
+//
+
+#if defined(MSWIN)
+// A directory handle with a pending ReadDirectoryChangesW
+typedef struct bore_watch_dir_t
+{
+    HANDLE handle;
+    OVERLAPPED overlapped;
+    u32 path;
+    int tree;
+    DWORD buffer[16 * 1024]; // FILE_NOTIFY_INFORMATION records
+} bore_watch_dir_t;
+#endif
+
+struct bore_watch_t
+{
+    char root[BORE_MAX_PATH];
+    int root_len;
+    int changes;
+    bore_alloc_t data_alloc; // the paths of the directories, offset 0 is none
+#if defined(MSWIN)
+    bore_alloc_t dir_alloc;  // bore_watch_dir_t*, NULL when the directory is gone
+    int dir_count;
+#elif defined(__linux__)
+    int fd;
+    bore_alloc_t wd_alloc;   // u32 path of each watch descriptor, 0 when it is gone
+    int wd_count;
+#endif
+};
+
+static u32 bore_watch_strdup(bore_alloc_t* p, const char* s1, size_t len1, const char* s2, size_t len2)
+{
+    char* s = (char*)bore_alloc(p, len1 + len2 + 1);
+    memcpy(s, s1, len1);
+    memcpy(s + len1, s2, len2);
+    s[len1 + len2] = NUL;
+    return (u32)(s - (char*)p->base);
+}
+
+static void bore_watch_add_event(bore_watch_t* watch, u32 dir, const char* name, size_t name_len, int flags,
+        bore_alloc_t* data_alloc, bore_alloc_t* event_alloc)
+{
+    const char* dir_path = (const char*)watch->data_alloc.base + dir;
+    bore_watch_event_t* event = (bore_watch_event_t*)bore_alloc(event_alloc, sizeof(bore_watch_event_t));
+    event->path = bore_watch_strdup(data_alloc, dir_path, strlen(dir_path), name, name_len);
+    event->flags = flags;
+}
+
+#if defined(MSWIN)
+
+static int bore_watch_issue(bore_watch_t* watch, bore_watch_dir_t* d)
+{
+    DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME;
+    if (watch->changes)
+        filter |= FILE_NOTIFY_CHANGE_LAST_WRITE;
+    ResetEvent(d->overlapped.hEvent);
+    return ReadDirectoryChangesW(d->handle, d->buffer, sizeof(d->buffer), d->tree, filter,
+            NULL, &d->overlapped, NULL);
+}
+
+static void bore_watch_close_dir(bore_watch_dir_t* d)
+{
+    DWORD bytes;
+    if (CancelIo(d->handle))
+        GetOverlappedResult(d->handle, &d->overlapped, &bytes, TRUE);
+    CloseHandle(d->handle);
+    CloseHandle(d->overlapped.hEvent);
+    vim_free(d);
+}
+
+#endif
+
+struct bore_watch_t* bore_watch_start(const char* root, int changes)
+{
+#if defined(MSWIN) || defined(__linux__)
+    bore_watch_t* watch = (bore_watch_t*)alloc_clear(sizeof(bore_watch_t));
+    if (!watch)
+        return NULL;
+    watch->root_len = (int)strlen(root);
+    if (watch->root_len + 1 > BORE_MAX_PATH)
+    {
+        vim_free(watch);
+        return NULL;
+    }
+    strcpy(watch->root, root);
+    watch->changes = changes;
+# if defined(MSWIN)
+    bore_prealloc(&watch->dir_alloc, sizeof(bore_watch_dir_t*) * 64);
+# else
+    watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch->fd < 0)
+    {
+        vim_free(watch);
+        return NULL;
+    }
+    bore_prealloc(&watch->wd_alloc, sizeof(u32) * 1024);
+# endif
+    bore_prealloc(&watch->data_alloc, 64 * 1024);
+    *(char*)bore_alloc(&watch->data_alloc, 1) = NUL;
+    return watch;
+#else
+    return NULL;
+#endif
+}
+
+int bore_watch_add(struct bore_watch_t* watch, const char* dir, int tree)
+{
+    char path[BORE_MAX_PATH];
+    size_t len = strlen(dir);
+
+    if (watch->root_len + len + 1 > BORE_MAX_PATH)
+        return FAIL;
+    memcpy(path, watch->root, watch->root_len);
+    memcpy(path + watch->root_len, dir, len + 1);
+
+#if defined(MSWIN)
+    WCHAR wpath[BORE_MAX_PATH];
+    bore_watch_dir_t** dirs = (bore_watch_dir_t**)watch->dir_alloc.base;
+    bore_watch_dir_t* d;
+    int i;
+
+    for (i = 0; i < watch->dir_count; ++i)
+        if (dirs[i] && 0 == STRICMP((char*)watch->data_alloc.base + dirs[i]->path, dir))
+            return OK;
+    if (0 == MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, BORE_MAX_PATH))
+        return FAIL;
+    d = (bore_watch_dir_t*)alloc_clear(sizeof(bore_watch_dir_t));
+    if (!d)
+        return FAIL;
+    d->handle = CreateFileW(wpath, FILE_LIST_DIRECTORY,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+            FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+    if (d->handle == INVALID_HANDLE_VALUE)
+    {
+        DWORD error = GetLastError();
+        vim_free(d);
+        // Already gone, its parent reports that
+        return error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND ? OK : FAIL;
+    }
+    d->overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    d->tree = tree;
+    if (!d->overlapped.hEvent || !bore_watch_issue(watch, d))
+    {
+        if (d->overlapped.hEvent)
+            CloseHandle(d->overlapped.hEvent);
+        CloseHandle(d->handle);
+        vim_free(d);
+        return FAIL;
+    }
+    d->path = bore_watch_strdup(&watch->data_alloc, dir, len, "", 0);
+    *(bore_watch_dir_t**)bore_alloc(&watch->dir_alloc, sizeof(bore_watch_dir_t*)) = d;
+    ++watch->dir_count;
+    return OK;
+#elif defined(__linux__)
+    u32 mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK;
+    int wd;
+
+    if (watch->changes)
+        mask |= IN_CLOSE_WRITE;
+    // A directory that is watched already gets the same descriptor, with
+    // the path it has now
+    wd = inotify_add_watch(watch->fd, path, mask);
+    if (wd < 0)
+        return errno == ENOENT || errno == ENOTDIR ? OK : FAIL;
+    while (watch->wd_count <= wd)
+    {
+        *(u32*)bore_alloc(&watch->wd_alloc, sizeof(u32)) = 0;
+        ++watch->wd_count;
+    }
+    ((u32*)watch->wd_alloc.base)[wd] = bore_watch_strdup(&watch->data_alloc, dir, len, "", 0);
+    return OK;
+#else
+    return FAIL;
+#endif
+}
+
+int bore_watch_read(struct bore_watch_t* watch, bore_alloc_t* data_alloc, bore_alloc_t* event_alloc)
+{
+    int count = 0;
+    int lost = 0;
+
+#if defined(MSWIN)
+    bore_watch_dir_t** dirs = (bore_watch_dir_t**)watch->dir_alloc.base;
+    char name[BORE_MAX_PATH];
+    int i;
+
+    for (i = 0; i < watch->dir_count; ++i)
+    {
+        bore_watch_dir_t* d = dirs[i];
+        DWORD bytes;
+
+        while (d)
+        {
+            if (!GetOverlappedResult(d->handle, &d->overlapped, &bytes, FALSE))
+            {
+                if (GetLastError() == ERROR_IO_INCOMPLETE)
+                    break;
+                // The directory is gone, its parent reports that
+                bore_watch_close_dir(d);
+                d = dirs[i] = NULL;
+                break;
+            }
+
+            if (bytes == 0)
+                lost = 1; // more changes than fit in the buffer
+            else
+            {
+                const u8* p = (const u8*)d->buffer;
+                for (;;)
+                {
+                    const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)p;
+                    int len = WideCharToMultiByte(CP_UTF8, 0, info->FileName,
+                            info->FileNameLength / sizeof(WCHAR), name, BORE_MAX_PATH - 1, 0, 0);
+                    int flags = 0;
+                    switch (info->Action)
+                    {
+                    case FILE_ACTION_ADDED:
+                    case FILE_ACTION_RENAMED_NEW_NAME: flags = BORE_WATCH_ADDED; break;
+                    case FILE_ACTION_REMOVED:
+                    case FILE_ACTION_RENAMED_OLD_NAME: flags = BORE_WATCH_REMOVED; break;
+                    case FILE_ACTION_MODIFIED: flags = watch->changes ? BORE_WATCH_CHANGED : 0; break;
+                    }
+                    if (len > 0 && flags)
+                    {
+                        bore_watch_add_event(watch, d->path, name, len, flags, data_alloc, event_alloc);
+                        ++count;
+                    }
+                    if (!info->NextEntryOffset)
+                        break;
+                    p += info->NextEntryOffset;
+                }
+            }
+
+            if (!bore_watch_issue(watch, d))
+            {
+                bore_watch_close_dir(d);
+                d = dirs[i] = NULL;
+            }
+        }
+    }
+#elif defined(__linux__)
+    u64 buf[2 * 1024]; // aligned for struct inotify_event
+    ssize_t n;
+
+    while ((n = read(watch->fd, buf, sizeof(buf))) > 0)
+    {
+        const char* p = (const char*)buf;
+        const char* end = p + n;
+        while (p < end)
+        {
+            const struct inotify_event* e = (const struct inotify_event*)p;
+            u32* wds = (u32*)watch->wd_alloc.base;
+            int flags = 0;
+
+            p += sizeof(struct inotify_event) + e->len;
+            if (e->mask & IN_Q_OVERFLOW)
+            {
+                lost = 1;
+                continue;
+            }
+            if (e->wd < 0 || e->wd >= watch->wd_count || !wds[e->wd])
+                continue;
+            if (e->mask & IN_IGNORED)
+            {
+                wds[e->wd] = 0;
+                continue;
+            }
+            if (e->mask & IN_MOVE_SELF)
+            {
+                // The new name is reported by the parent, and watched again
+                // from there
+                inotify_rm_watch(watch->fd, e->wd);
+                wds[e->wd] = 0;
+                continue;
+            }
+
+            if (e->mask & (IN_CREATE | IN_MOVED_TO))
+                flags |= BORE_WATCH_ADDED;
+            if (e->mask & (IN_DELETE | IN_MOVED_FROM))
+                flags |= BORE_WATCH_REMOVED;
+            if (e->mask & IN_CLOSE_WRITE)
+                flags |= BORE_WATCH_CHANGED;
+            if (e->mask & IN_ISDIR)
+                flags |= BORE_WATCH_DIR;
+            if (!flags || !e->len)
+                continue;
+            bore_watch_add_event(watch, wds[e->wd], e->name, strlen(e->name), flags, data_alloc, event_alloc);
+            ++count;
+        }
+    }
+#endif
+
+    return lost ? -1 : count;
+}
+
+void bore_watch_free(struct bore_watch_t* watch)
+{
+    if (!watch)
+        return;
+#if defined(MSWIN)
+    bore_watch_dir_t** dirs = (bore_watch_dir_t**)watch->dir_alloc.base;
+    for (int i = 0; i < watch->dir_count; ++i)
+        if (dirs[i])
+            bore_watch_close_dir(dirs[i]);
+    bore_alloc_free(&watch->dir_alloc);
+#elif defined(__linux__)
+    close(watch->fd);
+    bore_alloc_free(&watch->wd_alloc);
+#endif
+    bore_alloc_free(&watch->data_alloc);
+    vim_free(watch);
+}
+
+#endif
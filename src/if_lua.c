@@ -964,6 +964,9 @@ luaV_list_newindex(lua_State *L)
 	    luaV_checktypval(L, 3, &v, "setting list item");
 	    clear_tv(&li->li_tv);
 	    li->li_tv = v;
+#ifdef FEAT_BORE
+	    list_changed(l);
+#endif
 	}
     }
     return 0;
@@ -2738,6 +2738,9 @@ ListAssIndex(ListObject *self, Py_ssize_t index, PyObject *obj)
 	clear_tv(&li->li_tv);
 	copy_tv(&tv, &li->li_tv);
 	clear_tv(&tv);
+#ifdef FEAT_BORE
+	list_changed(l);
+#endif
     }
     return 0;
 }
@@ -23,6 +23,20 @@ static list_T		*first_list = NULL;	// list of all lists
 
 static void list_free_item(list_T *l, listitem_T *item);
 
+#if defined(FEAT_BORE) || defined(PROTO)
+static varnumber_T	last_list_changedtick = 0;
+
+/*
+ * Called when list "l" is allocated or its items are changed.  Its changedtick
+ * is one no list had before, also when it is allocated where a freed list was.
+ */
+    void
+list_changed(list_T *l)
+{
+    l->lv_changedtick = ++last_list_changedtick;
+}
+#endif
+
 /*
  * Add a watcher to a list.
  */
@@ -77,6 +91,9 @@ list_init(list_T *l)
     l->lv_used_prev = NULL;
     l->lv_used_next = first_list;
     first_list = l;
+#ifdef FEAT_BORE
+    list_changed(l);
+#endif
 }
 
 /*
@@ -590,6 +607,9 @@ list_append(list_T *l, listitem_T *item)
     l->lv_u.mat.lv_last = item;
     ++l->lv_len;
     item->li_next = NULL;
+#ifdef FEAT_BORE
+    list_changed(l);
+#endif
 }
 
 /*
@@ -755,6 +775,9 @@ list_insert(list_T *l, listitem_T *ni, listitem_T *item)
 	}
 	item->li_prev = ni;
 	++l->lv_len;
+#ifdef FEAT_BORE
+	list_changed(l);
+#endif
     }
 }
 
@@ -887,6 +910,9 @@ list_assign_range(
 	    clear_tv(&dest_li->li_tv);
 	    copy_tv(&src_li->li_tv, &dest_li->li_tv);
 	}
+#ifdef FEAT_BORE
+	list_changed(dest);
+#endif
 	src_li = src_li->li_next;
 	if (src_li == NULL || (!empty_idx2 && idx2 == idx))
 	    break;
@@ -1358,6 +1384,9 @@ vimlist_remove(list_T *l, listitem_T *item, listitem_T *item2)
     else
 	item->li_prev->li_next = item2->li_next;
     l->lv_u.mat.lv_idx_item = NULL;
+#ifdef FEAT_BORE
+    list_changed(l);
+#endif
 }
 
 /*
@@ -1690,6 +1719,9 @@ init_static_list(staticList10_T *sl)
     l->lv_refcount = DO_NOT_FREE_CNT;
     l->lv_lock = VAR_FIXED;
     sl->sl_list.lv_len = 10;
+#ifdef FEAT_BORE
+    list_changed(l);
+#endif
 
     for (i = 0; i < 10; ++i)
     {
@@ -2140,6 +2172,9 @@ do_uniq(list_T *l, sortinfo_T *info)
 	    listitem_free(l, li);
 	    l->lv_len--;
 	}
+#ifdef FEAT_BORE
+	list_changed(l);
+#endif
     }
 
     vim_free(ptrs);
@@ -2487,6 +2522,9 @@ list_filter_map(
 		clear_tv(&li->li_tv);
 		newtv.v_lock = 0;
 		li->li_tv = newtv;
+#ifdef FEAT_BORE
+		list_changed(l);
+#endif
 	    }
 	    else if (filtermap == FILTERMAP_MAPNEW)
 	    {
@@ -286,6 +286,9 @@ match_delete(win_T *wp, int id, int perr)
 	rtype = UPD_VALID;
     }
     vim_free(cur->mit_pos_array);
+#ifdef FEAT_BORE
+    vim_free(cur->mit_bore_filters);
+#endif
     vim_free(cur);
     redraw_win_later(wp, rtype);
     return 0;
@@ -305,6 +308,9 @@ clear_matches(win_T *wp)
 	vim_regfree(wp->w_match_head->mit_match.regprog);
 	vim_free(wp->w_match_head->mit_pattern);
 	vim_free(wp->w_match_head->mit_pos_array);
+#ifdef FEAT_BORE
+	vim_free(wp->w_match_head->mit_bore_filters);
+#endif
 	vim_free(wp->w_match_head);
 	wp->w_match_head = m;
     }
@@ -325,6 +331,55 @@ get_match(win_T *wp, int id)
     return cur;
 }
 
+#ifdef FEAT_BORE
+/*
+ * Add a match to window "wp" that highlights the "count" literal strings
+ * "filters" with group "grp", found while the lines are drawn instead of
+ * with a regexp.  Used by bore_ctrlpmatch() for every keystroke.
+ * "flags" are BORE_MATCH_ flags.
+ * Return ID of added match, -1 on failure.
+ */
+    int
+bore_match_add_filters(
+    win_T	*wp,
+    char_u	*grp,
+    char_u	**filters,
+    int		count,
+    int		flags)
+{
+    matchitem_T	*m;
+    size_t	size = 1;
+    char_u	*p;
+    int		id;
+    int		i;
+
+    for (i = 0; i < count; ++i)
+	size += STRLEN(filters[i]) + 1;
+    p = alloc(size);
+    if (p == NULL)
+	return -1;
+    id = match_add(wp, grp, NULL, 10, -1, NULL, NULL);
+    m = id == -1 ? NULL : get_match(wp, id);
+    if (m == NULL)
+    {
+	vim_free(p);
+	return -1;
+    }
+
+    m->mit_bore_filters = p;
+    m->mit_bore_flags = flags;
+    for (i = 0; i < count; ++i)
+    {
+	if (*filters[i] == NUL)
+	    continue;
+	STRCPY(p, filters[i]);
+	p += STRLEN(p) + 1;
+    }
+    *p = NUL;
+    return id;
+}
+#endif
+
 /*
  * Init for calling prepare_search_hl().
  */
@@ -414,6 +469,71 @@ next_search_hl_pos(
     return 0;
 }
 
+#ifdef FEAT_BORE
+/*
+ * Find the first of the literal strings of "match" in line "lnum" that starts
+ * at or after "mincol".  If there is one fill "shl" and return one.
+ * Return zero otherwise.
+ */
+    static int
+next_search_hl_bore(
+    match_T	    *shl,	// points to a match
+    linenr_T	    lnum,
+    matchitem_T	    *match,	// match item with literal strings
+    colnr_T	    mincol)	// minimal column for a match
+{
+    char_u	*line = ml_get_buf(shl->buf, lnum, FALSE);
+    char_u	*start;
+    char_u	*filter;
+    colnr_T	best_col = MAXCOL;
+    int		best_len = 0;
+    int		ic = match->mit_bore_flags & BORE_MATCH_IC;
+
+    if (mincol > (colnr_T)STRLEN(line))
+	return 0;
+    start = line + mincol;
+    if (match->mit_bore_flags & BORE_MATCH_TAIL)
+    {
+	char_u	*tail = gettail(line);
+
+	if (start < tail)
+	    start = tail;
+    }
+
+    for (filter = match->mit_bore_filters; *filter != NUL;
+					     filter += STRLEN(filter) + 1)
+    {
+	int	len = (int)STRLEN(filter);
+	char_u	*p;
+
+	for (p = start; *p != NUL && p - line < best_col; ++p)
+	{
+	    if (ic ? STRNICMP(p, filter, len) == 0
+						: STRNCMP(p, filter, len) == 0)
+	    {
+		best_col = (colnr_T)(p - line);
+		best_len = len;
+		break;
+	    }
+	    if (match->mit_bore_flags & BORE_MATCH_START)
+		break;
+	}
+    }
+    if (best_col == MAXCOL
+	    || ((match->mit_bore_flags & BORE_MATCH_START) && best_col > 0))
+	return 0;
+
+    shl->lnum = lnum;
+    shl->rm.startpos[0].lnum = 0;
+    shl->rm.startpos[0].col = best_col;
+    shl->rm.endpos[0].lnum = 0;
+    shl->rm.endpos[0].col = best_col + best_len;
+    shl->is_addpos = FALSE;
+    shl->has_cursor = FALSE;
+    return 1;
+}
+#endif
+
 /*
  * Search for a next 'hlsearch' or match.
  * Uses shl->buf.
@@ -520,6 +640,10 @@ next_search_hl(
 		break;
 	    }
 	}
+#ifdef FEAT_BORE
+	else if (cur != NULL && cur->mit_bore_filters != NULL)
+	    nmatched = next_search_hl_bore(shl, lnum, cur, matchcol);
+#endif
 	else if (cur != NULL)
 	    nmatched = next_search_hl_pos(shl, lnum, cur, matchcol);
 	else
@@ -990,6 +1114,53 @@ matchadd_dict_arg(typval_T *tv, char_u **conceal_char, win_T **win)
 
     return OK;
 }
+
+#  ifdef FEAT_BORE
+/*
+ * Return a pattern that highlights the same text as the literal strings of
+ * bore_match_add_filters() match "m", for getmatches().  The caller must free
+ * it.  Returns NULL when out of memory.
+ */
+    static char_u *
+bore_match_pattern(matchitem_T *m)
+{
+    garray_T	ga;
+    char_u	*filter;
+    char_u	*p;
+
+    ga_init2(&ga, 1, 100);
+    ga_concat(&ga, (char_u *)((m->mit_bore_flags & BORE_MATCH_IC)
+							    ? "\\c" : "\\C"));
+    if (m->mit_bore_flags & BORE_MATCH_TAIL)
+#   ifdef BACKSLASH_IN_FILENAME
+	ga_concat(&ga, (char_u *)"\\%([^/\\\\:]*$\\)\\@=");
+#   else
+	ga_concat(&ga, (char_u *)"\\%([^/]*$\\)\\@=");
+#   endif
+    if (m->mit_bore_flags & BORE_MATCH_START)
+	ga_concat(&ga, (char_u *)"^");
+    ga_concat(&ga, (char_u *)"\\V\\%(");
+    for (filter = m->mit_bore_filters; *filter != NUL;
+					     filter += STRLEN(filter) + 1)
+    {
+	if (filter != m->mit_bore_filters)
+	    ga_concat(&ga, (char_u *)"\\|");
+	for (p = filter; *p != NUL; ++p)
+	{
+	    if (*p == '\\')
+		ga_append(&ga, '\\');
+	    ga_append(&ga, *p);
+	}
+    }
+    ga_concat(&ga, (char_u *)"\\)");
+    if (ga_append(&ga, NUL) == FAIL)
+    {
+	ga_clear(&ga);
+	return NULL;
+    }
+    return ga.ga_data;
+}
+#  endif
 #endif
 
 /*
@@ -1035,6 +1206,19 @@ f_getmatches(typval_T *argvars UNUSED, typval_T *rettv UNUSED)
 	dict = dict_alloc();
 	if (dict == NULL)
 	    return;
+#  ifdef FEAT_BORE
+	if (cur->mit_bore_filters != NULL)
+	{
+	    // match added by bore_ctrlpmatch(), give a pattern that
+	    // setmatches() can use
+	    char_u *pat = bore_match_pattern(cur);
+
+	    if (pat != NULL)
+		dict_add_string(dict, "pattern", pat);
+	    vim_free(pat);
+	}
+	else
+#  endif
 	if (cur->mit_match.regprog == NULL)
 	{
 	    // match added with matchaddpos()
@@ -65,11 +65,91 @@ extern int dos2;			// this is in os_amiga.c
 
 static long_u	total_mem_used = 0;	// total memory used for memfiles
 
+#ifdef FEAT_BORE
+/*
+ * The used blocks of all memfiles are also kept in a cache of two lists,
+ * like 2Q: a block starts in the probation list and moves to the protected
+ * list when mf_get() finds it in memory.  When 'maxmemtot' is reached blocks
+ * are released from the probation list first, so that a pass over a large
+ * buffer releases the blocks it used once, and not the blocks that this and
+ * other buffers keep using.  The protected list gets at most 3/4 of
+ * 'maxmemtot', its least recently used blocks go back to probation.
+ */
+# define MF_PROBATION	0
+# define MF_PROTECTED	1
+static bhdr_T	*mf_cache_first[2];	// mru block_hdr in cache lists
+static bhdr_T	*mf_cache_last[2];	// lru block_hdr in cache lists
+static long_u	mf_cache_mem[2];	// memory used by cache lists
+static long	mf_cache_count[2];	// number of blocks in cache lists
+
+// For bore_stats().
+static long_u	mf_stat_hits = 0;	// mf_get() found the block in memory
+static long_u	mf_stat_misses = 0;	// mf_get() read the block
+static long_u	mf_stat_writes = 0;	// blocks written to the swap file
+static long_u	mf_stat_evictions = 0;	// blocks released to reuse memory
+#endif
+
+#if defined(FEAT_BORE) && (defined(__linux__) || defined(__FreeBSD__))
+/*
+ * ml_sync_all() does not write the swap file itself while the user is
+ * typing: the dirty blocks of a memfile are handed to a writer thread, which
+ * writes them in the order of their offset with pwritev() and does one
+ * fdatasync() for all of them.  The blocks are marked BH_WRITING until it's
+ * done, only mf_get() of such a block waits for it.  The writer has its own
+ * file descriptor, the memfile can close and open its own.
+ */
+# define MF_WRITER
+# include <sys/uio.h>
+# include "if_bore_thread.h"
+
+# define MF_WRITER_IOV 64	// blocks per pwritev()
+
+typedef struct
+{
+    bhdr_T	*mwb_hp;	// block being written, not used by the writer
+    off_T	mwb_offset;
+    char_u	*mwb_data;
+    unsigned	mwb_size;
+} mfwblock_T;
+
+typedef struct mfwbatch_S mfwbatch_T;
+struct mfwbatch_S
+{
+    mfwbatch_T	*mwb_next;	// next batch in mf_writer_queue
+    int		mwb_fd;		// dup() of mf_fd, closed by the writer
+    int		mwb_flush;	// 0: no flush, 1: fdatasync(), 2: sync()
+    mfwblock_T	*mwb_blocks;
+    int		mwb_count;
+    int		mwb_done;	// set by the writer
+    int		mwb_status;	// OK or FAIL, set by the writer
+};
+
+static bore_thread_t	mf_writer_thread;
+static int		mf_writer_state = 0;	// 0: not started, 1: running,
+						// -1: failed to start
+static bore_mutex_t	mf_writer_mutex;
+static bore_cond_t	mf_writer_cond;		// a batch was queued
+static bore_cond_t	mf_writer_done_cond;	// a batch was written
+static mfwbatch_T	*mf_writer_queue = NULL;
+static int		mf_writer_hold = FALSE;	// for testing: don't write
+static long_u		mf_stat_batches = 0;	// batches given to the writer
+static long_u		mf_stat_writing = 0;	// blocks not written yet
+#endif
+
 static void mf_ins_hash(memfile_T *, bhdr_T *);
 static void mf_rem_hash(memfile_T *, bhdr_T *);
 static bhdr_T *mf_find_hash(memfile_T *, blocknr_T);
 static void mf_ins_used(memfile_T *, bhdr_T *);
 static void mf_rem_used(memfile_T *, bhdr_T *);
+#ifdef FEAT_BORE
+static void mf_cache_ins(bhdr_T *);
+static void mf_cache_rem(bhdr_T *);
+static bhdr_T *mf_cache_victim(void);
+#endif
+#ifdef MF_WRITER
+static int mf_writer_sync(memfile_T *mfp, int flags);
+static void mf_writer_wait(memfile_T *mfp);
+#endif
 static bhdr_T *mf_release(memfile_T *, int);
 static bhdr_T *mf_alloc_bhdr(memfile_T *, int);
 static void mf_free_bhdr(bhdr_T *);
@@ -152,6 +232,9 @@ mf_open(char_u *fname, int flags)
     mfp->mf_used_last = NULL;
     mfp->mf_dirty = FALSE;
     mfp->mf_used_count = 0;
+#ifdef FEAT_BORE
+    mfp->mf_batch = NULL;
+#endif
     mf_hash_init(&mfp->mf_hash);
     mf_hash_init(&mfp->mf_trans);
     mfp->mf_page_size = MEMFILE_PAGE_SIZE;
@@ -238,6 +321,9 @@ mf_close(memfile_T *mfp, int del_file)
 
     if (mfp == NULL)		    // safety check
 	return;
+#ifdef MF_WRITER
+    mf_writer_wait(mfp);
+#endif
     if (mfp->mf_fd >= 0)
     {
 	if (close(mfp->mf_fd) < 0)
@@ -249,6 +335,9 @@ mf_close(memfile_T *mfp, int del_file)
     for (hp = mfp->mf_used_first; hp != NULL; hp = nextp)
     {
 	total_mem_used -= (long_u)hp->bh_page_count * mfp->mf_page_size;
+#ifdef FEAT_BORE
+	mf_cache_rem(hp);
+#endif
 	nextp = hp->bh_next;
 	mf_free_bhdr(hp);
     }
@@ -285,6 +374,9 @@ mf_close_file(
 	mf_dont_release = FALSE;
 	// TODO: should check if all blocks are really in core
     }
+#ifdef MF_WRITER
+    mf_writer_wait(mfp);
+#endif
 
     if (close(mfp->mf_fd) < 0)			// close the file
 	emsg(_(e_close_error_on_swap_file));
@@ -308,6 +400,22 @@ mf_new_page_size(memfile_T *mfp, unsigned new_size)
     // Correct the memory used for block 0 to the new size, because it will be
     // freed with that size later on.
     total_mem_used += new_size - mfp->mf_page_size;
+#ifdef FEAT_BORE
+    {
+	bhdr_T	*hp;
+
+	// The blocks stay where they are in the cache, correct the memory of
+	// their list.
+	for (hp = mfp->mf_used_first; hp != NULL; hp = hp->bh_next)
+	{
+	    int	list = (hp->bh_flags & BH_PROTECTED) ? MF_PROTECTED
+							       : MF_PROBATION;
+
+	    mf_cache_mem[list] += (long_u)hp->bh_page_count * new_size;
+	    mf_cache_mem[list] -= (long_u)hp->bh_page_count * mfp->mf_page_size;
+	}
+    }
+#endif
     mfp->mf_page_size = new_size;
 }
 
@@ -442,11 +550,23 @@ mf_get(memfile_T *mfp, blocknr_T nr, int page_count)
 	    mf_free_bhdr(hp);
 	    return NULL;
 	}
+#ifdef FEAT_BORE
+	++mf_stat_misses;
+#endif
     }
     else
     {
+#ifdef MF_WRITER
+	if (hp->bh_flags & BH_WRITING)
+	    mf_writer_wait(mfp);
+#endif
 	mf_rem_used(mfp, hp);	// remove from list, insert in front below
 	mf_rem_hash(mfp, hp);
+#ifdef FEAT_BORE
+	// used again, keep it longer
+	hp->bh_flags |= BH_PROTECTED;
+	++mf_stat_hits;
+#endif
     }
 
     hp->bh_flags |= BH_LOCKED;
@@ -494,6 +614,10 @@ mf_put(
     void
 mf_free(memfile_T *mfp, bhdr_T *hp)
 {
+#ifdef MF_WRITER
+    if (hp->bh_flags & BH_WRITING)
+	mf_writer_wait(mfp);
+#endif
     vim_free(hp->bh_data);	// free the memory
     mf_rem_hash(mfp, hp);	// get *hp out of the hash list
     mf_rem_used(mfp, hp);	// get *hp out of the used list
@@ -516,6 +640,8 @@ mf_free(memfile_T *mfp, bhdr_T *hp)
  *  MFS_FLUSH	Make sure buffers are flushed to disk, so they will survive a
  *		system crash.
  *  MFS_ZERO	Only write block 0.
+ *  MFS_ASYNC	Write the blocks in the background, if possible.  Returns
+ *		early when the previous blocks are still being written.
  *
  * Return FAIL for failure, OK otherwise
  */
@@ -532,6 +658,18 @@ mf_sync(memfile_T *mfp, int flags)
 	return FAIL;
     }
 
+#ifdef MF_WRITER
+    if (mfp->mf_batch != NULL)
+    {
+	// Don't wait for the previous blocks when typing, try again later.
+	if ((flags & MFS_ASYNC) && !mfp->mf_batch->mwb_done)
+	    return OK;
+	mf_writer_wait(mfp);
+    }
+    if ((flags & (MFS_ASYNC | MFS_ALL | MFS_ZERO)) == MFS_ASYNC)
+	return mf_writer_sync(mfp, flags);
+#endif
+
     // Only a CTRL-C while writing will break us here, not one typed
     // previously.
     got_int = FALSE;
@@ -718,6 +856,10 @@ mf_ins_used(memfile_T *mfp, bhdr_T *hp)
 	hp->bh_next->bh_prev = hp;
     mfp->mf_used_count += hp->bh_page_count;
     total_mem_used += (long_u)hp->bh_page_count * mfp->mf_page_size;
+#ifdef FEAT_BORE
+    hp->bh_mfp = mfp;
+    mf_cache_ins(hp);
+#endif
 }
 
 /*
@@ -736,8 +878,96 @@ mf_rem_used(memfile_T *mfp, bhdr_T *hp)
 	hp->bh_prev->bh_next = hp->bh_next;
     mfp->mf_used_count -= hp->bh_page_count;
     total_mem_used -= (long_u)hp->bh_page_count * mfp->mf_page_size;
+#ifdef FEAT_BORE
+    mf_cache_rem(hp);
+#endif
+}
+
+#ifdef FEAT_BORE
+/*
+ * Insert block *hp in front of its cache list.
+ */
+    static void
+mf_cache_ins(bhdr_T *hp)
+{
+    int		list = (hp->bh_flags & BH_PROTECTED) ? MF_PROTECTED
+							       : MF_PROBATION;
+    bhdr_T	*lru;
+
+    hp->bh_cache_next = mf_cache_first[list];
+    hp->bh_cache_prev = NULL;
+    if (hp->bh_cache_next == NULL)
+	mf_cache_last[list] = hp;
+    else
+	hp->bh_cache_next->bh_cache_prev = hp;
+    mf_cache_first[list] = hp;
+    mf_cache_mem[list] += (long_u)hp->bh_page_count * hp->bh_mfp->mf_page_size;
+    ++mf_cache_count[list];
+
+    // Keep the protected list to 3/4 of 'maxmemtot'.
+    if (list == MF_PROTECTED)
+	while ((mf_cache_mem[MF_PROTECTED] >> 10) > (long_u)p_mmt / 4 * 3
+				    && (lru = mf_cache_last[MF_PROTECTED]) != hp)
+	{
+	    mf_cache_rem(lru);
+	    lru->bh_flags &= ~BH_PROTECTED;
+	    mf_cache_ins(lru);
+	}
+}
+
+/*
+ * Remove block *hp from its cache list.
+ */
+    static void
+mf_cache_rem(bhdr_T *hp)
+{
+    int		list = (hp->bh_flags & BH_PROTECTED) ? MF_PROTECTED
+							       : MF_PROBATION;
+
+    if (hp->bh_cache_next == NULL)
+	mf_cache_last[list] = hp->bh_cache_prev;
+    else
+	hp->bh_cache_next->bh_cache_prev = hp->bh_cache_prev;
+    if (hp->bh_cache_prev == NULL)
+	mf_cache_first[list] = hp->bh_cache_next;
+    else
+	hp->bh_cache_prev->bh_cache_next = hp->bh_cache_next;
+    mf_cache_mem[list] -= (long_u)hp->bh_page_count * hp->bh_mfp->mf_page_size;
+    --mf_cache_count[list];
 }
 
+/*
+ * Find the block to release when 'maxmemtot' is reached: the least recently
+ * used block in the probation list, or else in the protected list, that is
+ * not locked and has a swap file.  Blocks without a swap file are moved to
+ * the front, so that they are not looked at every time.
+ */
+    static bhdr_T *
+mf_cache_victim(void)
+{
+    int		list;
+    long	n;
+    bhdr_T	*hp;
+    bhdr_T	*prev;
+
+    for (list = MF_PROBATION; list <= MF_PROTECTED; ++list)
+    {
+	n = mf_cache_count[list];
+	for (hp = mf_cache_last[list]; hp != NULL && n-- > 0; hp = prev)
+	{
+	    prev = hp->bh_cache_prev;
+	    if (hp->bh_flags & (BH_LOCKED | BH_WRITING))
+		continue;
+	    if (hp->bh_mfp->mf_fd >= 0)
+		return hp;
+	    mf_cache_rem(hp);
+	    mf_cache_ins(hp);
+	}
+    }
+    return NULL;
+}
+#endif
+
 /*
  * Release the least recently used block from the used list if the number
  * of used memory blocks gets to big.
@@ -753,6 +983,7 @@ mf_release(memfile_T *mfp, int page_count)
     bhdr_T	*hp;
     int		need_release;
     buf_T	*buf;
+    memfile_T	*rmfp = mfp;	// memfile of the released block
 
     // don't release while in mf_close_file()
     if (mf_dont_release)
@@ -779,6 +1010,36 @@ mf_release(memfile_T *mfp, int page_count)
 	    ml_open_file(buf);
     }
 
+#ifdef FEAT_BORE
+    if (!need_release)
+	return NULL;
+
+    if (mfp->mf_used_count >= mfp->mf_used_count_max)
+    {
+	bhdr_T	*used_hp = NULL;
+
+	// Over 'maxmem': release a block of this memfile, one that was used
+	// only once if there is one.
+	if (mfp->mf_fd < 0)
+	    return NULL;
+	for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+	    if (!(hp->bh_flags & (BH_LOCKED | BH_WRITING)))
+	    {
+		if (!(hp->bh_flags & BH_PROTECTED))
+		    break;
+		if (used_hp == NULL)
+		    used_hp = hp;
+	    }
+	if (hp == NULL)
+	    hp = used_hp;
+    }
+    else
+	// Over 'maxmemtot': release a block of any memfile.
+	hp = mf_cache_victim();
+    if (hp == NULL)	// not a single one that can be released
+	return NULL;
+    rmfp = hp->bh_mfp;
+#else
     /*
      * don't release a block if
      *	there is no file for this memfile
@@ -795,22 +1056,32 @@ mf_release(memfile_T *mfp, int page_count)
 	    break;
     if (hp == NULL)	// not a single one that can be released
 	return NULL;
+#endif
 
     /*
      * If the block is dirty, write it.
      * If the write fails we don't free it.
      */
-    if ((hp->bh_flags & BH_DIRTY) && mf_write(mfp, hp) == FAIL)
+    if ((hp->bh_flags & BH_DIRTY) && mf_write(rmfp, hp) == FAIL)
 	return NULL;
 
-    mf_rem_used(mfp, hp);
-    mf_rem_hash(mfp, hp);
+    mf_rem_used(rmfp, hp);
+    mf_rem_hash(rmfp, hp);
+#ifdef FEAT_BORE
+    ++mf_stat_evictions;
+#endif
 
     /*
      * If a bhdr_T is returned, make sure that the page_count of bh_data is
      * right
      */
+#ifdef FEAT_BORE
+    // The block may come from a memfile with another page size.
+    if ((size_t)hp->bh_page_count * rmfp->mf_page_size
+			       != (size_t)page_count * mfp->mf_page_size)
+#else
     if (hp->bh_page_count != page_count)
+#endif
     {
 	vim_free(hp->bh_data);
 	if ((hp->bh_data = alloc((size_t)mfp->mf_page_size * page_count))
@@ -821,6 +1092,9 @@ mf_release(memfile_T *mfp, int page_count)
 	}
 	hp->bh_page_count = page_count;
     }
+#ifdef FEAT_BORE
+    hp->bh_page_count = page_count;
+#endif
     return hp;
 }
 
@@ -852,7 +1126,7 @@ mf_release_all(void)
 	    {
 		for (hp = mfp->mf_used_last; hp != NULL; )
 		{
-		    if (!(hp->bh_flags & BH_LOCKED)
+		    if (!(hp->bh_flags & (BH_LOCKED | BH_WRITING))
 			    && (!(hp->bh_flags & BH_DIRTY)
 				|| mf_write(mfp, hp) != FAIL))
 		    {
@@ -861,6 +1135,9 @@ mf_release_all(void)
 			mf_free_bhdr(hp);
 			hp = mfp->mf_used_last;	// re-start, list was changed
 			retval = TRUE;
+#ifdef FEAT_BORE
+			++mf_stat_evictions;
+#endif
 		    }
 		    else
 			hp = hp->bh_prev;
@@ -871,6 +1148,363 @@ mf_release_all(void)
     return retval;
 }
 
+#if (defined(FEAT_BORE) && defined(FEAT_EVAL)) || defined(PROTO)
+/*
+ * Add the counters of the memfile cache to dict "d", for bore_stats().
+ */
+    void
+mf_bore_stats(dict_T *d)
+{
+    dict_add_number(d, "hits", (varnumber_T)mf_stat_hits);
+    dict_add_number(d, "misses", (varnumber_T)mf_stat_misses);
+    dict_add_number(d, "writes", (varnumber_T)mf_stat_writes);
+    dict_add_number(d, "evictions", (varnumber_T)mf_stat_evictions);
+# ifdef MF_WRITER
+    dict_add_number(d, "batches", (varnumber_T)mf_stat_batches);
+    if (mf_writer_state == 1)
+	bore_mutex_lock(&mf_writer_mutex);
+    dict_add_number(d, "writing", (varnumber_T)mf_stat_writing);
+    if (mf_writer_state == 1)
+	bore_mutex_unlock(&mf_writer_mutex);
+# else
+    dict_add_number(d, "batches", 0);
+    dict_add_number(d, "writing", 0);
+# endif
+    dict_add_number(d, "used", (varnumber_T)total_mem_used);
+    dict_add_number(d, "protected", (varnumber_T)mf_cache_mem[MF_PROTECTED]);
+}
+#endif
+
+#ifdef MF_WRITER
+    static int
+mf_writer_cmp(const void *a, const void *b)
+{
+    off_T	oa = ((mfwblock_T *)a)->mwb_offset;
+    off_T	ob = ((mfwblock_T *)b)->mwb_offset;
+
+    return oa < ob ? -1 : oa > ob ? 1 : 0;
+}
+
+/*
+ * Write the blocks of batch "bp" to its file descriptor, contiguous blocks
+ * with one pwritev().  Runs in the writer thread, must not use anything of
+ * Vim but the batch.
+ */
+    static int
+mf_writer_write(mfwbatch_T *bp)
+{
+    struct iovec	iov[MF_WRITER_IOV];
+    int			i = 0;
+    int			n;
+    off_T		offset;
+    ssize_t		len;
+
+    qsort(bp->mwb_blocks, (size_t)bp->mwb_count, sizeof(mfwblock_T),
+								mf_writer_cmp);
+    while (i < bp->mwb_count)
+    {
+	offset = bp->mwb_blocks[i].mwb_offset;
+	for (n = 0; n < MF_WRITER_IOV && i + n < bp->mwb_count; ++n)
+	{
+	    mfwblock_T *wp = &bp->mwb_blocks[i + n];
+
+	    if (n > 0 && wp->mwb_offset != wp[-1].mwb_offset
+							     + wp[-1].mwb_size)
+		break;
+	    iov[n].iov_base = wp->mwb_data;
+	    iov[n].iov_len = wp->mwb_size;
+	}
+	i += n;
+
+	// Write the rest after a short write.
+	for (;;)
+	{
+	    struct iovec *ip = iov;
+
+	    len = pwritev(bp->mwb_fd, iov, n, offset);
+	    if (len < 0)
+	    {
+		if (errno == EINTR)
+		    continue;
+		return FAIL;
+	    }
+	    offset += len;
+	    while (n > 0 && (size_t)len >= ip->iov_len)
+	    {
+		len -= ip->iov_len;
+		++ip;
+		--n;
+	    }
+	    if (n == 0)
+		break;
+	    ip->iov_base = (char *)ip->iov_base + len;
+	    ip->iov_len -= len;
+	    if (ip != iov)
+		mch_memmove(iov, ip, n * sizeof(struct iovec));
+	}
+    }
+
+    if (bp->mwb_flush == 1)
+    {
+	if (fdatasync(bp->mwb_fd) != 0)
+	    return FAIL;
+    }
+    else if (bp->mwb_flush == 2)
+	sync();
+    return OK;
+}
+
+BORE_THREAD_PROC(mf_writer_proc)
+{
+    mfwbatch_T	*bp;
+    int		status;
+
+    (void)param;
+    bore_mutex_lock(&mf_writer_mutex);
+    for (;;)
+    {
+	while (mf_writer_queue == NULL || mf_writer_hold)
+	    bore_cond_wait(&mf_writer_cond, &mf_writer_mutex);
+	bp = mf_writer_queue;
+	mf_writer_queue = bp->mwb_next;
+	bore_mutex_unlock(&mf_writer_mutex);
+
+	status = mf_writer_write(bp);
+	close(bp->mwb_fd);
+
+	bore_mutex_lock(&mf_writer_mutex);
+	bp->mwb_status = status;
+	bp->mwb_done = TRUE;
+	mf_stat_writing -= bp->mwb_count;
+	bore_cond_broadcast(&mf_writer_done_cond);
+    }
+    BORE_THREAD_RETURN;
+}
+
+/*
+ * Start the writer thread when it's first needed.  Signals are blocked in it,
+ * they are handled by the main thread.
+ * Return FAIL when there is no writer thread.
+ */
+    static int
+mf_writer_start(void)
+{
+    sigset_t	all;
+    sigset_t	old;
+
+    if (mf_writer_state == 0)
+    {
+	bore_mutex_init(&mf_writer_mutex);
+	bore_cond_init(&mf_writer_cond);
+	bore_cond_init(&mf_writer_done_cond);
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	mf_writer_state = bore_thread_start(&mf_writer_thread, mf_writer_proc,
+								NULL) ? 1 : -1;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (mf_writer_state == 1)
+	    pthread_detach(mf_writer_thread);
+    }
+    return mf_writer_state == 1 ? OK : FAIL;
+}
+
+/*
+ * Write the dirty blocks of "mfp" in the background.  Blocks that extend the
+ * file and block 0 are written here, so that the file has no gaps.
+ * Return FAIL when a block could not be written.
+ */
+    static int
+mf_writer_sync(memfile_T *mfp, int flags)
+{
+    bhdr_T	*hp;
+    mfwbatch_T	*bp;
+    int		status = OK;
+    int		count = 0;
+    int		locked = 0;
+    unsigned	page_size = mfp->mf_page_size;
+
+# ifdef FEAT_CRYPT
+    // Encrypted blocks are written one by one.
+    if (*mfp->mf_buffer->b_p_key != NUL || mfp->mf_old_key != NULL)
+	return mf_sync(mfp, flags & ~MFS_ASYNC);
+# endif
+    if (mf_writer_start() == FAIL)
+	return mf_sync(mfp, flags & ~MFS_ASYNC);
+
+    for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+	if (hp->bh_bnum >= 0 && (hp->bh_flags & BH_DIRTY))
+	{
+	    if (hp->bh_bnum == 0 || hp->bh_bnum + hp->bh_page_count
+						     > mfp->mf_infile_count)
+	    {
+		if (mf_write(mfp, hp) == FAIL)
+		    status = FAIL;
+	    }
+	    else if (!(hp->bh_flags & BH_LOCKED))
+		++count;
+	    else
+		++locked;
+	}
+    if (count == 0 || mfp->mf_fd < 0)
+    {
+	// Locked blocks are written by a later sync, stay dirty for them.
+	if (locked == 0 || mfp->mf_fd < 0)
+	    mfp->mf_dirty = FALSE;
+	return status;
+    }
+
+    bp = ALLOC_CLEAR_ONE(mfwbatch_T);
+    if (bp != NULL)
+    {
+	bp->mwb_blocks = ALLOC_MULT(mfwblock_T, count);
+	bp->mwb_fd = dup(mfp->mf_fd);
+    }
+    if (bp == NULL || bp->mwb_blocks == NULL || bp->mwb_fd < 0)
+    {
+	if (bp != NULL)
+	{
+	    if (bp->mwb_fd >= 0)
+		close(bp->mwb_fd);
+	    vim_free(bp->mwb_blocks);
+	    vim_free(bp);
+	}
+	return mf_sync(mfp, flags & ~MFS_ASYNC);
+    }
+
+    if ((flags & MFS_FLUSH) && *p_sws != NUL)
+	bp->mwb_flush = STRCMP(p_sws, "fsync") == 0 ? 1 : 2;
+    for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+	if (hp->bh_bnum > 0
+		&& (hp->bh_flags & (BH_DIRTY | BH_LOCKED)) == BH_DIRTY
+		&& hp->bh_bnum + hp->bh_page_count <= mfp->mf_infile_count
+		&& bp->mwb_count < count)
+	{
+	    mfwblock_T *wp = &bp->mwb_blocks[bp->mwb_count++];
+
+	    wp->mwb_hp = hp;
+	    wp->mwb_offset = (off_T)page_size * hp->bh_bnum;
+	    wp->mwb_data = hp->bh_data;
+	    wp->mwb_size = page_size * hp->bh_page_count;
+	    hp->bh_flags = (hp->bh_flags & ~BH_DIRTY) | BH_WRITING;
+	    ++mf_stat_writes;
+	}
+
+    // Stays dirty until the writer is done, mf_sync() is called again then.
+    mfp->mf_batch = bp;
+    ++mf_stat_batches;
+    bore_mutex_lock(&mf_writer_mutex);
+    mf_stat_writing += bp->mwb_count;
+    bp->mwb_next = NULL;
+    if (mf_writer_queue == NULL)
+	mf_writer_queue = bp;
+    else
+    {
+	mfwbatch_T *qp = mf_writer_queue;
+
+	while (qp->mwb_next != NULL)
+	    qp = qp->mwb_next;
+	qp->mwb_next = bp;
+    }
+    bore_cond_signal(&mf_writer_cond);
+    bore_mutex_unlock(&mf_writer_mutex);
+    return status;
+}
+
+/*
+ * Wait for the writer to finish the blocks of "mfp".  Blocks it failed to
+ * write are dirty again.
+ * When preserving files after a deadly signal the mutex may be held by the
+ * writer or by the interrupted code, then the blocks are made dirty again
+ * without waiting, for the caller to write them.
+ */
+    static void
+mf_writer_wait(memfile_T *mfp)
+{
+    mfwbatch_T	*bp = mfp->mf_batch;
+    int		done = FALSE;
+    int		i;
+
+    if (bp == NULL)
+	return;
+    if (really_exiting)
+    {
+	if (bore_mutex_trylock(&mf_writer_mutex))
+	{
+	    done = bp->mwb_done;
+	    bore_mutex_unlock(&mf_writer_mutex);
+	}
+	if (!done)
+	{
+	    // The writer may still use the batch, it is not freed.
+	    for (i = 0; i < bp->mwb_count; ++i)
+	    {
+		bhdr_T *hp = bp->mwb_blocks[i].mwb_hp;
+
+		hp->bh_flags = (hp->bh_flags & ~BH_WRITING) | BH_DIRTY;
+	    }
+	    mfp->mf_dirty = TRUE;
+	    mfp->mf_batch = NULL;
+	    return;
+	}
+    }
+    else
+    {
+	bore_mutex_lock(&mf_writer_mutex);
+	if (!bp->mwb_done && mf_writer_hold)
+	{
+	    // Held for testing, don't wait forever.
+	    mf_writer_hold = FALSE;
+	    bore_cond_signal(&mf_writer_cond);
+	}
+	while (!bp->mwb_done)
+	    bore_cond_wait(&mf_writer_done_cond, &mf_writer_mutex);
+	bore_mutex_unlock(&mf_writer_mutex);
+    }
+
+    for (i = 0; i < bp->mwb_count; ++i)
+    {
+	bhdr_T *hp = bp->mwb_blocks[i].mwb_hp;
+
+	hp->bh_flags &= ~BH_WRITING;
+	if (bp->mwb_status == FAIL)
+	    hp->bh_flags |= BH_DIRTY;
+    }
+    if (bp->mwb_status == FAIL)
+    {
+	mfp->mf_dirty = TRUE;
+	if (!did_swapwrite_msg)
+	    emsg(_(e_write_error_in_swap_file));
+	did_swapwrite_msg = TRUE;
+    }
+    mfp->mf_batch = NULL;
+    vim_free(bp->mwb_blocks);
+    vim_free(bp);
+}
+#endif
+
+#if defined(FEAT_BORE) || defined(PROTO)
+/*
+ * For test_override("swap_writer"): when "hold" is TRUE the writer does not
+ * write the blocks given to it, as if it was very slow, until this is called
+ * with FALSE or the main thread waits for them.
+ */
+    void
+mf_writer_hold_for_testing(int hold)
+{
+# ifdef MF_WRITER
+    if (mf_writer_state != 1)
+    {
+	mf_writer_hold = hold;
+	return;
+    }
+    bore_mutex_lock(&mf_writer_mutex);
+    mf_writer_hold = hold;
+    bore_cond_signal(&mf_writer_cond);
+    bore_mutex_unlock(&mf_writer_mutex);
+# endif
+}
+#endif
+
 /*
  * Allocate a block header and a block of memory for it
  */
@@ -1054,6 +1688,9 @@ mf_write(memfile_T *mfp, bhdr_T *hp)
 	}
 
 	did_swapwrite_msg = FALSE;
+#ifdef FEAT_BORE
+	++mf_stat_writes;
+#endif
 	if (hp2 != NULL)		    // written a non-dummy block
 	    hp2->bh_flags &= ~BH_DIRTY;
 					    // appended to the file
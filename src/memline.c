@@ -290,6 +290,11 @@ ml_open(buf_T *buf)
 #ifdef FEAT_BYTEOFF
     buf->b_ml.ml_chunksize = NULL;
     buf->b_ml.ml_usedchunks = 0;
+# ifdef FEAT_BORE
+    buf->b_ml.ml_chunktree = NULL;
+    buf->b_ml.ml_chunktree_size = 0;
+    buf->b_ml.ml_chunktree_valid = 0;
+# endif
 #endif
 
     if (cmdmod.cmod_flags & CMOD_NOSWAPFILE)
@@ -864,6 +869,19 @@ ml_close(buf_T *buf, int del_file)
     vim_free(buf->b_ml.ml_stack);
 #ifdef FEAT_BYTEOFF
     VIM_CLEAR(buf->b_ml.ml_chunksize);
+# ifdef FEAT_BORE
+    VIM_CLEAR(buf->b_ml.ml_chunktree);
+    buf->b_ml.ml_chunktree_size = 0;
+    buf->b_ml.ml_chunktree_valid = 0;
+# endif
+#endif
+#ifdef FEAT_BORE
+    buf->b_ml.ml_bore_get = NULL;
+    if (buf->b_ml.ml_bore_map != NULL)
+    {
+	bore_map_free(buf->b_ml.ml_bore_map);
+	buf->b_ml.ml_bore_map = NULL;
+    }
 #endif
     buf->b_ml.ml_mfp = NULL;
 
@@ -2458,6 +2476,9 @@ ml_sync_all(int check_file, int check_char)
 	if (buf->b_ml.ml_mfp->mf_dirty)
 	{
 	    (void)mf_sync(buf->b_ml.ml_mfp, (check_char ? MFS_STOP : 0)
+#ifdef FEAT_BORE
+					| (check_char ? MFS_ASYNC : 0)
+#endif
 					| (bufIsChanged(buf) ? MFS_FLUSH : 0));
 	    if (check_char && ui_char_avail())	// character available now
 		break;
@@ -2630,6 +2651,21 @@ errorret:
     if (lnum <= 0)			// pretend line 0 is line 1
 	lnum = 1;
 
+#ifdef FEAT_BORE
+    // The lines of a mapped file or the picker are copied into the memfile
+    // before one of them is changed.
+    if (will_change && buf->b_ml.ml_bore_get != NULL
+						  && ml_bore_load(buf) == FAIL)
+	goto errorret;
+    if (buf->b_ml.ml_bore_get != NULL)
+    {
+	char_u	*line = buf->b_ml.ml_bore_get(buf, lnum);
+
+	buf->b_ml.ml_line_len = (colnr_T)STRLEN(line) + 1;
+	return line;
+    }
+#endif
+
     if (buf->b_ml.ml_mfp == NULL)	// there are no lines
     {
 	buf->b_ml.ml_line_len = 1;
@@ -2827,6 +2863,10 @@ ml_append_int(
 #endif
     int		ret = FAIL;
 
+#ifdef FEAT_BORE
+    if (buf->b_ml.ml_bore_get != NULL && ml_bore_load(buf) == FAIL)
+	return FAIL;
+#endif
     if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL)
 	return FAIL;  // lnum out of range
 
@@ -3470,6 +3510,10 @@ ml_replace_len(
     // When starting up, we might still need to create the memfile
     if (curbuf->b_ml.ml_mfp == NULL && open_buffer(FALSE, NULL, 0) == FAIL)
 	return FAIL;
+#ifdef FEAT_BORE
+    if (curbuf->b_ml.ml_bore_get != NULL && ml_bore_load(curbuf) == FAIL)
+	return FAIL;
+#endif
 
     if (!has_props)
 	++len;  // include the NUL after the text
@@ -3668,6 +3712,10 @@ ml_delete_int(buf_T *buf, linenr_T lnum, int flags)
     long	textprop_len = 0;
 #endif
 
+#ifdef FEAT_BORE
+    if (buf->b_ml.ml_bore_get != NULL && ml_bore_load(buf) == FAIL)
+	return FAIL;
+#endif
     if (lowest_marked && lowest_marked > lnum)
 	lowest_marked--;
 
@@ -3874,6 +3922,67 @@ ml_delete_flags(linenr_T lnum, int flags)
     return ml_delete_int(curbuf, lnum, flags);
 }
 
+#if defined(FEAT_BORE) || defined(PROTO)
+/*
+ * Copy the lines of a buffer that readfile() mapped, or of the :boreopen
+ * picker, into its memfile, before the buffer is changed, its file is written
+ * or its blocks are used.  Like readfile() does, the lines are inserted before
+ * the empty line of the empty buffer, which is deleted afterwards.
+ * Return FAIL when out of memory, the lines are still read with ml_bore_get
+ * then.
+ */
+    int
+ml_bore_load(buf_T *buf)
+{
+    struct bore_map_t	*map = buf->b_ml.ml_bore_map;
+    char_u		*(*get)(buf_T *buf, linenr_T lnum) = buf->b_ml.ml_bore_get;
+    linenr_T		count = buf->b_ml.ml_line_count;
+    linenr_T		lnum;
+    char_u		*line;
+
+    if (get == NULL)
+	return OK;
+    buf->b_ml.ml_bore_map = NULL;
+    buf->b_ml.ml_bore_get = NULL;
+    buf->b_ml.ml_line_count = 1;
+    for (lnum = 1; lnum <= count; ++lnum)
+    {
+	line = map != NULL ? bore_map_line(map, lnum) : get(buf, lnum);
+	if (line == NULL || ml_append_int(buf, lnum - 1, line,
+			   (colnr_T)STRLEN(line) + 1,
+			   ML_APPEND_NEW | ML_APPEND_NOPROP) == FAIL)
+	{
+	    while (buf->b_ml.ml_line_count > 1)
+		(void)ml_delete_int(buf, (linenr_T)1, 0);
+	    buf->b_ml.ml_bore_map = map;
+	    buf->b_ml.ml_bore_get = get;
+	    buf->b_ml.ml_line_count = count;
+	    return FAIL;
+	}
+    }
+    if (map != NULL)
+	bore_map_free(map);
+    return ml_delete_int(buf, count + 1, 0);
+}
+
+/*
+ * Move the mapped file of "frombuf" to the empty buffer "tobuf" instead of
+ * copying its lines, "frombuf" becomes empty.
+ */
+    void
+ml_bore_move(buf_T *frombuf, buf_T *tobuf)
+{
+    tobuf->b_ml.ml_bore_map = frombuf->b_ml.ml_bore_map;
+    tobuf->b_ml.ml_bore_get = frombuf->b_ml.ml_bore_get;
+    tobuf->b_ml.ml_line_count = frombuf->b_ml.ml_line_count;
+    tobuf->b_ml.ml_flags &= ~ML_EMPTY;
+    frombuf->b_ml.ml_bore_map = NULL;
+    frombuf->b_ml.ml_bore_get = NULL;
+    frombuf->b_ml.ml_line_count = 1;
+    frombuf->b_ml.ml_flags |= ML_EMPTY;
+}
+#endif
+
 /*
  * set the DB_MARKED flag for line 'lnum'
  */
@@ -4070,14 +4179,16 @@ ml_flush_line(buf_T *buf)
 		// copy new line into the data block
 		mch_memmove(old_line - extra, new_line, (size_t)new_len);
 		buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
-#if defined(FEAT_BYTEOFF) && defined(FEAT_PROP_POPUP)
+#ifdef FEAT_BYTEOFF
 		// The else case is already covered by the insert and delete
+# ifdef FEAT_PROP_POPUP
 		if (buf->b_has_textprop)
 		{
 		    // Do not count the size of any text properties.
 		    extra += old_prop_len;
 		    extra -= new_len - (int)STRLEN(new_line) - 1;
 		}
+# endif
 		if (extra != 0)
 		    ml_updatechunk(buf, lnum, (long)extra, ML_CHNK_UPDLINE);
 #endif
@@ -4185,6 +4296,13 @@ ml_find_line(buf_T *buf, linenr_T lnum, int action)
     int		page_count;
     int		idx;
 
+#ifdef FEAT_BORE
+    // Anything else that uses the blocks of a mapped file or the picker needs
+    // its lines, e.g. ":g" marking them.
+    if (buf->b_ml.ml_bore_get != NULL && action != ML_FLUSH
+					       && ml_bore_load(buf) == FAIL)
+	return NULL;
+#endif
     mfp = buf->b_ml.ml_mfp;
 
     /*
@@ -5531,6 +5649,155 @@ ml_crypt_prepare(memfile_T *mfp, off_T offset, int reading)
 #define MLCS_MAXL 800	// max no of lines in chunk
 #define MLCS_MINL 400   // should be half of MLCS_MAXL
 
+// The chunk that ml_updatechunk() updated last, to add lines after it.
+static buf_T	*ml_upd_lastbuf = NULL;
+static linenr_T	ml_upd_lastline;
+static linenr_T	ml_upd_lastcurline;
+static int	ml_upd_lastcurix;
+
+#ifdef FEAT_BORE
+/*
+ * The chunks are also kept in a Fenwick tree, so that the chunk with a line
+ * or a byte offset is found in O(log n) steps instead of adding up all the
+ * chunks before it.  Entry "i" of ml_chunktree has the sums of the "i & -i"
+ * chunks that end with chunk "i - 1".  Changing the size of a chunk updates
+ * O(log n) entries.  When chunks are split, joined or deleted the chunks
+ * after it move, the entries up to that chunk stay valid and only the ones
+ * after it are built again when the tree is used next.  Lines are mostly
+ * added and deleted near the end, which keeps that short.
+ */
+
+/*
+ * Add "lines" and "size" to chunk "ix" in the tree.
+ */
+    static void
+ml_chunktree_add(buf_T *buf, int ix, int lines, long size)
+{
+    chunksize_T	*tree = buf->b_ml.ml_chunktree;
+    int		i;
+
+    // The entries after the valid ones are built from ml_chunksize
+    for (i = ix + 1; i <= buf->b_ml.ml_chunktree_valid; i += i & -i)
+    {
+	tree[i].mlcs_numlines += lines;
+	tree[i].mlcs_totalsize += size;
+    }
+}
+
+/*
+ * Chunk "ix" and the ones after it were changed, moved or removed.
+ */
+    static void
+ml_chunktree_invalidate(buf_T *buf, int ix)
+{
+    if (buf->b_ml.ml_chunktree_valid > ix)
+	buf->b_ml.ml_chunktree_valid = ix;
+}
+
+/*
+ * Build the entries of the tree after the valid ones from ml_chunksize.
+ * Returns FAIL when out of memory.
+ */
+    static int
+ml_chunktree_build(buf_T *buf)
+{
+    int		n = buf->b_ml.ml_usedchunks;
+    int		first = buf->b_ml.ml_chunktree_valid + 1;
+    chunksize_T	*tree;
+    int		i;
+    int		j;
+
+    if (first > n)
+	return OK;
+    if (buf->b_ml.ml_chunktree_size < n + 1)
+    {
+	int size = buf->b_ml.ml_numchunks > n ? buf->b_ml.ml_numchunks + 1
+								      : n + 1;
+
+	tree = vim_realloc(buf->b_ml.ml_chunktree,
+						   size * sizeof(chunksize_T));
+	if (tree == NULL)
+	    return FAIL;
+	buf->b_ml.ml_chunktree = tree;
+	buf->b_ml.ml_chunktree_size = size;
+    }
+    tree = buf->b_ml.ml_chunktree;
+    mch_memmove(tree + first, buf->b_ml.ml_chunksize + first - 1,
+					  (n - first + 1) * sizeof(chunksize_T));
+    // The valid entries that are part of an entry that is built again are
+    // the ones that sum up the chunks before "first".
+    for (i = first - 1; i > 0; i -= i & -i)
+    {
+	j = i + (i & -i);
+	if (j <= n)
+	{
+	    tree[j].mlcs_numlines += tree[i].mlcs_numlines;
+	    tree[j].mlcs_totalsize += tree[i].mlcs_totalsize;
+	}
+    }
+    for (i = first; i <= n; ++i)
+    {
+	j = i + (i & -i);
+	if (j <= n)
+	{
+	    tree[j].mlcs_numlines += tree[i].mlcs_numlines;
+	    tree[j].mlcs_totalsize += tree[i].mlcs_totalsize;
+	}
+    }
+    buf->b_ml.ml_chunktree_valid = n;
+    return OK;
+}
+
+/*
+ * Find the chunk with line "lnum" when it is not zero, or with byte "offset"
+ * when it is not zero, counting a CR for every line when "ffdos" is TRUE.
+ * The last chunk is used for anything after it.  Sets "*linep" to the first
+ * line of the chunk and "*sizep" to the bytes before it, the CRs only
+ * included for "offset".  Returns the index of the chunk, -1 when out of
+ * memory.
+ */
+    static int
+ml_chunktree_find(
+    buf_T	*buf,
+    linenr_T	lnum,
+    long	offset,
+    int		ffdos,
+    linenr_T	*linep,
+    long	*sizep)
+{
+    int		n = buf->b_ml.ml_usedchunks - 1;
+    int		ix = 0;
+    int		mask = 1;
+    linenr_T	curline = 1;
+    long	size = 0;
+    chunksize_T	*t;
+
+    if (ml_chunktree_build(buf) == FAIL)
+	return -1;
+    while (mask * 2 <= n)
+	mask *= 2;
+    for ( ; n > 0 && mask > 0; mask /= 2)
+    {
+	if (ix + mask > n)
+	    continue;
+	t = buf->b_ml.ml_chunktree + ix + mask;
+	if ((lnum != 0 && lnum >= curline + t->mlcs_numlines)
+		|| (offset != 0 && offset > size + t->mlcs_totalsize
+				      + (long)ffdos * t->mlcs_numlines))
+	{
+	    ix += mask;
+	    curline += t->mlcs_numlines;
+	    size += t->mlcs_totalsize;
+	    if (offset && ffdos)
+		size += t->mlcs_numlines;
+	}
+    }
+    *linep = curline;
+    *sizep = size;
+    return ix;
+}
+#endif
+
 /*
  * Keep information for finding byte offset of a line, updtype may be one of:
  * ML_CHNK_ADDLINE: Add len to parent chunk, possibly splitting it
@@ -5545,11 +5812,6 @@ ml_updatechunk(
     long	len,
     int		updtype)
 {
-    static buf_T	*ml_upd_lastbuf = NULL;
-    static linenr_T	ml_upd_lastline;
-    static linenr_T	ml_upd_lastcurline;
-    static int		ml_upd_lastcurix;
-
     linenr_T		curline = ml_upd_lastcurline;
     int			curix = ml_upd_lastcurix;
     long		size;
@@ -5572,6 +5834,9 @@ ml_updatechunk(
 	buf->b_ml.ml_usedchunks = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize = 1;
+#ifdef FEAT_BORE
+	ml_chunktree_invalidate(buf, 0);
+#endif
     }
 
     if (updtype == ML_CHNK_UPDLINE && buf->b_ml.ml_line_count == 1)
@@ -5582,6 +5847,9 @@ ml_updatechunk(
 	buf->b_ml.ml_usedchunks = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize = (long)buf->b_ml.ml_line_len;
+#ifdef FEAT_BORE
+	ml_chunktree_invalidate(buf, 0);
+#endif
 	return;
     }
 
@@ -5592,11 +5860,20 @@ ml_updatechunk(
     if (buf != ml_upd_lastbuf || line != ml_upd_lastline + 1
 	    || updtype != ML_CHNK_ADDLINE)
     {
+#ifdef FEAT_BORE
+	if ((curix = ml_chunktree_find(buf, line, 0L, FALSE, &curline, &size))
+									< 0)
+	{
+	    buf->b_ml.ml_usedchunks = -1;
+	    return;
+	}
+#else
 	for (curline = 1, curix = 0;
 	     curix < buf->b_ml.ml_usedchunks - 1
 	     && line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines;
 	     curix++)
 	    curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+#endif
     }
     else if (curix < buf->b_ml.ml_usedchunks - 1
 	      && line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines)
@@ -5610,6 +5887,10 @@ ml_updatechunk(
     if (updtype == ML_CHNK_DELLINE)
 	len = -len;
     curchnk->mlcs_totalsize += len;
+#ifdef FEAT_BORE
+    ml_chunktree_add(buf, curix, updtype == ML_CHNK_ADDLINE ? 1
+			     : updtype == ML_CHNK_DELLINE ? -1 : 0, len);
+#endif
     if (updtype == ML_CHNK_ADDLINE)
     {
 	curchnk->mlcs_numlines++;
@@ -5680,7 +5961,7 @@ ml_updatechunk(
 		    // We cannot use the text pointers to get the text length,
 		    // the text prop info would also be counted.  Go over the
 		    // lines.
-		    for (i = end_idx; i < idx; ++i)
+		    for (i = idx; i <= end_idx; ++i)
 			size += (int)STRLEN((char_u *)dp
 				      + (dp->db_index[i] & DB_INDEX_MASK)) + 1;
 		}
@@ -5700,6 +5981,9 @@ ml_updatechunk(
 	    buf->b_ml.ml_chunksize[curix].mlcs_totalsize = size;
 	    buf->b_ml.ml_chunksize[curix + 1].mlcs_totalsize -= size;
 	    buf->b_ml.ml_usedchunks++;
+#ifdef FEAT_BORE
+	    ml_chunktree_invalidate(buf, curix);
+#endif
 	    ml_upd_lastbuf = NULL;   // Force recalc of curix & curline
 	    return;
 	}
@@ -5713,6 +5997,9 @@ ml_updatechunk(
 	     */
 	    curchnk = buf->b_ml.ml_chunksize + curix + 1;
 	    buf->b_ml.ml_usedchunks++;
+#ifdef FEAT_BORE
+	    ml_chunktree_invalidate(buf, curix);
+#endif
 	    if (line == buf->b_ml.ml_line_count)
 	    {
 		curchnk->mlcs_numlines = 0;
@@ -5731,6 +6018,13 @@ ml_updatechunk(
 		    return;
 		}
 		dp = (DATA_BL *)(hp->bh_data);
+#ifdef FEAT_PROP_POPUP
+		if (buf->b_has_textprop)
+		    // Do not count the text properties.
+		    rest = (int)STRLEN((char_u *)dp + ((dp->db_index[
+				dp->db_line_count - 1]) & DB_INDEX_MASK)) + 1;
+		else
+#endif
 		if (dp->db_line_count == 1)
 		    rest = dp->db_txt_end - dp->db_txt_start;
 		else
@@ -5758,6 +6052,9 @@ ml_updatechunk(
 	else if (curix == 0 && curchnk->mlcs_numlines <= 0)
 	{
 	    buf->b_ml.ml_usedchunks--;
+#ifdef FEAT_BORE
+	    ml_chunktree_invalidate(buf, 0);
+#endif
 	    mch_memmove(buf->b_ml.ml_chunksize, buf->b_ml.ml_chunksize + 1,
 			buf->b_ml.ml_usedchunks * sizeof(chunksize_T));
 	    return;
@@ -5773,6 +6070,9 @@ ml_updatechunk(
 	curchnk[-1].mlcs_numlines += curchnk->mlcs_numlines;
 	curchnk[-1].mlcs_totalsize += curchnk->mlcs_totalsize;
 	buf->b_ml.ml_usedchunks--;
+#ifdef FEAT_BORE
+	ml_chunktree_invalidate(buf, curix - 1);
+#endif
 	if (curix < buf->b_ml.ml_usedchunks)
 	    mch_memmove(buf->b_ml.ml_chunksize + curix,
 			buf->b_ml.ml_chunksize + curix + 1,
@@ -5812,8 +6112,15 @@ ml_find_line_or_offset(buf_T *buf, linenr_T lnum, long *offp)
     // take care of cached line first
     ml_flush_line(curbuf);
 
+#ifdef FEAT_BORE
+    if (buf->b_ml.ml_bore_map != NULL)
+	return bore_map_offset(buf, lnum, offp);
+#endif
     if (buf->b_ml.ml_usedchunks == -1
 	    || buf->b_ml.ml_chunksize == NULL
+#ifdef FEAT_BORE
+	    || buf->b_ml.ml_bore_get != NULL
+#endif
 	    || lnum < 0)
 	return -1;
 
@@ -5827,6 +6134,10 @@ ml_find_line_or_offset(buf_T *buf, linenr_T lnum, long *offp)
      * Find the last chunk before the one containing our line. Last chunk is
      * special because it will never qualify.
      */
+#ifdef FEAT_BORE
+    if (ml_chunktree_find(buf, lnum, offset, ffdos, &curline, &size) < 0)
+	return -1;
+#else
     curline = 1;
     curix = size = 0;
     while (curix < buf->b_ml.ml_usedchunks - 1
@@ -5842,6 +6153,7 @@ ml_find_line_or_offset(buf_T *buf, linenr_T lnum, long *offp)
 	    size += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
 	curix++;
     }
+#endif
 
     while ((lnum != 0 && curline < lnum) || (offset != 0 && size < offset))
     {
@@ -6001,3 +6313,346 @@ goto_byte(long cnt)
 	mb_adjust_cursor();
 }
 #endif
+
+#if defined(FEAT_BORE) || defined(PROTO)
+/*
+ * Loading a file into an empty buffer: readfile() fills the data blocks one
+ * after the other, and the pointer blocks and the byte offset chunks are made
+ * when it is done.  Otherwise ml_append() finds the place of every line in
+ * the tree and updates the chunks for it.
+ */
+typedef struct
+{
+    buf_T	*mlb_buf;	// buffer being loaded, NULL if none
+    bhdr_T	*mlb_hp;	// data block being filled, NULL if none
+    linenr_T	mlb_line_count;	// number of lines added
+    PTR_EN	*mlb_leaf;	// the data blocks that are filled
+    int		mlb_leaf_count;
+    int		mlb_leaf_size;
+    PTR_EN	mlb_empty;	// the block with the line of the empty buffer
+# ifdef FEAT_BYTEOFF
+    chunksize_T	*mlb_chunk;	// the chunks of the lines added
+    int		mlb_chunk_count;
+    int		mlb_chunk_size;
+# endif
+} mlbulk_T;
+
+static mlbulk_T ml_bulk;
+
+/*
+ * Start loading lines into the empty buffer "buf" with ml_bulk_append().
+ * Returns FAIL when they have to be appended with ml_append().
+ */
+    int
+ml_bulk_start(buf_T *buf)
+{
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    bhdr_T	*hp;
+    PTR_BL	*pp;
+    PTR_EN	pe;
+    int		ok;
+
+    if (ml_bulk.mlb_buf != NULL || mfp == NULL
+	    || !(buf->b_ml.ml_flags & ML_EMPTY)
+	    || buf->b_ml.ml_line_count != 1
+# ifdef FEAT_PROP_POPUP
+	    || buf->b_has_textprop
+# endif
+# ifdef FEAT_EVAL
+	    || buf->b_listener != NULL
+# endif
+# ifdef FEAT_NETBEANS_INTG
+	    || netbeans_active()
+# endif
+       )
+	return FAIL;
+
+    ml_flush_line(buf);
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+
+    // The root must point to the data block with the empty line.
+    if ((hp = mf_get(mfp, (blocknr_T)1, 1)) == NULL)
+	return FAIL;
+    pp = (PTR_BL *)(hp->bh_data);
+    ok = pp->pb_id == PTR_ID && pp->pb_count == 1;
+    pe = pp->pb_pointer[0];
+    mf_put(mfp, hp, FALSE, FALSE);
+    if (!ok || (hp = mf_get(mfp, pe.pe_bnum, pe.pe_page_count)) == NULL)
+	return FAIL;
+    ok = ((DATA_BL *)(hp->bh_data))->db_id == DATA_ID;
+    mf_put(mfp, hp, FALSE, FALSE);
+    if (!ok)
+	return FAIL;
+
+    CLEAR_FIELD(ml_bulk);
+    ml_bulk.mlb_buf = buf;
+    ml_bulk.mlb_empty = pe;
+    return OK;
+}
+
+/*
+ * Add the filled data block to the leaves.
+ */
+    static int
+ml_bulk_put_block(void)
+{
+    memfile_T	*mfp = ml_bulk.mlb_buf->b_ml.ml_mfp;
+    bhdr_T	*hp = ml_bulk.mlb_hp;
+    PTR_EN	*pe;
+
+    if (ml_bulk.mlb_leaf_count + 1 >= ml_bulk.mlb_leaf_size)
+    {
+	int	size = ml_bulk.mlb_leaf_size == 0 ? 256
+						 : ml_bulk.mlb_leaf_size * 2;
+	PTR_EN	*leaf = vim_realloc(ml_bulk.mlb_leaf, size * sizeof(PTR_EN));
+
+	if (leaf == NULL)
+	    return FAIL;
+	ml_bulk.mlb_leaf = leaf;
+	ml_bulk.mlb_leaf_size = size;
+    }
+    pe = &ml_bulk.mlb_leaf[ml_bulk.mlb_leaf_count++];
+    pe->pe_bnum = hp->bh_bnum;
+    pe->pe_line_count = ((DATA_BL *)(hp->bh_data))->db_line_count;
+    pe->pe_old_lnum = ml_bulk.mlb_line_count - pe->pe_line_count + 1;
+    pe->pe_page_count = hp->bh_page_count;
+    mf_put(mfp, hp, TRUE, FALSE);
+    ml_bulk.mlb_hp = NULL;
+    return OK;
+}
+
+/*
+ * Add a line after the ones added since ml_bulk_start().  "len" includes the
+ * NUL.
+ */
+    int
+ml_bulk_append(char_u *line, colnr_T len)
+{
+    memfile_T	*mfp = ml_bulk.mlb_buf->b_ml.ml_mfp;
+    int		space_needed = len + INDEX_SIZE;
+    DATA_BL	*dp;
+
+    if (ml_bulk.mlb_hp != NULL
+	 && (int)((DATA_BL *)(ml_bulk.mlb_hp->bh_data))->db_free < space_needed
+	 && ml_bulk_put_block() == FAIL)
+	return FAIL;
+    if (ml_bulk.mlb_hp == NULL)
+    {
+	// A long line gets a block of several pages, like in ml_append_int().
+	int page_count = (space_needed + HEADER_SIZE + mfp->mf_page_size - 1)
+							 / mfp->mf_page_size;
+
+	if ((ml_bulk.mlb_hp = ml_new_data(mfp, TRUE, page_count)) == NULL)
+	    return FAIL;
+    }
+
+    dp = (DATA_BL *)(ml_bulk.mlb_hp->bh_data);
+    dp->db_txt_start -= len;
+    dp->db_free -= space_needed;
+    dp->db_index[dp->db_line_count++] = dp->db_txt_start;
+    mch_memmove((char_u *)dp + dp->db_txt_start, line, (size_t)len);
+    ++ml_bulk.mlb_line_count;
+
+# ifdef FEAT_BYTEOFF
+    if (ml_bulk.mlb_chunk_count == 0 || (ml_bulk.mlb_chunk != NULL
+	    && ml_bulk.mlb_chunk[ml_bulk.mlb_chunk_count - 1].mlcs_numlines
+								>= MLCS_MINL))
+    {
+	if (ml_bulk.mlb_chunk_count == ml_bulk.mlb_chunk_size)
+	{
+	    int		size = ml_bulk.mlb_chunk_size == 0 ? 100
+					      : ml_bulk.mlb_chunk_size * 2;
+	    chunksize_T	*chunk = vim_realloc(ml_bulk.mlb_chunk,
+						   size * sizeof(chunksize_T));
+
+	    if (chunk == NULL)
+	    {
+		// Like ml_updatechunk(): no byte offsets, the lines are fine.
+		VIM_CLEAR(ml_bulk.mlb_chunk);
+		ml_bulk.mlb_chunk_size = 0;
+		ml_bulk.mlb_chunk_count = -1;
+	    }
+	    else
+	    {
+		ml_bulk.mlb_chunk = chunk;
+		ml_bulk.mlb_chunk_size = size;
+	    }
+	}
+	if (ml_bulk.mlb_chunk != NULL)
+	{
+	    ml_bulk.mlb_chunk[ml_bulk.mlb_chunk_count].mlcs_numlines = 0;
+	    ml_bulk.mlb_chunk[ml_bulk.mlb_chunk_count].mlcs_totalsize = 0;
+	    ++ml_bulk.mlb_chunk_count;
+	}
+    }
+    if (ml_bulk.mlb_chunk != NULL)
+    {
+	++ml_bulk.mlb_chunk[ml_bulk.mlb_chunk_count - 1].mlcs_numlines;
+	ml_bulk.mlb_chunk[ml_bulk.mlb_chunk_count - 1].mlcs_totalsize += len;
+    }
+# endif
+    return OK;
+}
+
+/*
+ * Make the pointer blocks for the "count" entries in "pe", one level up.
+ * "pe" is replaced by the entries of the new blocks.  When out of memory the
+ * entries that were not put in a new block are kept after the new ones, so
+ * that all the blocks can still be found in "pe".
+ */
+    static int
+ml_bulk_level(memfile_T *mfp, PTR_EN *pe, int *count, int count_max)
+{
+    int		from;
+    int		to = 0;
+    int		i;
+    bhdr_T	*hp;
+    PTR_BL	*pp;
+    PTR_EN	parent;
+
+    for (from = 0; from < *count; from += count_max)
+    {
+	if ((hp = ml_new_ptr(mfp)) == NULL)
+	{
+	    mch_memmove(pe + to, pe + from, (*count - from) * sizeof(PTR_EN));
+	    *count = to + *count - from;
+	    return FAIL;
+	}
+	pp = (PTR_BL *)(hp->bh_data);
+	parent.pe_bnum = hp->bh_bnum;
+	parent.pe_line_count = 0;
+	parent.pe_old_lnum = pe[from].pe_old_lnum;
+	parent.pe_page_count = 1;
+	for (i = from; i < *count && i < from + count_max; ++i)
+	{
+	    pp->pb_pointer[pp->pb_count++] = pe[i];
+	    parent.pe_line_count += pe[i].pe_line_count;
+	}
+	mf_put(mfp, hp, TRUE, FALSE);
+	pe[to++] = parent;
+    }
+    *count = to;
+    return OK;
+}
+
+/*
+ * Free the block of "pe" and, for a pointer block, the blocks below it.  The
+ * block with the line of the empty buffer is kept.
+ */
+    static void
+ml_bulk_free(memfile_T *mfp, PTR_EN *pe)
+{
+    bhdr_T	*hp;
+    PTR_BL	*pp;
+    int		i;
+
+    if (pe->pe_bnum == ml_bulk.mlb_empty.pe_bnum
+	    || (hp = mf_get(mfp, pe->pe_bnum, pe->pe_page_count)) == NULL)
+	return;
+    pp = (PTR_BL *)(hp->bh_data);
+    if (pp->pb_id == PTR_ID)
+	for (i = 0; i < pp->pb_count; ++i)
+	    ml_bulk_free(mfp, &pp->pb_pointer[i]);
+    mf_free(mfp, hp);
+}
+
+/*
+ * Finish loading lines.  When "keep" is TRUE the lines added are put in the
+ * buffer before its empty line, like ml_append() does, otherwise they are
+ * dropped.  Returns FAIL when out of memory, the buffer is empty then.
+ */
+    int
+ml_bulk_end(int keep)
+{
+    buf_T	*buf = ml_bulk.mlb_buf;
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+    PTR_BL	*pp;
+    int		count_max;
+    int		ret = FAIL;
+    int		i;
+
+    if (buf == NULL)
+	return FAIL;
+    mfp = buf->b_ml.ml_mfp;
+    if (ml_bulk.mlb_line_count == 0)
+    {
+	// nothing was added, the buffer is as it was
+	keep = FALSE;
+	ret = OK;
+    }
+    if (keep && ml_bulk.mlb_hp != NULL && ml_bulk_put_block() == FAIL)
+	keep = FALSE;
+
+    if (keep && (hp = mf_get(mfp, (blocknr_T)1, 1)) != NULL)
+    {
+	pp = (PTR_BL *)(hp->bh_data);
+	count_max = pp->pb_count_max;
+	mf_put(mfp, hp, FALSE, FALSE);
+
+	// The empty line is after the lines added.  The last entry is always
+	// free, ml_bulk_put_block() grows the array when it's full.
+	ml_bulk.mlb_empty.pe_old_lnum = ml_bulk.mlb_line_count + 1;
+	ml_bulk.mlb_leaf[ml_bulk.mlb_leaf_count++] = ml_bulk.mlb_empty;
+
+	// Make the pointer blocks bottom-up, until they fit in the root.
+	while (ml_bulk.mlb_leaf_count > count_max)
+	    if (ml_bulk_level(mfp, ml_bulk.mlb_leaf, &ml_bulk.mlb_leaf_count,
+							   count_max) == FAIL)
+		break;
+	if (ml_bulk.mlb_leaf_count <= count_max
+			       && (hp = mf_get(mfp, (blocknr_T)1, 1)) != NULL)
+	{
+	    pp = (PTR_BL *)(hp->bh_data);
+	    pp->pb_count = ml_bulk.mlb_leaf_count;
+	    for (i = 0; i < ml_bulk.mlb_leaf_count; ++i)
+		pp->pb_pointer[i] = ml_bulk.mlb_leaf[i];
+	    mf_put(mfp, hp, TRUE, FALSE);
+
+	    buf->b_ml.ml_line_count = ml_bulk.mlb_line_count + 1;
+	    buf->b_ml.ml_flags &= ~ML_EMPTY;
+	    buf->b_ml.ml_stack_top = 0;	    // the stack is invalid now
+	    if (lowest_marked)
+		lowest_marked = 1;
+# ifdef FEAT_BYTEOFF
+	    if (ml_bulk.mlb_chunk == NULL)
+	    {
+		VIM_CLEAR(buf->b_ml.ml_chunksize);
+		buf->b_ml.ml_numchunks = 0;
+		buf->b_ml.ml_usedchunks = -1;
+	    }
+	    else if (buf->b_ml.ml_usedchunks != -1)
+	    {
+		// Add the empty line to the last chunk.
+		++ml_bulk.mlb_chunk[ml_bulk.mlb_chunk_count - 1].mlcs_numlines;
+		++ml_bulk.mlb_chunk[ml_bulk.mlb_chunk_count - 1].mlcs_totalsize;
+		vim_free(buf->b_ml.ml_chunksize);
+		buf->b_ml.ml_chunksize = ml_bulk.mlb_chunk;
+		buf->b_ml.ml_numchunks = ml_bulk.mlb_chunk_size;
+		buf->b_ml.ml_usedchunks = ml_bulk.mlb_chunk_count;
+		ml_bulk.mlb_chunk = NULL;
+		buf->b_ml.ml_chunktree_valid = 0;
+		if (ml_upd_lastbuf == buf)
+		    ml_upd_lastbuf = NULL;
+	    }
+# endif
+	    ret = OK;
+	}
+    }
+
+    if (!keep || ret == FAIL)
+    {
+	// Drop the data blocks and the pointer blocks made for them.
+	if (ml_bulk.mlb_hp != NULL)
+	    mf_free(mfp, ml_bulk.mlb_hp);
+	for (i = 0; i < ml_bulk.mlb_leaf_count; ++i)
+	    ml_bulk_free(mfp, &ml_bulk.mlb_leaf[i]);
+    }
+    vim_free(ml_bulk.mlb_leaf);
+# ifdef FEAT_BYTEOFF
+    vim_free(ml_bulk.mlb_chunk);
+# endif
+    CLEAR_FIELD(ml_bulk);
+    return ret;
+}
+#endif
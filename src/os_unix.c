@@ -1043,6 +1043,12 @@ deathtrap SIGDEFARG(sigarg)
     }
 #endif
 
+#if defined(FEAT_BORE) && defined(SIGBUS) && defined(SIGHASARG)
+    // A mapped file was truncated, jump back to where it was read.
+    if (sigarg == SIGBUS)
+	bore_map_sigbus();
+#endif
+
 #ifdef SIGHASARG
 # ifdef SIGQUIT
     // While in mch_delay() we go to cooked mode to allow a CTRL-C to
@@ -1,5 +1,13 @@
 /* if_bore.c */
 char_u* bore_statusline(int flags);
+void bore_stats(dict_T* d);
+void bore_map_sigbus(void);
+void bore_file_written(char_u* fname);
+int bore_map_read(buf_T* buf, int fd, off_T size, int detect_ff, int check_utf8, int* eol);
+char_u* bore_map_line(struct bore_map_t* map, linenr_T lnum);
+long bore_map_offset(buf_T* buf, linenr_T lnum, long* offp);
+void bore_map_free(struct bore_map_t* map);
+char_u* bore_find_eol(char_u* p, char_u* end);
 void bore_sortfilenames(char_u** files, int count, char_u* current);
 void ex_borefind(exarg_T *eap);
 void ex_boresln(exarg_T *eap);
@@ -1,4 +1,5 @@
 /* list.c */
+void list_changed(list_T *l);
 void list_add_watch(list_T *l, listwatch_T *lw);
 void list_rem_watch(list_T *l, listwatch_T *lwrem);
 list_T *list_alloc(void);
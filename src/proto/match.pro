@@ -1,5 +1,6 @@
 /* match.c */
 void clear_matches(win_T *wp);
+int bore_match_add_filters(win_T *wp, char_u *grp, char_u **filters, int count, int flags);
 void init_search_hl(win_T *wp, match_T *search_hl);
 void prepare_search_hl(win_T *wp, match_T *search_hl, linenr_T lnum);
 int prepare_search_hl_line(win_T *wp, linenr_T lnum, colnr_T mincol, char_u **line, match_T *search_hl, int *search_attr);
@@ -11,6 +11,8 @@ void mf_free(memfile_T *mfp, bhdr_T *hp);
 int mf_sync(memfile_T *mfp, int flags);
 void mf_set_dirty(memfile_T *mfp);
 int mf_release_all(void);
+void mf_bore_stats(dict_T *d);
+void mf_writer_hold_for_testing(int hold);
 blocknr_T mf_trans_del(memfile_T *mfp, blocknr_T old_nr);
 void mf_set_ffname(memfile_T *mfp);
 void mf_fullname(memfile_T *mfp);
@@ -28,6 +28,8 @@ int ml_replace(linenr_T lnum, char_u *line, int copy);
 int ml_replace_len(linenr_T lnum, char_u *line_arg, colnr_T len_arg, int has_props, int copy);
 int ml_delete(linenr_T lnum);
 int ml_delete_flags(linenr_T lnum, int flags);
+int ml_bore_load(buf_T *buf);
+void ml_bore_move(buf_T *frombuf, buf_T *tobuf);
 void ml_setmarked(linenr_T lnum);
 linenr_T ml_firstmarked(void);
 void ml_clearmarked(void);
@@ -39,4 +41,7 @@ char_u *ml_encrypt_data(memfile_T *mfp, char_u *data, off_T offset, unsigned siz
 void ml_decrypt_data(memfile_T *mfp, char_u *data, off_T offset, unsigned size);
 long ml_find_line_or_offset(buf_T *buf, linenr_T lnum, long *offp);
 void goto_byte(long cnt);
+int ml_bulk_start(buf_T *buf);
+int ml_bulk_append(char_u *line, colnr_T len);
+int ml_bulk_end(int keep);
 /* vim: set ft=c : */
@@ -36,6 +36,10 @@ int trigger_cexpr_autocmd(int cmdidx);
 int cexpr_core(exarg_T *eap, typval_T *tv);
 void ex_cexpr(exarg_T *eap);
 void ex_helpgrep(exarg_T *eap);
+int qf_bore_new_list(char_u *qf_title, int replace_id);
+int qf_bore_add_lines(int qf_id, char_u *lines, int *valid);
+int qf_bore_add_entry(int qf_id, char_u *fname, long lnum, int col, char_u *text);
+int qf_bore_update_buffer(int qf_id, char_u *qf_title);
 void free_quickfix(void);
 void f_getloclist(typval_T *argvars, typval_T *rettv);
 void f_getqflist(typval_T *argvars, typval_T *rettv);
@@ -8473,6 +8473,158 @@ ex_helpgrep(exarg_T *eap)
     }
 }
 
+# if defined(FEAT_BORE) || defined(PROTO)
+// The list filled by ":borefind", with its changedtick and the last entry
+// shown in the quickfix window by qf_bore_update_buffer().
+static int	qf_bore_id = 0;
+static long	qf_bore_changedtick = 0;
+static qfline_T *qf_bore_last = NULL;
+
+/*
+ * Bore: get the list with id "qf_id" that ":borefind" is filling.  Returns
+ * NULL when it is gone, is not the current list any more or was changed by
+ * something else, then qf_bore_last can't be used and the search stops adding
+ * to it.
+ */
+    static qf_list_T *
+qf_bore_get_list(int qf_id)
+{
+    qf_info_T	*qi = &ql_info;
+    qf_list_T	*qfl;
+
+    if (qf_id == 0 || qf_id != qf_bore_id
+				    || qf_id2nr(qi, qf_id) != qi->qf_curlist)
+	return NULL;
+    qfl = qf_get_curlist(qi);
+    if (qfl->qf_changedtick != qf_bore_changedtick)
+	return NULL;
+    return qfl;
+}
+
+/*
+ * Bore: start a new quickfix list with title "qf_title", to be filled with
+ * qf_bore_add_entry() while ":borefind" is searching.  When "replace_id" is
+ * not zero the entries of that list are removed instead, to fill it again in
+ * another order.  Returns the id of the list, or zero when the list to
+ * replace is gone or was changed.
+ */
+    int
+qf_bore_new_list(char_u *qf_title, int replace_id)
+{
+    qf_info_T	*qi = &ql_info;
+    qf_list_T	*qfl;
+
+    if (replace_id != 0)
+    {
+	qfl = qf_bore_get_list(replace_id);
+	if (qfl == NULL)
+	    return 0;
+	qf_free_items(qfl);
+	qf_store_title(qfl, qf_title);
+    }
+    else
+    {
+	qf_new_list(qi, qf_title);
+	qfl = qf_get_curlist(qi);
+    }
+
+    VIM_CLEAR(qf_last_bufname);
+    qf_list_changed(qfl);
+    qf_bore_id = qfl->qf_id;
+    qf_bore_changedtick = qfl->qf_changedtick;
+    qf_bore_last = NULL;
+    // Autocommands may change the list, it is checked when it is used
+    qf_update_buffer(qi, NULL);
+    return qf_bore_id;
+}
+
+/*
+ * Bore: parse the newline separated "lines" with 'errorformat' and append
+ * the entries to the quickfix list with id "qf_id", while ":borebuild" is
+ * running.  "*valid" is set to TRUE when the list has a valid entry.
+ * Returns the number of entries, or -1 when the list does not exist.
+ */
+    int
+qf_bore_add_lines(int qf_id, char_u *lines, int *valid)
+{
+    qf_info_T	*qi = &ql_info;
+    qf_list_T	*qfl;
+    qfline_T	*qfp;
+    typval_T	tv;
+    int		qf_idx = qf_id2nr(qi, qf_id);
+    int		nonevalid;
+    int		count;
+    int		i;
+
+    if (qf_idx == INVALID_QFIDX)
+	return -1;
+
+    qfl = qf_get_list(qi, qf_idx);
+    nonevalid = qf_list_empty(qfl) || qfl->qf_nonevalid;
+    qfp = qf_list_empty(qfl) ? NULL : qfl->qf_last;
+    i = qfl->qf_count;
+
+    tv.v_type = VAR_STRING;
+    tv.vval.v_string = lines;
+    count = qf_init_ext(qi, qf_idx, NULL, NULL, &tv, p_efm, FALSE,
+					(linenr_T)0, (linenr_T)0, NULL, NULL);
+
+    // qf_init_ext() only looks for the first valid entry in a new list,
+    // find it in the lines added here.
+    if (nonevalid && !qf_list_empty(qfl))
+    {
+	qfp = qfp == NULL ? qfl->qf_start : qfp->qf_next;
+	for (++i; qfp != NULL && !qfp->qf_valid; ++i)
+	    qfp = qfp->qf_next;
+	qfl->qf_nonevalid = qfp == NULL;
+	qfl->qf_index = qfp == NULL ? 1 : i;
+	qfl->qf_ptr = qfp == NULL ? qfl->qf_start : qfp;
+    }
+    qf_list_changed(qfl);
+    *valid = !qf_list_empty(qfl) && !qfl->qf_nonevalid;
+    return count;
+}
+
+/*
+ * Bore: add an entry to the quickfix list with id "qf_id".
+ * Returns FAIL when the list is gone or changed, or on a memory allocation
+ * failure.
+ */
+    int
+qf_bore_add_entry(int qf_id, char_u *fname, long lnum, int col, char_u *text)
+{
+    qf_list_T	*qfl = qf_bore_get_list(qf_id);
+
+    if (qfl == NULL || qf_add_entry(qfl, NULL, fname, NULL, 0, text, lnum, 0,
+				col, 0, FALSE, NULL, 0, 0, TRUE) == QF_FAIL)
+	return FAIL;
+    return OK;
+}
+
+/*
+ * Bore: append the entries added to the list with id "qf_id" since the last
+ * call to the quickfix window.  When "qf_title" is not NULL it becomes the
+ * title of the list.  Returns FAIL when the list is gone or changed.
+ */
+    int
+qf_bore_update_buffer(int qf_id, char_u *qf_title)
+{
+    qf_info_T	*qi = &ql_info;
+    qf_list_T	*qfl = qf_bore_get_list(qf_id);
+    qfline_T	*old_last = qf_bore_last;
+
+    if (qfl == NULL)
+	return FAIL;
+    if (qf_title != NULL)
+	qf_store_title(qfl, qf_title);
+    qf_list_changed(qfl);
+    qf_bore_changedtick = qfl->qf_changedtick;
+    qf_bore_last = qfl->qf_last;
+    qf_update_buffer(qi, old_last);
+    return OK;
+}
+# endif
+
 # if defined(EXITFREE) || defined(PROTO)
     void
 free_quickfix()
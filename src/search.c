@@ -4272,7 +4272,7 @@ typedef struct
  * Compute a score for a fuzzy matched string. The matching character locations
  * are in 'matches'.
  */
-    static int
+    int
 fuzzy_match_compute_score(
 	char_u		*str,
 	int		strSz,
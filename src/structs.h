@@ -515,6 +515,8 @@ typedef struct mf_hashtab_S
  * The free list is a single linked list, not sorted.
  *	The blocks in the free list have no block of memory allocated and
  *	the contents of the block in the file (if any) is irrelevant.
+ * With FEAT_BORE the used blocks of all memfiles are also in the cache
+ *	lists, see memfile.c.
  */
 
 struct block_hdr
@@ -526,9 +528,16 @@ struct block_hdr
     bhdr_T	*bh_prev;	    // previous block_hdr in used list
     char_u	*bh_data;	    // pointer to memory (for used block)
     int		bh_page_count;	    // number of pages in this block
+#ifdef FEAT_BORE
+    memfile_T	*bh_mfp;	    // memfile of a used block
+    bhdr_T	*bh_cache_next;	    // next block_hdr in cache list
+    bhdr_T	*bh_cache_prev;	    // previous block_hdr in cache list
+#endif
 
 #define BH_DIRTY    1
 #define BH_LOCKED   2
+#define BH_PROTECTED 4		    // in the protected cache list
+#define BH_WRITING  8		    // being written in the background
     char	bh_flags;	    // BH_DIRTY or BH_LOCKED
 };
 
@@ -706,6 +715,9 @@ struct memfile
     blocknr_T	mf_infile_count;	// number of pages in the file
     unsigned	mf_page_size;		// number of bytes in a page
     int		mf_dirty;		// TRUE if there are dirty blocks
+#ifdef FEAT_BORE
+    struct mfwbatch_S *mf_batch;	// blocks being written in background
+#endif
 #ifdef FEAT_CRYPT
     buf_T	*mf_buffer;		// buffer this memfile is for
     char_u	mf_seed[MF_SEED_LEN];	// seed for encryption
@@ -781,6 +793,19 @@ typedef struct memline
     chunksize_T *ml_chunksize;
     int		ml_numchunks;
     int		ml_usedchunks;
+# ifdef FEAT_BORE
+    chunksize_T *ml_chunktree;	// Fenwick tree of ml_chunksize
+    int		ml_chunktree_size;  // number of entries in ml_chunktree
+    int		ml_chunktree_valid; // entries that are up to date
+# endif
+#endif
+#ifdef FEAT_BORE
+    // Get the lines of a buffer that are not in the memfile, for the
+    // ":boreopen" picker.  ml_line_count is set by its owner.
+    char_u	*(*ml_bore_get)(buf_T *buf, linenr_T lnum);
+    // A large file that readfile() mapped, the lines are found in it until
+    // the buffer is changed.  The memfile has a single empty line.
+    struct bore_map_t *ml_bore_map;
 #endif
 } memline_T;
 
@@ -1542,6 +1567,9 @@ struct listvar_S
 				// should not be freed
     int		lv_copyID;	// ID used by deepcopy()
     char	lv_lock;	// zero, VAR_LOCKED, VAR_FIXED
+#ifdef FEAT_BORE
+    varnumber_T	lv_changedtick;	// set by list_changed()
+#endif
 };
 
 /*
@@ -1683,7 +1711,7 @@ typedef struct
     type_T	*uf_func_type;	// type of the function, &t_func_any if unknown
     int		uf_block_depth;	// nr of entries in uf_block_ids
     int		*uf_block_ids;	// blocks a :def function is defined inside
-# if defined(FEAT_LUA)
+# if defined(FEAT_LUA) || defined(FEAT_BORE)
     cfunc_T     uf_cb;		// callback function for cfunc
     cfunc_free_T uf_cb_free;    // callback function to free cfunc
     void	*uf_cb_state;   // state of uf_cb
@@ -3233,6 +3261,9 @@ struct file_buffer
 
 #ifdef FEAT_BORE
     int		b_borebuf;
+    int		b_bore_file_index;  // index of the file in the solution, or -1
+    int		b_bore_generation;  // b_bore_file_index is valid when equal to
+				    // the generation of the solution files
 #endif
 
 #if defined(FEAT_SYN_HL) || defined(FEAT_SPELL)
@@ -3448,6 +3479,14 @@ typedef struct
  * matchadd() and matchaddpos().
  */
 typedef struct matchitem matchitem_T;
+
+#ifdef FEAT_BORE
+// Flags for the literal strings of a match added by bore_match_add_filters()
+# define BORE_MATCH_IC		1   // ignore case, the strings are lower case
+# define BORE_MATCH_TAIL	2   // only after the last path separator
+# define BORE_MATCH_START	4   // only at the start of the line
+#endif
+
 struct matchitem
 {
     matchitem_T	*mit_next;
@@ -3464,6 +3503,11 @@ struct matchitem
     int		mit_pos_cur;	// internal position counter
     linenr_T	mit_toplnum;	// top buffer line
     linenr_T	mit_botlnum;	// bottom buffer line
+#ifdef FEAT_BORE
+    char_u	*mit_bore_filters; // literal strings to highlight, each NUL
+				   // terminated, an empty one ends the list
+    int		mit_bore_flags;	// BORE_MATCH_ flags
+#endif
 
     match_T	mit_hl;		// struct for doing the actual highlighting
     int		mit_hlg_id;	// highlight group ID
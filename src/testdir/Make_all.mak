@@ -75,6 +75,7 @@ NEW_TESTS = \
 	test_behave \
 	test_blob \
 	test_blockedit \
+	test_bore \
 	test_breakindent \
 	test_buffer \
 	test_bufline \
@@ -337,6 +338,7 @@ NEW_TESTS_RES = \
 	test_balloon_gui.res \
 	test_blob.res \
 	test_blockedit.res \
+	test_bore.res \
 	test_breakindent.res \
 	test_buffer.res \
 	test_bufline.res \
@@ -0,0 +1,615 @@
+" Tests for the bore extensions.
+
+source check.vim
+CheckFeature bore
+
+" A large file is mapped, another program may truncate it while it is shown.
+func Test_bore_map_truncated()
+  CheckUnix
+  let g:bore_map_size = 1
+  call writefile(map(range(1, 100000), '"line " .. v:val .. repeat("x", v:val % 40)'), 'Xbore_map', 'D')
+  edit Xbore_map
+  call assert_equal(100000, line('$'))
+  call assert_equal('line 50010' .. repeat('x', 10), getline(50010))
+
+  call writefile(['line 1'], 'Xbore_map')
+  call assert_fails('call getline(90000)', 'truncated')
+  call assert_equal('', getline(90000))
+  call assert_equal('', getline('$'))
+
+  " Changing it copies the lines that are left.
+  normal! Gdd
+  call assert_equal(99999, line('$'))
+  call assert_equal('', getline(90000))
+
+  bwipe!
+  unlet g:bore_map_size
+endfunc
+
+" The :boreopen picker shows the files without copying them into the buffer,
+" until something else than reading a line needs them.
+func Test_bore_picker_global()
+  " Not in the git work tree of Vim, only files in its index would be used
+  let dir = tempname()
+  call mkdir(dir .. '/a', 'pR')
+  for i in range(1, 12)
+    call writefile([], dir .. '/a/f' .. i .. '.c')
+  endfor
+  exe 'boresln ' .. dir
+  boreopen
+  call assert_equal(12, line('$'))
+
+  let found = []
+  g/f1/call add(found, getline('.'))
+  call assert_equal(['a/f1.c', 'a/f10.c', 'a/f11.c', 'a/f12.c'], sort(found))
+  call assert_equal(12, line('$'))
+
+  " It shows the files again for another filter
+  boreopen 2
+  call assert_equal(['a/f12.c', 'a/f2.c'], sort(getline(1, '$')))
+  setlocal modifiable
+  normal! ggdd
+  call assert_equal(1, line('$'))
+  boreopen
+  call assert_equal(12, line('$'))
+  close
+endfunc
+
+" The files of the solution as the picker shows them, without the .gitignore
+" files.
+func s:BoreFiles()
+  boreopen
+  let files = getline(1, '$')->filter({_, v -> v !~ 'gitignore$'})->sort()
+  close
+  return files
+endfunc
+
+" A directory is walked without what .gitignore files ignore.
+func Test_bore_gitignore()
+  let dir = tempname()
+  for d in ['build', 'sub/build', 'sub/deeper', 'gen/x/y', 'other']
+    call mkdir(dir .. '/' .. d, 'pR')
+  endfor
+  call writefile(['*.log', '!keep.log', 'build/', 'file/', '/top.txt', 'any.txt', 'gen/**/out.c'], dir .. '/.gitignore')
+  call writefile(['local.c', '!any.txt'], dir .. '/sub/.gitignore')
+  for f in ['a.c', 'x.log', 'keep.log', 'sub/y.log', 'sub/keep.log', 'build/b.c',
+        \ 'sub/build/c.c', 'sub/file', 'top.txt', 'sub/top.txt', 'any.txt',
+        \ 'other/any.txt', 'sub/any.txt', 'gen/out.c', 'gen/x/y/out.c', 'gen/x/in.c',
+        \ 'local.c', 'sub/local.c', 'sub/deeper/local.c', 'sub/deeper/d.c']
+    call writefile([], dir .. '/' .. f)
+  endfor
+  exe 'boresln ' .. dir
+  call assert_equal(['a.c', 'gen/x/in.c', 'keep.log', 'local.c', 'sub/any.txt',
+        \ 'sub/deeper/d.c', 'sub/file', 'sub/keep.log', 'sub/top.txt'], s:BoreFiles())
+endfunc
+
+" A git directory lists the files in the git index, and is walked when the
+" index has a version that isn't read.
+func Test_bore_git_index()
+  CheckExecutable git
+  let dir = tempname()
+  call mkdir(dir .. '/sub', 'pR')
+  call system('git init -q ' .. dir)
+  call writefile(['*.log'], dir .. '/.gitignore')
+  for f in ['a.c', 'b.c', 'sub/c.c', 'x.log', 'sub/untracked.c']
+    call writefile([], dir .. '/' .. f)
+  endfor
+  call system('git -C ' .. dir .. ' add a.c b.c sub/c.c && git -C ' .. dir .. ' add -f x.log')
+  exe 'boresln ' .. dir
+  call assert_equal(['a.c', 'b.c', 'sub/c.c', 'x.log'], s:BoreFiles())
+
+  let index = readblob(dir .. '/.git/index')
+  call assert_equal(0z44495243, index[0 : 3])
+  let index[7] = 9
+  call writefile(index, dir .. '/.git/index')
+  exe 'boresln! ' .. dir
+  call assert_equal(['a.c', 'b.c', 'sub/c.c', 'sub/untracked.c'], s:BoreFiles())
+endfunc
+
+" The name of the file boretoggle goes to.
+func s:Toggled()
+  boretoggle
+  return expand('%:t')
+endfunc
+
+" boretoggle goes through the suffixes of g:bore_toggle instead of the default
+" ones, an invalid suffix is left out with an error.
+func Test_bore_toggle_config()
+  let dir = tempname()
+  call mkdir(dir .. '/a', 'pR')
+  for f in ['foo.cpp', 'foo_test.cpp', 'foo.c', 'foo.h', 'foo.proto', 'foo.pb.h']
+    call writefile([], dir .. '/a/' .. f)
+  endfor
+
+  exe 'boresln ' .. dir
+  exe 'edit ' .. dir .. '/a/foo.cpp'
+  call assert_equal(['foo.c', 'foo.h', 'foo.cpp'], [s:Toggled(), s:Toggled(), s:Toggled()])
+
+  let g:bore_toggle = 'cpp,_test.cpp,h,proto,.pb.h'
+  exe 'boresln ' .. dir
+  exe 'edit ' .. dir .. '/a/foo.cpp'
+  call assert_equal(['foo_test.cpp', 'foo.h', 'foo.proto', 'foo.pb.h', 'foo.cpp'],
+        \ [s:Toggled(), s:Toggled(), s:Toggled(), s:Toggled(), s:Toggled()])
+  " Not in the list any more
+  exe 'edit ' .. dir .. '/a/foo.c'
+  call assert_equal('foo.c', s:Toggled())
+
+  let g:bore_toggle = 'cpp, a/b ,' .. repeat('x', 40) .. ',h,pb.'
+  call assert_fails('boresln ' .. dir, ['Invalid suffix in g:bore_toggle: a/b',
+        \ 'Invalid suffix in g:bore_toggle: pb.'])
+  exe 'edit ' .. dir .. '/a/foo.cpp'
+  call assert_equal(['foo.h', 'foo.cpp'], [s:Toggled(), s:Toggled()])
+
+  %bwipe!
+  unlet g:bore_toggle
+endfunc
+
+" A project file of the solution.
+func s:WriteProject(path, files)
+  call writefile(['<Project>', '  <ItemGroup>']
+        \ + map(copy(a:files), '"    <ClCompile Include=\"" .. v:val .. "\" />"')
+        \ + ['  </ItemGroup>', '</Project>'], a:path)
+endfunc
+
+" The cached solution is parsed again when a project file changes or is
+" removed.
+func Test_bore_sln_cache()
+  let dir = tempname()
+  call mkdir(dir .. '/a', 'pR')
+  call mkdir(dir .. '/b')
+  call writefile(['Microsoft Visual Studio Solution File, Format Version 12.00'], dir .. '/X.sln')
+  for p in ['a', 'b']
+    call writefile([printf('Project("{8BC9CEB8-8B4A-11D0-8D11-00A0C91BC942}") = "%s", "%s/%s.vcxproj", "{0000000%d-0000-0000-0000-000000000000}"', p, p, p, p == 'a' ? 1 : 2),
+          \ "\tProjectSection(SolutionItems) = preProject", "\tEndProjectSection", 'EndProject'], dir .. '/X.sln', 'a')
+  endfor
+  for f in ['a/a1.cpp', 'a/a2.cpp', 'a/a3.cpp', 'b/b1.cpp']
+    call writefile([], dir .. '/' .. f)
+  endfor
+  call s:WriteProject(dir .. '/a/a.vcxproj', ['a1.cpp', 'a2.cpp'])
+  call s:WriteProject(dir .. '/b/b.vcxproj', ['b1.cpp'])
+  let g:bore_cache_dir = tempname()
+  call mkdir(g:bore_cache_dir, 'R')
+
+  exe 'boresln ' .. dir .. '/X.sln'
+  call assert_equal(0, bore_stats().sln.cached)
+  call assert_equal(['a/a1.cpp', 'a/a2.cpp', 'b/b1.cpp'], s:BoreFiles())
+  exe 'boresln ' .. dir .. '/X.sln'
+  call assert_equal(1, bore_stats().sln.cached)
+  call assert_equal(['a/a1.cpp', 'a/a2.cpp', 'b/b1.cpp'], s:BoreFiles())
+
+  call s:WriteProject(dir .. '/a/a.vcxproj', ['a1.cpp', 'a3.cpp'])
+  exe 'boresln ' .. dir .. '/X.sln'
+  call assert_equal(0, bore_stats().sln.cached)
+  call assert_equal(['a/a1.cpp', 'a/a3.cpp', 'b/b1.cpp'], s:BoreFiles())
+
+  call delete(dir .. '/b/b.vcxproj')
+  exe 'boresln ' .. dir .. '/X.sln'
+  call assert_equal(0, bore_stats().sln.cached)
+  call assert_equal(['a/a1.cpp', 'a/a3.cpp'], s:BoreFiles())
+  exe 'boresln ' .. dir .. '/X.sln'
+  call assert_equal(1, bore_stats().sln.cached)
+
+  unlet g:bore_cache_dir
+endfunc
+
+" The trigram index skips the files that can't contain the string, unless
+" they were changed since they were indexed.
+func Test_bore_index()
+  let dir = tempname()
+  call mkdir(dir .. '/a', 'pR')
+  for i in range(1, 40)
+    call writefile(['int value_' .. i .. ';'], dir .. '/a/f' .. i .. '.c')
+  endfor
+  call writefile(['int needle;'], dir .. '/a/f7.c')
+  let g:bore_index = 1
+  let g:bore_cache_dir = tempname()
+  call mkdir(g:bore_cache_dir, 'R')
+  exe 'boresln ' .. dir
+  call WaitForAssert({-> execute('borefind needle') + assert_equal(1, bore_stats().find.indexed)})
+  call assert_equal(['f7.c'], getqflist()->map({_, v -> fnamemodify(bufname(v.bufnr), ':t')}))
+
+  " Written by Vim
+  exe 'split ' .. dir .. '/a/f3.c'
+  call setline(1, 'int needle_too;')
+  write
+  close
+  borefind needle
+  call assert_equal(['f3.c', 'f7.c'], getqflist()->map({_, v -> fnamemodify(bufname(v.bufnr), ':t')})->sort())
+
+  " Written by another program, the saved index is loaded and the file is
+  " indexed again
+  call writefile(['int needle_three;', ''], dir .. '/a/f5.c')
+  exe 'boresln ' .. dir
+  call WaitForAssert({-> execute('borefind needle') + assert_equal(1, bore_stats().find.indexed)})
+  call assert_equal(['f3.c', 'f5.c', 'f7.c'], getqflist()->map({_, v -> fnamemodify(bufname(v.bufnr), ':t')})->sort())
+  call assert_equal(37, bore_stats().find.skipped_index)
+
+  " It is loaded: a saved index that has all files unindexed is used as it is.
+  " The bitmap of the unindexed files is after the header, the trigrams and
+  " their postings.
+  let saved = readblob(g:bore_index_file)
+  let unindexed = 24 + (saved[16 : 19]->reverse()->blob2list()->reduce({n, v -> n * 256 + v}) + 1) * 8
+        \ + saved[20 : 23]->reverse()->blob2list()->reduce({n, v -> n * 256 + v}) * 4
+  for i in range(unindexed, unindexed + 7)
+    let saved[i] = 0xff
+  endfor
+  call writefile(saved, g:bore_index_file)
+  exe 'boresln ' .. dir
+  call WaitForAssert({-> execute('borefind needle') + assert_equal(1, bore_stats().find.indexed)})
+  call assert_equal(0, bore_stats().find.skipped_index)
+  call assert_equal(3, len(getqflist()))
+
+  " A saved index that doesn't fit is not used
+  call writefile(['BIDX'], g:bore_index_file)
+  exe 'boresln ' .. dir
+  call WaitForAssert({-> execute('borefind needle') + assert_equal(1, bore_stats().find.indexed)})
+  call assert_equal(['f3.c', 'f5.c', 'f7.c'], getqflist()->map({_, v -> fnamemodify(bufname(v.bufnr), ':t')})->sort())
+
+  call setqflist([], 'f')
+  unlet g:bore_index g:bore_cache_dir
+endfunc
+
+" A file with too many distinct trigrams is not indexed and always searched.
+func Test_bore_index_dense()
+  let dir = tempname()
+  call mkdir(dir .. '/a', 'pR')
+  for i in range(1, 10)
+    call writefile(['int value_' .. i .. ';'], dir .. '/a/f' .. i .. '.c')
+  endfor
+  let chars = '0123456789abcdefghijklmnopqrstuvwxyz'
+  call writefile([range(36 * 36 * 36)->map({_, v -> chars[v / 1296] .. chars[v / 36 % 36] .. chars[v % 36]})->join('')], dir .. '/a/dense.c')
+  let g:bore_index = 1
+  exe 'boresln ' .. dir
+  call WaitForAssert({-> execute('silent! borefind needle') + assert_equal(1, bore_stats().find.indexed)})
+  call assert_equal(10, bore_stats().find.skipped_index)
+  call assert_equal(1, bore_stats().find.searched)
+
+  call writefile(['int needle;'], dir .. '/a/dense.c')
+  exe 'boresln ' .. dir
+  call WaitForAssert({-> execute('borefind needle') + assert_equal(1, bore_stats().find.indexed)})
+  call assert_equal(['dense.c'], getqflist()->map({_, v -> fnamemodify(bufname(v.bufnr), ':t')}))
+  call assert_equal(10, bore_stats().find.skipped_index)
+
+  call setqflist([], 'f')
+  unlet g:bore_index
+endfunc
+
+" A watched directory reports the files that are written.
+func Test_bore_index_watch()
+  CheckLinux
+  let dir = tempname()
+  call mkdir(dir .. '/a', 'pR')
+  for i in range(1, 40)
+    call writefile(['int value_' .. i .. ';'], dir .. '/a/f' .. i .. '.c')
+  endfor
+  let g:bore_index = 1
+  let g:bore_watch = 1
+  exe 'boresln ' .. dir
+  call WaitForAssert({-> execute('silent! borefind value_9') + assert_equal(1, bore_stats().find.indexed)})
+
+  call writefile(['int needle;'], dir .. '/a/f9.c')
+  call WaitForAssert({-> execute('silent! borefind needle') + assert_equal(1, len(getqflist()))})
+  call assert_equal(39, bore_stats().find.skipped_index)
+
+  call setqflist([], 'f')
+  unlet g:bore_index g:bore_watch
+endfunc
+
+" borefind fills the quickfix list while it searches, autocommands that run
+" meanwhile can't load another solution and another list is left alone.
+func Test_bore_find_autocmd()
+  let dir = tempname()
+  call mkdir(dir .. '/a', 'pR')
+  for i in range(1, 100)
+    call writefile(['int needle_' .. i .. ';'], dir .. '/a/f' .. i .. '.c')
+  endfor
+  exe 'boresln ' .. dir
+  cclose
+
+  let g:caught = ''
+  augroup BoreTest
+    au WinEnter * try | exe 'boresln ' .. g:dir | catch | let g:caught = v:exception | endtry
+  augroup END
+  let g:dir = dir
+  borefind needle
+  call assert_match('Not while borefind is searching', g:caught)
+  call assert_equal(100, len(getqflist()))
+  cclose
+
+  " bore_ctrlpmatch() does not use the threads of the search that runs the
+  " autocommand
+  let g:items = map(range(20000), '"file" .. v:val')
+  augroup BoreTest
+    au!
+    au WinEnter * let g:hits = s:CtrlpMatch(g:items, '99')
+  augroup END
+  borefind needle
+  call assert_equal(s:CtrlpExpected(g:items, '99'), g:hits)
+  call assert_equal(100, len(getqflist()))
+  cclose
+
+  " A new list made by an autocommand stops the search
+  augroup BoreTest
+    au!
+    au FileType qf call setqflist([], ' ', {'title': 'other'})
+  augroup END
+  borefind needle
+  call assert_equal('other', getqflist({'title': 1}).title)
+  call assert_equal(0, getqflist({'size': 0}).size)
+
+  " The matches are sorted for a file of the solution, the list that is filled
+  " again is the one of the search
+  cclose
+  exe 'edit ' .. dir .. '/a/f50.c'
+  borefind needle
+  call assert_equal('other', getqflist({'title': 1}).title)
+  call assert_equal(0, getqflist({'size': 0}).size)
+  au! BoreTest
+  augroup! BoreTest
+  colder
+  call assert_match('borefind needle', getqflist({'title': 1}).title)
+  cclose
+  bwipe!
+  call setqflist([], 'f')
+  unlet g:caught g:dir g:items g:hits
+endfunc
+
+" The file, line and column of the matches of borefind.
+func s:BoreFindHits(args)
+  exe 'silent borefind ' .. a:args
+  return getqflist()->map({_, v -> [fnamemodify(bufname(v.bufnr), ':t'), v.lnum, v.col]})->sort()
+endfunc
+
+" The first match in every line of the files in "dir", found by Vim.
+func s:VimHits(dir, pat)
+  let hits = []
+  for f in glob(a:dir .. '/a/*', 0, 1)
+    let lnum = 0
+    for line in readfile(f)
+      let lnum += 1
+      let col = match(line, a:pat)
+      if col >= 0
+        call add(hits, [fnamemodify(f, ':t'), lnum, col + 1])
+      endif
+    endfor
+  endfor
+  return sort(hits)
+endfunc
+
+" borefind -r finds the same lines and columns as Vim's own regex.
+func Test_bore_find_regex()
+  let dir = tempname()
+  call mkdir(dir .. '/a', 'pR')
+  call writefile(['int foo_bar = 1;', 'int FooBar = 2;', 'call foo(bar);',
+        \ 'foofoo barbar', 'xyzzy 12345 end', 'a1b22c333d4444', 'the food is good',
+        \ 'foo', "tab\there", 'BAR_FOO'], dir .. '/a/one.c')
+  call writefile(['static FOO_BAR x;', 'return a12 + b345;', 'mid_literal_hello_x',
+        \ '  say hello_world', '123', '', 'say_literal_ only', 'X_LITERAL_Y'], dir .. '/a/two.h')
+  set noignorecase
+  exe 'boresln ' .. dir
+  cclose
+
+  for pat in [
+        \ 'foo\|bar', 'foo_bar\|FooBar\|hello', '\(foo\|bar\)\{2}',
+        \ '\d\{2,3}', 'a\d\{1,2}\>', '\d\{4}', 'o\{2,}',
+        \ '\<foo\>', '\<foo', 'bar\>', '\<hello_\w\+',
+        \ '\cfoo_bar', '\cbar_foo', 'foo\c', '\c_literal_',
+        \ '[A-Z][a-z]\+', '[[:digit:]]\{3}', '[^a-z ]\+;', '\u\+_\u\+', '[fb]oo\?d',
+        \ '\w\+_literal_\w\+', '\s\+\w\+_world',
+        \ '\d\+', '^\s*\a\+$', '\t\a', '^$\|^\d\+$',
+        \ ]
+    call assert_equal(s:VimHits(dir, pat), s:BoreFindHits('-r ' .. pat), pat)
+    cclose
+  endfor
+
+  call setqflist([], 'f')
+  set ignorecase&
+endfunc
+
+" borefind -i finds a mixed case string wherever it starts, also where it
+" crosses the 16 and 32 byte blocks of the search, and next to or with
+" non-ASCII characters.
+func Test_bore_find_ignorecase()
+  let dir = tempname()
+  call mkdir(dir .. '/a', 'pR')
+  for k in range(40)
+    call writefile([repeat('x', k) .. 'NeEdLe' .. repeat('y', k % 3)], dir .. '/a/x' .. k .. '.c')
+    call writefile([repeat("\u00e9", k / 2) .. repeat('z', k % 2) .. 'nEEDLe'], dir .. '/a/e' .. k .. '.c')
+  endfor
+  call writefile(["\u00c4NEEDLE", "\u00e4needle\u00d6", "x\u00ffNeedle", "NEEDLE\u00e9",
+        \ "\u0178NEEDLE", "nee\u00e9dle", "\u00c9NEEDLE\u00c9", "N\u00c9EDLE"], dir .. '/a/u.c')
+  exe 'boresln ' .. dir
+  cclose
+
+  for pat in ['nEEdle', 'NEEDLE', 'eedL', 'xNEE', 'dleY', "\u00e9NEE", "\u00c9needle",
+        \ "\u00e4NEEDLE\u00f6", "\u00ffneedle", "E\u00c9", "ee\u00e9D", "n\u00c9e"]
+    call assert_equal(s:VimHits(dir, '\V\c' .. pat), s:BoreFindHits('-i ' .. pat), pat)
+    cclose
+  endfor
+
+  call setqflist([], 'f')
+endfunc
+
+" The output of borebuild is parsed as it arrives, a line that arrives in
+" pieces is parsed once it is complete.
+func Test_bore_build_partial_lines()
+  CheckFeature channel
+  CheckUnix
+  let dir = tempname()
+  call mkdir(dir, 'R')
+  call writefile([], dir .. '/a.cpp')
+  call writefile([], dir .. '/b.cpp')
+  exe 'boresln ' .. dir
+  let save_efm = &efm
+  let &efm = '%f(%l\,%c): %trror %m,%f(%l\,%c): %tarning %m'
+  let g:bore_build_cmd = "printf 'a.cpp(12,5): err'; sleep 0.3;"
+        \ .. " printf 'or C2065: x: undeclared\\nb.cpp(3,1): warn'; sleep 0.3;"
+        \ .. " printf 'ing C4100: y: unused\\nno newline at the end'"
+  borebuildsln
+
+  " The start of the warning is kept until the rest of it arrives
+  call WaitForAssert({-> assert_equal(1, len(getqflist()))})
+  let qf = getqflist()
+  call assert_equal(['a.cpp', 12, 5, 'e', 'C2065: x: undeclared', 1],
+        \ [bufname(qf[0].bufnr), qf[0].lnum, qf[0].col, qf[0].type, qf[0].text, qf[0].valid])
+
+  call WaitForAssert({-> assert_match('success', execute('borebuildinfo'))})
+  let qf = getqflist()
+  call assert_equal(3, len(qf))
+  call assert_equal(['b.cpp', 3, 1, 'w', 'C4100: y: unused', 1],
+        \ [bufname(qf[1].bufnr), qf[1].lnum, qf[1].col, qf[1].type, qf[1].text, qf[1].valid])
+  call assert_equal(['no newline at the end', 0], [qf[2].text, qf[2].valid])
+
+  cclose
+  call setqflist([], 'f')
+  let &efm = save_efm
+  unlet g:bore_build_cmd
+endfunc
+
+" Big files are mapped, one that is truncated while it is searched is read
+" again and what is left of it is searched.
+func Test_bore_find_mapped_truncated()
+  CheckUnix
+  let dir = tempname()
+  call mkdir(dir .. '/a', 'pR')
+  let lines = map(range(1, 20000), 'v:val % 1000 ? repeat("x", 40) : "int needle_" .. v:val .. ";"')
+  call writefile(lines, dir .. '/a/big.c')
+  call writefile(['int needle;'], dir .. '/a/small.c')
+  exe 'boresln ' .. dir
+  silent borefind needle
+  call assert_equal(21, len(getqflist()))
+  call assert_equal(1, bore_stats().find.mapped)
+
+  call test_override('bore_truncate', 1)
+  silent borefind needle
+  call test_override('bore_truncate', 0)
+  let left = readfile(dir .. '/a/big.c')
+  call assert_inrange(1, 19, len(left) / 1000)
+  call assert_equal(len(filter(left, 'v:val =~ "needle"')) + 1, len(getqflist()))
+  call assert_equal(0, bore_stats().find.mapped)
+  call assert_equal(0, bore_stats().find.failed)
+
+  cclose
+  call setqflist([], 'f')
+endfunc
+
+" The items of "items" that contain all the space separated words of "str".
+func s:CtrlpExpected(items, str)
+  let expected = copy(a:items)
+  for f in split(a:str)
+    call filter(expected, 'stridx(v:val, f) >= 0')
+  endfor
+  return expected
+endfunc
+
+func s:CtrlpMatch(items, str, ...)
+  " the groups of ctrlp that the matches are highlighted with
+  highlight default link CtrlPMatch Identifier
+  highlight default link CtrlPLinePre Comment
+  return bore_ctrlpmatch(extend({'items': a:items, 'str': a:str, 'limit': 0,
+        \ 'mmode': 'full-line'}, a:0 ? a:1 : {}))
+endfunc
+
+" bore_ctrlpmatch() searches a query that extends the previous one only in
+" its hits, also when the list is searched on several threads.
+func Test_bore_ctrlpmatch()
+  let items = map(range(20000), '"dir" .. (v:val % 7) .. "/file" .. v:val .. ".c"')
+  for str in ['1', '12', '123', '123 dir3', '12', 'file1 4', 'file1 42', '']
+    let expected = str == '' ? items : s:CtrlpExpected(items, str)
+    call assert_equal(expected, s:CtrlpMatch(items, str), str)
+  endfor
+  call assert_equal(s:CtrlpExpected(items, '99')[: 9],
+        \ s:CtrlpMatch(items, '99', {'limit': 10}))
+  " the hits are not limited, the next query finds all of them
+  call assert_equal(s:CtrlpExpected(items, '99 .c'), s:CtrlpMatch(items, '99 .c'))
+
+  " A case sensitive query extends a case insensitive one, not the other way
+  " around.
+  set ignorecase smartcase
+  let items = ['Foo/a', 'foo/b', 'FOO/c', 'bar/d']
+  call assert_equal(['Foo/a', 'foo/b', 'FOO/c'], s:CtrlpMatch(items, 'fo'))
+  call assert_equal(['Foo/a'], s:CtrlpMatch(items, 'Foo'))
+  call assert_equal(['Foo/a', 'foo/b', 'FOO/c'], s:CtrlpMatch(items, 'foo'))
+  set ignorecase& smartcase&
+endfunc
+
+" The hits are ranked like matchfuzzy() ranks them when asked for.
+func Test_bore_ctrlpmatch_rank()
+  let items = ['src/xfoo/a.c', 'lib/bar.c', 'foo.c', 'src/main/foo.c', 'afoo_b.c']
+  call assert_equal(['src/xfoo/a.c', 'foo.c', 'src/main/foo.c', 'afoo_b.c'],
+        \ s:CtrlpMatch(items, 'foo'))
+  let hits = s:CtrlpMatch(items, 'foo')
+  call assert_equal(matchfuzzy(hits, 'foo'), s:CtrlpMatch(items, 'foo', {'rank': 1}))
+  call assert_equal(matchfuzzy(hits, 'foo')[: 1],
+        \ s:CtrlpMatch(items, 'foo', {'rank': 1, 'limit': 2}))
+
+  let g:bore_ctrlp_rank = 1
+  call assert_equal(matchfuzzy(hits, 'foo'), s:CtrlpMatch(items, 'foo'))
+  unlet g:bore_ctrlp_rank
+
+  " Ranking many items keeps the best ones in the same order.
+  let items = map(range(20000), '"dir" .. (v:val % 7) .. "/file" .. v:val .. ".c"')
+  let ranked = s:CtrlpMatch(items, 'file12', {'rank': 1})
+  call assert_equal(len(s:CtrlpExpected(items, 'file12')), len(ranked))
+  call assert_equal(ranked[: 49], s:CtrlpMatch(items, 'file12', {'rank': 1, 'limit': 50}))
+  call assert_equal(['dir5/file12.c'], ranked[: 0])
+endfunc
+
+" The hits of the previous query are not used when the list changed, even if
+" a changed string is allocated where the old one was.
+func Test_bore_ctrlpmatch_list_changed()
+  let items = ['xyz/a', 'foo/b', 'bar/c']
+  call assert_equal(['foo/b'], s:CtrlpMatch(items, 'fo'))
+  let items[0] = 'abc/a'
+  let items[0] = 'foo/a'
+  call assert_equal(['foo/a', 'foo/b'], s:CtrlpMatch(items, 'foo'))
+
+  call add(items, 'foo/d')
+  call assert_equal(['foo/a', 'foo/b', 'foo/d'], s:CtrlpMatch(items, 'foo/'))
+  call remove(items, 1)
+  call assert_equal(['foo/a', 'foo/d'], s:CtrlpMatch(items, 'foo/'))
+
+  " another list with the same number of items
+  call assert_equal(['foo/a'], s:CtrlpMatch(items, 'foo/a'))
+  call assert_equal(['foo/x'], s:CtrlpMatch(['abc/a', 'bar/c', 'foo/x'], 'foo/'))
+
+  " a copy of the list, and an item that is not a string
+  call assert_equal(['foo/a', 'foo/d'], s:CtrlpMatch(copy(items), 'foo'))
+  call assert_equal(['foo/d'], s:CtrlpMatch([42, 'bar/c', 'foo/d'], 'foo'))
+  call assert_equal(['42'], s:CtrlpMatch(['42', 'bar/c', 'foo/d'], '4'))
+
+  " changed in place by functions and assignments
+  let items = ['foo/a', 'bar/b', 'foo/c']
+  call assert_equal(['foo/a', 'foo/c'], s:CtrlpMatch(items, 'foo'))
+  call map(items, 'toupper(v:val)')
+  call assert_equal([], s:CtrlpMatch(items, 'foo'))
+  call map(items, 'tolower(v:val)')
+  call reverse(items)
+  call assert_equal(['foo/c', 'foo/a'], s:CtrlpMatch(items, 'foo'))
+  call sort(items)
+  call assert_equal(['foo/a', 'foo/c'], s:CtrlpMatch(items, 'foo'))
+  let items[0:1] = ['foo/x', 'foo/y']
+  call assert_equal(['foo/x', 'foo/y', 'foo/c'], s:CtrlpMatch(items, 'foo'))
+  let items[0] ..= 'z'
+  call assert_equal(['foo/xz'], s:CtrlpMatch(items, 'foo/x'))
+  call insert(items, 'foo/x')
+  call extend(items, ['foo/x'])
+  call assert_equal(['foo/x', 'foo/xz', 'foo/x'], s:CtrlpMatch(items, 'foo/x'))
+  call uniq(sort(items))
+  call filter(items, 'v:val !~ "z"')
+  call assert_equal(['foo/x'], s:CtrlpMatch(items, 'foo/x'))
+  def s:SetItem(l: list<string>, i: number, s: string)
+    l[i] = s
+  enddef
+  call s:SetItem(items, 1, 'bar/x')
+  call assert_equal([], s:CtrlpMatch(items, 'foo/x'))
+
+  " filename-only uses the tail of the changed string
+  let items = ['foo/bar', 'x/y']
+  call assert_equal(['foo/bar'], s:CtrlpMatch(items, 'ba', {'mmode': 'filename-only'}))
+  let items[0] = 'abc/ab'
+  let items[0] = 'bar/fo'
+  call assert_equal([], s:CtrlpMatch(items, 'bar', {'mmode': 'filename-only'}))
+endfunc
+
+" vim: shiftwidth=2 sts=2 expandtab
@@ -319,4 +319,48 @@ func Test_fileformat_on_startup()
   call delete('Xonsfile')
 endfunc
 
+" An empty file and a file without an end-of-line at the end are read like
+" other files, also when they are split over many blocks.
+func Test_fileformat_empty_and_noeol()
+  call writefile([], 'Xffempty')
+  let msg = execute('edit Xffempty')
+  call assert_notmatch('READ ERRORS', msg)
+  call assert_equal(1, line('$'))
+  call assert_equal('', getline(1))
+  call assert_equal(-1, line2byte(1))
+  call assert_true(&modifiable)
+  call assert_false(&readonly)
+  call assert_false(&modified)
+  call setline(1, 'added')
+  call assert_equal(['added'], getline(1, '$'))
+  bwipe!
+
+  let lines = map(range(1, 10000), '"line " .. v:val')
+  for ff in ['unix', 'dos', 'mac']
+    for content in [['one'], lines]
+      if ff == 'mac'
+        call writefile([join(content, "\r")], 'Xffnoeol', 'b')
+      else
+        let eol = ff == 'dos' ? "\r" : ''
+        call writefile(map(content[: -2], 'v:val .. eol') + content[-1 :],
+              \ 'Xffnoeol', 'b')
+      endif
+      let expected = readfile('Xffnoeol', 'B')
+      let msg = execute('edit ++ff=' .. ff .. ' Xffnoeol')
+      call assert_notmatch('READ ERRORS', msg)
+      call assert_equal(ff, &fileformat)
+      call assert_false(&endofline)
+      call assert_equal(content, getline(1, '$'))
+      setlocal nofixendofline
+      call assert_equal(getfsize('Xffnoeol') + 1, line2byte(line('$') + 1))
+      write
+      call assert_equal(expected, readfile('Xffnoeol', 'B'))
+      bwipe!
+    endfor
+  endfor
+
+  call delete('Xffempty')
+  call delete('Xffnoeol')
+endfunc
+
 " vim: shiftwidth=2 sts=2 expandtab
@@ -1188,6 +1188,65 @@ func Test_byte2line_line2byte()
   bw!
 endfunc
 
+" Check line2byte(), byte2line() and :goto against the line lengths, for a
+" sample of the lines.
+func s:CheckByteOffsets(ff)
+  let &fileformat = a:ff
+  let eol = a:ff == 'dos' ? 2 : 1
+  let offsets = [1]
+  for l in getline(1, '$')
+    call add(offsets, offsets[-1] + len(l) + eol)
+  endfor
+  let last = line('$')
+  for lnum in range(1, last, 97) + [last - 1, last]
+    call assert_equal(offsets[lnum - 1], line2byte(lnum), 'line ' .. lnum)
+    call assert_equal(lnum, byte2line(offsets[lnum - 1]), 'offset of ' .. lnum)
+    call assert_equal(lnum, byte2line(offsets[lnum] - 1), 'end of ' .. lnum)
+    exe 'goto ' .. offsets[lnum - 1]
+    call assert_equal(lnum, line('.'))
+  endfor
+  call assert_equal(offsets[-1], line2byte(last + 1))
+endfunc
+
+" The byte offsets are kept for chunks of lines, which are split when lines
+" are added and joined or deleted when lines are deleted.
+func Test_byte2line_line2byte_chunks()
+  new
+  call setline(1, map(range(20000), 'repeat("x", v:val % 73)'))
+  call s:CheckByteOffsets('unix')
+
+  " Split chunks in the middle, one line at a time and in one go
+  for i in range(1200)
+    call append(7000, 'inserted ' .. i)
+  endfor
+  call append(15000, map(range(3000), 'repeat("y", v:val % 31)'))
+  call s:CheckByteOffsets('unix')
+  call s:CheckByteOffsets('dos')
+
+  " Change lines, the chunks stay
+  5000,5500s/x/zz/
+  call s:CheckByteOffsets('unix')
+
+  " Join and delete chunks
+  9000,12000d
+  for i in range(900)
+    3000d
+  endfor
+  1,1500d
+  call s:CheckByteOffsets('unix')
+  call s:CheckByteOffsets('dos')
+
+  " Add at the end and the start again
+  call append('$', map(range(2000), '"end " .. v:val'))
+  call append(0, map(range(2000), '"start " .. v:val'))
+  call s:CheckByteOffsets('mac')
+
+  %d
+  call assert_equal(1, line2byte(1))
+  call assert_equal(2, line2byte(2))
+  bw!
+endfunc
+
 " Test for byteidx() and byteidxcomp() functions
 func Test_byteidx()
   let a = '.é.' " one char of two bytes
@@ -434,4 +434,85 @@ func Test_match_tab_with_linebreak()
 endfunc
 
 
+" The matches of bore_ctrlpmatch() find the filters in the lines as they are
+" drawn.  getmatches() gives patterns that highlight the same text.
+func Test_match_bore_ctrlpmatch()
+  CheckFeature bore
+  new
+  set ignorecase smartcase
+  highlight CtrlPMatch term=bold ctermbg=red guibg=red
+  highlight CtrlPLinePre term=underline ctermbg=blue guibg=blue
+  let items = ['src/Foo/bar.c', 'src/bar/foo.c', 'lib/FOOBAR.h']
+  call setline(1, map(copy(items), '"> " .. v:val') + ['x > src/foo'])
+  redraw!
+  let normal = screenattr(1, 3)
+
+  " The columns that are highlighted, -1 for CtrlPLinePre.
+  func s:HlCols(lnum, normal, pre) closure
+    let cols = []
+    for col in range(1, 15)
+      let attr = screenattr(a:lnum, col)
+      if attr == a:pre
+        call add(cols, -1)
+      elseif attr != a:normal
+        call add(cols, col)
+      endif
+    endfor
+    return cols
+  endfunc
+
+  " lower case ignores case with 'smartcase', "^>" only at the start of the line
+  call assert_equal(items, bore_ctrlpmatch({'items': items, 'str': 'foo',
+        \ 'limit': 10, 'mmode': 'full-line'}))
+  redraw!
+  let pre = screenattr(1, 1)
+  call assert_notequal(normal, pre)
+  call assert_equal([-1, 7, 8, 9], s:HlCols(1, normal, pre))
+  call assert_equal([-1, 11, 12, 13], s:HlCols(2, normal, pre))
+  call assert_equal([-1, 7, 8, 9], s:HlCols(3, normal, pre))
+  call assert_equal([9, 10, 11], s:HlCols(4, normal, pre))
+
+  " upper case matches case, every filter is highlighted
+  call assert_equal(['src/Foo/bar.c'], bore_ctrlpmatch({'items': items,
+        \ 'str': 'Foo bar', 'limit': 10, 'mmode': 'full-line'}))
+  redraw!
+  call assert_equal([-1, 7, 8, 9, 11, 12, 13], s:HlCols(1, normal, pre))
+  call assert_equal([-1, 7, 8, 9], s:HlCols(2, normal, pre))
+  call assert_equal([-1], s:HlCols(3, normal, pre))
+
+  " filename-only does not highlight in the path
+  call assert_equal(['src/Foo/bar.c', 'lib/FOOBAR.h'], bore_ctrlpmatch(
+        \ {'items': items, 'str': 'bar', 'limit': 10, 'mmode': 'filename-only'}))
+  redraw!
+  let hl = map(range(1, 4), 's:HlCols(v:val, normal, pre)')
+  call assert_equal([[-1, 11, 12, 13], [-1], [-1, 10, 11, 12], []], hl)
+
+  let m = getmatches()
+  call assert_equal(2, len(m))
+  call assert_equal('CtrlPMatch', m[0].group)
+  call assert_equal('\c\%([^/]*$\)\@=\V\%(bar\)', m[0].pattern)
+  call assert_equal('CtrlPLinePre', m[1].group)
+  call assert_equal('\C^\V\%(>\)', m[1].pattern)
+
+  " the patterns highlight the same text
+  call clearmatches()
+  redraw!
+  call assert_equal([[], [], [], []],
+        \ map(range(1, 4), 's:HlCols(v:val, normal, pre)'))
+  call setmatches(m)
+  redraw!
+  call assert_equal(hl, map(range(1, 4), 's:HlCols(v:val, normal, pre)'))
+
+  call bore_ctrlpmatch({'items': items, 'str': 'a\b', 'limit': 10,
+        \ 'mmode': 'full-line'})
+  call assert_equal('\c\V\%(a\\b\)', getmatches()[0].pattern)
+
+  delfunc s:HlCols
+  set ignorecase& smartcase&
+  highlight clear CtrlPMatch
+  highlight clear CtrlPLinePre
+  bwipe!
+endfunc
+
+
 " vim: shiftwidth=2 sts=2 expandtab
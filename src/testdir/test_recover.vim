@@ -1,6 +1,7 @@
 " Test :recover
 
 source check.vim
+source term_util.vim
 
 func Test_recover_root_dir()
   " This used to access invalid memory.
@@ -448,4 +449,161 @@ func Test_noname_buffer()
   call assert_equal(['one', 'two'], getline(1, '$'))
 endfunc
 
+" Make the swap file of the current buffer be written in the background by
+" typing a character, like when the user types.  Returns the swap file name.
+func s:SwapInBackground()
+  let sn = swapname('')
+  let batches = bore_stats().memfile.batches
+  set updatecount=1
+  call feedkeys("\<Ignore>", 'xt')
+  set updatecount&
+  call assert_equal(batches + 1, bore_stats().memfile.batches)
+  return sn
+endfunc
+
+" Recover "Xbgswap" from swap file contents "swap", as if Vim was killed when
+" they were on disk.
+func s:RecoverFrom(swap, sn)
+  new
+  only!
+  bwipe! Xbgswap
+  call writefile(a:swap, a:sn)
+  recover Xbgswap
+  call delete(a:sn)
+endfunc
+
+" Blocks written in the background are only in the swap file when the writer
+" is done, until then recovering gives the text of the previous sync.
+func Test_recover_background_writes()
+  CheckFeature bore
+  CheckLinux
+  set fileformat=unix undolevels=-1
+  edit! Xbgswap
+  call setline(1, map(range(1, 20000), '"line " .. v:val'))
+  preserve
+
+  call test_override('swap_writer', 1)
+  call setline(1000, 'changed 1000')
+  call setline(15000, 'changed 15000')
+  let sn = s:SwapInBackground()
+  call assert_equal(2, bore_stats().memfile.writing)
+  let swap = readblob(sn)
+  call test_override('swap_writer', 0)
+  call WaitForAssert({-> assert_equal(0, bore_stats().memfile.writing)})
+  let written = readblob(sn)
+
+  call s:RecoverFrom(swap, sn)
+  call assert_equal(20000, line('$'))
+  call assert_equal('line 1000', getline(1000))
+  call assert_equal('line 15000', getline(15000))
+
+  call s:RecoverFrom(written, sn)
+  call assert_equal(20000, line('$'))
+  call assert_equal('changed 1000', getline(1000))
+  call assert_equal('changed 15000', getline(15000))
+  call assert_equal('line 20000', getline(20000))
+
+  set fileformat& undolevels&
+  enew! | only
+endfunc
+
+" A block that is being written is not released when memory is needed and is
+" not changed until it is written.  A sync of all blocks waits for it.
+func Test_recover_background_writes_busy()
+  CheckFeature bore
+  CheckLinux
+  set fileformat=unix undolevels=-1
+  edit! Xbgswap
+  call setline(1, map(range(1, 20000), '"line " .. v:val'))
+  preserve
+
+  call test_override('swap_writer', 1)
+  call setline(1000, 'changed 1000')
+  call setline(15000, 'changed 15000')
+  let sn = s:SwapInBackground()
+  let evictions = bore_stats().memfile.evictions
+  set maxmem=1 maxmemtot=1
+  new
+  call setline(1, map(range(1, 20000), '"other " .. v:val'))
+  bwipe!
+  for lnum in range(1, 20000, 50)
+    " getting the blocks being written would wait for them
+    if abs(lnum - 1000) > 500 && abs(lnum - 15000) > 500
+      call assert_equal('line ' .. lnum, getline(lnum))
+    endif
+  endfor
+  set maxmem& maxmemtot&
+  call assert_true(bore_stats().memfile.evictions > evictions)
+  call assert_equal(2, bore_stats().memfile.writing)
+
+  " Changing the lines again waits for the writer when the first one is put
+  " in its block.
+  call setline(1000, 'again 1000')
+  call setline(15000, 'again 15000')
+  call assert_equal(0, bore_stats().memfile.writing)
+
+  call test_override('swap_writer', 1)
+  call setline(5000, 'changed 5000')
+  " the blocks with lines 1000, 5000 and 15000
+  call s:SwapInBackground()
+  call assert_equal(3, bore_stats().memfile.writing)
+  preserve
+  call assert_equal(0, bore_stats().memfile.writing)
+  call test_override('swap_writer', 0)
+
+  call s:RecoverFrom(readblob(sn), sn)
+  call assert_equal(20000, line('$'))
+  call assert_equal('again 1000', getline(1000))
+  call assert_equal('changed 5000', getline(5000))
+  call assert_equal('again 15000', getline(15000))
+  call assert_equal('line 19999', getline(19999))
+
+  set fileformat& undolevels&
+  enew! | only
+endfunc
+
+" A deadly signal while blocks are being written in the background writes
+" them again, without waiting for the writer.
+func Test_recover_background_writes_deadly_signal()
+  CheckFeature bore
+  CheckLinux
+  CheckRunVimInTerminal
+
+  call delete('.Xbgdeadly.swp')
+  let lines =<< trim END
+    set fileformat=unix undolevels=-1
+    func Setup()
+      call setline(1, map(range(1, 20000), '"line " .. v:val'))
+      silent preserve
+      call test_override('swap_writer', 1)
+      call setline(1000, 'changed 1000')
+      call setline(15000, 'changed 15000')
+      set updatecount=1
+      call feedkeys("\<Ignore>", 'xt')
+      set updatecount&
+      call writefile([bore_stats().memfile.writing], 'XdeadlyOut')
+    endfunc
+  END
+  call writefile(lines, 'XsetupDeadly', 'D')
+  let buf = RunVimInTerminal('-S XsetupDeadly Xbgdeadly', {'rows': 6})
+  let pid_vim = term_getjob(buf)->job_info().process
+  call term_sendkeys(buf, ":call Setup()\n")
+  call WaitForAssert({-> assert_true(filereadable('XdeadlyOut'))})
+  call assert_equal(['2'], readfile('XdeadlyOut'))
+
+  exe 'silent !kill -s TERM ' .. pid_vim
+  call WaitForAssert({-> assert_equal("finished", term_getstatus(buf))})
+
+  new
+  silent recover .Xbgdeadly.swp
+  call assert_equal(20000, line('$'))
+  call assert_equal('changed 1000', getline(1000))
+  call assert_equal('changed 15000', getline(15000))
+  call assert_equal('line 20000', getline(20000))
+
+  %bwipe!
+  call delete('.Xbgdeadly.swp')
+  call delete('XdeadlyOut')
+endfunc
+
 " vim: shiftwidth=2 sts=2 expandtab
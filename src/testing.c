@@ -12,6 +12,9 @@
  */
 
 #include "vim.h"
+#ifdef FEAT_BORE
+# include "if_bore.h"
+#endif
 
 #if defined(FEAT_EVAL) || defined(PROTO)
 
@@ -1061,6 +1064,12 @@ f_test_override(typval_T *argvars, typval_T *rettv UNUSED)
 	ml_get_alloc_lines = val;
     else if (STRCMP(name, (char_u *)"autoload") == 0)
 	override_autoload = val;
+#ifdef FEAT_BORE
+    else if (STRCMP(name, (char_u *)"swap_writer") == 0)
+	mf_writer_hold_for_testing(val);
+    else if (STRCMP(name, (char_u *)"bore_truncate") == 0)
+	bore_find_truncate_for_testing(val);
+#endif
     else if (STRCMP(name, (char_u *)"ALL") == 0)
     {
 	disable_char_avail_for_testing = FALSE;
@@ -1071,6 +1080,10 @@ f_test_override(typval_T *argvars, typval_T *rettv UNUSED)
 	ui_delay_for_testing = 0;
 	reset_term_props_on_termresponse = FALSE;
 	override_sysinfo_uptime = -1;
+#ifdef FEAT_BORE
+	mf_writer_hold_for_testing(FALSE);
+	bore_find_truncate_for_testing(FALSE);
+#endif
 	// ml_get_alloc_lines is not reset by "ALL"
 	if (save_starting >= 0)
 	{
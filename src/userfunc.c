@@ -559,7 +559,7 @@ get_lambda_name(void)
     return name;
 }
 
-#if defined(FEAT_LUA) || defined(PROTO)
+#if defined(FEAT_LUA) || defined(FEAT_BORE) || defined(PROTO)
 /*
  * Registers a native C callback which can be called from Vim script.
  * Returns the name of the Vim script function.
@@ -2373,7 +2373,7 @@ func_clear_items(ufunc_T *fp)
     fp->uf_partial = NULL;
     fp->uf_refcount -= 3;
 
-#ifdef FEAT_LUA
+#if defined(FEAT_LUA) || defined(FEAT_BORE)
     if (fp->uf_cb_free != NULL)
     {
 	fp->uf_cb_free(fp->uf_cb_state);
@@ -3071,7 +3071,7 @@ call_user_func_check(
 {
     int error;
 
-#ifdef FEAT_LUA
+#if defined(FEAT_LUA) || defined(FEAT_BORE)
     if (fp->uf_flags & FC_CFUNC)
     {
 	cfunc_T cb = fp->uf_cb;
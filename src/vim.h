@@ -1105,6 +1105,7 @@ extern int (*dyn_libintl_wputenv)(const wchar_t *envstring);
 #define MFS_STOP	2	// stop syncing when a character is available
 #define MFS_FLUSH	4	// flushed file to disk
 #define MFS_ZERO	8	// only write block 0
+#define MFS_ASYNC	16	// write in the background when possible
 
 // flags for buf_copy_options()
 #define BCO_ENTER	1	// going to enter the buffer
@@ -2127,6 +2127,9 @@ execute_storeindex(isn_T *iptr, ectx_T *ectx)
 		// overwrite existing list item
 		clear_tv(&li->li_tv);
 		li->li_tv = *tv;
+#ifdef FEAT_BORE
+		list_changed(list);
+#endif
 	    }
 	    else
 	    {